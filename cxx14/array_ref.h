@@ -8,12 +8,18 @@
 #ifndef LIBCPP_UTIL_ARRAY_REF_H
 #define LIBCPP_UTIL_ARRAY_REF_H
 
+#include <algorithm>
 #include <iterator>
 #include <cstddef>
+#include <functional>
 #include <vector>
 #include <array>
 #include <limits>
 #include <stdexcept>
+#include <type_traits>
+#include <cassert>
+#include "libcpp-util/util/hash.h"
+#include "libcpp-util/util/mem_compare.h"
 
 // TODO: This class has been to changed to array_view and is now far more
 // complicated than something I'm interested in implementing. Delete?
@@ -66,9 +72,10 @@ public:
 	array_ref& operator=(const array_ref&) = default;
 
 	array_ref slice(size_type pos, size_type n = size_type(-1)) const {
-		// If n == -1, it's the whole string.
+		// If n == -1, it's the rest of the array.
+		assert(pos <= len && "array_ref::slice out of range");
 		return array_ref(start + pos,
-				(n == size_type(-1) ? n : len - pos));
+				(n == size_type(-1) ? len - pos : n));
 	}
 
 	// Container access
@@ -102,7 +109,7 @@ public:
 	}
 
 	// Capacity/Size
-	bool empty() {
+	bool empty() const {
 		return len == 0;
 	}
 	size_t size() const {
@@ -121,6 +128,7 @@ public:
 	}
 
 	const T& operator[](size_t idx) const {
+		assert(idx < len && "array_ref index out of range");
 		return start[idx];
 	}
 	const T& at(size_t idx) const {
@@ -186,4 +194,151 @@ template <typename T, size_t N>
 array_ref<T> make_array_ref(const std::array<T, N>& arr) {
 	return array_ref<T>(arr);
 }
+
+// An array_ref whose elements can be written through, for output buffers.
+// It converts to array_ref<T> wherever read-only access is enough.
+// Indexing is checked with assert(), so it is free with NDEBUG.
+template <typename T>
+class mutable_array_ref : public array_ref<T> {
+public:
+	using pointer = T*;
+	using reference = T&;
+	using iterator = T*;
+	using reverse_iterator = std::reverse_iterator<iterator>;
+
+	mutable_array_ref() = default;
+	mutable_array_ref(T& elem)
+		: array_ref<T>(elem) {}
+	mutable_array_ref(T* data, size_t length)
+		: array_ref<T>(data, length) {}
+	mutable_array_ref(T* data, T* end)
+		: array_ref<T>(data, end) {}
+
+	template <typename Alloc>
+		mutable_array_ref(std::vector<T, Alloc>& v)
+		: array_ref<T>(v) {}
+
+	template <size_t N>
+		mutable_array_ref(T (&arr)[N]) : array_ref<T>(arr) {}
+
+	template <size_t N>
+		mutable_array_ref(std::array<T, N>& arr) : array_ref<T>(arr) {}
+
+	mutable_array_ref slice(size_t pos, size_t n = size_t(-1)) const {
+		return mutable_array_ref(data() + pos,
+				array_ref<T>::slice(pos, n).size());
+	}
+
+	T* data() const {
+		return const_cast<T*>(array_ref<T>::data());
+	}
+	iterator begin() const {
+		return data();
+	}
+	iterator end() const {
+		return data() + this->size();
+	}
+	reverse_iterator rbegin() const {
+		return reverse_iterator(end());
+	}
+	reverse_iterator rend() const {
+		return reverse_iterator(begin());
+	}
+
+	T& front() const {
+		return *data();
+	}
+	T& back() const {
+		return data()[this->size() - 1];
+	}
+	T& operator[](size_t idx) const {
+		assert(idx < this->size() && "array_ref index out of range");
+		return data()[idx];
+	}
+	T& at(size_t idx) const {
+		return idx >= this->size() ?
+			throw std::out_of_range("at() index out of range")
+			: data()[idx];
+	}
+};
+
+template <typename T>
+mutable_array_ref<T> make_mutable_array_ref(T* data, size_t length) {
+	return mutable_array_ref<T>(data, length);
+}
+
+template <typename T>
+mutable_array_ref<T> make_mutable_array_ref(std::vector<T>& v) {
+	return v;
+}
+
+template <typename T, size_t N>
+mutable_array_ref<T> make_mutable_array_ref(T (&arr)[N]) {
+	return mutable_array_ref<T>(arr);
+}
+
+// Comparison operators. Integers, enums and pointers are equal exactly when
+// their bytes are, so those compare with the byte kernels; anything else
+// (floats, where -0.0 == 0.0 and NaN != NaN, or class types) uses its own
+// operator== and operator<.
+template <typename T>
+struct array_ref_bytewise
+	: std::integral_constant<bool, std::is_integral<T>::value ||
+					       std::is_enum<T>::value ||
+					       std::is_pointer<T>::value> {};
+
+template <typename T>
+bool operator==(array_ref<T> x, array_ref<T> y) {
+	if (x.size() != y.size())
+		return false;
+	if (array_ref_bytewise<T>::value)
+		return cpputil::mem_equal(x.data(), y.data(),
+					  x.size() * sizeof(T));
+	return std::equal(x.begin(), x.end(), y.begin());
+}
+template <typename T>
+bool operator!=(array_ref<T> x, array_ref<T> y) {
+	return !(x == y);
+}
+template <typename T>
+bool operator<(array_ref<T> x, array_ref<T> y) {
+	return std::lexicographical_compare(x.begin(), x.end(), y.begin(),
+					    y.end());
+}
+template <typename T>
+bool operator>(array_ref<T> x, array_ref<T> y) {
+	return y < x;
+}
+template <typename T>
+bool operator<=(array_ref<T> x, array_ref<T> y) {
+	return !(y < x);
+}
+template <typename T>
+bool operator>=(array_ref<T> x, array_ref<T> y) {
+	return !(x < y);
+}
+
+namespace std {
+template <typename T>
+struct hash<array_ref<T>> {
+private:
+	size_t hash_elements(array_ref<T> a, std::true_type) const {
+		return static_cast<size_t>(
+			cpputil::hash_bytes(a.data(), a.size() * sizeof(T)));
+	}
+	size_t hash_elements(array_ref<T> a, std::false_type) const {
+		std::uint64_t h = a.size();
+		for (const T &x : a)
+			h = cpputil::hash_detail::mix(
+				h ^ cpputil::hash_detail::k1,
+				std::hash<T>()(x) ^ cpputil::hash_detail::k0);
+		return static_cast<size_t>(h);
+	}
+
+public:
+	size_t operator()(array_ref<T> a) const {
+		return hash_elements(a, array_ref_bytewise<T>());
+	}
+};
+}
 #endif
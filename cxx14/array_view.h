@@ -0,0 +1,361 @@
+//============================================================================
+//                                  libcpp-util
+//                   A simple odds-n-ends library for C++11
+//
+//         Licensed under modified BSD license. See LICENSE for details.
+//============================================================================
+
+#ifndef LIBCPP_UTIL_ARRAY_VIEW_H
+#define LIBCPP_UTIL_ARRAY_VIEW_H
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+#include "libcpp-util/cxx14/array_ref.h"
+
+// Non-owning views over memory that isn't laid out as one contiguous run:
+// strided_array_ref is every stride'th element (a matrix column, one channel
+// of interleaved samples), and array_view<T, Rank> is an N-dimensional array
+// described by its extents and strides, like the array_view proposal that
+// replaced array_ref. Use a const T for read-only views.
+//
+// Both store the stride at runtime and index with one multiply-add per
+// dimension. Bounds are checked with assert(), so with NDEBUG the loops
+// compile to the same code as raw pointer arithmetic. That includes not
+// being vectorized when the stride is unknown: hot kernels should test
+// is_contiguous() and run a flat loop over data() when it holds.
+
+// Random access iterator stepping stride elements at a time. It keeps the
+// base and an index rather than a moving pointer, so end() and anything
+// else one step outside the elements is never formed as a pointer.
+template <typename T>
+class strided_iterator {
+public:
+	using iterator_category = std::random_access_iterator_tag;
+	using value_type = typename std::remove_cv<T>::type;
+	using difference_type = ptrdiff_t;
+	using pointer = T*;
+	using reference = T&;
+
+private:
+	T* base;
+	ptrdiff_t idx;
+	ptrdiff_t stride;
+
+public:
+	strided_iterator() : base(nullptr), idx(0), stride(1) {}
+	strided_iterator(T* base, ptrdiff_t i, ptrdiff_t stride)
+		: base(base), idx(i), stride(stride) {}
+
+	T& operator*() const { return base[idx * stride]; }
+	T* operator->() const { return base + idx * stride; }
+	T& operator[](ptrdiff_t n) const { return base[(idx + n) * stride]; }
+
+	strided_iterator& operator++() { ++idx; return *this; }
+	strided_iterator& operator--() { --idx; return *this; }
+	strided_iterator operator++(int) {
+		strided_iterator ret = *this;
+		++idx;
+		return ret;
+	}
+	strided_iterator operator--(int) {
+		strided_iterator ret = *this;
+		--idx;
+		return ret;
+	}
+	strided_iterator& operator+=(ptrdiff_t n) {
+		idx += n;
+		return *this;
+	}
+	strided_iterator& operator-=(ptrdiff_t n) {
+		idx -= n;
+		return *this;
+	}
+	strided_iterator operator+(ptrdiff_t n) const {
+		return strided_iterator(base, idx + n, stride);
+	}
+	strided_iterator operator-(ptrdiff_t n) const {
+		return strided_iterator(base, idx - n, stride);
+	}
+	ptrdiff_t operator-(const strided_iterator& rhs) const {
+		return idx - rhs.idx;
+	}
+
+	bool operator==(const strided_iterator& rhs) const {
+		return idx == rhs.idx;
+	}
+	bool operator!=(const strided_iterator& rhs) const {
+		return idx != rhs.idx;
+	}
+	bool operator<(const strided_iterator& rhs) const {
+		return idx < rhs.idx;
+	}
+	bool operator>(const strided_iterator& rhs) const { return rhs < *this; }
+	bool operator<=(const strided_iterator& rhs) const {
+		return !(rhs < *this);
+	}
+	bool operator>=(const strided_iterator& rhs) const {
+		return !(*this < rhs);
+	}
+};
+
+template <typename T>
+strided_iterator<T> operator+(ptrdiff_t n, const strided_iterator<T>& it) {
+	return it + n;
+}
+
+// len elements starting at data, stride elements apart. A negative stride
+// walks backwards.
+template <typename T>
+class strided_array_ref {
+public:
+	using value_type = typename std::remove_cv<T>::type;
+	using pointer = T*;
+	using reference = T&;
+	using iterator = strided_iterator<T>;
+	using const_iterator = iterator;
+	using size_type = size_t;
+	using difference_type = ptrdiff_t;
+
+private:
+	T* start;
+	size_t len;
+	ptrdiff_t step;
+
+public:
+	strided_array_ref() : start(nullptr), len(0), step(1) {}
+	strided_array_ref(T* data, size_t length, ptrdiff_t stride = 1)
+		: start(data), len(length), step(stride) {}
+	strided_array_ref(mutable_array_ref<value_type> a)
+		: start(a.data()), len(a.size()), step(1) {}
+	template <typename U = T,
+		  typename = typename std::enable_if<
+			  std::is_const<U>::value>::type>
+	strided_array_ref(array_ref<value_type> a)
+		: start(a.data()), len(a.size()), step(1) {}
+	// Read-only view of a writable one.
+	template <typename U,
+		  typename = typename std::enable_if<
+			  std::is_same<const U, T>::value>::type>
+	strided_array_ref(const strided_array_ref<U>& o)
+		: start(o.data()), len(o.size()), step(o.stride()) {}
+
+	T* data() const { return start; }
+	size_t size() const { return len; }
+	bool empty() const { return len == 0; }
+	ptrdiff_t stride() const { return step; }
+	bool is_contiguous() const { return step == 1 || len <= 1; }
+
+	iterator begin() const { return iterator(start, 0, step); }
+	iterator end() const { return iterator(start, ptrdiff_t(len), step); }
+
+	T& operator[](size_t i) const {
+		assert(i < len && "strided_array_ref index out of range");
+		return start[ptrdiff_t(i) * step];
+	}
+	T& front() const { return (*this)[0]; }
+	T& back() const { return (*this)[len - 1]; }
+
+	// An empty slice at the end starts at data(), since the slot after
+	// the last element may lie outside the array.
+	strided_array_ref slice(size_t pos, size_t n = size_t(-1)) const {
+		assert(pos <= len && "strided_array_ref::slice out of range");
+		if (n == size_t(-1))
+			n = len - pos;
+		assert(n <= len - pos && "strided_array_ref::slice too long");
+		T* p = pos < len ? start + ptrdiff_t(pos) * step : start;
+		return strided_array_ref(p, n, step);
+	}
+	// Every k'th element of this view.
+	strided_array_ref every(size_t k) const {
+		assert(k > 0);
+		return strided_array_ref(start, (len + k - 1) / k,
+				step * ptrdiff_t(k));
+	}
+	strided_array_ref reversed() const {
+		return strided_array_ref(
+				len ? start + ptrdiff_t(len - 1) * step : start,
+				len, -step);
+	}
+};
+
+enum class array_layout { row_major, column_major };
+
+// An N-dimensional view: element (i0, i1, ...) lives at
+// data + i0 * stride(0) + i1 * stride(1) + ..., strides in elements.
+template <typename T, size_t Rank>
+class array_view {
+	static_assert(Rank > 0, "array_view needs at least one dimension");
+
+public:
+	using value_type = typename std::remove_cv<T>::type;
+	using pointer = T*;
+	using reference = T&;
+	using size_type = size_t;
+	using extents_type = std::array<size_t, Rank>;
+	using strides_type = std::array<ptrdiff_t, Rank>;
+	static constexpr size_t rank = Rank;
+
+private:
+	T* start;
+	extents_type ext;
+	strides_type str;
+
+	template <typename... Idx>
+	ptrdiff_t offset(Idx... idx) const {
+		const size_t i[] = {size_t(idx)...};
+		ptrdiff_t off = 0;
+		for (size_t d = 0; d < Rank; ++d) {
+			assert(i[d] < ext[d] && "array_view index out of range");
+			off += ptrdiff_t(i[d]) * str[d];
+		}
+		return off;
+	}
+
+public:
+	array_view() : start(nullptr), ext(), str() {}
+	// Densely packed data in the given layout.
+	array_view(T* data, const extents_type& extents,
+		   array_layout layout = array_layout::row_major)
+		: start(data), ext(extents) {
+		ptrdiff_t s = 1;
+		if (layout == array_layout::row_major) {
+			for (size_t d = Rank; d-- > 0;) {
+				str[d] = s;
+				s *= ptrdiff_t(ext[d]);
+			}
+		} else {
+			for (size_t d = 0; d < Rank; ++d) {
+				str[d] = s;
+				s *= ptrdiff_t(ext[d]);
+			}
+		}
+	}
+	array_view(T* data, const extents_type& extents,
+		   const strides_type& strides)
+		: start(data), ext(extents), str(strides) {}
+	template <typename U,
+		  typename = typename std::enable_if<
+			  std::is_same<const U, T>::value>::type>
+	array_view(const array_view<U, Rank>& o)
+		: start(o.data()), ext(o.extents()), str(o.strides()) {}
+
+	T* data() const { return start; }
+	const extents_type& extents() const { return ext; }
+	const strides_type& strides() const { return str; }
+	size_t extent(size_t d) const { return ext[d]; }
+	ptrdiff_t stride(size_t d) const { return str[d]; }
+	size_t size() const {
+		size_t n = 1;
+		for (size_t e : ext)
+			n *= e;
+		return n;
+	}
+	bool empty() const { return size() == 0; }
+	// True if the elements fill size() consecutive slots in row-major
+	// order, so the view can be handed to flat loops.
+	bool is_contiguous() const {
+		ptrdiff_t s = 1;
+		for (size_t d = Rank; d-- > 0;) {
+			if (ext[d] != 1 && str[d] != s)
+				return false;
+			s *= ptrdiff_t(ext[d]);
+		}
+		return true;
+	}
+	typedef typename std::conditional<std::is_const<T>::value,
+			array_ref<value_type>,
+			mutable_array_ref<value_type>>::type flat_type;
+	flat_type flat() const {
+		assert(is_contiguous() && "array_view is not contiguous");
+		return flat_type(start, size());
+	}
+
+	template <typename... Idx>
+	T& operator()(Idx... idx) const {
+		static_assert(sizeof...(Idx) == Rank,
+				"Wrong number of indices for array_view");
+		return start[offset(idx...)];
+	}
+
+	// The Rank-1 view with dimension d fixed at i.
+	array_view<T, Rank - 1> slice(size_t d, size_t i) const {
+		static_assert(Rank > 1, "Can't slice a 1D array_view");
+		assert(d < Rank && i < ext[d] && "array_view::slice out of range");
+		std::array<size_t, Rank - 1> e;
+		std::array<ptrdiff_t, Rank - 1> s;
+		for (size_t k = 0, j = 0; k < Rank; ++k) {
+			if (k == d)
+				continue;
+			e[j] = ext[k];
+			s[j++] = str[k];
+		}
+		return array_view<T, Rank - 1>(start + ptrdiff_t(i) * str[d], e, s);
+	}
+
+	// The elements along dimension d, starting from origin.
+	strided_array_ref<T> line(size_t d, const extents_type& origin) const {
+		ptrdiff_t off = 0;
+		for (size_t k = 0; k < Rank; ++k) {
+			assert(origin[k] < ext[k] && "array_view::line out of range");
+			off += ptrdiff_t(origin[k]) * str[k];
+		}
+		return strided_array_ref<T>(start + off, ext[d] - origin[d],
+				str[d]);
+	}
+
+	// Same rank, offset by origin, with the given extents.
+	array_view subview(const extents_type& origin,
+			   const extents_type& extents) const {
+		ptrdiff_t off = 0;
+		for (size_t k = 0; k < Rank; ++k) {
+			assert(origin[k] + extents[k] <= ext[k] &&
+					"array_view::subview out of range");
+			off += ptrdiff_t(origin[k]) * str[k];
+		}
+		return array_view(start + off, extents, str);
+	}
+
+	// Swaps two dimensions without touching the data.
+	array_view transposed(size_t a = 0, size_t b = 1) const {
+		array_view ret = *this;
+		std::swap(ret.ext[a], ret.ext[b]);
+		std::swap(ret.str[a], ret.str[b]);
+		return ret;
+	}
+
+	// 2D conveniences.
+	size_t rows() const { return ext[0]; }
+	size_t cols() const {
+		static_assert(Rank == 2, "cols() is for 2D views");
+		return ext[1];
+	}
+	strided_array_ref<T> row(size_t i) const {
+		static_assert(Rank == 2, "row() is for 2D views");
+		assert(i < ext[0] && "array_view::row out of range");
+		return strided_array_ref<T>(start + ptrdiff_t(i) * str[0],
+				ext[1], str[1]);
+	}
+	strided_array_ref<T> col(size_t j) const {
+		static_assert(Rank == 2, "col() is for 2D views");
+		assert(j < ext[1] && "array_view::col out of range");
+		return strided_array_ref<T>(start + ptrdiff_t(j) * str[1],
+				ext[0], str[0]);
+	}
+};
+
+template <typename T, size_t Rank>
+constexpr size_t array_view<T, Rank>::rank;
+
+template <typename T>
+using array_view2d = array_view<T, 2>;
+
+template <typename T, size_t Rank>
+array_view<T, Rank> make_array_view(T* data,
+		const std::array<size_t, Rank>& extents,
+		array_layout layout = array_layout::row_major) {
+	return array_view<T, Rank>(data, extents, layout);
+}
+#endif
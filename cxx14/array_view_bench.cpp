@@ -0,0 +1,164 @@
+// Build with -O2 -DNDEBUG (or -O3): the point is that the views cost
+// nothing once the asserts are gone.
+#include "array_view.h"
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+using bench_clock = std::chrono::steady_clock;
+
+template <typename F>
+void run(const char *name, size_t elems, F f) {
+	unsigned rounds = 0;
+	double sink = 0;
+	auto start = bench_clock::now();
+	std::chrono::duration<double, std::nano> elapsed;
+	do {
+		sink += f();
+		++rounds;
+		elapsed = bench_clock::now() - start;
+	} while (elapsed.count() < 2e8);
+	printf("%-34s %7.3f ns/elem  (%g)\n", name,
+	       elapsed.count() / (double(rounds) * elems), sink);
+}
+
+// The kernels are out of line so that each one is compiled and vectorized
+// on its own, like a library routine would be.
+__attribute__((noinline)) void saxpy_raw(float a, const float *x, float *y,
+					  size_t n) {
+	for (size_t i = 0; i < n; ++i)
+		y[i] += a * x[i];
+}
+
+__attribute__((noinline)) void saxpy_ref(float a, array_ref<float> x,
+					  mutable_array_ref<float> y) {
+	for (size_t i = 0; i < y.size(); ++i)
+		y[i] += a * x[i];
+}
+
+__attribute__((noinline)) void saxpy_range(float a, array_ref<float> x,
+					    mutable_array_ref<float> y) {
+	const float *xi = x.begin();
+	for (float &v : y)
+		v += a * *xi++;
+}
+
+__attribute__((noinline)) void saxpy_strided(float a,
+					      strided_array_ref<const float> x,
+					      strided_array_ref<float> y) {
+	for (size_t i = 0; i < y.size(); ++i)
+		y[i] += a * x[i];
+}
+
+// A runtime stride keeps the compiler from vectorizing, so kernels that care
+// check for the contiguous case and hand it to the flat loop.
+__attribute__((noinline)) void
+saxpy_strided_dispatch(float a, strided_array_ref<const float> x,
+		       strided_array_ref<float> y) {
+	if (x.is_contiguous() && y.is_contiguous()) {
+		saxpy_raw(a, x.data(), y.data(), y.size());
+		return;
+	}
+	for (size_t i = 0; i < y.size(); ++i)
+		y[i] += a * x[i];
+}
+
+__attribute__((noinline)) float sum_raw(const float *m, size_t rows,
+					size_t cols) {
+	float s = 0;
+	for (size_t i = 0; i < rows; ++i)
+		for (size_t j = 0; j < cols; ++j)
+			s += m[i * cols + j];
+	return s;
+}
+
+__attribute__((noinline)) float sum_view(array_view<const float, 2> m) {
+	float s = 0;
+	for (size_t i = 0; i < m.rows(); ++i)
+		for (size_t j = 0; j < m.cols(); ++j)
+			s += m(i, j);
+	return s;
+}
+
+// Column sums: the strided direction.
+__attribute__((noinline)) void col_sums_raw(const float *m, size_t rows,
+					     size_t cols, float *out) {
+	for (size_t j = 0; j < cols; ++j)
+		out[j] = 0;
+	for (size_t i = 0; i < rows; ++i)
+		for (size_t j = 0; j < cols; ++j)
+			out[j] += m[i * cols + j];
+}
+
+__attribute__((noinline)) void col_sums_view(array_view<const float, 2> m,
+					      mutable_array_ref<float> out) {
+	for (size_t j = 0; j < m.cols(); ++j)
+		out[j] = 0;
+	for (size_t i = 0; i < m.rows(); ++i) {
+		strided_array_ref<const float> r = m.row(i);
+		for (size_t j = 0; j < r.size(); ++j)
+			out[j] += r[j];
+	}
+}
+
+__attribute__((noinline)) void col_sums_by_col(array_view<const float, 2> m,
+						mutable_array_ref<float> out) {
+	for (size_t j = 0; j < m.cols(); ++j) {
+		float s = 0;
+		for (float v : m.col(j))
+			s += v;
+		out[j] = s;
+	}
+}
+
+int main() {
+#ifndef NDEBUG
+	printf("Warning: asserts are on, expect the views to be slower\n");
+#endif
+	const size_t n = 1 << 14;
+	std::vector<float> x(n, 1.0f), y(n, 2.0f);
+	run("saxpy raw pointers", n, [&]() {
+		saxpy_raw(0.5f, x.data(), y.data(), n);
+		return y[n - 1];
+	});
+	run("saxpy array_ref[]", n, [&]() {
+		saxpy_ref(0.5f, x, y);
+		return y[n - 1];
+	});
+	run("saxpy array_ref range-for", n, [&]() {
+		saxpy_range(0.5f, x, y);
+		return y[n - 1];
+	});
+	run("saxpy strided_array_ref, stride 1", n, [&]() {
+		saxpy_strided(0.5f, array_ref<float>(x),
+			      mutable_array_ref<float>(y));
+		return y[n - 1];
+	});
+	run("saxpy strided, contiguous dispatch", n, [&]() {
+		saxpy_strided_dispatch(0.5f, array_ref<float>(x),
+				       mutable_array_ref<float>(y));
+		return y[n - 1];
+	});
+	printf("\n");
+
+	const size_t rows = 512, cols = 512;
+	std::vector<float> m(rows * cols, 1.0f), out(cols);
+	array_view<const float, 2> mv(m.data(), {{rows, cols}});
+	run("sum raw pointers", rows * cols,
+	    [&]() { return sum_raw(m.data(), rows, cols); });
+	run("sum array_view(i, j)", rows * cols,
+	    [&]() { return sum_view(mv); });
+	run("column sums raw pointers", rows * cols, [&]() {
+		col_sums_raw(m.data(), rows, cols, out.data());
+		return out[0];
+	});
+	run("column sums array_view rows", rows * cols, [&]() {
+		col_sums_view(mv, out);
+		return out[0];
+	});
+	run("column sums array_view col()", rows * cols, [&]() {
+		col_sums_by_col(mv, out);
+		return out[0];
+	});
+	return 0;
+}
@@ -0,0 +1,171 @@
+#include "array_view.h"
+#include "libcpp-util/util/test_check.h"
+#include <algorithm>
+#include <cstdio>
+#include <numeric>
+#include <vector>
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Writes through the view land in the vector; slice() with no length is
+// the rest of the array.
+static void test_mutable_array_ref() {
+	std::vector<int> v(10);
+	mutable_array_ref<int> m(v);
+	for (size_t i = 0; i < m.size(); ++i)
+		m[i] = int(i);
+	std::reverse(m.begin(), m.end());
+	CHECK(v[0] == 9 && v[9] == 0);
+	mutable_array_ref<int> tail = m.slice(7);
+	CHECK(tail.size() == 3 && tail.data() == &v[7]);
+	tail.front() = 70;
+	tail.back() = -1;
+	CHECK(v[7] == 70 && v[9] == -1);
+	CHECK(m.slice(10).empty() && m.slice(2, 3).size() == 3);
+	array_ref<int> r = m;
+	CHECK(r.slice(4).size() == 6 && r.slice(4)[0] == 5);
+	CHECK(r.slice(0).size() == 10 && r.slice(10).empty());
+	int sum = std::accumulate(m.rbegin(), m.rend(), 0);
+	CHECK(sum == std::accumulate(v.begin(), v.end(), 0));
+}
+
+static std::vector<int> collect(strided_array_ref<const int> s) {
+	return std::vector<int>(s.begin(), s.end());
+}
+
+// Columns, every k'th and reversed views, walked forwards and backwards,
+// never stepping outside the array at either end.
+static void test_strided() {
+	int a[12];
+	std::iota(a, a + 12, 0);
+	strided_array_ref<int> col(a + 1, 4, 3);
+	CHECK(collect(col) == std::vector<int>({1, 4, 7, 10}));
+	CHECK(col.end() - col.begin() == 4 && col.begin() < col.end());
+	std::vector<int> back;
+	for (auto it = col.end(); it != col.begin();)
+		back.push_back(*--it);
+	CHECK(back == std::vector<int>({10, 7, 4, 1}));
+	CHECK(col.begin()[2] == 7 && *(col.end() - 1) == 10);
+	CHECK(!col.is_contiguous() && col.back() == 10);
+
+	strided_array_ref<int> rev = col.reversed();
+	CHECK(rev.stride() == -3);
+	CHECK(collect(rev) == std::vector<int>({10, 7, 4, 1}));
+	CHECK(rev.begin() < rev.end() && rev.end() - rev.begin() == 4);
+	std::vector<int> fwd;
+	for (int x : rev.reversed())
+		fwd.push_back(x);
+	CHECK(fwd == std::vector<int>({1, 4, 7, 10}));
+
+	strided_array_ref<int> all(a, 12);
+	CHECK(all.is_contiguous());
+	CHECK(collect(all.every(5)) == std::vector<int>({0, 5, 10}));
+	CHECK(collect(all.every(4).reversed()) ==
+	      std::vector<int>({8, 4, 0}));
+	CHECK(collect(all.reversed().every(5)) ==
+	      std::vector<int>({11, 6, 1}));
+	CHECK(collect(col.slice(1, 2)) == std::vector<int>({4, 7}));
+	CHECK(collect(col.slice(2)) == std::vector<int>({7, 10}));
+	CHECK(col.slice(4).empty() && collect(col.slice(4)).empty());
+	CHECK(collect(rev.slice(1)) == std::vector<int>({7, 4, 1}));
+
+	for (int& x : col)
+		x = -x;
+	CHECK(a[1] == -1 && a[10] == -10 && a[2] == 2);
+	std::sort(col.begin(), col.end());
+	CHECK(a[1] == -10 && a[10] == -1);
+
+	strided_array_ref<int> none;
+	CHECK(none.empty() && none.begin() == none.end());
+	CHECK(none.reversed().empty() && none.every(3).empty());
+}
+
+static void test_array_view() {
+	// 3 x 4, element (i, j) = 10 * i + j.
+	int rm[12], cm[12];
+	for (int i = 0; i < 3; ++i)
+		for (int j = 0; j < 4; ++j)
+			rm[i * 4 + j] = cm[j * 3 + i] = 10 * i + j;
+	array_view<int, 2> r(rm, {{3, 4}});
+	array_view<int, 2> c(cm, {{3, 4}}, array_layout::column_major);
+	CHECK(r.size() == 12 && r.rows() == 3 && r.cols() == 4);
+	CHECK(r.stride(0) == 4 && r.stride(1) == 1);
+	CHECK(c.stride(0) == 1 && c.stride(1) == 3);
+	for (size_t i = 0; i < 3; ++i)
+		for (size_t j = 0; j < 4; ++j)
+			CHECK(r(i, j) == int(10 * i + j) && c(i, j) == r(i, j));
+	CHECK(r.is_contiguous() && !c.is_contiguous());
+	CHECK(r.flat().size() == 12 && r.flat()[5] == 11);
+	r.flat()[0] = 99;
+	CHECK(r(0, 0) == 99);
+	r(0, 0) = 0;
+
+	array_view<int, 1> row1 = r.slice(0, 1), col2 = r.slice(1, 2);
+	CHECK(row1.extent(0) == 4 && row1(3) == 13 && row1.is_contiguous());
+	CHECK(col2.extent(0) == 3 && col2(2) == 22 && !col2.is_contiguous());
+	CHECK(c.slice(1, 2)(1) == 12);
+
+	CHECK(collect(r.line(1, {{1, 0}})) ==
+	      std::vector<int>({10, 11, 12, 13}));
+	CHECK(collect(r.line(0, {{1, 3}})) == std::vector<int>({13, 23}));
+	CHECK(collect(c.line(1, {{2, 1}})) == std::vector<int>({21, 22, 23}));
+	CHECK(collect(r.col(3)) == std::vector<int>({3, 13, 23}));
+	CHECK(collect(c.row(2)) == std::vector<int>({20, 21, 22, 23}));
+
+	array_view<int, 2> sub = r.subview({{1, 1}}, {{2, 2}});
+	CHECK(sub(0, 0) == 11 && sub(1, 1) == 22 && !sub.is_contiguous());
+	CHECK(r.subview({{1, 0}}, {{2, 4}}).is_contiguous());
+	array_view<int, 2> t = r.transposed();
+	CHECK(t.rows() == 4 && t.cols() == 3 && t(3, 2) == 23);
+	CHECK(!t.is_contiguous() && c.transposed().is_contiguous());
+	CHECK(c.transposed().flat()[4] == 11);
+
+	array_view<const int, 2> ro = r;
+	CHECK(ro(2, 1) == 21 && ro.flat().size() == 12);
+
+	int cube[24];
+	std::iota(cube, cube + 24, 0);
+	array_view<int, 3> v3(cube, {{2, 3, 4}});
+	CHECK(v3(1, 2, 3) == 23 && v3.slice(0, 1)(2, 3) == 23);
+	CHECK(v3.slice(2, 0)(1, 1) == 16);
+}
+
+// Out of range indexing hits the assert in a debug build.
+template <typename F>
+static bool aborts(F f) {
+	pid_t pid = fork();
+	CHECK(pid >= 0);
+	if (pid == 0) {
+		// Keep the assertion message out of the test's output.
+		freopen("/dev/null", "w", stderr);
+		f();
+		_exit(0);
+	}
+	int status;
+	CHECK(waitpid(pid, &status, 0) == pid);
+	return WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT;
+}
+
+static void test_bounds() {
+#ifdef NDEBUG
+	printf("NDEBUG build, bounds asserts not tested\n");
+#else
+	static int a[6];
+	CHECK(aborts([] { (mutable_array_ref<int>(a))[6] = 1; }));
+	CHECK(aborts([] { (strided_array_ref<int>(a, 3, 2))[3] = 1; }));
+	CHECK(aborts([] { array_view<int, 2>(a, {{2, 3}})(0, 3) = 1; }));
+	CHECK(aborts([] { array_view<int, 2>(a, {{2, 3}})(2, 0) = 1; }));
+	CHECK(!aborts([] { array_view<int, 2>(a, {{2, 3}})(1, 2) = 1; }));
+#endif
+}
+
+int main() {
+	test_mutable_array_ref();
+	test_strided();
+	test_array_view();
+	test_bounds();
+	printf("array_view_test: all passed\n");
+	return 0;
+}
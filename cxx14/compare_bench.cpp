@@ -0,0 +1,106 @@
+#include "string_ref.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using bench_clock = std::chrono::steady_clock;
+
+// Pairs of strings of length len that agree on their first prefix bytes
+// (all of them when prefix >= len).
+struct pairs {
+	std::vector<std::string> a, b;
+};
+
+pairs make_pairs(size_t len, size_t prefix, size_t n) {
+	std::mt19937 mt(len * 131 + prefix);
+	pairs p;
+	for (size_t i = 0; i < n; ++i) {
+		std::string s(len, '\0');
+		for (char &c : s)
+			c = 'a' + mt() % 26;
+		std::string t = s;
+		if (prefix < len)
+			t[prefix] = t[prefix] == 'z' ? 'a' : t[prefix] + 1;
+		p.a.push_back(s);
+		p.b.push_back(t);
+	}
+	return p;
+}
+
+template <typename F>
+void run(const char *what, size_t len, size_t prefix, const char *name,
+	 size_t n, F f) {
+	unsigned rounds = 0;
+	size_t sink = 0;
+	auto start = bench_clock::now();
+	std::chrono::duration<double, std::nano> elapsed;
+	do {
+		for (size_t i = 0; i < n; ++i)
+			sink += f(i);
+		++rounds;
+		elapsed = bench_clock::now() - start;
+	} while (elapsed.count() < 5e7);
+	printf("%-8s %4zu %6zu  %-22s %7.2f ns/op  (%zu)\n", what, len, prefix,
+	       name, elapsed.count() / (rounds * n), sink % 10);
+}
+
+// What operator== used to do: a full compare with no length check.
+int old_compare(string_ref x, string_ref y) {
+	return std::char_traits<char>::compare(x.data(), y.data(),
+					       std::min(x.size(), y.size()));
+}
+
+void compare_pairs(const char *what, size_t len, size_t prefix) {
+	const size_t n = 2048;
+	pairs p = make_pairs(len, prefix, n);
+	std::vector<string_ref> a(p.a.begin(), p.a.end());
+	std::vector<string_ref> b(p.b.begin(), p.b.end());
+
+	run(what, len, prefix, "memcmp ==", n, [&](size_t i) {
+		return (size_t)(a[i].size() == b[i].size() &&
+				!std::memcmp(a[i].data(), b[i].data(),
+					     a[i].size()));
+	});
+	run(what, len, prefix, "old compare ==", n,
+	    [&](size_t i) { return (size_t)!old_compare(a[i], b[i]); });
+	run(what, len, prefix, "string_ref ==", n,
+	    [&](size_t i) { return (size_t)(a[i] == b[i]); });
+	run(what, len, prefix, "memcmp <", n, [&](size_t i) {
+		return (size_t)(std::memcmp(a[i].data(), b[i].data(),
+					    a[i].size()) < 0);
+	});
+	run(what, len, prefix, "string_ref::compare", n,
+	    [&](size_t i) { return (size_t)(a[i].compare(b[i]) < 0); });
+}
+
+int main() {
+	for (size_t len : {0, 3, 7, 8, 15, 16, 24, 32, 48, 64, 128, 256})
+		compare_pairs("equal", len, len);
+	printf("\n");
+	for (size_t prefix : {0, 4, 12, 28, 60, 124})
+		compare_pairs("prefix", 128, prefix);
+	printf("\n");
+
+	// Hot map keyed by string_ref.
+	const size_t n = 4096;
+	std::vector<std::string> keys;
+	for (size_t i = 0; i < n; ++i)
+		keys.push_back("service.requests." + std::to_string(i * 7919) +
+			       ".count");
+	std::unordered_map<std::string, size_t> by_string;
+	std::unordered_map<string_ref, size_t> by_ref;
+	for (size_t i = 0; i < n; ++i) {
+		by_string[keys[i]] = i;
+		by_ref[keys[i]] = i;
+	}
+	run("map", 0, 0, "std::string key", n,
+	    [&](size_t i) { return by_string.find(keys[i])->second; });
+	run("map", 0, 0, "string_ref key", n, [&](size_t i) {
+		return by_ref.find(string_ref(keys[i]))->second;
+	});
+	return 0;
+}
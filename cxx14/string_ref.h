@@ -14,6 +14,8 @@
 #include <bitset>
 #include "libcpp-util/cxx14/array_ref.h"
 #include "libcpp-util/cxx14/string_algo.h"
+#include "libcpp-util/util/hash.h"
+#include "libcpp-util/util/mem_compare.h"
 
 template<typename charT, typename traits = std::char_traits<charT>>
 class basic_string_ref {
@@ -35,7 +37,7 @@ private:
 	size_t len;
 
 	// TODO: Hm, if this is too large to fit into a size_t, we're SOL.
-	static constexpr size_t charT_bits = 1 << (sizeof(charT) * CHAR_BIT);
+	static constexpr size_t charT_bits = size_t(1) << (sizeof(charT) * CHAR_BIT);
 	typedef std::bitset<charT_bits> charT_set;
 
 	static void init_bitset(charT_set& set, basic_string_ref s) {
@@ -58,9 +60,9 @@ public:
 
 	// iterators
 	constexpr const_iterator begin() const { return start; }
-	constexpr const_iterator end() const { return start; }
+	constexpr const_iterator end() const { return start + len; }
 	constexpr const_iterator cbegin() const { return start; }
-	constexpr const_iterator cend() const { return start; }
+	constexpr const_iterator cend() const { return start + len; }
 	const_reverse_iterator rbegin() const {
 	       	return reverse_iterator(end());
 	}
@@ -95,7 +97,7 @@ public:
 		return *start;
 	}
 	constexpr const charT & back() const {
-		return *(start + len);
+		return start[len - 1];
 	}
 	constexpr const charT * data() const {
 		return start;
@@ -134,14 +136,17 @@ public:
 
 	// string operations with the same semantics as std::basic_string
 	int compare(basic_string_ref x) const {
-		return traits::compare(data(), x.start(),
-			       	std::min(size(), x.size()));
+		int r = cpputil::traits_compare<charT, traits>(data(), x.data(),
+				std::min(size(), x.size()));
+		if (r)
+			return r;
+		return size() < x.size() ? -1 : size() > x.size();
 	}
 	constexpr basic_string_ref
 	substr(size_type pos, size_type n=npos) const {
 		return (pos > size())
 		       	? throw std::out_of_range("substr(): invalid size") :
-			basic_string_ref(pos, std::min(size(), n));
+			basic_string_ref(data() + pos, std::min(size() - pos, n));
 	}
 	size_type find(basic_string_ref s) const {
 		return KMP(*this, s);
@@ -228,7 +233,8 @@ public:
 	bool ends_with(basic_string_ref x) const {
 		if (x.size() > size())
 			return false;
-		return !traits::compare(data() + size() - x.size(), x.size());
+		return !traits::compare(data() + size() - x.size(), x.data(),
+					x.size());
 	}
 };
 
@@ -242,12 +248,14 @@ typedef basic_string_ref<wchar_t> wstring_ref;
 template<typename charT, typename traits>
 bool operator==(basic_string_ref<charT, traits> x,
 		basic_string_ref<charT, traits> y) {
-	return !x.compare(y);
+	return x.size() == y.size() &&
+	       cpputil::traits_equal<charT, traits>(x.data(), y.data(),
+						    x.size());
 }
 template<typename charT, typename traits>
 bool operator!=(basic_string_ref<charT, traits> x,
 	       	basic_string_ref<charT, traits> y) {
-	return x.compare(y);
+	return !(x == y);
 }
 template<typename charT, typename traits>
 bool operator<(basic_string_ref<charT, traits> x,
@@ -270,6 +278,18 @@ bool operator>=(basic_string_ref<charT, traits> x,
 	return x.compare(y) >= 0;
 }
 
+// Hashes the bytes; equal to hashing the equivalent std::basic_string with
+// hash_bytes(), but not to std::hash<std::string>.
+namespace std {
+template <typename charT, typename traits>
+struct hash<basic_string_ref<charT, traits>> {
+	size_t operator()(basic_string_ref<charT, traits> s) const {
+		return static_cast<size_t>(cpputil::hash_bytes(
+			s.data(), s.size() * sizeof(charT)));
+	}
+};
+}
+
 // numeric conversions
 // TODO
 int stoi(const string_ref & str, size_t * idx=0, int base=10);
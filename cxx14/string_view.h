@@ -14,6 +14,8 @@
 #include <bitset>
 #include "libcpp-util/cxx14/array_ref.h"
 #include "libcpp-util/cxx14/string_algo.h"
+#include "libcpp-util/util/hash.h"
+#include "libcpp-util/util/mem_compare.h"
 
 // TODO: This is far out-of-date with the most recent revision of the TS
 
@@ -38,7 +40,7 @@ private:
 
 	// TODO: Hm, if this is too large to fit into a size_t, we're SOL.
 	// Acceptable limit though.
-	static constexpr size_t charT_bits = 1 << (sizeof(charT) * CHAR_BIT);
+	static constexpr size_t charT_bits = size_t(1) << (sizeof(charT) * CHAR_BIT);
 	typedef std::bitset<charT_bits> charT_set;
 
 	static void init_bitset(charT_set& set, basic_string_view s) {
@@ -61,9 +63,9 @@ public:
 
 	// iterators
 	constexpr const_iterator begin() const { return data_; }
-	constexpr const_iterator end() const { return data_; }
+	constexpr const_iterator end() const { return data_ + size_; }
 	constexpr const_iterator cbegin() const { return data_; }
-	constexpr const_iterator cend() const { return data_; }
+	constexpr const_iterator cend() const { return data_ + size_; }
 	const_reverse_iterator rbegin() const {
 	       	return reverse_iterator(end());
 	}
@@ -98,7 +100,7 @@ public:
 		return *data_;
 	}
 	constexpr const charT & back() const {
-		return *(data_ + size_);
+		return data_[size_ - 1];
 	}
 	constexpr const charT * data() const noexcept {
 		return data_;
@@ -137,14 +139,17 @@ public:
 
 	// string operations with the same semantics as std::basic_string
 	int compare(basic_string_view x) const {
-		return traits::compare(data(), x.data_(),
-			       	std::min(size(), x.size()));
+		int r = cpputil::traits_compare<charT, traits>(data(), x.data(),
+				std::min(size(), x.size()));
+		if (r)
+			return r;
+		return size() < x.size() ? -1 : size() > x.size();
 	}
 	constexpr basic_string_view
 	substr(size_type pos, size_type n=npos) const {
 		return (pos > size())
 		       	? throw std::out_of_range("substr(): invalid size") :
-			basic_string_view(pos, std::min(size(), n));
+			basic_string_view(data() + pos, std::min(size() - pos, n));
 	}
 	size_type find(basic_string_view s) const {
 		return KMP(*this, s);
@@ -231,7 +236,8 @@ public:
 	bool ends_with(basic_string_view x) const {
 		if (x.size() > size())
 			return false;
-		return !traits::compare(data() + size() - x.size(), x.size());
+		return !traits::compare(data() + size() - x.size(), x.data(),
+					x.size());
 	}
 };
 
@@ -245,12 +251,14 @@ typedef basic_string_view<wchar_t> wstring_view;
 template<typename charT, typename traits>
 bool operator==(basic_string_view<charT, traits> x,
 		basic_string_view<charT, traits> y) {
-	return !x.compare(y);
+	return x.size() == y.size() &&
+	       cpputil::traits_equal<charT, traits>(x.data(), y.data(),
+						    x.size());
 }
 template<typename charT, typename traits>
 bool operator!=(basic_string_view<charT, traits> x,
 	       	basic_string_view<charT, traits> y) {
-	return x.compare(y);
+	return !(x == y);
 }
 template<typename charT, typename traits>
 bool operator<(basic_string_view<charT, traits> x,
@@ -273,6 +281,18 @@ bool operator>=(basic_string_view<charT, traits> x,
 	return x.compare(y) >= 0;
 }
 
+// Hashes the bytes; equal to hashing the equivalent std::basic_string with
+// hash_bytes(), but not to std::hash<std::string>.
+namespace std {
+template <typename charT, typename traits>
+struct hash<basic_string_view<charT, traits>> {
+	size_t operator()(basic_string_view<charT, traits> s) const {
+		return static_cast<size_t>(cpputil::hash_bytes(
+			s.data(), s.size() * sizeof(charT)));
+	}
+};
+}
+
 // numeric conversions
 // TODO
 int stoi(const string_view & str, size_t * idx=0, int base=10);
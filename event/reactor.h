@@ -0,0 +1,344 @@
+//============================================================================
+//                                  libcpp-util
+//                   A simple odds-n-ends library for C++11
+//
+//         Licensed under modified BSD license. See LICENSE for details.
+//============================================================================
+
+#ifndef LIBCPP_UTIL_REACTOR_H
+#define LIBCPP_UTIL_REACTOR_H
+
+#include "libcpp-util/event/timer_wheel.h"
+#include "libcpp-util/fifo/concurrent_queue.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace cpputil {
+
+// An epoll event loop: callbacks for descriptors becoming readable or
+// writable, timers, and tasks posted from other threads, all run on the
+// thread calling run().
+//
+// Descriptors are registered edge-triggered, so a callback is told once
+// that there is something to do and must read (or write) until EAGAIN;
+// give them O_NONBLOCK. Timers go on a timer_wheel with millisecond ticks
+// and fire no earlier than asked. post() is the one way in from other
+// threads: tasks go through a concurrent_queue, and an eventfd wakes the
+// loop, once however many tasks arrive before it gets round to them. A
+// full queue blocks the poster until the loop catches up, once the loop has
+// run on some other thread; before any run_once() the poster may be the
+// one who will run it, so the task waits in an unbounded overflow list
+// instead. Everything else (add(), run_after(), ...) belongs to the loop
+// thread, or to whoever has the reactor before run() starts.
+//
+// A signal_dispatcher plugs in through its fd(), which dispatch() drains:
+//
+//   reactor r;
+//   r.add(d.fd(), EPOLLIN, [&](uint32_t) { d.dispatch(); });
+//   r.run_after(std::chrono::seconds(5), [&] { r.stop(); });
+//   r.run();
+class reactor {
+public:
+	// Gets the epoll events: EPOLLIN, EPOLLOUT, EPOLLERR, EPOLLHUP, ...
+	typedef std::function<void(uint32_t events)> io_callback;
+	typedef std::function<void()> task;
+	typedef timer_wheel::timer_id timer_id;
+
+	static const unsigned queue_size = 4096;
+
+private:
+	static const int max_events = 256;
+	static const uint64_t wake_tag = ~uint64_t(0);
+
+	struct handler {
+		io_callback cb;
+		// Tells this registration from an earlier one of the same
+		// descriptor whose events are still in the batch.
+		uint32_t gen;
+	};
+
+	int epoll_fd;
+	int wake_fd;
+	// By descriptor. Handlers removed while dispatching are kept alive,
+	// in case it is their own callback running, until the batch is done.
+	std::vector<std::unique_ptr<handler>> handlers;
+	std::vector<std::unique_ptr<handler>> removed;
+	uint32_t next_gen;
+	timer_wheel timers;
+	std::chrono::steady_clock::time_point origin;
+	mpsc_queue<task, queue_size> posted;
+	// Tasks the loop thread posts to itself, which mustn't block on
+	// the queue it alone empties.
+	std::deque<task> local;
+	// Tasks posted while the queue was full, by a thread that might be
+	// the one to run the loop (none has run yet), so couldn't wait.
+	std::mutex overflow_lock;
+	std::deque<task> overflow;
+	std::atomic<bool> overflow_pending;
+	std::atomic<bool> wake_pending;
+	std::atomic<bool> stopping;
+	std::atomic<std::thread::id> loop_thread;
+
+	reactor(const reactor&) = delete;
+	reactor& operator=(const reactor&) = delete;
+
+	uint64_t tick_now() const {
+		using namespace std::chrono;
+		return uint64_t(duration_cast<milliseconds>(
+					steady_clock::now() - origin)
+					.count());
+	}
+
+	void wake() {
+		uint64_t one = 1;
+		ssize_t r = ::write(wake_fd, &one, sizeof(one));
+		(void)r;
+	}
+
+	int timeout_for(int timeout_ms) const {
+		if (!local.empty() || overflow_pending.load())
+			return 0;
+		if (timers.empty())
+			return timeout_ms;
+		uint64_t next = timers.next_expiry();
+		uint64_t cur = tick_now();
+		uint64_t until = next <= cur ? 0 : next - cur;
+		if (timeout_ms >= 0 && uint64_t(timeout_ms) < until)
+			return timeout_ms;
+		return int(std::min<uint64_t>(until, INT_MAX));
+	}
+
+	size_t run_posted() {
+		// Cleared first: a post() after this wakes the loop again.
+		wake_pending.store(false);
+		size_t n = 0;
+		task t;
+		// No more than a queue's worth, so posters can't starve I/O.
+		while (n < queue_size && posted.try_pop(t)) {
+			t();
+			++n;
+		}
+		if (n == queue_size && !wake_pending.exchange(true))
+			wake();
+		std::deque<task> mine;
+		if (overflow_pending.exchange(false)) {
+			std::lock_guard<std::mutex> l(overflow_lock);
+			mine.swap(overflow);
+		}
+		for (auto& o : mine) {
+			o();
+			++n;
+		}
+		mine.clear();
+		mine.swap(local);
+		for (auto& l : mine) {
+			l();
+			++n;
+		}
+		return n;
+	}
+
+public:
+	// Fails only where the descriptors can't be had; check fd() >= 0.
+	reactor()
+		: epoll_fd(-1), wake_fd(-1), next_gen(0),
+		  origin(std::chrono::steady_clock::now()),
+		  overflow_pending(false), wake_pending(false), stopping(false),
+		  loop_thread(std::thread::id()) {
+		epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+		if (epoll_fd < 0)
+			return;
+		wake_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		struct epoll_event ev;
+		ev.events = EPOLLIN;
+		ev.data.u64 = wake_tag;
+		if (wake_fd < 0 ||
+		    ::epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev) < 0) {
+			int e = errno;
+			if (wake_fd >= 0)
+				::close(wake_fd);
+			::close(epoll_fd);
+			wake_fd = epoll_fd = -1;
+			errno = e;
+		}
+	}
+
+	// Posted tasks not yet run are destroyed unrun; descriptors are left
+	// open.
+	~reactor() {
+		if (epoll_fd < 0)
+			return;
+		::close(wake_fd);
+		::close(epoll_fd);
+	}
+
+	// The epoll descriptor, readable when run_once(0) has work; for
+	// nesting in another loop.
+	int fd() const {
+		return epoll_fd;
+	}
+
+	// Calls cb with the events when fd becomes ready for any of events
+	// (EPOLLIN, EPOLLOUT, EPOLLRDHUP, ...; EPOLLET is added). Returns -1
+	// with EEXIST if fd is registered already, or errno from epoll_ctl.
+	int add(int fd, uint32_t events, io_callback cb) {
+		if (fd < 0) {
+			errno = EBADF;
+			return -1;
+		}
+		if (size_t(fd) >= handlers.size())
+			handlers.resize(size_t(fd) + 1);
+		if (handlers[fd]) {
+			errno = EEXIST;
+			return -1;
+		}
+		std::unique_ptr<handler> h(new handler);
+		h->cb = std::move(cb);
+		h->gen = ++next_gen;
+		struct epoll_event ev;
+		ev.events = events | EPOLLET;
+		ev.data.u64 = uint64_t(h->gen) << 32 | uint32_t(fd);
+		if (::epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0)
+			return -1;
+		handlers[fd] = std::move(h);
+		return 0;
+	}
+
+	// Changes the events fd is watched for. Re-arms it, too: if it is
+	// ready now, its callback runs again.
+	int modify(int fd, uint32_t events) {
+		if (fd < 0 || size_t(fd) >= handlers.size() || !handlers[fd]) {
+			errno = ENOENT;
+			return -1;
+		}
+		struct epoll_event ev;
+		ev.events = events | EPOLLET;
+		ev.data.u64 = uint64_t(handlers[fd]->gen) << 32 | uint32_t(fd);
+		return ::epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+	}
+
+	// Stops watching fd. Call it before closing fd: epoll forgets a
+	// closed descriptor by itself, but the callback would stay here.
+	// A callback may remove its own descriptor, or any other.
+	int remove(int fd) {
+		if (fd < 0 || size_t(fd) >= handlers.size() || !handlers[fd]) {
+			errno = ENOENT;
+			return -1;
+		}
+		struct epoll_event ev;
+		::epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, &ev);
+		removed.push_back(std::move(handlers[fd]));
+		return 0;
+	}
+
+	// Calls t on the loop thread no sooner than delay from now.
+	template <class Rep, class Period>
+	timer_id run_after(std::chrono::duration<Rep, Period> delay, task t) {
+		using namespace std::chrono;
+		int64_t ns = duration_cast<nanoseconds>(steady_clock::now() -
+							origin + delay)
+				     .count();
+		if (ns < 0)
+			ns = 0;
+		return timers.add((uint64_t(ns) + 999999) / 1000000,
+				  std::move(t));
+	}
+
+	// Returns false if the timer has fired or was cancelled already.
+	bool cancel(timer_id id) {
+		return timers.cancel(id);
+	}
+
+	// Runs t on the loop thread. Safe from any thread, including the
+	// loop's own, and from callbacks.
+	void post(task t) {
+		std::thread::id loop =
+			loop_thread.load(std::memory_order_relaxed);
+		if (std::this_thread::get_id() == loop) {
+			local.push_back(std::move(t));
+			return;
+		}
+		if (loop != std::thread::id())
+			posted.push(std::move(t));
+		else if (!posted.try_push(std::move(t))) {
+			std::lock_guard<std::mutex> l(overflow_lock);
+			overflow.push_back(std::move(t));
+			overflow_pending.store(true);
+		}
+		if (!wake_pending.exchange(true))
+			wake();
+	}
+
+	// Waits up to timeout_ms (-1: for ever, 0: not at all) for
+	// something to do, and does everything due: descriptor callbacks,
+	// timers, then posted tasks. Returns how many callbacks ran, or -1
+	// with errno set if epoll_wait fails.
+	int run_once(int timeout_ms = -1) {
+		loop_thread.store(std::this_thread::get_id(),
+				  std::memory_order_relaxed);
+		struct epoll_event events[max_events];
+		int n = ::epoll_wait(epoll_fd, events, max_events,
+				     timeout_for(timeout_ms));
+		if (n < 0) {
+			if (errno != EINTR)
+				return -1;
+			n = 0;
+		}
+		int ran = 0;
+		for (int i = 0; i < n; ++i) {
+			uint64_t data = events[i].data.u64;
+			if (data == wake_tag) {
+				uint64_t count;
+				ssize_t r = ::read(wake_fd, &count,
+						   sizeof(count));
+				(void)r;
+				continue;
+			}
+			size_t fd = uint32_t(data);
+			if (fd >= handlers.size() || !handlers[fd] ||
+			    handlers[fd]->gen != uint32_t(data >> 32))
+				continue;
+			handler* h = handlers[fd].get();
+			h->cb(events[i].events);
+			++ran;
+		}
+		removed.clear();
+		ran += int(timers.advance(tick_now()));
+		ran += int(run_posted());
+		return ran;
+	}
+
+	// Runs the loop until stop().
+	void run() {
+		while (!stopping.load())
+			run_once();
+		stopping.store(false);
+	}
+
+	// Makes run() return once the callbacks in hand have run. Safe from
+	// any thread.
+	void stop() {
+		stopping.store(true);
+		wake();
+	}
+};
+
+}
+#endif
@@ -0,0 +1,211 @@
+// Timer wheel throughput, and round trip latency through the reactor.
+//
+//   reactor_bench [timers] [round trips]
+//
+// Adds timers (default 1000000) with random delays of up to an hour in
+// millisecond ticks, then cancels them in random order, timing each, on
+// the timer_wheel and on a std::multimap keyed by expiry, the usual
+// alternative; then fires as many spread over ten seconds of ticks.
+//
+// Then sends 64 byte messages over a socketpair to be echoed back, one at
+// a time, round trips times (default 20000): by a reactor on its own
+// thread, edge-triggered, and by a thread in a blocking read() loop. And
+// times post() from another thread to the task starting on the loop.
+#include "reactor.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace cpputil;
+
+using bench_clock = std::chrono::steady_clock;
+
+static double seconds_since(bench_clock::time_point start) {
+	return std::chrono::duration<double>(bench_clock::now() - start)
+		.count();
+}
+
+static void report_rate(const char *name, size_t n, double secs) {
+	printf("%-28s %10.2f %10.1f\n", name, n / secs / 1e6,
+	       secs * 1e9 / n);
+}
+
+static void bench_timers(size_t n) {
+	std::mt19937_64 rng(1);
+	std::vector<uint64_t> expires(n);
+	for (auto& e : expires)
+		e = 1 + rng() % 3600000;
+	std::vector<size_t> order(n);
+	for (size_t i = 0; i < n; ++i)
+		order[i] = i;
+	std::shuffle(order.begin(), order.end(), rng);
+	size_t fired = 0;
+	auto cb = [&fired] { ++fired; };
+
+	printf("%-28s %10s %10s\n", "timers", "Mops/s", "ns/op");
+	{
+		timer_wheel w;
+		std::vector<timer_wheel::timer_id> ids(n);
+		bench_clock::time_point start = bench_clock::now();
+		for (size_t i = 0; i < n; ++i)
+			ids[i] = w.add(expires[i], cb);
+		report_rate("timer_wheel add", n, seconds_since(start));
+		start = bench_clock::now();
+		for (size_t i : order)
+			w.cancel(ids[i]);
+		report_rate("timer_wheel cancel", n, seconds_since(start));
+	}
+	{
+		typedef std::multimap<uint64_t, std::function<void()>> map;
+		map m;
+		std::vector<map::iterator> its(n);
+		bench_clock::time_point start = bench_clock::now();
+		for (size_t i = 0; i < n; ++i)
+			its[i] = m.emplace(expires[i], cb);
+		report_rate("std::multimap insert", n, seconds_since(start));
+		start = bench_clock::now();
+		for (size_t i : order)
+			m.erase(its[i]);
+		report_rate("std::multimap erase", n, seconds_since(start));
+	}
+	{
+		timer_wheel w;
+		for (size_t i = 0; i < n; ++i)
+			w.add(expires[i] % 10000, cb);
+		bench_clock::time_point start = bench_clock::now();
+		for (uint64_t t = 0; t < 10000; ++t)
+			w.advance(t);
+		report_rate("timer_wheel fire", fired, seconds_since(start));
+	}
+}
+
+static std::vector<double> latencies;
+
+static void report_latency(const char *name) {
+	std::sort(latencies.begin(), latencies.end());
+	double sum = 0;
+	for (double l : latencies)
+		sum += l;
+	size_t n = latencies.size();
+	printf("%-28s %8.2f %8.2f %8.2f %8.2f\n", name, sum / n,
+	       latencies[n / 2], latencies[n * 99 / 100],
+	       latencies[n * 999 / 1000]);
+	latencies.clear();
+}
+
+// Sends round_trips messages down fd and waits for each to come back.
+static void ping(int fd, size_t round_trips) {
+	char msg[64] = {0}, reply[64];
+	for (size_t i = 0; i < round_trips; ++i) {
+		bench_clock::time_point start = bench_clock::now();
+		if (write(fd, msg, sizeof(msg)) != ssize_t(sizeof(msg))) {
+			perror("write");
+			exit(1);
+		}
+		size_t got = 0;
+		while (got < sizeof(reply)) {
+			ssize_t r = read(fd, reply + got, sizeof(reply) - got);
+			if (r <= 0) {
+				perror("read");
+				exit(1);
+			}
+			got += size_t(r);
+		}
+		latencies.push_back(std::chrono::duration<double, std::micro>(
+					    bench_clock::now() - start)
+					    .count());
+	}
+}
+
+static void echo_reactor(size_t round_trips) {
+	int sv[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+		perror("socketpair");
+		exit(1);
+	}
+	fcntl(sv[1], F_SETFL, fcntl(sv[1], F_GETFL) | O_NONBLOCK);
+	reactor r;
+	r.add(sv[1], EPOLLIN, [&](uint32_t) {
+		char buf[4096];
+		ssize_t n;
+		while ((n = read(sv[1], buf, sizeof(buf))) > 0)
+			if (write(sv[1], buf, size_t(n)) != n)
+				abort();
+	});
+	std::thread loop([&] { r.run(); });
+	ping(sv[0], round_trips);
+	r.stop();
+	loop.join();
+	close(sv[0]);
+	close(sv[1]);
+	report_latency("echo, reactor");
+}
+
+static void echo_blocking(size_t round_trips) {
+	int sv[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+		perror("socketpair");
+		exit(1);
+	}
+	std::thread echo([&] {
+		char buf[4096];
+		ssize_t n;
+		while ((n = read(sv[1], buf, sizeof(buf))) > 0)
+			if (write(sv[1], buf, size_t(n)) != n)
+				abort();
+	});
+	ping(sv[0], round_trips);
+	shutdown(sv[0], SHUT_WR);
+	echo.join();
+	close(sv[0]);
+	close(sv[1]);
+	report_latency("echo, blocking thread");
+}
+
+static void post_latency(size_t round_trips) {
+	reactor r;
+	std::thread loop([&] { r.run(); });
+	std::atomic<bool> done(false);
+	bench_clock::time_point start;
+	for (size_t i = 0; i < round_trips; ++i) {
+		done.store(false);
+		start = bench_clock::now();
+		r.post([&] {
+			latencies.push_back(
+				std::chrono::duration<double, std::micro>(
+					bench_clock::now() - start)
+					.count());
+			done.store(true);
+		});
+		while (!done.load())
+			std::this_thread::yield();
+	}
+	r.stop();
+	loop.join();
+	report_latency("post to task start");
+}
+
+int main(int argc, char **argv) {
+	size_t timers = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000000;
+	size_t round_trips = argc > 2 ? strtoul(argv[2], nullptr, 10) : 20000;
+
+	bench_timers(timers);
+	printf("\n");
+
+	latencies.reserve(round_trips);
+	printf("%-28s %8s %8s %8s %8s\n", "us", "mean", "p50", "p99",
+	       "p99.9");
+	echo_reactor(round_trips);
+	echo_blocking(round_trips);
+	post_latency(round_trips);
+	return 0;
+}
@@ -0,0 +1,270 @@
+#include "reactor.h"
+#include "libcpp-util/util/test_check.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace cpputil;
+
+static void set_nonblocking(int fd) {
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+// Random adds, cancels and advances against a map of what should be
+// live: every timer fires exactly once, in the advance() that reaches its
+// tick, in order, unless cancelled first.
+static void test_wheel_random() {
+	timer_wheel w(12345);
+	std::mt19937_64 rng(1);
+	std::map<timer_wheel::timer_id, uint64_t> live;
+	std::vector<timer_wheel::timer_id> ids;
+	uint64_t prev_to = w.current() - 1, to = prev_to, last = 0;
+	size_t fired = 0;
+	for (int round = 0; round < 1000; ++round) {
+		for (int i = 0; i < 200; ++i) {
+			uint64_t delay;
+			switch (rng() % 4) {
+			case 0:
+				delay = rng() % 100;
+				break;
+			case 1:
+				delay = rng() % 100000;
+				break;
+			case 2:
+				delay = rng() % 100000000;
+				break;
+			default:
+				delay = rng() % (uint64_t(1) << 40);
+				break;
+			}
+			uint64_t expires = w.current() + delay;
+			auto id = std::make_shared<timer_wheel::timer_id>();
+			*id = w.add(expires, [&, id, expires] {
+				CHECK(expires > prev_to && expires <= to);
+				CHECK(expires >= last);
+				last = expires;
+				CHECK(live.erase(*id) == 1);
+				++fired;
+			});
+			live[*id] = expires;
+			ids.push_back(*id);
+		}
+		for (int i = 0; i < 100; ++i) {
+			auto id = ids[rng() % ids.size()];
+			bool was_live = live.erase(id) == 1;
+			CHECK(w.cancel(id) == was_live);
+		}
+		CHECK(w.size() == live.size());
+		if (round % 10 == 0) {
+			uint64_t first = ~uint64_t(0);
+			for (auto& l : live)
+				first = std::min(first, l.second);
+			CHECK(w.next_expiry() <= first);
+		}
+
+		prev_to = to;
+		to += rng() % 3 ? rng() % 5000 : rng() % 10000000;
+		last = 0;
+		w.advance(to);
+		CHECK(w.current() == to + 1);
+	}
+	prev_to = to;
+	to += uint64_t(1) << 41;
+	last = 0;
+	w.advance(to);
+	CHECK(live.empty() && w.empty());
+	CHECK(w.next_expiry() == ~uint64_t(0));
+	CHECK(fired > 0);
+}
+
+// Callbacks cancelling timers due in the same tick, and adding timers
+// for a tick already run.
+static void test_wheel_reentrant() {
+	timer_wheel w;
+	int a = 0, b = 0, again = 0;
+	timer_wheel::timer_id ib = 0;
+	w.add(10, [&] {
+		++a;
+		CHECK(w.cancel(ib));
+	});
+	ib = w.add(10, [&] { ++b; });
+	std::function<void()> repeat = [&] {
+		if (++again < 5)
+			w.add(0, repeat);
+	};
+	w.add(20, repeat);
+	CHECK(w.advance(10) == 1);
+	CHECK(a == 1 && b == 0 && !w.cancel(ib));
+	CHECK(w.advance(22) == 3);
+	CHECK(again == 3);
+	CHECK(w.advance(100) == 2 && again == 5);
+}
+
+// One megabyte over a socketpair, both ends edge-triggered: the writer
+// writes until EAGAIN and waits for EPOLLOUT, the reader reads until
+// EAGAIN.
+static void test_edge_triggered() {
+	reactor r;
+	CHECK(r.fd() >= 0);
+	int sv[2];
+	CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+	set_nonblocking(sv[0]);
+	set_nonblocking(sv[1]);
+	const size_t total = 1 << 20;
+	size_t sent = 0, received = 0;
+	unsigned char out = 0, in = 0;
+	CHECK(r.add(sv[0], EPOLLOUT, [&](uint32_t ev) {
+		CHECK(ev & EPOLLOUT);
+		unsigned char buf[7000];
+		while (sent < total) {
+			size_t n = std::min(sizeof(buf), total - sent);
+			for (size_t i = 0; i < n; ++i)
+				buf[i] = out++;
+			ssize_t w = write(sv[0], buf, n);
+			if (w < 0) {
+				CHECK(errno == EAGAIN);
+				out = (unsigned char)(out - n);
+				return;
+			}
+			out = (unsigned char)(out - (n - size_t(w)));
+			sent += size_t(w);
+		}
+		r.remove(sv[0]);
+	}) == 0);
+	CHECK(r.add(sv[0], EPOLLIN, nullptr) < 0 && errno == EEXIST);
+	CHECK(r.add(sv[1], EPOLLIN, [&](uint32_t) {
+		unsigned char buf[3000];
+		ssize_t n;
+		while ((n = read(sv[1], buf, sizeof(buf))) > 0) {
+			for (ssize_t i = 0; i < n; ++i)
+				CHECK(buf[i] == in++);
+			received += size_t(n);
+		}
+		CHECK(n < 0 && errno == EAGAIN);
+		if (received == total)
+			r.stop();
+	}) == 0);
+	r.run();
+	CHECK(sent == total && received == total);
+	CHECK(r.remove(sv[0]) < 0 && errno == ENOENT);
+	CHECK(r.remove(sv[1]) == 0);
+	close(sv[0]);
+	close(sv[1]);
+}
+
+// Events still in the batch for a descriptor that an earlier callback
+// removed, or removed and added back, don't reach the old callback.
+static void test_remove_in_batch() {
+	reactor r;
+	int a[2], b[2];
+	CHECK(pipe(a) == 0 && pipe(b) == 0);
+	int calls = 0, calls_new = 0;
+	// Whichever runs first takes both away and puts a back.
+	auto cb = [&](uint32_t) {
+		++calls;
+		CHECK(r.remove(a[0]) == 0 && r.remove(b[0]) == 0);
+		CHECK(r.add(a[0], EPOLLIN, [&](uint32_t) { ++calls_new; }) ==
+		      0);
+	};
+	r.add(a[0], EPOLLIN, cb);
+	r.add(b[0], EPOLLIN, cb);
+	CHECK(write(a[1], "x", 1) == 1 && write(b[1], "x", 1) == 1);
+	r.run_once(1000);
+	CHECK(calls == 1 && calls_new == 0);
+	CHECK(write(a[1], "x", 1) == 1);
+	r.run_once(1000);
+	CHECK(calls_new == 1);
+	r.remove(a[0]);
+	for (int fd : {a[0], a[1], b[0], b[1]})
+		close(fd);
+}
+
+static void test_timers() {
+	reactor r;
+	typedef std::chrono::steady_clock clock;
+	clock::time_point start = clock::now();
+	std::vector<int> order;
+	auto at = [&](int ms) {
+		return [&, ms] {
+			CHECK(clock::now() - start >=
+			      std::chrono::milliseconds(ms));
+			order.push_back(ms);
+		};
+	};
+	r.run_after(std::chrono::milliseconds(30), at(30));
+	r.run_after(std::chrono::milliseconds(10), at(10));
+	auto id = r.run_after(std::chrono::milliseconds(20), at(20));
+	r.run_after(std::chrono::microseconds(1500), at(1));
+	r.run_after(std::chrono::milliseconds(40), [&] { r.stop(); });
+	CHECK(r.cancel(id) && !r.cancel(id));
+	r.run();
+	CHECK((order == std::vector<int>{1, 10, 30}));
+}
+
+// Tasks posted from several threads and from the loop itself all run on
+// the loop thread; stop() from another thread ends run().
+static void test_post() {
+	reactor r;
+	const int threads = 4, per_thread = 20000;
+	long sum = 0;
+	int ran = 0, local = 0;
+	std::thread::id loop = std::this_thread::get_id();
+	std::vector<std::thread> posters;
+	for (int t = 0; t < threads; ++t)
+		posters.emplace_back([&] {
+			for (int i = 0; i < per_thread; ++i)
+				r.post([&, i] {
+					CHECK(std::this_thread::get_id() ==
+					      loop);
+					sum += i;
+					if (++ran % 1000 == 0)
+						r.post([&] { ++local; });
+				});
+		});
+	while (ran < threads * per_thread || local < ran / 1000)
+		r.run_once(1000);
+	for (auto& p : posters)
+		p.join();
+	CHECK(sum == long(threads) * per_thread * (per_thread - 1) / 2);
+
+	std::thread stopper([&] {
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		r.stop();
+	});
+	r.run();
+	stopper.join();
+}
+
+// More than a queue's worth posted before the loop first runs, by the
+// thread that will run it, doesn't block, and all of it runs in order.
+static void test_post_before_run() {
+	reactor r;
+	const int n = int(reactor::queue_size) * 2 + 10;
+	std::vector<int> order;
+	for (int i = 0; i < n; ++i)
+		r.post([&, i] { order.push_back(i); });
+	while (int(order.size()) < n)
+		CHECK(r.run_once(1000) > 0);
+	for (int i = 0; i < n; ++i)
+		CHECK(order[i] == i);
+}
+
+int main() {
+	test_wheel_random();
+	test_wheel_reentrant();
+	test_edge_triggered();
+	test_remove_in_batch();
+	test_timers();
+	test_post();
+	test_post_before_run();
+	printf("reactor_test: all passed\n");
+	return 0;
+}
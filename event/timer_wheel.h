@@ -0,0 +1,266 @@
+//============================================================================
+//                                  libcpp-util
+//                   A simple odds-n-ends library for C++11
+//
+//         Licensed under modified BSD license. See LICENSE for details.
+//============================================================================
+
+#ifndef LIBCPP_UTIL_TIMER_WHEEL_H
+#define LIBCPP_UTIL_TIMER_WHEEL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+namespace cpputil {
+
+// A hierarchical timer wheel: add() and cancel() are O(1) whatever the
+// number of timers, so it copes with millions of timeouts that mostly get
+// cancelled before they fire (the usual fate of I/O timeouts).
+//
+// Time is in ticks, whatever the caller makes them; the reactor uses
+// milliseconds. There are levels of 64 slots, each slot of level n
+// spanning 64^n ticks. A timer goes in the lowest level whose span covers
+// its delay, and as time reaches each slot of a higher level its timers are
+// cascaded down, until they land in level 0 and fire on their tick. Delays
+// past 64^levels ticks (about 8900 years at a millisecond) are clamped.
+//
+// Timers live in one vector with a free list, linked into their slots by
+// index, so adding one doesn't allocate once the vector has grown (nor
+// does std::function for a small closure). Not thread safe.
+class timer_wheel {
+public:
+	typedef std::function<void()> callback;
+
+	// Names one timer; stale ids, of timers that have fired or been
+	// cancelled, are recognized as such. 0 is never a timer.
+	typedef uint64_t timer_id;
+
+private:
+	static const unsigned slot_bits = 6;
+	static const unsigned slots = 1u << slot_bits;
+	static const unsigned levels = 8;
+	static const uint32_t nil = ~0u;
+	// Heads of the slot lists are nodes too, at [0, heads), followed by
+	// the list of timers due in the tick being run.
+	static const uint32_t heads = levels * slots;
+	static const uint32_t due = heads;
+
+	struct node {
+		uint32_t prev;
+		uint32_t next;
+		// The generation, bumped on free, so stale ids miss.
+		uint32_t gen;
+		// The list the node is on: a slot, due, or nil if free.
+		uint32_t list;
+		uint64_t expires;
+		callback cb;
+	};
+
+	std::vector<node> nodes;
+	uint32_t free_head;
+	uint64_t occupied[levels];
+	// The next tick to run; everything before it has fired.
+	uint64_t now;
+	size_t count;
+
+	timer_wheel(const timer_wheel&) = delete;
+	timer_wheel& operator=(const timer_wheel&) = delete;
+
+	void link(uint32_t list, uint32_t i) {
+		node& n = nodes[i];
+		node& h = nodes[list];
+		n.list = list;
+		n.prev = h.prev;
+		n.next = list;
+		nodes[h.prev].next = i;
+		h.prev = i;
+		if (list < heads)
+			occupied[list / slots] |= uint64_t(1) << (list % slots);
+	}
+
+	void unlink(uint32_t i) {
+		node& n = nodes[i];
+		nodes[n.prev].next = n.next;
+		nodes[n.next].prev = n.prev;
+		uint32_t list = n.list;
+		if (list < heads && nodes[list].next == list)
+			occupied[list / slots] &=
+				~(uint64_t(1) << (list % slots));
+		n.list = nil;
+	}
+
+	void place(uint32_t i) {
+		uint64_t expires = nodes[i].expires;
+		uint64_t delta = expires - now;
+		unsigned level = 0;
+		while (level + 1 < levels &&
+		       delta >= uint64_t(1) << (slot_bits * (level + 1)))
+			++level;
+		unsigned slot = unsigned(expires >> (slot_bits * level)) &
+				(slots - 1);
+		link(level * slots + slot, i);
+	}
+
+	void release(uint32_t i) {
+		node& n = nodes[i];
+		n.cb = nullptr;
+		++n.gen;
+		n.next = free_head;
+		free_head = i;
+		--count;
+	}
+
+	// Moves the timers in slot of level down to where they now belong.
+	void cascade(unsigned level, unsigned slot) {
+		uint32_t head = level * slots + slot;
+		while (nodes[head].next != head) {
+			uint32_t i = nodes[head].next;
+			unlink(i);
+			place(i);
+		}
+	}
+
+	// The first tick at or after now that some slot of level will be
+	// run or cascaded at, or ~0 if the level is empty.
+	uint64_t first_at(unsigned level) const {
+		uint64_t bits = occupied[level];
+		if (!bits)
+			return ~uint64_t(0);
+		unsigned shift = slot_bits * level;
+		uint64_t base = now >> shift;
+		// Unless now is the first tick of its slot, that slot has
+		// been run (or cascaded) already, and comes round next after
+		// the other 63.
+		if (now & ((uint64_t(1) << shift) - 1))
+			++base;
+		unsigned start = unsigned(base) & (slots - 1);
+		uint64_t rotated = bits >> start;
+		if (start)
+			rotated |= bits << (slots - start);
+		return (base + uint64_t(__builtin_ctzll(rotated))) << shift;
+	}
+
+public:
+	explicit timer_wheel(uint64_t start = 0)
+		: free_head(nil), now(start), count(0) {
+		nodes.resize(heads + 1);
+		for (uint32_t i = 0; i <= heads; ++i) {
+			nodes[i].prev = nodes[i].next = i;
+			nodes[i].gen = 0;
+			nodes[i].list = nil;
+			nodes[i].expires = 0;
+		}
+		for (unsigned l = 0; l < levels; ++l)
+			occupied[l] = 0;
+	}
+
+	// The next tick advance() will run.
+	uint64_t current() const {
+		return now;
+	}
+
+	size_t size() const {
+		return count;
+	}
+
+	bool empty() const {
+		return count == 0;
+	}
+
+	// Calls cb from the advance() that reaches tick expires, or the next
+	// one if that has passed.
+	timer_id add(uint64_t expires, callback cb) {
+		uint32_t i;
+		if (free_head != nil) {
+			i = free_head;
+			free_head = nodes[i].next;
+		} else {
+			i = uint32_t(nodes.size());
+			nodes.emplace_back();
+			nodes[i].gen = 0;
+		}
+		node& n = nodes[i];
+		n.expires = expires < now ? now : expires;
+		uint64_t max_delta = (uint64_t(1) << (slot_bits * levels)) - 1;
+		if (n.expires - now > max_delta)
+			n.expires = now + max_delta;
+		n.cb = std::move(cb);
+		place(i);
+		++count;
+		return uint64_t(n.gen) << 32 | i;
+	}
+
+	// Stops a timer from firing. Returns false if it already has, or was
+	// cancelled. Callbacks may cancel any timer, their own included.
+	bool cancel(timer_id id) {
+		uint32_t i = uint32_t(id);
+		if (i <= heads || i >= nodes.size() ||
+		    nodes[i].gen != uint32_t(id >> 32) || nodes[i].list == nil)
+			return false;
+		unlink(i);
+		release(i);
+		return true;
+	}
+
+	// The first tick at which a timer may fire, or ~0 if there are none.
+	// Exact for timers due within the 64 ticks of the current level 0
+	// round; otherwise the tick their slot cascades at, which is no
+	// later. Either way, advance() to it and ask again.
+	uint64_t next_expiry() const {
+		uint64_t first = ~uint64_t(0);
+		for (unsigned l = 0; l < levels; ++l) {
+			uint64_t t = first_at(l);
+			if (t < first)
+				first = t;
+		}
+		return first;
+	}
+
+	// Runs the ticks up to and including to, firing the timers due in
+	// them in order of expiry. Returns how many fired. Callbacks may add
+	// and cancel timers; one added for a tick already run fires in the
+	// next.
+	size_t advance(uint64_t to) {
+		size_t fired = 0;
+		while (now <= to) {
+			// Skip straight to the next tick with work in it.
+			uint64_t next = next_expiry();
+			if (next > to) {
+				now = to + 1;
+				break;
+			}
+			now = next;
+			unsigned slot = unsigned(now) & (slots - 1);
+			for (unsigned l = 1; l < levels && !slot; ++l) {
+				slot = unsigned(now >> (slot_bits * l)) &
+				       (slots - 1);
+				cascade(l, slot);
+			}
+			// Take the tick's timers off the wheel first, so
+			// that callbacks adding timers for now don't add to
+			// the list being run.
+			uint32_t head = unsigned(now) & (slots - 1);
+			while (nodes[head].next != head) {
+				uint32_t i = nodes[head].next;
+				unlink(i);
+				link(due, i);
+			}
+			++now;
+			while (nodes[due].next != due) {
+				uint32_t i = nodes[due].next;
+				unlink(i);
+				callback cb = std::move(nodes[i].cb);
+				release(i);
+				cb();
+				++fired;
+			}
+		}
+		return fired;
+	}
+};
+
+}
+#endif
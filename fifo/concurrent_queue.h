@@ -13,7 +13,9 @@
 #include "libcpp-util/util/ref_count_handle.h"
 
 #include <atomic>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
 #include <cassert>
 #include <cstddef>
 #include <type_traits>
@@ -54,11 +56,9 @@ typedef atomic_discipline<true, false> mpsc_discipline;
 typedef atomic_discipline<false, true> spmc_discipline;
 typedef atomic_discipline<true, true> mpmc_discipline;
 
-// FIXME: This implementation is exception-unsafe. When an exception is thrown
-// while copying an object, a block of undefined bits is left there to be
-// consumed later by a pull operation. Instead check the relevant functions for
-// noexcept and don't release the lock until we have completed putting the item
-// in the queue. If an exception is thrown, decrement the index and rethrow.
+// Every operation holds the lock while it touches the slots and counts, so
+// an element is only visible to pop() once it is fully constructed, and an
+// exception thrown while copying or moving one leaves the queue unchanged.
 template <typename T, size_t N, class AtomicPolicy,
 	  class Alloc = std::allocator<T>>
 class concurrent_queue : public AtomicPolicy {
@@ -85,8 +85,8 @@ private:
 		closed
 	};
 
-	wait_result wait_for_used_space_or_close() {
-		std::unique_lock<std::mutex> l(lock);
+	wait_result
+	wait_for_used_space_or_close(std::unique_lock<std::mutex>& l) {
 		while (1) {
 			if (full)
 				return wait_result::ready;
@@ -96,21 +96,31 @@ private:
 		}
 	}
 
-	void wait_for_empty_space() {
-		std::unique_lock<std::mutex> l(lock);
-		while (1) {
-			if (empty)
-				return;
+	void wait_for_empty_space(std::unique_lock<std::mutex>& l) {
+		while (!empty)
 			empty_cv.wait(l);
-		}
 	}
 
-	bool pop_value_common(T& val) {
+	// Called with the lock held and a free slot.
+	template <class... Args>
+	void push_value_common(std::unique_lock<std::mutex>& l,
+			       Args&&... args) {
+		alloc.construct(&fifo[tail], std::forward<Args>(args)...);
+		AtomicPolicy::increment_index(tail, N);
+		empty--;
+		full++;
+		l.unlock();
+		full_cv.notify_one();
+	}
+
+	// Called with the lock held and a used slot.
+	bool pop_value_common(std::unique_lock<std::mutex>& l, T& val) {
+		val = std::move(fifo[head]);
 		auto tmp_head = AtomicPolicy::increment_index(head, N);
-		full--;
-		val = std::move(fifo[tmp_head]);
 		alloc.destroy(&fifo[tmp_head]);
+		full--;
 		empty++;
+		l.unlock();
 		empty_cv.notify_one();
 		return true;
 	}
@@ -130,7 +140,8 @@ public:
 		// everyone again as we're destroying things.
 		if (is_closed())
 			close();
-		while (head != tail) {
+		// head == tail when full as well as when empty.
+		for (; full; full--) {
 			alloc.destroy(&fifo[head]);
 			head = (head + 1) % N;
 		}
@@ -141,7 +152,11 @@ public:
 	}
 
 	void close() {
-		open = false;
+		{
+			// Under the lock, or a reader about to wait misses it.
+			std::lock_guard<std::mutex> l(lock);
+			open = false;
+		}
 		full_cv.notify_all(); // Make sure to wake any readers
 	}
 
@@ -151,48 +166,44 @@ public:
 
 	template <class... Args>
 	void emplace(Args&&... args) {
-		wait_for_empty_space();
-		empty--;
-		auto tmp_tail = AtomicPolicy::increment_index(tail, N);
-		alloc.construct(&fifo[tmp_tail], std::forward<Args>(args)...);
-		full++;
-		full_cv.notify_one();
+		std::unique_lock<std::mutex> l(lock);
+		wait_for_empty_space(l);
+		push_value_common(l, std::forward<Args>(args)...);
 	}
 
 	void push(const T& val) {
-		wait_for_empty_space();
-		empty--;
-		auto tmp_tail = AtomicPolicy::increment_index(tail, N);
-		alloc.construct(&fifo[tmp_tail], val);
-		full++;
-		full_cv.notify_one();
+		std::unique_lock<std::mutex> l(lock);
+		wait_for_empty_space(l);
+		push_value_common(l, val);
 	}
 
 	void push(T&& val) {
-		wait_for_empty_space();
-		empty--;
-		auto tmp_tail = AtomicPolicy::increment_index(tail, N);
-		alloc.construct(&fifo[tmp_tail], std::move(val));
-		full++;
-		full_cv.notify_one();
+		std::unique_lock<std::mutex> l(lock);
+		wait_for_empty_space(l);
+		push_value_common(l, std::move(val));
 	}
 
 	bool try_push(const T& val) {
 		std::unique_lock<std::mutex> l(lock);
 		if (!empty)
 			return false;
-		empty--;
-		auto tmp_tail = AtomicPolicy::increment_index(tail, N);
-		l.unlock();
-		alloc.construct(&fifo[tmp_tail], val);
-		full++;
-		full_cv.notify_one();
+		push_value_common(l, val);
+		return true;
+	}
+
+	bool try_push(T&& val) {
+		std::unique_lock<std::mutex> l(lock);
+		if (!empty)
+			return false;
+		push_value_common(l, std::move(val));
+		return true;
 	}
 
 	bool pop(T& val) {
-		switch (wait_for_used_space_or_close()) {
+		std::unique_lock<std::mutex> l(lock);
+		switch (wait_for_used_space_or_close(l)) {
 		case wait_result::ready:
-			return pop_value_common(val);
+			return pop_value_common(l, val);
 		case wait_result::closed:
 			return false;
 		}
@@ -203,10 +214,7 @@ public:
 		std::unique_lock<std::mutex> l(lock);
 		if (!full)
 			return false;
-		if (queue_is_finished())
-			return false;
-		l.unlock();
-		return pop_value_common(val);
+		return pop_value_common(l, val);
 	}
 };
 
@@ -11,6 +11,7 @@
 #include "libcpp-util/mem/util.h"
 
 #include <cstddef>
+#include <cstdlib>
 #include <new>
 #include <memory>
 #include <limits>
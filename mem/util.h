@@ -10,6 +10,7 @@
 
 #include <cstdint>
 #include <cstddef>
+#include <new>
 #include <utility>
 
 #if defined(_WIN32)
@@ -25,7 +26,7 @@ inline void *align(std::size_t alignment, std::size_t size, void *&ptr,
 	if (alignment > space)
 		return nullptr;
 	std::uintptr_t pn = reinterpret_cast<std::uintptr_t>(ptr);
-	std::uintptr_t aligned = (pn + alignment - 1) & ~alignment;
+	std::uintptr_t aligned = (pn + alignment - 1) & ~(alignment - 1);
 	std::size_t padding = aligned - pn; // Distance we adjusted by.
 	if (space < size + padding)
 		return nullptr;
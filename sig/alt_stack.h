@@ -0,0 +1,225 @@
+//============================================================================
+//                                  libcpp-util
+//                   A simple odds-n-ends library for C++11
+//
+//         Licensed under modified BSD license. See LICENSE for details.
+//============================================================================
+
+#ifndef LIBCPP_UTIL_ALT_STACK_H
+#define LIBCPP_UTIL_ALT_STACK_H
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+
+#include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "libcpp-util/smp/thread_pool.h"
+
+// Per-thread alternate signal stacks, and what a SIGSEGV handler needs to
+// tell a stack overflow from any other bad pointer.
+//
+// A thread that overflows its stack has nowhere to run a handler unless
+// it has an alternate stack, and sigaltstack() is per thread, so without
+// one on every thread an overflow anywhere but the main thread dies
+// silently. alt_stack::ensure() gives the calling thread an mmap()ed one,
+// with a guard page below, freed when the thread exits, and registers the
+// bounds of its stack. Call it at the start of threads you create;
+// use_in_thread_pools() has every cpputil::thread_pool worker started
+// afterwards do so. crash_reporter::install() does both.
+//
+// In a handler, find_stack_overflow() then says whether a fault hit the
+// guard below the thread's stack, and how much stack was in use.
+
+struct stack_overflow_info {
+	// The thread's stack: [lo, hi).
+	uintptr_t lo;
+	uintptr_t hi;
+	// Bytes between the stack pointer at the fault and hi.
+	uintptr_t used;
+};
+
+namespace alt_stack_detail {
+
+const size_t max_threads = 4096;
+
+// The stacks of threads that have called ensure(), by kernel thread id.
+// Slots are claimed and released with atomics, so the handler can read
+// them without a lock.
+struct thread_stack {
+	std::atomic<int> tid;
+	std::atomic<uintptr_t> lo;
+	std::atomic<uintptr_t> hi;
+	std::atomic<uintptr_t> guard;
+};
+
+inline thread_stack *registry() {
+	static thread_stack slots[max_threads];
+	return slots;
+}
+
+inline int gettid() {
+	return int(::syscall(SYS_gettid));
+}
+
+// The calling thread's alternate stack and registry slot, undone at
+// thread exit.
+struct thread_state {
+	void *map;
+	size_t map_size;
+	thread_stack *slot;
+
+	thread_state() : map(nullptr), map_size(0), slot(nullptr) {
+	}
+
+	~thread_state() {
+		if (map) {
+			stack_t cur;
+			if (::sigaltstack(nullptr, &cur) == 0 &&
+			    static_cast<char *>(cur.ss_sp) ==
+				    static_cast<char *>(map) + page_size()) {
+				stack_t off;
+				off.ss_sp = nullptr;
+				off.ss_size = 0;
+				off.ss_flags = SS_DISABLE;
+				::sigaltstack(&off, nullptr);
+			}
+			::munmap(map, map_size);
+		}
+		if (slot)
+			slot->tid.store(0, std::memory_order_release);
+	}
+
+	static size_t page_size() {
+		return size_t(::sysconf(_SC_PAGESIZE));
+	}
+};
+
+inline thread_state &this_thread() {
+	static thread_local thread_state s;
+	return s;
+}
+
+inline void register_stack(thread_state &s) {
+	if (s.slot)
+		return;
+	pthread_attr_t attr;
+	if (::pthread_getattr_np(::pthread_self(), &attr) != 0)
+		return;
+	void *addr;
+	size_t size, guard = 0;
+	::pthread_attr_getstack(&attr, &addr, &size);
+	::pthread_attr_getguardsize(&attr, &guard);
+	::pthread_attr_destroy(&attr);
+
+	int tid = gettid();
+	thread_stack *slots = registry();
+	for (size_t i = 0; i < max_threads; ++i) {
+		int expected = 0;
+		if (slots[i].tid.load(std::memory_order_relaxed) == 0 &&
+		    slots[i].tid.compare_exchange_strong(expected, -1)) {
+			slots[i].lo.store(uintptr_t(addr));
+			slots[i].hi.store(uintptr_t(addr) + size);
+			slots[i].guard.store(guard);
+			slots[i].tid.store(tid, std::memory_order_release);
+			s.slot = &slots[i];
+			return;
+		}
+	}
+}
+
+} // End namespace alt_stack_detail
+
+class alt_stack {
+public:
+	// Enough for the crash reporter, which symbolizes from the handler.
+	static const size_t default_size = 64 * 1024;
+
+	// Gives the calling thread an alternate signal stack of size bytes,
+	// unless it already has one, and registers its stack for
+	// find_stack_overflow(). Returns -1 with errno set on failure.
+	static int ensure(size_t size = default_size) {
+		alt_stack_detail::thread_state &s =
+			alt_stack_detail::this_thread();
+		alt_stack_detail::register_stack(s);
+		stack_t cur;
+		if (::sigaltstack(nullptr, &cur) < 0)
+			return -1;
+		if (!(cur.ss_flags & SS_DISABLE))
+			return 0;
+
+		size_t page = alt_stack_detail::thread_state::page_size();
+		size = (std::max<size_t>(size, MINSIGSTKSZ) + page - 1) &
+		       ~(page - 1);
+		void *p = ::mmap(nullptr, size + page, PROT_READ | PROT_WRITE,
+				 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+				 -1, 0);
+		if (p == MAP_FAILED)
+			return -1;
+		// Overrunning the alternate stack faults here rather than
+		// scribbling on whatever is mapped below.
+		::mprotect(p, page, PROT_NONE);
+		stack_t st;
+		st.ss_sp = static_cast<char *>(p) + page;
+		st.ss_size = size;
+		st.ss_flags = 0;
+		if (::sigaltstack(&st, nullptr) < 0) {
+			int e = errno;
+			::munmap(p, size + page);
+			errno = e;
+			return -1;
+		}
+		if (s.map)
+			::munmap(s.map, s.map_size);
+		s.map = p;
+		s.map_size = size + page;
+		return 0;
+	}
+
+	// Has every cpputil::thread_pool worker started from now on call
+	// ensure(). Only the first call does anything.
+	static void use_in_thread_pools() {
+		static std::atomic<bool> done(false);
+		if (!done.exchange(true))
+			cpputil::thread_pool::add_thread_start_hook(
+				[] { ensure(); });
+	}
+};
+
+// Whether a fault at fault_addr, with the stack pointer at sp, is the
+// calling thread running off the end of its stack: into the guard below
+// it, or below the stack with sp already at its end. Async-signal-safe.
+// Only knows threads that have called alt_stack::ensure().
+inline bool find_stack_overflow(uintptr_t fault_addr, uintptr_t sp,
+				stack_overflow_info *info) {
+	int tid = alt_stack_detail::gettid();
+	alt_stack_detail::thread_stack *slots = alt_stack_detail::registry();
+	for (size_t i = 0; i < alt_stack_detail::max_threads; ++i) {
+		if (slots[i].tid.load(std::memory_order_acquire) != tid)
+			continue;
+		uintptr_t lo = slots[i].lo.load();
+		uintptr_t hi = slots[i].hi.load();
+		// Big frames can skip past the guard; the main thread's
+		// guard is the kernel's gap below the stack.
+		uintptr_t slack = std::max<uintptr_t>(slots[i].guard.load(),
+						      1 << 20);
+		uintptr_t page = 4096;
+		bool in_guard = fault_addr < lo + page &&
+				fault_addr + slack >= lo;
+		bool sp_at_end = sp < lo + page && sp + slack >= lo;
+		if (!in_guard && !sp_at_end)
+			return false;
+		info->lo = lo;
+		info->hi = hi;
+		info->used = sp < hi ? hi - sp : 0;
+		return true;
+	}
+	return false;
+}
+#endif
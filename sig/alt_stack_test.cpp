@@ -0,0 +1,121 @@
+#include "crash_reporter.h"
+#include "libcpp-util/util/test_check.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static volatile int limit = 1 << 30;
+
+__attribute__((noinline)) int recurse(int n) {
+	volatile char frame[256];
+	frame[0] = char(n);
+	if (n == limit)
+		return 0;
+	return recurse(n + 1) + frame[0];
+}
+
+static void overflow(const char *name) {
+	pthread_setname_np(pthread_self(), name);
+	recurse(0);
+}
+
+static std::string slurp(int fd) {
+	std::string s;
+	char buf[4096];
+	ssize_t n;
+	while ((n = read(fd, buf, sizeof(buf))) > 0)
+		s.append(buf, size_t(n));
+	return s;
+}
+
+// Runs body in a child with the crash reporter installed, and checks that
+// it died of SIGSEGV after reporting an overflow in the thread name.
+template <class F>
+static void expect_overflow(const char *name, F body) {
+	int fds[2];
+	CHECK(pipe(fds) == 0);
+	pid_t pid = fork();
+	CHECK(pid >= 0);
+	if (pid == 0) {
+		close(fds[0]);
+		CHECK(crash_reporter::install(crash_options(nullptr, fds[1],
+							    false)) == 0);
+		body();
+		_exit(0);
+	}
+	close(fds[1]);
+	std::string report = slurp(fds[0]);
+	close(fds[0]);
+	int status;
+	CHECK(waitpid(pid, &status, 0) == pid);
+	size_t nl = report.find('\n');
+	nl = report.find('\n', nl == std::string::npos ? nl : nl + 1);
+	fprintf(stderr, "%s\n", report.substr(0, nl).c_str());
+	CHECK(WIFSIGNALED(status) && WTERMSIG(status) == SIGSEGV);
+	CHECK(report.find("Segmentation fault") != std::string::npos);
+	CHECK(report.find(std::string("\"") + name + "\"") !=
+	      std::string::npos);
+	size_t at = report.find("stack overflow: ");
+	CHECK(at != std::string::npos);
+	unsigned long used = strtoul(report.c_str() + at + 16, nullptr, 10);
+	at = report.find(", of ", at);
+	unsigned long size = strtoul(report.c_str() + at + 5, nullptr, 10);
+	CHECK(size > 0 && used > size - 64 * 1024 && used <= size + 4096);
+}
+
+int main() {
+	// The main thread.
+	expect_overflow("main-overflow", [] { overflow("main-overflow"); });
+
+	// A thread_pool worker, which got its alternate stack from the
+	// start hook install() added.
+	expect_overflow("pool-overflow", [] {
+		cpputil::thread_pool pool(2);
+		pool.submit([] { overflow("pool-overflow"); }).wait();
+	});
+
+	// A thread of our own, small, that calls ensure() itself.
+	expect_overflow("own-overflow", [] {
+		pthread_attr_t attr;
+		pthread_attr_init(&attr);
+		pthread_attr_setstacksize(&attr, 256 * 1024);
+		pthread_t t;
+		pthread_create(&t, &attr,
+			       [](void *) -> void * {
+				       CHECK(alt_stack::ensure() == 0);
+				       overflow("own-overflow");
+				       return nullptr;
+			       },
+			       nullptr);
+		pthread_join(t, nullptr);
+	});
+
+	// Several threads overflowing at once: one reports, and the process
+	// dies of it.
+	expect_overflow("many-overflow", [] {
+		cpputil::thread_pool pool(4);
+		for (int i = 0; i < 4; ++i)
+			pool.post([] { overflow("many-overflow"); });
+		pause();
+	});
+
+	// Threads come and go, and their stacks with them.
+	for (int i = 0; i < 100; ++i)
+		std::thread([] { CHECK(alt_stack::ensure() == 0); }).join();
+
+	// A fault that isn't an overflow isn't called one.
+	stack_overflow_info info;
+	CHECK(alt_stack::ensure() == 0);
+	CHECK(!find_stack_overflow(16, uintptr_t(&info), &info));
+	printf("alt_stack_test: all passed\n");
+	return 0;
+}
@@ -0,0 +1,150 @@
+//============================================================================
+//                                  libcpp-util
+//                   A simple odds-n-ends library for C++11
+//
+//         Licensed under modified BSD license. See LICENSE for details.
+//============================================================================
+
+#ifndef LIBCPP_UTIL_ASYNC_SAFE_H
+#define LIBCPP_UTIL_ASYNC_SAFE_H
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <unistd.h>
+
+inline size_t async_safe_strlen(const char *s) {
+	size_t n = 0;
+	while (s[n])
+		++n;
+	return n;
+}
+
+// Writes all of p to fd, retrying on EINTR and short writes. Gives up on
+// any other error, since there is nothing better to do in a handler.
+inline bool async_safe_write(int fd, const char *p, size_t n) {
+	while (n) {
+		ssize_t r = ::write(fd, p, n);
+		if (r < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		p += r;
+		n -= size_t(r);
+	}
+	return true;
+}
+
+// Text formatting for signal handlers: nothing but loops and write(2), so
+// no malloc, locale or stdio locks. Output goes to a descriptor, through a
+// small buffer flushed when full and on destruction, or to a caller's
+// array, which is kept NUL terminated and truncated when full. errno is
+// saved and restored around it, as a handler must.
+class async_safe_format {
+private:
+	char own[512];
+	char *buf;
+	size_t cap;
+	size_t n;
+	int fd;
+	int saved_errno;
+	bool ok;
+
+	async_safe_format(const async_safe_format &) = delete;
+	async_safe_format &operator=(const async_safe_format &) = delete;
+
+public:
+	explicit async_safe_format(int fd)
+		: buf(own), cap(sizeof(own)), n(0), fd(fd),
+		  saved_errno(errno), ok(true) {
+	}
+
+	async_safe_format(char *dst, size_t size)
+		: buf(dst), cap(size), n(0), fd(-1), saved_errno(errno),
+		  ok(true) {
+		if (cap)
+			buf[0] = '\0';
+	}
+
+	~async_safe_format() {
+		flush();
+		errno = saved_errno;
+	}
+
+	// False if anything was lost to a failed write or truncation.
+	bool flush() {
+		if (fd >= 0) {
+			if (n && !async_safe_write(fd, buf, n))
+				ok = false;
+			n = 0;
+		}
+		return ok;
+	}
+
+	async_safe_format &put(char c) {
+		if (fd >= 0) {
+			if (n == cap)
+				flush();
+			buf[n++] = c;
+		} else if (n + 1 < cap) {
+			buf[n++] = c;
+			buf[n] = '\0';
+		} else {
+			ok = false;
+		}
+		return *this;
+	}
+
+	async_safe_format &str(const char *s, size_t len) {
+		for (size_t i = 0; i < len; ++i)
+			put(s[i]);
+		return *this;
+	}
+
+	async_safe_format &str(const char *s) {
+		return str(s, async_safe_strlen(s));
+	}
+
+	async_safe_format &udec(uint64_t v) {
+		char tmp[20];
+		int i = 0;
+		do {
+			tmp[i++] = char('0' + v % 10);
+			v /= 10;
+		} while (v);
+		while (i)
+			put(tmp[--i]);
+		return *this;
+	}
+
+	async_safe_format &dec(int64_t v) {
+		if (v < 0) {
+			put('-');
+			return udec(0 - uint64_t(v));
+		}
+		return udec(uint64_t(v));
+	}
+
+	// "0x" and at least digits hex digits.
+	async_safe_format &hex(uint64_t v, int digits = 1) {
+		char tmp[16];
+		int i = 0;
+		do {
+			tmp[i++] = "0123456789abcdef"[v & 0xf];
+			v >>= 4;
+		} while (v);
+		put('0').put('x');
+		for (; i < digits; --digits)
+			put('0');
+		while (i)
+			put(tmp[--i]);
+		return *this;
+	}
+
+	// Where formatting into an array, what has been written.
+	size_t size() const {
+		return n;
+	}
+};
+#endif
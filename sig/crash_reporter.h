@@ -0,0 +1,803 @@
+//============================================================================
+//                                  libcpp-util
+//                   A simple odds-n-ends library for C++11
+//
+//         Licensed under modified BSD license. See LICENSE for details.
+//============================================================================
+
+#ifndef LIBCPP_UTIL_CRASH_REPORTER_H
+#define LIBCPP_UTIL_CRASH_REPORTER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <initializer_list>
+#include <memory>
+#include <string>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "libcpp-util/sig/alt_stack.h"
+#include "libcpp-util/sig/async_safe.h"
+#include "libcpp-util/sig/signal_handler.h"
+#include "libcpp-util/sig/stack_trace.h"
+
+// A crash handler for SIGSEGV, SIGBUS, SIGABRT and the like that does
+// nothing a signal handler mustn't: everything it needs is allocated at
+// install time, and at crash time it only makes system calls.
+//
+// It captures the signal, the registers, a backtrace (stack_trace.h),
+// whether a SIGSEGV was a stack overflow (alt_stack.h) and how deep the
+// stack was, and the executable mappings out of /proc/self/maps, and
+// writes them as a small text minidump to a file in dump_dir. It then
+// prints a report to report_fd, symbolized by addr2line in a forked child
+// (execve() straight after fork(), so nothing of the broken process runs
+// there), and re-raises the signal with the default action so the
+// process still dies of it and dumps core as it would have.
+//
+// A minidump can be symbolized later, on another machine with the same
+// binaries, with crash_reporter::symbolize() or the crash_symbolize tool.
+//
+//   crash_reporter::install(crash_options("/var/crash"));
+//
+// install() gives the calling thread and thread_pool workers alternate
+// signal stacks, so overflows can be reported; other threads need to call
+// alt_stack::ensure() themselves.
+//
+// The format is line based: a "crash_minidump 1" header, then "signal",
+// "code", "addr", "pid", "tid", "thread" and "time" lines, for a stack
+// overflow "stack_overflow <bytes used> <stack size>", "reg <name>
+// <value>" lines, "frame <pc>" lines innermost first, "map <start>-<end>
+// <load base> <path>" lines, and "end".
+
+struct crash_options {
+	// Directory for minidumps, named crash-<pid>-<time>.txt; null for
+	// none.
+	const char *dump_dir;
+	// Where the report goes; -1 for nowhere.
+	int report_fd;
+	// Symbolize the report with addr2line, if it can be found on PATH.
+	bool symbolize;
+
+	explicit crash_options(const char *dump_dir = nullptr,
+			       int report_fd = STDERR_FILENO,
+			       bool symbolize = true)
+		: dump_dir(dump_dir), report_fd(report_fd),
+		  symbolize(symbolize) {
+	}
+};
+
+namespace crash_detail {
+
+const size_t max_frames = 128;
+const size_t max_regs = 40;
+const size_t max_maps = 512;
+const size_t strings_size = 1 << 16;
+
+struct mapping {
+	uintptr_t start;
+	uintptr_t end;
+	// What addresses in the module are relative to: the start of its
+	// mapping at file offset 0.
+	uintptr_t base;
+	uint32_t path;
+};
+
+// Everything known about a crash. The handler fills one in static
+// storage; symbolize() parses one back out of a minidump. Strings live in
+// a pool, with offset 0 the empty string.
+struct crash_record {
+	int signo;
+	int code;
+	int pid;
+	int tid;
+	uintptr_t addr;
+	int64_t time;
+	char thread[17];
+	// For a stack overflow, the stack in use and its size; else 0.
+	uintptr_t stack_used;
+	uintptr_t stack_size;
+	size_t nregs;
+	uint32_t reg_names[max_regs];
+	uint64_t regs[max_regs];
+	size_t nframes;
+	uintptr_t frames[max_frames];
+	size_t nmaps;
+	mapping maps[max_maps];
+	size_t strings_used;
+	char strings[strings_size];
+
+	void clear() {
+		signo = code = pid = tid = 0;
+		addr = 0;
+		time = 0;
+		thread[0] = '\0';
+		stack_used = stack_size = 0;
+		nregs = nframes = nmaps = 0;
+		strings[0] = '\0';
+		strings_used = 1;
+	}
+
+	// Gives up (returning the empty string) when the pool is full.
+	uint32_t intern(const char *s, size_t n) {
+		if (strings_used + n + 1 > strings_size)
+			return 0;
+		uint32_t off = uint32_t(strings_used);
+		for (size_t i = 0; i < n; ++i)
+			strings[off + i] = s[i];
+		strings[off + n] = '\0';
+		strings_used += n + 1;
+		return off;
+	}
+
+	const char *str(uint32_t off) const {
+		return strings + off;
+	}
+
+	void add_reg(const char *name, uint64_t v) {
+		if (nregs == max_regs)
+			return;
+		reg_names[nregs] = intern(name, async_safe_strlen(name));
+		regs[nregs++] = v;
+	}
+
+	const mapping *find(uintptr_t pc) const {
+		for (size_t i = 0; i < nmaps; ++i)
+			if (pc >= maps[i].start && pc < maps[i].end)
+				return &maps[i];
+		return nullptr;
+	}
+};
+
+inline void capture_registers(crash_record &r, const void *uctx) {
+	const ucontext_t *uc = static_cast<const ucontext_t *>(uctx);
+#if defined(__x86_64__) && defined(__linux__)
+	static const struct {
+		const char *name;
+		int reg;
+	} table[] = {
+		{"rip", REG_RIP}, {"rsp", REG_RSP}, {"rbp", REG_RBP},
+		{"rax", REG_RAX}, {"rbx", REG_RBX}, {"rcx", REG_RCX},
+		{"rdx", REG_RDX}, {"rsi", REG_RSI}, {"rdi", REG_RDI},
+		{"r8", REG_R8},   {"r9", REG_R9},   {"r10", REG_R10},
+		{"r11", REG_R11}, {"r12", REG_R12}, {"r13", REG_R13},
+		{"r14", REG_R14}, {"r15", REG_R15}, {"efl", REG_EFL},
+		{"err", REG_ERR}, {"trapno", REG_TRAPNO},
+	};
+	for (auto &t : table)
+		r.add_reg(t.name, uint64_t(uc->uc_mcontext.gregs[t.reg]));
+#elif defined(__aarch64__) && defined(__linux__)
+	static const char *const names[] = {
+		"x0",  "x1",  "x2",  "x3",  "x4",  "x5",  "x6",  "x7",
+		"x8",  "x9",  "x10", "x11", "x12", "x13", "x14", "x15",
+		"x16", "x17", "x18", "x19", "x20", "x21", "x22", "x23",
+		"x24", "x25", "x26", "x27", "x28", "fp",  "lr",
+	};
+	r.add_reg("pc", uc->uc_mcontext.pc);
+	r.add_reg("sp", uc->uc_mcontext.sp);
+	r.add_reg("pstate", uc->uc_mcontext.pstate);
+	for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i)
+		r.add_reg(names[i], uc->uc_mcontext.regs[i]);
+#else
+	machine_registers m;
+	if (get_machine_registers(uc, &m)) {
+		r.add_reg("pc", m.pc);
+		r.add_reg("sp", m.sp);
+		r.add_reg("fp", m.fp);
+	}
+#endif
+}
+
+inline uintptr_t parse_hex(const char *&p, const char *end) {
+	uintptr_t v = 0;
+	if (end - p > 1 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X'))
+		p += 2;
+	for (; p < end; ++p) {
+		char c = *p;
+		if (c >= '0' && c <= '9')
+			v = v << 4 | uintptr_t(c - '0');
+		else if (c >= 'a' && c <= 'f')
+			v = v << 4 | uintptr_t(c - 'a' + 10);
+		else if (c >= 'A' && c <= 'F')
+			v = v << 4 | uintptr_t(c - 'A' + 10);
+		else
+			break;
+	}
+	return v;
+}
+
+inline int64_t parse_dec(const char *&p, const char *end) {
+	bool neg = p < end && *p == '-';
+	int64_t v = 0;
+	for (p += neg; p < end && *p >= '0' && *p <= '9'; ++p)
+		v = v * 10 + (*p - '0');
+	return neg ? -v : v;
+}
+
+inline void skip_field(const char *&p, const char *end) {
+	while (p < end && *p != ' ')
+		++p;
+	while (p < end && *p == ' ')
+		++p;
+}
+
+// Remembers the offset 0 mapping of the file being walked through, which
+// /proc/self/maps lists first, to find each module's load base.
+struct maps_cursor {
+	char path[512];
+	size_t path_len;
+	uintptr_t base;
+};
+
+// One line of /proc/self/maps: "start-end perms offset dev inode path".
+// Only executable mappings are kept.
+inline void add_maps_line(crash_record &r, maps_cursor &cur, const char *p,
+			  const char *end) {
+	uintptr_t start = parse_hex(p, end);
+	++p;
+	uintptr_t stop = parse_hex(p, end);
+	skip_field(p, end);
+	bool exec = end - p > 2 && p[2] == 'x';
+	skip_field(p, end);
+	uintptr_t offset = parse_hex(p, end);
+	skip_field(p, end);
+	skip_field(p, end);
+	skip_field(p, end);
+	const char *path = p;
+	size_t len = size_t(end - p);
+	bool same = len == cur.path_len && !memcmp(path, cur.path, len);
+	if (offset == 0 && len < sizeof(cur.path)) {
+		memcpy(cur.path, path, len);
+		cur.path_len = len;
+		cur.base = start;
+		same = true;
+	}
+	if (!exec || r.nmaps == max_maps)
+		return;
+	mapping &m = r.maps[r.nmaps];
+	m.start = start;
+	m.end = stop;
+	m.base = same ? cur.base : start - offset;
+	const char *prev = r.nmaps ? r.str(r.maps[r.nmaps - 1].path) : "";
+	if (r.nmaps && async_safe_strlen(prev) == len &&
+	    !memcmp(prev, path, len))
+		m.path = r.maps[r.nmaps - 1].path;
+	else
+		m.path = r.intern(path, len);
+	++r.nmaps;
+}
+
+// Reads /proc/self/maps with open() and read(), buf being scratch space.
+inline void capture_maps(crash_record &r, char *buf, size_t size) {
+	int fd = ::open("/proc/self/maps", O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return;
+	maps_cursor cur;
+	cur.path_len = 0;
+	cur.base = 0;
+	size_t have = 0;
+	for (;;) {
+		ssize_t n = ::read(fd, buf + have, size - have);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		have += size_t(n);
+		size_t line = 0;
+		for (size_t i = 0; i < have; ++i)
+			if (buf[i] == '\n') {
+				add_maps_line(r, cur, buf + line, buf + i);
+				line = i + 1;
+			}
+		// A line longer than the buffer is dropped.
+		if (line == 0 && have == size)
+			line = have;
+		memmove(buf, buf + line, have - line);
+		have -= line;
+	}
+	::close(fd);
+}
+
+inline void capture(crash_record &r, int signo, const siginfo_t *info,
+		    const void *uctx, char *scratch, size_t scratch_size) {
+	r.clear();
+	r.signo = signo;
+	r.code = info ? info->si_code : 0;
+	switch (signo) {
+	case SIGSEGV:
+	case SIGBUS:
+	case SIGILL:
+	case SIGFPE:
+		r.addr = info ? uintptr_t(info->si_addr) : 0;
+	}
+	r.pid = int(::getpid());
+	r.tid = int(::syscall(SYS_gettid));
+	struct timespec ts;
+	if (::clock_gettime(CLOCK_REALTIME, &ts) == 0)
+		r.time = ts.tv_sec;
+	memset(r.thread, 0, sizeof(r.thread));
+	::prctl(PR_GET_NAME, r.thread, 0, 0, 0);
+	machine_registers m;
+	stack_overflow_info so;
+	if ((signo == SIGSEGV || signo == SIGBUS) && uctx &&
+	    get_machine_registers(uctx, &m) &&
+	    find_stack_overflow(r.addr, m.sp, &so)) {
+		r.stack_used = so.used;
+		r.stack_size = so.hi - so.lo;
+	}
+	if (uctx) {
+		capture_registers(r, uctx);
+		r.nframes = signal_backtrace(uctx, r.frames, max_frames);
+	}
+	capture_maps(r, scratch, scratch_size);
+}
+
+inline void write_minidump(const crash_record &r, int fd) {
+	async_safe_format out(fd);
+	out.str("crash_minidump 1\n");
+	out.str("signal ").dec(r.signo).put('\n');
+	out.str("code ").dec(r.code).put('\n');
+	out.str("addr ").hex(r.addr).put('\n');
+	out.str("pid ").dec(r.pid).put('\n');
+	out.str("tid ").dec(r.tid).put('\n');
+	out.str("thread ").str(r.thread).put('\n');
+	out.str("time ").dec(r.time).put('\n');
+	if (r.stack_size)
+		out.str("stack_overflow ")
+			.udec(r.stack_used)
+			.put(' ')
+			.udec(r.stack_size)
+			.put('\n');
+	for (size_t i = 0; i < r.nregs; ++i)
+		out.str("reg ")
+			.str(r.str(r.reg_names[i]))
+			.put(' ')
+			.hex(r.regs[i])
+			.put('\n');
+	for (size_t i = 0; i < r.nframes; ++i)
+		out.str("frame ").hex(r.frames[i]).put('\n');
+	for (size_t i = 0; i < r.nmaps; ++i)
+		out.str("map ")
+			.hex(r.maps[i].start)
+			.put('-')
+			.hex(r.maps[i].end)
+			.put(' ')
+			.hex(r.maps[i].base)
+			.put(' ')
+			.str(r.str(r.maps[i].path))
+			.put('\n');
+	out.str("end\n");
+}
+
+// Non-PIE executables are linked at their run time address; everything
+// else is symbolized relative to its load base.
+inline bool is_fixed_address_elf(const char *path) {
+	int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+	unsigned char hdr[18];
+	bool fixed = ::read(fd, hdr, sizeof(hdr)) == ssize_t(sizeof(hdr)) &&
+		     !memcmp(hdr, "\177ELF", 4) &&
+		     (hdr[5] == 1 ? hdr[16] | hdr[17] << 8
+				  : hdr[16] << 8 | hdr[17]) == 2;
+	::close(fd);
+	return fixed;
+}
+
+// Runs "addr2line -C -f -p -e module addrs..." in a child and reads its
+// output, one line per address, into out. Uses fork() and execve() only,
+// so it can run in a signal handler. Kills the child if it hasn't finished
+// within timeout_ms. Returns the number of bytes read, or -1.
+inline ssize_t run_addr2line(const char *addr2line, const char *module,
+			     const uintptr_t *addrs, size_t n, char *out,
+			     size_t cap, int timeout_ms = 10000) {
+	char text[max_frames][2 * sizeof(uintptr_t) + 3];
+	const char *argv[max_frames + 8];
+	size_t argc = 0;
+	argv[argc++] = "addr2line";
+	argv[argc++] = "-C";
+	argv[argc++] = "-f";
+	argv[argc++] = "-p";
+	argv[argc++] = "-e";
+	argv[argc++] = module;
+	for (size_t i = 0; i < n && i < max_frames; ++i) {
+		async_safe_format(text[i], sizeof(text[i])).hex(addrs[i]);
+		argv[argc++] = text[i];
+	}
+	argv[argc] = nullptr;
+
+	int fds[2];
+	if (::pipe(fds) < 0)
+		return -1;
+	// The raw system call: glibc's fork() runs atfork handlers, which
+	// aren't async-safe.
+#ifdef SYS_fork
+	pid_t pid = pid_t(::syscall(SYS_fork));
+#else
+	pid_t pid = pid_t(::syscall(SYS_clone, SIGCHLD, 0, 0, 0, 0));
+#endif
+	if (pid < 0) {
+		::close(fds[0]);
+		::close(fds[1]);
+		return -1;
+	}
+	if (pid == 0) {
+		::dup2(fds[1], STDOUT_FILENO);
+		int null = ::open("/dev/null", O_WRONLY);
+		if (null >= 0)
+			::dup2(null, STDERR_FILENO);
+		char *const envp[] = {nullptr};
+		::execve(addr2line, const_cast<char *const *>(argv), envp);
+		::_exit(127);
+	}
+	::close(fds[1]);
+
+	size_t got = 0;
+	bool killed = false;
+	for (;;) {
+		struct pollfd pfd = {fds[0], POLLIN, 0};
+		int ready = ::poll(&pfd, 1, timeout_ms);
+		if (ready < 0 && errno == EINTR)
+			continue;
+		if (ready <= 0) {
+			::kill(pid, SIGKILL);
+			killed = true;
+			break;
+		}
+		char discard[256];
+		char *dst = got < cap ? out + got : discard;
+		size_t room = got < cap ? cap - got : sizeof(discard);
+		ssize_t r = ::read(fds[0], dst, room);
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r <= 0)
+			break;
+		if (got < cap)
+			got += size_t(r);
+	}
+	::close(fds[0]);
+	int status;
+	while (::waitpid(pid, &status, 0) < 0 && errno == EINTR)
+		;
+	if (killed || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		return -1;
+	return ssize_t(got);
+}
+
+// The human-readable report: the signal, the registers and the frames,
+// symbolized if addr2line (a path) is given, each with its module and
+// offset. scratch holds addr2line's output.
+inline void write_report(const crash_record &r, int fd, const char *addr2line,
+			 char *scratch, size_t scratch_size) {
+	async_safe_format out(fd);
+	out.str("*** ");
+	if (r.signo > 0 && r.signo < 64 && lazy_sig_info::get(r.signo)[0])
+		out.str(lazy_sig_info::get(r.signo));
+	else
+		out.str("Signal");
+	out.str(" (signal ").dec(r.signo).str(", code ").dec(r.code);
+	out.put(')');
+	if (r.addr)
+		out.str(" at ").hex(r.addr);
+	out.str(" in thread ").dec(r.tid);
+	if (r.thread[0])
+		out.str(" \"").str(r.thread).put('"');
+	out.str(" of process ").dec(r.pid).put('\n');
+	if (r.stack_size)
+		out.str("    stack overflow: ")
+			.udec(r.stack_used)
+			.str(" bytes of stack in use, of ")
+			.udec(r.stack_size)
+			.put('\n');
+	for (size_t i = 0; i < r.nregs; ++i) {
+		out.str(i % 4 ? "  " : "    ");
+		const char *name = r.str(r.reg_names[i]);
+		for (size_t k = async_safe_strlen(name); k < 6; ++k)
+			out.put(' ');
+		out.str(name).put(' ').hex(r.regs[i], 16);
+		if (i % 4 == 3 || i + 1 == r.nregs)
+			out.put('\n');
+	}
+
+	// Consecutive frames in the same module go to one addr2line.
+	for (size_t i = 0; i < r.nframes;) {
+		const mapping *m = r.find(r.frames[i]);
+		size_t j = i + 1;
+		while (j < r.nframes && m && r.find(r.frames[j]) == m)
+			++j;
+		const char *path = m ? r.str(m->path) : "";
+		bool file = path[0] == '/';
+		bool fixed = file && is_fixed_address_elf(path);
+		uintptr_t rel[max_frames];
+		for (size_t k = i; k < j; ++k) {
+			rel[k - i] = m && !fixed ? r.frames[k] - m->base
+						 : r.frames[k];
+			// A return address is past its call; look up the call.
+			if (k)
+				--rel[k - i];
+		}
+		ssize_t got = -1;
+		if (addr2line && file) {
+			out.flush();
+			got = run_addr2line(addr2line, path, rel, j - i,
+					    scratch, scratch_size);
+		}
+		const char *line = scratch;
+		const char *end = got > 0 ? scratch + got : scratch;
+		for (size_t k = i; k < j; ++k) {
+			out.str("    #").dec(int64_t(k));
+			out.str(k < 10 ? "  " : " ").hex(r.frames[k], 16);
+			const char *eol = line;
+			while (eol < end && *eol != '\n')
+				++eol;
+			if (eol < end) {
+				out.str(" in ").str(line, size_t(eol - line));
+				line = eol + 1;
+			}
+			if (m) {
+				uintptr_t off = r.frames[k];
+				if (!fixed)
+					off -= m->base;
+				out.str(" (").str(path[0] ? path : "?");
+				out.put('+').hex(off).put(')');
+			}
+			out.put('\n');
+		}
+		i = j;
+	}
+}
+
+// Parses a minidump back into r. False if it isn't one.
+inline bool parse_minidump(crash_record &r, const char *p, const char *end) {
+	r.clear();
+	bool header = false;
+	while (p < end) {
+		const char *eol = p;
+		while (eol < end && *eol != '\n')
+			++eol;
+		const char *v = p;
+		skip_field(v, eol);
+		size_t key = size_t(v - p);
+		auto is = [&](const char *k) {
+			size_t n = strlen(k);
+			return key > n && !memcmp(p, k, n) && p[n] == ' ';
+		};
+		if (is("crash_minidump"))
+			header = true;
+		else if (is("signal"))
+			r.signo = int(parse_dec(v, eol));
+		else if (is("code"))
+			r.code = int(parse_dec(v, eol));
+		else if (is("addr"))
+			r.addr = parse_hex(v, eol);
+		else if (is("pid"))
+			r.pid = int(parse_dec(v, eol));
+		else if (is("tid"))
+			r.tid = int(parse_dec(v, eol));
+		else if (is("time"))
+			r.time = parse_dec(v, eol);
+		else if (is("stack_overflow")) {
+			r.stack_used = uintptr_t(parse_dec(v, eol));
+			skip_field(v, eol);
+			r.stack_size = uintptr_t(parse_dec(v, eol));
+		}
+		else if (is("thread")) {
+			size_t n = std::min(size_t(eol - v),
+					    sizeof(r.thread) - 1);
+			memcpy(r.thread, v, n);
+			r.thread[n] = '\0';
+		} else if (is("reg") && r.nregs < max_regs) {
+			const char *name = v;
+			skip_field(v, eol);
+			size_t n = size_t(v - name);
+			while (n && name[n - 1] == ' ')
+				--n;
+			r.reg_names[r.nregs] = r.intern(name, n);
+			r.regs[r.nregs++] = parse_hex(v, eol);
+		} else if (is("frame") && r.nframes < max_frames) {
+			r.frames[r.nframes++] = parse_hex(v, eol);
+		} else if (is("map") && r.nmaps < max_maps) {
+			mapping &m = r.maps[r.nmaps++];
+			m.start = parse_hex(v, eol);
+			++v;
+			m.end = parse_hex(v, eol);
+			skip_field(v, eol);
+			m.base = parse_hex(v, eol);
+			skip_field(v, eol);
+			m.path = r.intern(v, size_t(eol - v));
+		}
+		p = eol + 1;
+	}
+	return header;
+}
+
+// addr2line's full path, from PATH, or an empty string.
+inline std::string find_addr2line() {
+	const char *path = getenv("PATH");
+	std::string dirs = path ? path : "/usr/bin:/bin";
+	for (size_t i = 0; i <= dirs.size();) {
+		size_t j = dirs.find(':', i);
+		if (j == std::string::npos)
+			j = dirs.size();
+		std::string p = dirs.substr(i, j - i);
+		p += p.empty() ? "./addr2line" : "/addr2line";
+		if (access(p.c_str(), X_OK) == 0)
+			return p;
+		i = j + 1;
+	}
+	return std::string();
+}
+
+} // End namespace crash_detail
+
+class crash_reporter {
+private:
+	struct state {
+		std::atomic<int> owner;
+		int report_fd;
+		bool have_dir;
+		bool have_addr2line;
+		char dump_dir[1024];
+		char addr2line[1024];
+		char dump_path[1200];
+		char scratch[1 << 16];
+		crash_detail::crash_record record;
+	};
+
+	static state &get() {
+		static state s;
+		return s;
+	}
+
+public:
+	// Installs the handler for signals. Not itself async-safe; call it
+	// early, from main() or the like. Returns -1 with errno set on
+	// failure.
+	static int install(const crash_options &opts = crash_options(),
+			   std::initializer_list<int> signals = {
+				   SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT,
+				   SIGTRAP}) {
+		state &s = get();
+		s.report_fd = opts.report_fd;
+		s.have_dir = false;
+		if (opts.dump_dir) {
+			if (strlen(opts.dump_dir) >= sizeof(s.dump_dir)) {
+				errno = ENAMETOOLONG;
+				return -1;
+			}
+			strcpy(s.dump_dir, opts.dump_dir);
+			s.have_dir = true;
+		}
+		s.have_addr2line = false;
+		if (opts.symbolize) {
+			std::string a = crash_detail::find_addr2line();
+			if (!a.empty() && a.size() < sizeof(s.addr2line)) {
+				strcpy(s.addr2line, a.c_str());
+				s.have_addr2line = true;
+			}
+		}
+		stack_trace_prepare();
+		if (alt_stack::ensure() < 0)
+			return -1;
+		alt_stack::use_in_thread_pools();
+
+		struct sigaction sa;
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_sigaction = handler;
+		sa.sa_flags = SA_SIGINFO | SA_ONSTACK;
+		sigemptyset(&sa.sa_mask);
+		for (int signo : signals) {
+			lazy_sig_info::register_signal(signo);
+			if (sigaction(signo, &sa, nullptr) < 0)
+				return -1;
+		}
+		return 0;
+	}
+
+	// Where the last minidump went, once the handler has run.
+	static const char *last_dump_path() {
+		return get().dump_path;
+	}
+
+	static void handler(int signo, siginfo_t *info, void *uctx) {
+		state &s = get();
+		int tid = int(::syscall(SYS_gettid));
+		int expected = 0;
+		if (!s.owner.compare_exchange_strong(expected, tid) &&
+		    expected != tid) {
+			// Another thread is reporting, and will take the
+			// process down when done.
+			for (;;)
+				::pause();
+		}
+		if (expected != tid) {
+			crash_detail::crash_record &r = s.record;
+			crash_detail::capture(r, signo, info, uctx, s.scratch,
+					      sizeof(s.scratch));
+			s.dump_path[0] = '\0';
+			if (s.have_dir) {
+				async_safe_format(s.dump_path,
+						  sizeof(s.dump_path))
+					.str(s.dump_dir)
+					.str("/crash-")
+					.dec(r.pid)
+					.put('-')
+					.dec(r.time)
+					.str(".txt");
+				int fd = ::open(s.dump_path,
+						O_WRONLY | O_CREAT | O_TRUNC |
+							O_CLOEXEC,
+						0644);
+				if (fd >= 0) {
+					crash_detail::write_minidump(r, fd);
+					::close(fd);
+				} else {
+					s.dump_path[0] = '\0';
+				}
+			}
+			if (s.report_fd >= 0) {
+				crash_detail::write_report(
+					r, s.report_fd,
+					s.have_addr2line ? s.addr2line
+							 : nullptr,
+					s.scratch, sizeof(s.scratch));
+				if (s.dump_path[0]) {
+					async_safe_format out(s.report_fd);
+					out.str("    minidump ")
+						.str(s.dump_path)
+						.put('\n');
+				}
+			}
+		}
+		// A second signal while reporting (an abort() in a helper,
+		// say) lands here too, and ends things.
+		struct sigaction sa;
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_handler = SIG_DFL;
+		sigaction(signo, &sa, nullptr);
+		raise(signo);
+	}
+
+	// Reads the minidump at path and writes its report, symbolized with
+	// addr2line from PATH if there is one, to fd. Returns false if the
+	// file can't be read or isn't a minidump.
+	static bool symbolize(const char *path, int fd) {
+		FILE *f = fopen(path, "r");
+		if (!f)
+			return false;
+		std::string text;
+		char buf[4096];
+		size_t n;
+		while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+			text.append(buf, n);
+		bool ok = !ferror(f);
+		fclose(f);
+		std::unique_ptr<crash_detail::crash_record> r(
+			new crash_detail::crash_record);
+		if (!ok || !crash_detail::parse_minidump(
+				   *r, text.data(), text.data() + text.size()))
+			return false;
+		if (r->signo > 0 && r->signo < 64)
+			lazy_sig_info::register_signal(r->signo);
+		std::string addr2line = crash_detail::find_addr2line();
+		std::unique_ptr<char[]> scratch(new char[1 << 16]);
+		crash_detail::write_report(
+			*r, fd, addr2line.empty() ? nullptr : addr2line.c_str(),
+			scratch.get(), 1 << 16);
+		return true;
+	}
+};
+#endif
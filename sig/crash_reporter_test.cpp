@@ -0,0 +1,132 @@
+#include "crash_reporter.h"
+#include "libcpp-util/util/test_check.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Each crash happens a few calls down, to have a stack to walk.
+__attribute__((noinline)) void crash_segv(volatile int *p) {
+	*p = 1;
+}
+
+__attribute__((noinline)) void crash_abort() {
+	abort();
+}
+
+// Touching a mapping past the end of its file raises SIGBUS.
+__attribute__((noinline)) void crash_bus(const char *path) {
+	int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+	CHECK(fd >= 0);
+	CHECK(ftruncate(fd, 4096) == 0);
+	volatile char *p = static_cast<volatile char *>(mmap(
+		nullptr, 4096, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
+	CHECK(p != MAP_FAILED);
+	CHECK(ftruncate(fd, 0) == 0);
+	p[0] = 1;
+}
+
+__attribute__((noinline)) void crash(int which, const char *bus_path) {
+	if (which == SIGSEGV)
+		crash_segv(reinterpret_cast<volatile int *>(uintptr_t(16)));
+	else if (which == SIGABRT)
+		crash_abort();
+	else
+		crash_bus(bus_path);
+}
+
+static std::string slurp(int fd) {
+	std::string s;
+	char buf[4096];
+	ssize_t n;
+	while ((n = read(fd, buf, sizeof(buf))) > 0)
+		s.append(buf, size_t(n));
+	return s;
+}
+
+static std::string slurp(const char *path) {
+	int fd = open(path, O_RDONLY);
+	CHECK(fd >= 0);
+	std::string s = slurp(fd);
+	close(fd);
+	return s;
+}
+
+// Crashes a child with signo, and checks it died of it after reporting
+// the crash and the function it happened in.
+static void test_crash(int signo, const char *func, const char *dir) {
+	std::string bus_path = std::string(dir) + "/bus";
+	int fds[2];
+	CHECK(pipe(fds) == 0);
+	pid_t pid = fork();
+	CHECK(pid >= 0);
+	if (pid == 0) {
+		close(fds[0]);
+		crash_reporter::install(crash_options(dir, fds[1]));
+		crash(signo, bus_path.c_str());
+		_exit(0);
+	}
+	close(fds[1]);
+	std::string report = slurp(fds[0]);
+	close(fds[0]);
+	int status;
+	CHECK(waitpid(pid, &status, 0) == pid);
+	CHECK(WIFSIGNALED(status));
+	CHECK(WTERMSIG(status) == signo);
+	unlink(bus_path.c_str());
+
+	fputs(report.c_str(), stdout);
+	std::string sig = "(signal " + std::to_string(signo) + ",";
+	CHECK(report.find(sig) != std::string::npos);
+	CHECK(report.find("#0 ") != std::string::npos);
+	CHECK(report.find(func) != std::string::npos);
+	CHECK(report.find("in main at") != std::string::npos ||
+	      report.find("in main ") != std::string::npos);
+	if (signo == SIGSEGV)
+		CHECK(report.find(" at 0x10 ") != std::string::npos);
+
+	// The minidump, symbolized after the fact.
+	size_t at = report.find("minidump ");
+	CHECK(at != std::string::npos);
+	std::string path = report.substr(at + 9);
+	path.resize(path.find('\n'));
+	std::string dump = slurp(path.c_str());
+	CHECK(dump.compare(0, 17, "crash_minidump 1\n") == 0);
+	CHECK(dump.find("\nframe 0x") != std::string::npos);
+	CHECK(dump.find("\nmap ") != std::string::npos);
+	CHECK(dump.find("\nend\n") != std::string::npos);
+
+	char out_path[] = "/tmp/crash_reporter_test_out_XXXXXX";
+	int out = mkstemp(out_path);
+	CHECK(out >= 0);
+	CHECK(crash_reporter::symbolize(path.c_str(), out));
+	close(out);
+	std::string offline = slurp(out_path);
+	CHECK(offline.find(sig) != std::string::npos);
+	CHECK(offline.find(func) != std::string::npos);
+	unlink(out_path);
+	unlink(path.c_str());
+}
+
+int main() {
+	char dir[] = "/tmp/crash_reporter_test_XXXXXX";
+	CHECK(mkdtemp(dir));
+
+	test_crash(SIGSEGV, "crash_segv", dir);
+	test_crash(SIGABRT, "crash_abort", dir);
+	test_crash(SIGBUS, "crash_bus", dir);
+
+	// Not a minidump.
+	CHECK(!crash_reporter::symbolize("/dev/null", STDOUT_FILENO));
+	CHECK(!crash_reporter::symbolize("/nonexistent", STDOUT_FILENO));
+
+	CHECK(rmdir(dir) == 0);
+	printf("crash_reporter_test: all passed\n");
+	return 0;
+}
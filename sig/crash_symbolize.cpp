@@ -0,0 +1,30 @@
+// Symbolizes minidumps written by crash_reporter.
+//
+//   crash_symbolize minidump...
+//
+// Prints the report for each minidump, with frames resolved by addr2line
+// (from PATH) against the binaries named in the dump's maps, which must be
+// the same builds that crashed.
+#include "crash_reporter.h"
+#include <cstdio>
+
+#include <unistd.h>
+
+int main(int argc, char **argv) {
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s minidump...\n", argv[0]);
+		return 2;
+	}
+	int rc = 0;
+	for (int i = 1; i < argc; ++i) {
+		if (argc > 2)
+			printf("%s:\n", argv[i]);
+		fflush(stdout);
+		if (!crash_reporter::symbolize(argv[i], STDOUT_FILENO)) {
+			fprintf(stderr, "%s: not a readable minidump\n",
+				argv[i]);
+			rc = 1;
+		}
+	}
+	return rc;
+}
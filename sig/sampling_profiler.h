@@ -0,0 +1,548 @@
+//============================================================================
+//                                  libcpp-util
+//                   A simple odds-n-ends library for C++11
+//
+//         Licensed under modified BSD license. See LICENSE for details.
+//============================================================================
+
+#ifndef LIBCPP_UTIL_SAMPLING_PROFILER_H
+#define LIBCPP_UTIL_SAMPLING_PROFILER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <dlfcn.h>
+#include <signal.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "libcpp-util/sig/crash_reporter.h"
+#include "libcpp-util/sig/stack_trace.h"
+
+// A sampling CPU profiler meant to be left on in production. A POSIX timer
+// sends SIGPROF at hz, and the handler walks the interrupted stack into a
+// ring buffer belonging to its thread: a single producer, single consumer
+// ring, so the handler takes no lock and makes no system call beyond what
+// the walk needs. A background thread drains the rings every 100ms, or more
+// often at high rates, and counts identical stacks; symbolization happens
+// only when a profile is written, as pprof's legacy CPU format (read by
+// "pprof" and "go tool pprof" against the binary) or folded stacks for
+// flamegraph.pl.
+//
+//   sampling_profiler::start(profiler_options(1000));
+//   ...
+//   sampling_profiler::stop();
+//   sampling_profiler::write_folded(stdout);
+//
+// The default clock is the process's CPU time, so samples fall on threads in
+// proportion to the CPU they use. Linux checks CPU timers on the scheduler
+// tick, so above CONFIG_HZ expirations arrive in batches; the timer's
+// overrun count is kept as the sample's weight, and totals stay right though
+// the stacks are sparser. wall_time samples whichever thread is running on a
+// high resolution timer, idle time not included.
+//
+// The default unwinder follows frame pointers, so build with
+// -fno-omit-frame-pointer, or stacks stop at the first function without
+// one. A leaf function that needs no stack gets no frame even so, and a
+// sample in one is attributed to it and its caller's caller.
+// unwind_tables works on any code, but _Unwind_Backtrace takes the dynamic
+// loader's lock, so a sample landing inside dlopen() deadlocks.
+//
+// A thread gets a ring on its first sample, from max_threads allocated by
+// start(), and gives it back once it has exited and its ring is drained.
+// Samples on threads with no ring to take, or whose ring is full, are
+// counted as dropped.
+
+struct profiler_options {
+	enum clock_kind {
+		cpu_time,
+		wall_time,
+	};
+
+	enum unwinder_kind {
+		frame_pointers,
+		unwind_tables,
+	};
+
+	unsigned hz;
+	clock_kind clock;
+	unwinder_kind unwinder;
+	size_t max_threads;
+	// Per thread ring size, in words; a sample takes depth + 1.
+	size_t ring_words;
+	size_t max_depth;
+
+	explicit profiler_options(unsigned hz = 100,
+				  clock_kind clock = cpu_time,
+				  unwinder_kind unwinder = frame_pointers)
+		: hz(hz), clock(clock), unwinder(unwinder), max_threads(64),
+		  ring_words(1 << 13), max_depth(64) {
+	}
+};
+
+namespace profiler_detail {
+
+// Written by the thread's signal handler, read by the aggregator. Each
+// sample is a word of depth and weight, then depth pcs, innermost first.
+struct ring {
+	std::atomic<int> owner;
+	std::atomic<uint64_t> head;
+	std::atomic<uint64_t> tail;
+	std::atomic<uint64_t> dropped;
+	size_t size;
+	std::unique_ptr<uintptr_t[]> words;
+
+	ring() : owner(0), head(0), tail(0), dropped(0), size(0) {
+	}
+
+	bool push(const uintptr_t *pcs, size_t depth, uintptr_t weight) {
+		uint64_t h = head.load(std::memory_order_relaxed);
+		uint64_t t = tail.load(std::memory_order_acquire);
+		if (size - (h - t) < depth + 1) {
+			dropped.fetch_add(weight, std::memory_order_relaxed);
+			return false;
+		}
+		words[h % size] = uintptr_t(depth) | weight << 16;
+		for (size_t i = 0; i < depth; ++i)
+			words[(h + 1 + i) % size] = pcs[i];
+		head.store(h + 1 + depth, std::memory_order_release);
+		return true;
+	}
+
+	// Hands each sample to f(pcs, weight).
+	template <class F>
+	void drain(std::vector<uintptr_t> &pcs, F f) {
+		uint64_t t = tail.load(std::memory_order_relaxed);
+		uint64_t h = head.load(std::memory_order_acquire);
+		while (t != h) {
+			uintptr_t w = words[t % size];
+			size_t depth = w & 0xffff;
+			pcs.resize(depth);
+			for (size_t i = 0; i < depth; ++i)
+				pcs[i] = words[(t + 1 + i) % size];
+			f(pcs, uint64_t(w >> 16));
+			t += 1 + depth;
+		}
+		tail.store(t, std::memory_order_release);
+	}
+};
+
+struct state {
+	profiler_options opts;
+	std::unique_ptr<ring[]> rings;
+	timer_t timer;
+	// Bumped by each start(), to tell threads their cached ring is from
+	// an earlier run.
+	unsigned generation;
+	std::atomic<uint64_t> no_ring;
+
+	std::mutex lock;
+	std::condition_variable wake;
+	bool stopping;
+	std::thread aggregator;
+	std::map<std::vector<uintptr_t>, uint64_t> stacks;
+	uint64_t samples;
+	uint64_t dropped;
+
+	explicit state(const profiler_options &opts)
+		: opts(opts), rings(new ring[opts.max_threads]),
+		  generation(0), no_ring(0), stopping(false), samples(0),
+		  dropped(0) {
+		for (size_t i = 0; i < opts.max_threads; ++i) {
+			rings[i].size = opts.ring_words;
+			rings[i].words.reset(new uintptr_t[opts.ring_words]);
+		}
+	}
+};
+
+// The running profiler for the handler, and how many handlers are using
+// it, so stop() knows when it can be freed.
+inline std::atomic<state *> &current() {
+	static std::atomic<state *> s(nullptr);
+	return s;
+}
+
+inline std::atomic<int> &active_handlers() {
+	static std::atomic<int> n(0);
+	return n;
+}
+
+// Under the lock.
+inline void drain_all(state &s, bool release_exited) {
+	std::vector<uintptr_t> pcs;
+	pid_t pid = getpid();
+	for (size_t i = 0; i < s.opts.max_threads; ++i) {
+		ring &r = s.rings[i];
+		int tid = r.owner.load(std::memory_order_acquire);
+		if (!tid)
+			continue;
+		// A thread that has gone can't push any more, so once it is
+		// known dead its ring can be drained a last time and reused.
+		bool exited = release_exited &&
+			      syscall(SYS_tgkill, pid, tid, 0) < 0 &&
+			      errno == ESRCH;
+		r.drain(pcs, [&](const std::vector<uintptr_t> &p, uint64_t w) {
+			s.stacks[p] += w;
+			s.samples += w;
+		});
+		s.dropped += r.dropped.exchange(0, std::memory_order_relaxed);
+		if (exited)
+			r.owner.store(0, std::memory_order_release);
+	}
+	s.dropped += s.no_ring.exchange(0, std::memory_order_relaxed);
+}
+
+inline void aggregate(state *s) {
+	// Every 100ms, or often enough to empty a ring of full depth samples
+	// by the time it is a quarter full.
+	size_t per_ring = s->opts.ring_words / (s->opts.max_depth + 1);
+	long ms = long(250 * per_ring / s->opts.hz);
+	std::chrono::milliseconds period(std::max(1L, std::min(100L, ms)));
+	std::unique_lock<std::mutex> l(s->lock);
+	while (!s->stopping) {
+		s->wake.wait_for(l, period);
+		drain_all(*s, true);
+	}
+}
+
+inline ring *thread_ring(state &s) {
+	// Plain thread_locals in the executable are at a fixed offset from
+	// the thread pointer; in a dlopen()ed library the first access may
+	// allocate.
+	static thread_local ring *cached;
+	static thread_local unsigned cached_generation;
+	static thread_local int tid;
+	if (cached && cached_generation == s.generation &&
+	    cached->owner.load(std::memory_order_relaxed) == tid)
+		return cached;
+	if (!tid)
+		tid = int(syscall(SYS_gettid));
+	for (size_t i = 0; i < s.opts.max_threads; ++i) {
+		int expected = 0;
+		if (s.rings[i].owner.compare_exchange_strong(expected, tid)) {
+			cached = &s.rings[i];
+			cached_generation = s.generation;
+			return cached;
+		}
+	}
+	return nullptr;
+}
+
+inline void handler(int, siginfo_t *info, void *uctx) {
+	int saved_errno = errno;
+	// Sequentially consistent against stop(), which clears current()
+	// and then waits for active_handlers() to reach zero.
+	active_handlers().fetch_add(1);
+	state *s = current().load();
+	if (s) {
+		uintptr_t weight = 1;
+		if (info && info->si_code == SI_TIMER)
+			weight += uintptr_t(info->si_overrun);
+		ring *r = thread_ring(*s);
+		if (!r) {
+			s->no_ring.fetch_add(weight, std::memory_order_relaxed);
+		} else {
+			uintptr_t pcs[256];
+			size_t max = std::min<size_t>(s->opts.max_depth, 256);
+			size_t depth;
+			machine_registers m;
+			if (s->opts.unwinder == profiler_options::unwind_tables)
+				depth = signal_backtrace(uctx, pcs, max);
+			else if (get_machine_registers(uctx, &m))
+				depth = walk_frame_pointers(m.pc, m.fp, pcs,
+							    max);
+			else
+				depth = 0;
+			if (depth)
+				r->push(pcs, depth, weight);
+		}
+	}
+	active_handlers().fetch_sub(1, std::memory_order_release);
+	errno = saved_errno;
+}
+
+// Names for pcs, the innermost exact and the rest return addresses, by
+// addr2line where it can be found, else dladdr(), else module+offset.
+inline std::unordered_map<uintptr_t, std::string>
+symbolize(const std::vector<uintptr_t> &pcs) {
+	std::unordered_map<uintptr_t, std::string> names;
+	std::unique_ptr<crash_detail::crash_record> maps(
+		new crash_detail::crash_record);
+	maps->clear();
+	std::unique_ptr<char[]> scratch(new char[1 << 16]);
+	crash_detail::capture_maps(*maps, scratch.get(), 1 << 16);
+	std::string addr2line = crash_detail::find_addr2line();
+
+	std::map<const crash_detail::mapping *, std::vector<uintptr_t>> by_map;
+	for (uintptr_t pc : pcs)
+		by_map[maps->find(pc)].push_back(pc);
+	for (auto &m : by_map) {
+		const char *path = m.first ? maps->str(m.first->path) : "";
+		bool fixed = path[0] == '/' &&
+			     crash_detail::is_fixed_address_elf(path);
+		uintptr_t base = m.first && !fixed ? m.first->base : 0;
+		const std::vector<uintptr_t> &v = m.second;
+		const size_t batch = crash_detail::max_frames;
+		for (size_t i = 0; i < v.size(); i += batch) {
+			size_t n = std::min(batch, v.size() - i);
+			uintptr_t rel[crash_detail::max_frames];
+			for (size_t k = 0; k < n; ++k)
+				rel[k] = v[i + k] - base;
+			ssize_t got = -1;
+			if (!addr2line.empty() && path[0] == '/')
+				got = crash_detail::run_addr2line(
+					addr2line.c_str(), path, rel, n,
+					scratch.get(), 1 << 16);
+			const char *p = scratch.get();
+			const char *end = got > 0 ? p + got : p;
+			for (size_t k = 0; k < n; ++k) {
+				const char *eol = p;
+				while (eol < end && *eol != '\n')
+					++eol;
+				std::string name(p, eol);
+				p = eol < end ? eol + 1 : end;
+				size_t at = name.find(" at ");
+				if (at != std::string::npos)
+					name.resize(at);
+				if (!name.compare(0, 2, "??"))
+					name.clear();
+				if (name.empty()) {
+					Dl_info info;
+					void *a = reinterpret_cast<void *>(
+						v[i + k]);
+					if (dladdr(a, &info) && info.dli_sname)
+						name = info.dli_sname;
+				}
+				if (name.empty()) {
+					const char *slash = strrchr(path, '/');
+					char off[32];
+					snprintf(off, sizeof(off), "+0x%llx",
+						 (unsigned long long)rel[k]);
+					name = std::string(slash ? slash + 1
+								 : "?") +
+					       off;
+				}
+				names[v[i + k]] = name;
+			}
+		}
+	}
+	return names;
+}
+
+} // End namespace profiler_detail
+
+class sampling_profiler {
+private:
+	static std::unique_ptr<profiler_detail::state> &owned() {
+		static std::unique_ptr<profiler_detail::state> s;
+		return s;
+	}
+
+	static std::mutex &control() {
+		static std::mutex m;
+		return m;
+	}
+
+	static unsigned &generation() {
+		static unsigned g;
+		return g;
+	}
+
+	// Copies out what has been aggregated, after a last drain.
+	static bool collect(std::map<std::vector<uintptr_t>, uint64_t> &out,
+			    unsigned &hz) {
+		profiler_detail::state *s = owned().get();
+		if (!s)
+			return false;
+		std::lock_guard<std::mutex> l(s->lock);
+		profiler_detail::drain_all(*s, false);
+		out = s->stacks;
+		hz = s->opts.hz;
+		return true;
+	}
+
+public:
+	// Starts sampling, dropping any previous profile. Returns -1 with
+	// errno set on failure, or EBUSY if already running.
+	static int start(const profiler_options &opts = profiler_options()) {
+		std::lock_guard<std::mutex> c(control());
+		if (profiler_detail::current().load()) {
+			errno = EBUSY;
+			return -1;
+		}
+		if (!opts.hz || opts.hz > 1000000 || !opts.max_threads ||
+		    opts.ring_words < opts.max_depth + 1 ||
+		    opts.max_depth > 0xffff) {
+			errno = EINVAL;
+			return -1;
+		}
+		owned().reset();
+		std::unique_ptr<profiler_detail::state> s(
+			new profiler_detail::state(opts));
+		s->generation = ++generation();
+		stack_trace_prepare();
+
+		struct sigaction sa;
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_sigaction = profiler_detail::handler;
+		sa.sa_flags = SA_SIGINFO | SA_RESTART;
+		sigemptyset(&sa.sa_mask);
+		if (sigaction(SIGPROF, &sa, nullptr) < 0)
+			return -1;
+
+		struct sigevent ev;
+		memset(&ev, 0, sizeof(ev));
+		ev.sigev_notify = SIGEV_SIGNAL;
+		ev.sigev_signo = SIGPROF;
+		clockid_t clock = opts.clock == profiler_options::wall_time
+					  ? CLOCK_MONOTONIC
+					  : CLOCK_PROCESS_CPUTIME_ID;
+		if (timer_create(clock, &ev, &s->timer) < 0)
+			return -1;
+		s->aggregator = std::thread(profiler_detail::aggregate,
+					    s.get());
+		profiler_detail::current().store(s.get());
+
+		long ns = long(1000000000 / opts.hz);
+		struct itimerspec its;
+		its.it_interval.tv_sec = ns / 1000000000;
+		its.it_interval.tv_nsec = ns % 1000000000;
+		its.it_value = its.it_interval;
+		if (timer_settime(s->timer, 0, &its, nullptr) < 0) {
+			int e = errno;
+			owned() = std::move(s);
+			stop_locked();
+			errno = e;
+			return -1;
+		}
+		owned() = std::move(s);
+		return 0;
+	}
+
+	// Stops sampling. The profile stays to be written until the next
+	// start().
+	static void stop() {
+		std::lock_guard<std::mutex> c(control());
+		stop_locked();
+	}
+
+	static bool running() {
+		return profiler_detail::current().load() != nullptr;
+	}
+
+	// Samples taken, and lost to full or missing rings, so far.
+	static uint64_t samples() {
+		profiler_detail::state *s = owned().get();
+		if (!s)
+			return 0;
+		std::lock_guard<std::mutex> l(s->lock);
+		profiler_detail::drain_all(*s, false);
+		return s->samples;
+	}
+
+	static uint64_t dropped() {
+		profiler_detail::state *s = owned().get();
+		if (!s)
+			return 0;
+		std::lock_guard<std::mutex> l(s->lock);
+		profiler_detail::drain_all(*s, false);
+		return s->dropped;
+	}
+
+	// One line per distinct stack, outermost frame first, separated by
+	// semicolons, then the sample count, as flamegraph.pl takes.
+	static bool write_folded(FILE *f) {
+		std::map<std::vector<uintptr_t>, uint64_t> stacks;
+		unsigned hz;
+		if (!collect(stacks, hz))
+			return false;
+		// Return addresses are looked up by the call before them.
+		std::vector<uintptr_t> pcs;
+		for (auto &s : stacks)
+			for (size_t i = 0; i < s.first.size(); ++i)
+				pcs.push_back(s.first[i] - (i ? 1 : 0));
+		std::sort(pcs.begin(), pcs.end());
+		pcs.erase(std::unique(pcs.begin(), pcs.end()), pcs.end());
+		auto names = profiler_detail::symbolize(pcs);
+		std::map<std::string, uint64_t> lines;
+		for (auto &s : stacks) {
+			std::string line;
+			for (size_t i = s.first.size(); i--;) {
+				line += names[s.first[i] - (i ? 1 : 0)];
+				if (i)
+					line += ';';
+			}
+			lines[line] += s.second;
+		}
+		for (auto &l : lines)
+			fprintf(f, "%s %llu\n", l.first.c_str(),
+				(unsigned long long)l.second);
+		return !ferror(f);
+	}
+
+	// The legacy pprof CPU profile: native words of header, one record of
+	// count, depth and pcs per stack, trailer, then /proc/self/maps so
+	// pprof can find the modules.
+	static bool write_pprof(FILE *f) {
+		std::map<std::vector<uintptr_t>, uint64_t> stacks;
+		unsigned hz;
+		if (!collect(stacks, hz))
+			return false;
+		std::vector<uintptr_t> w = {0, 3, 0, 1000000 / hz, 0};
+		for (auto &s : stacks) {
+			w.push_back(uintptr_t(s.second));
+			w.push_back(s.first.size());
+			w.insert(w.end(), s.first.begin(), s.first.end());
+		}
+		w.push_back(0);
+		w.push_back(1);
+		w.push_back(0);
+		if (fwrite(w.data(), sizeof(w[0]), w.size(), f) != w.size())
+			return false;
+		FILE *maps = fopen("/proc/self/maps", "r");
+		if (maps) {
+			char buf[4096];
+			size_t n;
+			while ((n = fread(buf, 1, sizeof(buf), maps)) > 0)
+				fwrite(buf, 1, n, f);
+			fclose(maps);
+		}
+		return !ferror(f);
+	}
+
+private:
+	static void stop_locked() {
+		std::unique_ptr<profiler_detail::state> &s = owned();
+		if (!s || profiler_detail::current().load() != s.get())
+			return;
+		timer_delete(s->timer);
+		profiler_detail::current().store(nullptr);
+		// A SIGPROF already pending finds nothing to do; one already
+		// in the handler is waited out before the rings can go.
+		while (profiler_detail::active_handlers().load())
+			std::this_thread::yield();
+		{
+			std::lock_guard<std::mutex> l(s->lock);
+			s->stopping = true;
+		}
+		s->wake.notify_one();
+		s->aggregator.join();
+		std::lock_guard<std::mutex> l(s->lock);
+		profiler_detail::drain_all(*s, false);
+	}
+};
+#endif
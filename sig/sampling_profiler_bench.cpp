@@ -0,0 +1,86 @@
+// Overhead of sampling_profiler at 100 Hz, 1 kHz and 10 kHz.
+//
+//   sampling_profiler_bench [seconds]
+//
+// Times a fixed CPU-bound job, a recursion about 30 frames deep, that
+// takes about seconds (default 1) unprofiled, then again under the
+// profiler with each clock and rate and each unwinder, best of three.
+// Overhead is the slowdown against the unprofiled run; samples/s is what
+// reached the profile, and dropped what didn't. Build with
+// -fno-omit-frame-pointer.
+#include "sampling_profiler.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+using bench_clock = std::chrono::steady_clock;
+
+static double seconds_since(bench_clock::time_point t0) {
+	return std::chrono::duration<double>(bench_clock::now() - t0).count();
+}
+
+static volatile uint64_t sink;
+
+__attribute__((noinline)) uint64_t work(uint64_t x, int depth) {
+	if (depth)
+		return work(x * 31 + 7, depth - 1) ^ x;
+	for (int i = 0; i < 2000; ++i)
+		x = x * 6364136223846793005ull + 1442695040888963407ull;
+	return x;
+}
+
+static double run(uint64_t rounds) {
+	double best = 1e9;
+	for (int trial = 0; trial < 3; ++trial) {
+		auto t0 = bench_clock::now();
+		uint64_t x = 1;
+		for (uint64_t i = 0; i < rounds; ++i)
+			x += work(x, 30);
+		sink = x;
+		best = std::min(best, seconds_since(t0));
+	}
+	return best;
+}
+
+int main(int argc, char **argv) {
+	double seconds = argc > 1 ? atof(argv[1]) : 1.0;
+
+	// Size the job.
+	uint64_t rounds = 1000;
+	double t = run(rounds);
+	rounds = uint64_t(rounds * seconds / t) + 1;
+	double base = run(rounds);
+
+	printf("job %.3fs unprofiled\n", base);
+	printf("%-22s %6s %8s %11s %10s %8s\n", "", "hz", "seconds",
+	       "overhead %", "samples/s", "dropped");
+	static const struct {
+		const char *name;
+		profiler_options::clock_kind clock;
+		profiler_options::unwinder_kind unwinder;
+	} configs[] = {
+		{"cpu, frame pointers", profiler_options::cpu_time,
+		 profiler_options::frame_pointers},
+		{"wall, frame pointers", profiler_options::wall_time,
+		 profiler_options::frame_pointers},
+		{"cpu, unwind tables", profiler_options::cpu_time,
+		 profiler_options::unwind_tables},
+	};
+	for (auto &c : configs) {
+		for (unsigned hz : {100, 1000, 10000}) {
+			profiler_options opts(hz, c.clock, c.unwinder);
+			if (sampling_profiler::start(opts) < 0) {
+				perror("sampling_profiler::start");
+				return 1;
+			}
+			double s = run(rounds);
+			sampling_profiler::stop();
+			unsigned long long dropped =
+				sampling_profiler::dropped();
+			printf("%-22s %6u %8.3f %11.2f %10.0f %8llu\n", c.name,
+			       hz, s, (s / base - 1) * 100,
+			       sampling_profiler::samples() / (3 * s), dropped);
+		}
+	}
+	return 0;
+}
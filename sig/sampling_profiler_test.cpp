@@ -0,0 +1,112 @@
+#include "sampling_profiler.h"
+#include "libcpp-util/util/test_check.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+static std::atomic<uint64_t> sink;
+
+__attribute__((noinline)) uint64_t spin_leaf(uint64_t x) {
+	for (int i = 0; i < 1000; ++i)
+		x = x * 6364136223846793005ull + 1442695040888963407ull;
+	return x;
+}
+
+__attribute__((noinline)) void spin_for(double seconds) {
+	auto end = std::chrono::steady_clock::now() +
+		   std::chrono::duration<double>(seconds);
+	uint64_t x = 1;
+	while (std::chrono::steady_clock::now() < end)
+		x = spin_leaf(x);
+	sink = x;
+}
+
+static std::string read_file(FILE *f) {
+	std::string s;
+	rewind(f);
+	char buf[4096];
+	size_t n;
+	while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+		s.append(buf, n);
+	return s;
+}
+
+// The tests are built like anything else, without -fno-omit-frame-pointer,
+// so only unwind_tables can be relied on for whole stacks. With
+// frame_pointers the innermost pc, at least, is always right.
+static void test_profile(profiler_options::clock_kind clock,
+			 profiler_options::unwinder_kind unwinder) {
+	CHECK(sampling_profiler::start(
+		      profiler_options(1000, clock, unwinder)) == 0);
+	CHECK(sampling_profiler::running());
+	CHECK(sampling_profiler::start() == -1 && errno == EBUSY);
+
+	// Samples land on the threads doing the work.
+	std::vector<std::thread> threads;
+	for (int i = 0; i < 3; ++i)
+		threads.emplace_back(spin_for, 0.2);
+	spin_for(0.2);
+	for (auto &t : threads)
+		t.join();
+	sampling_profiler::stop();
+	CHECK(!sampling_profiler::running());
+
+	// At least 0.2s of CPU at 1kHz.
+	uint64_t n = sampling_profiler::samples();
+	printf("%s, %s: %llu samples, %llu dropped\n",
+	       clock == profiler_options::cpu_time ? "cpu" : "wall",
+	       unwinder == profiler_options::unwind_tables ? "unwind tables"
+							   : "frame pointers",
+	       (unsigned long long)n,
+	       (unsigned long long)sampling_profiler::dropped());
+	CHECK(n > 50);
+
+	FILE *f = tmpfile();
+	CHECK(f);
+	CHECK(sampling_profiler::write_folded(f));
+	std::string folded = read_file(f);
+	fclose(f);
+	CHECK(folded.find("spin_leaf(unsigned long)") != std::string::npos);
+	if (unwinder == profiler_options::unwind_tables)
+		CHECK(folded.find("main;test_profile(") != std::string::npos);
+	uint64_t total = 0;
+	for (size_t i = 0; i < folded.size();) {
+		size_t eol = folded.find('\n', i);
+		CHECK(eol != std::string::npos);
+		size_t sp = folded.rfind(' ', eol);
+		CHECK(sp != std::string::npos && sp > i);
+		total += strtoull(folded.c_str() + sp + 1, nullptr, 10);
+		i = eol + 1;
+	}
+	CHECK(total == n);
+
+	f = tmpfile();
+	CHECK(f);
+	CHECK(sampling_profiler::write_pprof(f));
+	std::string pprof = read_file(f);
+	fclose(f);
+	const uintptr_t *w = reinterpret_cast<const uintptr_t *>(pprof.data());
+	CHECK(pprof.size() > 8 * sizeof(uintptr_t));
+	CHECK(w[0] == 0 && w[1] == 3 && w[2] == 0 && w[3] == 1000);
+	CHECK(pprof.find("r-xp") != std::string::npos);
+}
+
+int main() {
+	test_profile(profiler_options::cpu_time,
+		     profiler_options::unwind_tables);
+	test_profile(profiler_options::wall_time,
+		     profiler_options::unwind_tables);
+	test_profile(profiler_options::cpu_time,
+		     profiler_options::frame_pointers);
+
+	profiler_options bad(0);
+	CHECK(sampling_profiler::start(bad) == -1 && errno == EINVAL);
+	printf("sampling_profiler_test: all passed\n");
+	return 0;
+}
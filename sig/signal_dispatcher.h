@@ -0,0 +1,377 @@
+//============================================================================
+//                                  libcpp-util
+//                   A simple odds-n-ends library for C++11
+//
+//         Licensed under modified BSD license. See LICENSE for details.
+//============================================================================
+
+#ifndef LIBCPP_UTIL_SIGNAL_DISPATCHER_H
+#define LIBCPP_UTIL_SIGNAL_DISPATCHER_H
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/signalfd.h>
+#define SIGNAL_DISPATCHER_HAVE_SIGNALFD 1
+#endif
+
+// Turns signals into ordinary callbacks, run outside signal context, for
+// the SIGTERM, SIGHUP and SIGCHLD kind that want real work done:
+// shutting down, reloading configuration, reaping children.
+//
+// With signalfd (Linux), add() blocks the signal in the calling thread
+// and reads it from a signalfd instead. Signals are process wide, and one
+// that isn't blocked in every thread may be delivered to a thread that
+// hasn't, so create the dispatcher and add() its signals from main()
+// before starting other threads, which then inherit the mask. Elsewhere,
+// or with self_pipe, add() installs a handler that writes the signal's
+// details to a pipe; nothing needs blocking, but system calls get EINTR
+// (the handler is installed with SA_RESTART, which covers most of them).
+//
+// fd() is readable while there are signals to dispatch(), for an event
+// loop to watch; or start_thread() runs them on a thread of their own.
+// Like the signals themselves, several deliveries of one signal may come
+// through as one.
+//
+//   signal_dispatcher d;
+//   d.add(SIGTERM, [&](const signal_info &) { shutdown(); });
+//   d.add(SIGHUP, [&](const signal_info &) { reload(); });
+//   d.start_thread();
+
+struct signal_info {
+	int signo;
+	int code;
+	// The sender, for kill() and sigqueue(); the child, for SIGCHLD.
+	pid_t pid;
+	uid_t uid;
+	// SIGCHLD's exit status or signal.
+	int status;
+	// sigqueue()'s value.
+	int value;
+};
+
+namespace signal_dispatcher_detail {
+
+// Which signals are taken, process wide, and for the self-pipe handler,
+// where each one's details go.
+inline std::atomic<int> *pipe_fds() {
+	static std::atomic<int> fds[NSIG];
+	return fds;
+}
+
+inline std::mutex &owners_lock() {
+	static std::mutex m;
+	return m;
+}
+
+inline std::map<int, const void *> &owners() {
+	static std::map<int, const void *> m;
+	return m;
+}
+
+inline void pipe_handler(int signo, siginfo_t *si, void *) {
+	int saved_errno = errno;
+	int fd = pipe_fds()[signo].load(std::memory_order_acquire);
+	if (fd >= 0) {
+		signal_info info;
+		memset(&info, 0, sizeof(info));
+		info.signo = signo;
+		info.code = si->si_code;
+		info.pid = si->si_pid;
+		info.uid = si->si_uid;
+		if (signo == SIGCHLD)
+			info.status = si->si_status;
+		if (si->si_code == SI_QUEUE)
+			info.value = si->si_value.sival_int;
+		// Under PIPE_BUF, so all or nothing. A full pipe loses this
+		// one, as a pending signal would.
+		ssize_t r = ::write(fd, &info, sizeof(info));
+		(void)r;
+	}
+	errno = saved_errno;
+}
+
+} // End namespace signal_dispatcher_detail
+
+class signal_dispatcher {
+public:
+	typedef std::function<void(const signal_info &)> callback;
+
+	enum class method {
+		automatic,
+		signalfd,
+		self_pipe,
+	};
+
+private:
+	method how;
+	int read_fd;
+	int write_fd;
+	sigset_t mask;
+	std::mutex lock;
+	std::map<int, callback> callbacks;
+	std::thread thread;
+	int wake[2];
+
+	signal_dispatcher(const signal_dispatcher &) = delete;
+	signal_dispatcher &operator=(const signal_dispatcher &) = delete;
+
+	static bool make_pipe(int fds[2]) {
+		if (::pipe(fds) < 0)
+			return false;
+		for (int i = 0; i < 2; ++i) {
+			::fcntl(fds[i], F_SETFL,
+				::fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+			::fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+		}
+		return true;
+	}
+
+	void run() {
+		struct pollfd p[2] = {{read_fd, POLLIN, 0},
+				      {wake[0], POLLIN, 0}};
+		for (;;) {
+			if (::poll(p, 2, -1) < 0) {
+				if (errno == EINTR)
+					continue;
+				break;
+			}
+			if (p[1].revents)
+				break;
+			dispatch();
+		}
+	}
+
+	bool read_one(signal_info &info) {
+#ifdef SIGNAL_DISPATCHER_HAVE_SIGNALFD
+		if (how == method::signalfd) {
+			struct signalfd_siginfo si;
+			ssize_t r;
+			while ((r = ::read(read_fd, &si, sizeof(si))) < 0 &&
+			       errno == EINTR)
+				;
+			if (r != ssize_t(sizeof(si)))
+				return false;
+			info.signo = int(si.ssi_signo);
+			info.code = si.ssi_code;
+			info.pid = pid_t(si.ssi_pid);
+			info.uid = uid_t(si.ssi_uid);
+			info.status = si.ssi_status;
+			info.value = si.ssi_int;
+			return true;
+		}
+#endif
+		ssize_t r;
+		while ((r = ::read(read_fd, &info, sizeof(info))) < 0 &&
+		       errno == EINTR)
+			;
+		return r == ssize_t(sizeof(info));
+	}
+
+public:
+	// Fails only where the descriptors can't be had; check fd() >= 0.
+	explicit signal_dispatcher(method m = method::automatic)
+		: how(m), read_fd(-1), write_fd(-1) {
+		sigemptyset(&mask);
+		wake[0] = wake[1] = -1;
+#ifdef SIGNAL_DISPATCHER_HAVE_SIGNALFD
+		if (how != method::self_pipe) {
+			read_fd = ::signalfd(-1, &mask,
+					     SFD_NONBLOCK | SFD_CLOEXEC);
+			if (read_fd >= 0) {
+				how = method::signalfd;
+				return;
+			}
+			if (how == method::signalfd)
+				return;
+		}
+#else
+		if (how == method::signalfd) {
+			errno = ENOSYS;
+			return;
+		}
+#endif
+		how = method::self_pipe;
+		int fds[2];
+		if (make_pipe(fds)) {
+			read_fd = fds[0];
+			write_fd = fds[1];
+		}
+	}
+
+	~signal_dispatcher() {
+		stop_thread();
+		int signals[NSIG];
+		int n = 0;
+		{
+			std::lock_guard<std::mutex> l(lock);
+			for (auto &c : callbacks)
+				signals[n++] = c.first;
+		}
+		for (int i = 0; i < n; ++i)
+			remove(signals[i]);
+		if (read_fd >= 0)
+			::close(read_fd);
+		if (write_fd >= 0)
+			::close(write_fd);
+	}
+
+	method get_method() const {
+		return how;
+	}
+
+	// Readable while there are signals waiting for dispatch().
+	int fd() const {
+		return read_fd;
+	}
+
+	// Routes signo to cb, replacing any callback it had here. Returns -1
+	// with EBUSY if another dispatcher has it, or errno from the system.
+	// SIGKILL and SIGSTOP can't be caught; SIGSEGV and the like, raised
+	// by faults, can't usefully wait.
+	int add(int signo, callback cb) {
+		using namespace signal_dispatcher_detail;
+		if (signo <= 0 || signo >= NSIG || read_fd < 0) {
+			errno = EINVAL;
+			return -1;
+		}
+		std::lock_guard<std::mutex> l(lock);
+		{
+			std::lock_guard<std::mutex> o(owners_lock());
+			auto it = owners().find(signo);
+			if (it != owners().end() && it->second != this) {
+				errno = EBUSY;
+				return -1;
+			}
+			owners()[signo] = this;
+		}
+		if (callbacks.count(signo)) {
+			callbacks[signo] = std::move(cb);
+			return 0;
+		}
+		int err = 0;
+#ifdef SIGNAL_DISPATCHER_HAVE_SIGNALFD
+		if (how == method::signalfd) {
+			sigset_t one;
+			sigemptyset(&one);
+			sigaddset(&one, signo);
+			sigaddset(&mask, signo);
+			if (::pthread_sigmask(SIG_BLOCK, &one, nullptr) != 0 ||
+			    ::signalfd(read_fd, &mask, 0) < 0) {
+				err = errno;
+				sigdelset(&mask, signo);
+			}
+		}
+#endif
+		if (how == method::self_pipe) {
+			pipe_fds()[signo].store(write_fd);
+			struct sigaction sa;
+			memset(&sa, 0, sizeof(sa));
+			sa.sa_sigaction = pipe_handler;
+			sa.sa_flags = SA_SIGINFO | SA_RESTART;
+			sigemptyset(&sa.sa_mask);
+			if (::sigaction(signo, &sa, nullptr) < 0) {
+				err = errno;
+				pipe_fds()[signo].store(-1);
+			}
+		}
+		if (err) {
+			std::lock_guard<std::mutex> o(owners_lock());
+			owners().erase(signo);
+			errno = err;
+			return -1;
+		}
+		callbacks[signo] = std::move(cb);
+		return 0;
+	}
+
+	// Gives signo back its default action (and, with signalfd, unblocks
+	// it in the calling thread).
+	int remove(int signo) {
+		using namespace signal_dispatcher_detail;
+		std::lock_guard<std::mutex> l(lock);
+		if (!callbacks.erase(signo)) {
+			errno = ENOENT;
+			return -1;
+		}
+		{
+			std::lock_guard<std::mutex> o(owners_lock());
+			owners().erase(signo);
+		}
+#ifdef SIGNAL_DISPATCHER_HAVE_SIGNALFD
+		if (how == method::signalfd) {
+			sigdelset(&mask, signo);
+			::signalfd(read_fd, &mask, 0);
+			sigset_t one;
+			sigemptyset(&one);
+			sigaddset(&one, signo);
+			::pthread_sigmask(SIG_UNBLOCK, &one, nullptr);
+			return 0;
+		}
+#endif
+		struct sigaction sa;
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_handler = SIG_DFL;
+		::sigaction(signo, &sa, nullptr);
+		pipe_fds()[signo].store(-1);
+		return 0;
+	}
+
+	// Runs the callbacks for every signal waiting, without blocking.
+	// Returns how many ran. Callbacks may add() and remove().
+	int dispatch() {
+		int n = 0;
+		signal_info info;
+		while (read_one(info)) {
+			callback cb;
+			{
+				std::lock_guard<std::mutex> l(lock);
+				auto it = callbacks.find(info.signo);
+				if (it == callbacks.end())
+					continue;
+				cb = it->second;
+			}
+			cb(info);
+			++n;
+		}
+		return n;
+	}
+
+	// Dispatches on a thread of its own until stop_thread() or
+	// destruction. Returns -1 with errno set on failure.
+	int start_thread() {
+		if (thread.joinable()) {
+			errno = EBUSY;
+			return -1;
+		}
+		if (read_fd < 0 || !make_pipe(wake))
+			return -1;
+		thread = std::thread([this] { run(); });
+		return 0;
+	}
+
+	void stop_thread() {
+		if (!thread.joinable())
+			return;
+		char c = 0;
+		ssize_t r = ::write(wake[1], &c, 1);
+		(void)r;
+		thread.join();
+		::close(wake[0]);
+		::close(wake[1]);
+		wake[0] = wake[1] = -1;
+	}
+};
+#endif
@@ -0,0 +1,122 @@
+// Signal to callback latency through signal_dispatcher.
+//
+//   signal_dispatcher_bench [iterations]
+//
+// Sends the process SIGUSR1 iterations (default 20000) times, one at a
+// time, and times from kill() to the callback starting: for a plain
+// handler, which runs in signal context; for dispatch() from the sending
+// thread's own poll loop; and for the dispatcher's own thread, with
+// signalfd and with a self-pipe, where the callback acks through a pipe
+// before the next signal goes.
+#include "signal_dispatcher.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <poll.h>
+#include <unistd.h>
+
+using bench_clock = std::chrono::steady_clock;
+
+static bench_clock::time_point sent;
+static std::vector<double> latencies;
+
+static void record() {
+	latencies.push_back(
+		std::chrono::duration<double, std::micro>(bench_clock::now() -
+							  sent)
+			.count());
+}
+
+static void report(const char *name) {
+	std::sort(latencies.begin(), latencies.end());
+	double sum = 0;
+	for (double l : latencies)
+		sum += l;
+	size_t n = latencies.size();
+	printf("%-26s %8.2f %8.2f %8.2f %8.2f\n", name, sum / n,
+	       latencies[n / 2], latencies[n * 99 / 100],
+	       latencies[n * 999 / 1000]);
+	latencies.clear();
+}
+
+static void handler(int, siginfo_t *, void *) {
+	record();
+}
+
+static void plain_handler(size_t iterations) {
+	struct sigaction sa, old;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_sigaction = handler;
+	sa.sa_flags = SA_SIGINFO;
+	sigaction(SIGUSR1, &sa, &old);
+	for (size_t i = 0; i < iterations; ++i) {
+		sent = bench_clock::now();
+		kill(getpid(), SIGUSR1);
+	}
+	sigaction(SIGUSR1, &old, nullptr);
+	report("handler (signal context)");
+}
+
+static void poll_loop(signal_dispatcher::method m, size_t iterations,
+		      const char *name) {
+	signal_dispatcher d(m);
+	d.add(SIGUSR1, [](const signal_info &) { record(); });
+	struct pollfd p = {d.fd(), POLLIN, 0};
+	for (size_t i = 0; i < iterations; ++i) {
+		sent = bench_clock::now();
+		kill(getpid(), SIGUSR1);
+		while (poll(&p, 1, -1) < 0 && errno == EINTR)
+			;
+		d.dispatch();
+	}
+	report(name);
+}
+
+static void own_thread(signal_dispatcher::method m, size_t iterations,
+		       const char *name) {
+	int ack[2];
+	if (pipe(ack) < 0) {
+		perror("pipe");
+		exit(1);
+	}
+	signal_dispatcher d(m);
+	d.add(SIGUSR1, [&](const signal_info &) {
+		record();
+		char c = 0;
+		ssize_t r = write(ack[1], &c, 1);
+		(void)r;
+	});
+	d.start_thread();
+	for (size_t i = 0; i < iterations; ++i) {
+		sent = bench_clock::now();
+		kill(getpid(), SIGUSR1);
+		char c;
+		while (read(ack[0], &c, 1) < 0 && errno == EINTR)
+			;
+	}
+	d.stop_thread();
+	close(ack[0]);
+	close(ack[1]);
+	report(name);
+}
+
+int main(int argc, char **argv) {
+	size_t iterations = argc > 1 ? strtoul(argv[1], nullptr, 10) : 20000;
+	latencies.reserve(iterations);
+
+	printf("%-26s %8s %8s %8s %8s\n", "us", "mean", "p50", "p99",
+	       "p99.9");
+	plain_handler(iterations);
+	poll_loop(signal_dispatcher::method::signalfd, iterations,
+		  "signalfd, poll loop");
+	poll_loop(signal_dispatcher::method::self_pipe, iterations,
+		  "self-pipe, poll loop");
+	own_thread(signal_dispatcher::method::signalfd, iterations,
+		   "signalfd, own thread");
+	own_thread(signal_dispatcher::method::self_pipe, iterations,
+		   "self-pipe, own thread");
+	return 0;
+}
@@ -0,0 +1,123 @@
+#include "signal_dispatcher.h"
+#include "libcpp-util/util/test_check.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// With a self-pipe the handler interrupts poll() itself.
+static bool wait_readable(int fd) {
+	struct pollfd p = {fd, POLLIN, 0};
+	int r;
+	while ((r = poll(&p, 1, 5000)) < 0 && errno == EINTR)
+		;
+	return r == 1;
+}
+
+template <class F>
+static bool wait_for(F done) {
+	auto end = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+	while (!done()) {
+		if (std::chrono::steady_clock::now() > end)
+			return false;
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	return true;
+}
+
+static void test_poll_loop(signal_dispatcher::method m) {
+	signal_dispatcher d(m);
+	CHECK(d.fd() >= 0);
+	CHECK(m == signal_dispatcher::method::automatic ||
+	      d.get_method() == m);
+
+	int usr1 = 0;
+	signal_info last;
+	memset(&last, 0, sizeof(last));
+	CHECK(d.add(SIGUSR1, [&](const signal_info &i) {
+		++usr1;
+		last = i;
+	}) == 0);
+	CHECK(d.dispatch() == 0);
+
+	CHECK(kill(getpid(), SIGUSR1) == 0);
+	CHECK(wait_readable(d.fd()));
+	CHECK(d.dispatch() == 1);
+	CHECK(usr1 == 1);
+	CHECK(last.signo == SIGUSR1);
+	CHECK(last.code == SI_USER);
+	CHECK(last.pid == getpid());
+	CHECK(last.uid == getuid());
+
+	union sigval v;
+	v.sival_int = 42;
+	CHECK(sigqueue(getpid(), SIGUSR1, v) == 0);
+	CHECK(wait_readable(d.fd()));
+	CHECK(d.dispatch() == 1);
+	CHECK(last.code == SI_QUEUE && last.value == 42);
+
+	// SIGCHLD carries the child and its status.
+	int chld = 0;
+	CHECK(d.add(SIGCHLD, [&](const signal_info &i) {
+		++chld;
+		last = i;
+	}) == 0);
+	pid_t pid = fork();
+	CHECK(pid >= 0);
+	if (pid == 0)
+		_exit(7);
+	CHECK(wait_readable(d.fd()));
+	CHECK(d.dispatch() == 1);
+	CHECK(chld == 1 && last.pid == pid && last.status == 7);
+	CHECK(waitpid(pid, nullptr, 0) == pid);
+
+	// One signal, one dispatcher.
+	signal_dispatcher other(m);
+	CHECK(other.add(SIGUSR1, [](const signal_info &) {}) == -1);
+	CHECK(errno == EBUSY);
+
+	CHECK(d.remove(SIGCHLD) == 0);
+	CHECK(d.remove(SIGCHLD) == -1 && errno == ENOENT);
+	CHECK(d.remove(SIGUSR1) == 0);
+	CHECK(other.add(SIGUSR1, [](const signal_info &) {}) == 0);
+	CHECK(other.remove(SIGUSR1) == 0);
+}
+
+static void test_thread(signal_dispatcher::method m) {
+	signal_dispatcher d(m);
+	std::atomic<int> n(0);
+	std::atomic<bool> off_main(false);
+	std::thread::id main_id = std::this_thread::get_id();
+	CHECK(d.add(SIGUSR2, [&](const signal_info &) {
+		off_main = std::this_thread::get_id() != main_id;
+		++n;
+	}) == 0);
+	CHECK(d.start_thread() == 0);
+	CHECK(d.start_thread() == -1 && errno == EBUSY);
+	for (int i = 0; i < 5; ++i) {
+		int before = n;
+		CHECK(kill(getpid(), SIGUSR2) == 0);
+		CHECK(wait_for([&] { return n > before; }));
+	}
+	CHECK(n == 5 && off_main);
+	d.stop_thread();
+	CHECK(d.start_thread() == 0);
+	CHECK(kill(getpid(), SIGUSR2) == 0);
+	CHECK(wait_for([&] { return n == 6; }));
+}
+
+int main() {
+	for (auto m : {signal_dispatcher::method::signalfd,
+		       signal_dispatcher::method::self_pipe}) {
+		test_poll_loop(m);
+		test_thread(m);
+	}
+	printf("signal_dispatcher_test: all passed\n");
+	return 0;
+}
@@ -8,12 +8,6 @@
 #ifndef LIBCPP_UTIL_SIGNAL_HANDLER
 #define LIBCPP_UTIL_SIGNAL_HANDLER
 
-#ifdef __GNU__
-// FIXME: No way to know if this header exists.
-#include <execinfo.h>
-#define HAVE_BACKTRACE
-#endif
-
 #include <cstring>
 #include <cstdio>
 #include <signal.h>
@@ -21,25 +15,21 @@
 #include <cstdint>
 #include <cassert>
 
-namespace {
-int ascii_to_hex(uintptr_t addr, char *out, int out_len) {
-	// TODO: Replace with guaranteed async-safe impl
-	return snprintf(out, out_len, "0x%016tX", addr);
-}
+// __GNU__ is only defined on Hurd, so this never used to be on. glibc has
+// had execinfo.h forever; other libcs (musl) may not.
+#if defined(__has_include)
+#if __has_include(<execinfo.h>)
+#include <execinfo.h>
+#define HAVE_BACKTRACE
+#endif
+#elif defined(__GLIBC__)
+#include <execinfo.h>
+#define HAVE_BACKTRACE
+#endif
 
-char *strcpy_end(char *dest, const char *src) {
-	while ((*dest++ = *src++))
-		/* Nada */;
-	return dest;
-}
-
-char *strcat_end(char *dest, const char *src) {
-	// Go to end of string
-	while (*dest)
-		dest++;
-	return strcpy_end(dest, src);
-}
-}
+#include "libcpp-util/sig/alt_stack.h"
+#include "libcpp-util/sig/async_safe.h"
+#include "libcpp-util/sig/stack_trace.h"
 
 // Simple class to gather up a bunch of information that the signal handler will
 // need, but can't safely during do during the handler execution. So this does
@@ -65,72 +55,54 @@ public:
 	}
 	static void put(int i, const char *name) {
 		assert(i < max_signal && "Signal number too large");
-		strncpy(get(i), name, max_name_len);
+		strncpy(get(i), name, max_name_len - 1);
+		get(i)[max_name_len - 1] = '\0';
 	}
 	static void register_signal(int signo) {
 		put(signo, strsignal(signo));
 	}
 };
 
-// TODO: Sweep this up. Use a sane method to build up the string. Remove the
-// async-unsafe functions. Easy since most of them can be replaced with a simple
-// while loop and don't need to be fast.
+// Prints the signal name, the faulting address and instruction where there
+// are such, and a backtrace of the interrupted code to stderr. Only
+// async-safe calls: the text is put together by hand and written with
+// write(2). backtrace_symbols_fd() doesn't allocate, but takes the dynamic
+// loader's lock to look symbols up, so a crash inside the loader can still
+// hang here; crash_reporter.h symbolizes out of process instead.
 inline void god_signal_handler(int signo, siginfo_t *info, void *uctx) {
-#if defined SIGSTKSZ && defined MINSIGSTKSZ
-	char print_scratch_space[SIGSTKSZ - MINSIGSTKSZ + 128];
-#else
-	char print_scratch_space[512];
-#endif
-	char *write_ptr = print_scratch_space;
-
-	// Grab pretty-printed signal information.
-	write_ptr = strcpy_end(write_ptr, lazy_sig_info::get(signo));
-	*write_ptr++ = ' ';
-
-	// Try to write to stderr.
+	// Try to write to stderr. fileno() doesn't lock.
 	int fd = fileno(stderr);
 	if (fd == -1)
 		fd = STDERR_FILENO;
 
-	// For SIGSEGV, print the memory address we tried to access, then the
-	// address of the instruction which referenced that address.
-	// For SIGABRT, just prints the same value twice. ...FIXME? =)
+	async_safe_format out(fd);
+	out.str(lazy_sig_info::get(signo));
+
+	// For the faults, print the memory address we tried to access, then
+	// the address of the instruction which referenced that address.
+	machine_registers regs;
 	switch (signo) {
-	case SIGABRT:
 	case SIGSEGV:
-		ascii_to_hex((uintptr_t)info->si_addr, write_ptr,
-			     print_scratch_space + sizeof(print_scratch_space) -
-				 write_ptr);
-#ifdef __x86_64__
-		// Dump the instruction that caused the signal
-		struct ucontext *uc = (struct ucontext *)uctx;
-		long insn_addr = uc->uc_mcontext.gregs[REG_RIP];
-		write_ptr = print_scratch_space + strlen(print_scratch_space);
-		write_ptr = strcat_end(write_ptr, " at instruction ");
-		ascii_to_hex(insn_addr, write_ptr,
-			     print_scratch_space + sizeof(print_scratch_space) -
-				 write_ptr);
-#endif
+	case SIGBUS:
+	case SIGILL:
+	case SIGFPE:
+		out.put(' ').hex(uintptr_t(info->si_addr), 16);
+		if (get_machine_registers(uctx, &regs))
+			out.str(" at instruction ").hex(regs.pc, 16);
 	}
+	out.put('\n');
+	out.flush();
 
-	strcat(write_ptr, "\n");
-
-	// FIXME: We'd want this to be non-blocking, in case we get a stop
-	// signal if we don't have a terminal to print to.
-	write(fd, print_scratch_space, strlen(print_scratch_space));
-
+	uintptr_t frames[64];
+	size_t nframes = signal_backtrace(uctx, frames, 64);
 #ifdef HAVE_BACKTRACE
-	// FIXME: The backtrace is helpful but uses more stack space than the
-	// average signal handler, so at least don't do it if we're not on the
-	// program stack. Also, ...don't do it at all because it's not
-	// async-safe.
-	stack_t old_stack;
-	sigaltstack(nullptr, &old_stack);
-	if (old_stack.ss_flags != SS_ONSTACK) {
-		void *stack_frames[64];
-		int nframes = backtrace(stack_frames, 64);
-		backtrace_symbols_fd(stack_frames, nframes, fd);
-	}
+	void *symbol_frames[64];
+	for (size_t i = 0; i < nframes; ++i)
+		symbol_frames[i] = reinterpret_cast<void *>(frames[i]);
+	backtrace_symbols_fd(symbol_frames, int(nframes), fd);
+#else
+	for (size_t i = 0; i < nframes; ++i)
+		out.hex(frames[i], 16).put('\n');
 #endif
 }
 
@@ -153,21 +125,17 @@ inline int register_to_god_handler(int signo, struct sigaction *new_sa,
 	    reraise ? god_reraise_handler : god_signal_handler;
 	new_sa->sa_flags |= SA_SIGINFO;
 
-	// Make sure that the string for the signal is available to us.
+	// Make sure that the string for the signal is available to us, and
+	// that the unwinder has been loaded.
 	lazy_sig_info::register_signal(signo);
+	stack_trace_prepare();
 
-	// FIXME: This needs error checking.
+	// An overflow can only be reported from an alternate stack, and each
+	// thread needs its own: this one, and thread_pool workers from now on.
 	if (signo == SIGSEGV) {
-		// If there's no alternate signal stack, set
-		stack_t new_stack, old_stack;
-		sigaltstack(nullptr, &old_stack);
-		if (old_stack.ss_flags == SS_DISABLE) {
-			static char alt_stack[SIGSTKSZ * 2];
-			new_stack.ss_sp = alt_stack;
-			new_stack.ss_size = sizeof(alt_stack);
-			new_stack.ss_flags = 0;
-			sigaltstack(&new_stack, nullptr);
-		}
+		if (alt_stack::ensure() < 0)
+			return -1;
+		alt_stack::use_in_thread_pools();
 		new_sa->sa_flags |= SA_ONSTACK;
 	}
 
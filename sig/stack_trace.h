@@ -0,0 +1,201 @@
+//============================================================================
+//                                  libcpp-util
+//                   A simple odds-n-ends library for C++11
+//
+//         Licensed under modified BSD license. See LICENSE for details.
+//============================================================================
+
+#ifndef LIBCPP_UTIL_STACK_TRACE_H
+#define LIBCPP_UTIL_STACK_TRACE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <signal.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+#if defined(__GNUC__) && defined(__has_include)
+#if __has_include(<unwind.h>)
+#include <unwind.h>
+#define STACK_TRACE_HAVE_UNWIND 1
+#endif
+#endif
+
+// Stack walking that is safe in a signal handler: return addresses come
+// either from the unwind tables (_Unwind_Backtrace, the same thing glibc's
+// backtrace() uses, which works with -fomit-frame-pointer) or by following
+// the frame pointer chain, which is much cheaper but needs code built with
+// -fno-omit-frame-pointer. Neither allocates. The first _Unwind_Backtrace
+// in a process may load libgcc_s, so call stack_trace_prepare() once
+// before relying on it in a handler.
+
+// Copies n bytes at addr into out, or returns false if any of them isn't
+// mapped readable, without faulting. Used to follow pointers off a stack
+// that may be corrupt.
+inline bool safe_read(const void *addr, void *out, size_t n) {
+#if defined(__linux__) && defined(SYS_process_vm_readv)
+	struct iovec local = {out, n};
+	struct iovec remote = {const_cast<void *>(addr), n};
+	return ::syscall(SYS_process_vm_readv, ::getpid(), &local, 1UL,
+			 &remote, 1UL, 0UL) == ssize_t(n);
+#else
+	// No way to probe; trust the caller's bounds checks.
+	const char *p = static_cast<const char *>(addr);
+	char *o = static_cast<char *>(out);
+	for (size_t i = 0; i < n; ++i)
+		o[i] = p[i];
+	return true;
+#endif
+}
+
+// The registers a stack walk starts from, out of a handler's ucontext.
+struct machine_registers {
+	uintptr_t pc;
+	uintptr_t sp;
+	uintptr_t fp;
+};
+
+inline bool get_machine_registers(const void *uctx, machine_registers *r) {
+	const ucontext_t *uc = static_cast<const ucontext_t *>(uctx);
+#if defined(__x86_64__) && defined(__linux__)
+	r->pc = uintptr_t(uc->uc_mcontext.gregs[REG_RIP]);
+	r->sp = uintptr_t(uc->uc_mcontext.gregs[REG_RSP]);
+	r->fp = uintptr_t(uc->uc_mcontext.gregs[REG_RBP]);
+	return true;
+#elif defined(__i386__) && defined(__linux__)
+	r->pc = uintptr_t(uc->uc_mcontext.gregs[REG_EIP]);
+	r->sp = uintptr_t(uc->uc_mcontext.gregs[REG_ESP]);
+	r->fp = uintptr_t(uc->uc_mcontext.gregs[REG_EBP]);
+	return true;
+#elif defined(__aarch64__) && defined(__linux__)
+	r->pc = uintptr_t(uc->uc_mcontext.pc);
+	r->sp = uintptr_t(uc->uc_mcontext.sp);
+	r->fp = uintptr_t(uc->uc_mcontext.regs[29]);
+	return true;
+#else
+	(void)uc;
+	(void)r;
+	return false;
+#endif
+}
+
+// Follows the frame pointer chain from fp. On x86 and AArch64 a frame
+// record is the caller's frame pointer followed by the return address.
+// frames[0] is pc. Stops at a null return address, a frame pointer that
+// doesn't move up the stack (by at most max_frame bytes), or one that
+// can't be read. Returns the number of frames.
+//
+// Each 4KB of stack is probed with safe_read() once, and frame records
+// within it are then read directly, so a walk costs a system call or two
+// rather than one per frame.
+inline size_t walk_frame_pointers(uintptr_t pc, uintptr_t fp,
+				  uintptr_t *frames, size_t max,
+				  uintptr_t max_frame = 1 << 24) {
+	const uintptr_t page_mask = ~uintptr_t(4095);
+	uintptr_t readable = 1;
+	size_t n = 0;
+	if (max && pc)
+		frames[n++] = pc;
+	while (n < max && fp && !(fp & (sizeof(uintptr_t) - 1))) {
+		uintptr_t rec[2];
+		uintptr_t last = fp + sizeof(rec) - 1;
+		if ((fp & page_mask) == readable &&
+		    (last & page_mask) == readable) {
+			const uintptr_t *p =
+				reinterpret_cast<const uintptr_t *>(fp);
+			rec[0] = p[0];
+			rec[1] = p[1];
+		} else if (safe_read(reinterpret_cast<const void *>(fp), rec,
+				     sizeof(rec))) {
+			readable = last & page_mask;
+		} else {
+			break;
+		}
+		if (!rec[1])
+			break;
+		frames[n++] = rec[1];
+		if (rec[0] <= fp || rec[0] - fp > max_frame)
+			break;
+		fp = rec[0];
+	}
+	return n;
+}
+
+#ifdef STACK_TRACE_HAVE_UNWIND
+namespace stack_trace_detail {
+
+struct unwind_state {
+	uintptr_t *frames;
+	size_t max;
+	size_t n;
+	// Frames are dropped until this pc turns up; 0 keeps all of them.
+	uintptr_t start_pc;
+};
+
+inline _Unwind_Reason_Code unwind_step(struct _Unwind_Context *ctx,
+				       void *arg) {
+	unwind_state *s = static_cast<unwind_state *>(arg);
+	uintptr_t pc = uintptr_t(_Unwind_GetIP(ctx));
+	if (!pc)
+		return _URC_END_OF_STACK;
+	if (s->start_pc) {
+		// Depending on how the unwinder treats the signal frame, the
+		// interrupted pc may come back as is or one past it.
+		if (pc != s->start_pc && pc != s->start_pc + 1)
+			return _URC_NO_REASON;
+		pc = s->start_pc;
+		s->start_pc = 0;
+	}
+	s->frames[s->n++] = pc;
+	return s->n < s->max ? _URC_NO_REASON : _URC_END_OF_STACK;
+}
+
+} // End namespace stack_trace_detail
+
+// Walks the unwind tables from the caller. If start_pc is given, frames
+// above it (a signal handler's own) are left out and the trace begins at
+// start_pc.
+inline size_t unwind_backtrace(uintptr_t *frames, size_t max,
+			       uintptr_t start_pc = 0) {
+	if (!max)
+		return 0;
+	stack_trace_detail::unwind_state s = {frames, max, 0, start_pc};
+	_Unwind_Backtrace(stack_trace_detail::unwind_step, &s);
+	return s.n;
+}
+#endif
+
+inline void stack_trace_prepare() {
+#ifdef STACK_TRACE_HAVE_UNWIND
+	uintptr_t frames[2];
+	unwind_backtrace(frames, 2);
+#endif
+}
+
+// The stack of the code a signal interrupted, from inside the handler:
+// through the unwind tables where possible, and by frame pointers where
+// that fails or there are none. frames[0] is the interrupted pc; the rest
+// are return addresses.
+inline size_t signal_backtrace(const void *uctx, uintptr_t *frames,
+			       size_t max) {
+	machine_registers r;
+	if (!get_machine_registers(uctx, &r)) {
+#ifdef STACK_TRACE_HAVE_UNWIND
+		return unwind_backtrace(frames, max);
+#else
+		return 0;
+#endif
+	}
+#ifdef STACK_TRACE_HAVE_UNWIND
+	size_t n = unwind_backtrace(frames, max, r.pc);
+	if (n > 1)
+		return n;
+#endif
+	return walk_frame_pointers(r.pc, r.fp, frames, max);
+}
+#endif
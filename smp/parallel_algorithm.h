@@ -0,0 +1,309 @@
+//============================================================================
+//                                  libcpp-util
+//                   A simple odds-n-ends library for C++11
+//
+//         Licensed under modified BSD license. See LICENSE for details.
+//============================================================================
+
+#ifndef LIBCPP_UTIL_PARALLEL_ALGORITHM_H
+#define LIBCPP_UTIL_PARALLEL_ALGORITHM_H
+
+#include "libcpp-util/cxx14/array_ref.h"
+#include "libcpp-util/smp/thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <type_traits>
+#include <vector>
+
+// Reductions, transforms and searches over array_ref, split into chunks that
+// run on a thread_pool. Inside a chunk, arithmetic element types are
+// accumulated in several independent lanes so the compiler can keep them in
+// vector registers; other types go through a plain loop.
+//
+// Like std::reduce, the operation given to parallel_reduce and
+// parallel_inclusive_scan must be associative and commutative: the lanes and
+// chunks regroup it. Chunk results are always combined in index order, so
+// the answer depends only on where the chunk boundaries fall. By default
+// that is a function of the pool size; set parallel_options::deterministic to
+// pin the boundaries to multiples of grain, so floating point sums come out
+// bit-identical no matter how many threads ran them.
+namespace cpputil {
+
+struct parallel_options {
+	// Pool to run on; the process-wide default pool if null.
+	thread_pool* pool;
+	// Smallest chunk worth a task. Inputs up to this size run inline.
+	std::size_t grain;
+	bool deterministic;
+
+	parallel_options(thread_pool* pool = nullptr,
+			 std::size_t grain = 32 * 1024,
+			 bool deterministic = false)
+		: pool(pool), grain(grain), deterministic(deterministic) {
+	}
+};
+
+namespace parallel_detail {
+
+// Independent accumulators per chunk; enough to fill two AVX registers of
+// floats and hide the add latency.
+static const std::size_t lanes = 8;
+
+struct chunking {
+	std::size_t n;
+	std::size_t chunk;
+	std::size_t count;
+
+	std::size_t begin(std::size_t i) const {
+		return i * chunk;
+	}
+	std::size_t end(std::size_t i) const {
+		return std::min(n, (i + 1) * chunk);
+	}
+};
+
+inline thread_pool& pool_of(const parallel_options& opt) {
+	return opt.pool ? *opt.pool : thread_pool::default_pool();
+}
+
+inline chunking make_chunks(std::size_t n, const parallel_options& opt) {
+	std::size_t grain = std::max<std::size_t>(opt.grain, 1);
+	std::size_t chunk = grain;
+	if (!opt.deterministic) {
+		// A few chunks per thread, for balance.
+		std::size_t target = 4 * std::size_t(pool_of(opt).size());
+		chunk = std::max(grain, (n + target - 1) / target);
+	}
+	chunking c = {n, chunk, n ? (n + chunk - 1) / chunk : 0};
+	return c;
+}
+
+// Runs fn(chunk index) for every chunk, inline if there is only one.
+template <class F>
+void for_chunks(const chunking& c, const parallel_options& opt, F fn) {
+	if (c.count <= 1) {
+		for (std::size_t i = 0; i < c.count; ++i)
+			fn(i);
+		return;
+	}
+	pool_of(opt).parallel_for(c.count, fn);
+}
+
+template <typename T>
+struct vectorizable
+	: std::integral_constant<bool, std::is_arithmetic<T>::value> {};
+
+// Folds p[0, n) with op, n > 0.
+template <typename T, class Op>
+T fold(const T* p, std::size_t n, Op op, std::false_type) {
+	T acc = p[0];
+	for (std::size_t i = 1; i < n; ++i)
+		acc = op(acc, p[i]);
+	return acc;
+}
+
+template <typename T, class Op>
+T fold(const T* p, std::size_t n, Op op, std::true_type) {
+	if (n < 2 * lanes)
+		return fold(p, n, op, std::false_type());
+	T acc[lanes];
+	for (std::size_t k = 0; k < lanes; ++k)
+		acc[k] = p[k];
+	std::size_t i = lanes;
+	for (; i + lanes <= n; i += lanes)
+		for (std::size_t k = 0; k < lanes; ++k)
+			acc[k] = op(acc[k], p[i + k]);
+	for (; i < n; ++i)
+		acc[0] = op(acc[0], p[i]);
+	// Pairwise, so the tree is fixed.
+	for (std::size_t w = lanes / 2; w; w /= 2)
+		for (std::size_t k = 0; k < w; ++k)
+			acc[k] = op(acc[k], acc[k + w]);
+	return acc[0];
+}
+
+template <typename T, class Op>
+T fold(const T* p, std::size_t n, Op op) {
+	return fold(p, n, op, vectorizable<T>());
+}
+
+// Ternaries rather than std::min/max: they vectorize, and they keep the
+// earlier value on ties like min_element does.
+struct min_op {
+	template <typename T>
+	T operator()(const T& a, const T& b) const {
+		return b < a ? b : a;
+	}
+};
+
+struct max_op {
+	template <typename T>
+	T operator()(const T& a, const T& b) const {
+		return a < b ? b : a;
+	}
+};
+
+} // End namespace parallel_detail
+
+// Combines init with every element using op.
+template <typename T, class Op>
+T parallel_reduce(array_ref<T> in, T init, Op op,
+		  const parallel_options& opt = parallel_options()) {
+	using namespace parallel_detail;
+	chunking c = make_chunks(in.size(), opt);
+	std::vector<T> partial(c.count);
+	for_chunks(c, opt, [&](std::size_t i) {
+		partial[i] = fold(in.data() + c.begin(i), c.end(i) - c.begin(i),
+				  op);
+	});
+	for (const T& x : partial)
+		init = op(init, x);
+	return init;
+}
+
+template <typename T>
+T parallel_sum(array_ref<T> in,
+	       const parallel_options& opt = parallel_options()) {
+	return parallel_reduce(in, T(), std::plus<T>(), opt);
+}
+
+// out[i] = f(in[i]). out must be at least as long as in.
+template <typename T, typename U, class F>
+void parallel_transform(array_ref<T> in, mutable_array_ref<U> out, F f,
+			const parallel_options& opt = parallel_options()) {
+	using namespace parallel_detail;
+	chunking c = make_chunks(in.size(), opt);
+	for_chunks(c, opt, [&](std::size_t i) {
+		const T* src = in.data();
+		U* dst = out.data();
+		for (std::size_t j = c.begin(i), e = c.end(i); j < e; ++j)
+			dst[j] = f(src[j]);
+	});
+}
+
+template <typename T, class Pred>
+std::size_t parallel_count_if(array_ref<T> in, Pred pred,
+			      const parallel_options& opt = parallel_options()) {
+	using namespace parallel_detail;
+	chunking c = make_chunks(in.size(), opt);
+	std::vector<std::size_t> partial(c.count);
+	for_chunks(c, opt, [&](std::size_t i) {
+		const T* p = in.data();
+		std::size_t count = 0;
+		for (std::size_t j = c.begin(i), e = c.end(i); j < e; ++j)
+			count += pred(p[j]) ? 1 : 0;
+		partial[i] = count;
+	});
+	std::size_t total = 0;
+	for (std::size_t x : partial)
+		total += x;
+	return total;
+}
+
+// out[i] = in[0] op in[1] op ... op in[i]. out may alias in.
+template <typename T, class Op>
+void parallel_inclusive_scan(array_ref<T> in, mutable_array_ref<T> out, Op op,
+			     const parallel_options& opt = parallel_options()) {
+	using namespace parallel_detail;
+	chunking c = make_chunks(in.size(), opt);
+	if (c.count <= 1) {
+		if (in.empty())
+			return;
+		T acc = in[0];
+		out[0] = acc;
+		for (std::size_t j = 1; j < in.size(); ++j)
+			out[j] = acc = op(acc, in[j]);
+		return;
+	}
+	// Total each chunk, scan the totals, then rescan each chunk starting
+	// from its predecessor's total.
+	std::vector<T> carry(c.count);
+	for_chunks(c, opt, [&](std::size_t i) {
+		carry[i] = fold(in.data() + c.begin(i), c.end(i) - c.begin(i),
+				op);
+	});
+	for (std::size_t i = 1; i < c.count; ++i)
+		carry[i] = op(carry[i - 1], carry[i]);
+	for_chunks(c, opt, [&](std::size_t i) {
+		const T* src = in.data();
+		T* dst = out.data();
+		std::size_t j = c.begin(i), e = c.end(i);
+		T acc = i ? op(carry[i - 1], src[j]) : src[j];
+		dst[j] = acc;
+		for (++j; j < e; ++j)
+			dst[j] = acc = op(acc, src[j]);
+	});
+}
+
+template <typename T>
+void parallel_prefix_sum(array_ref<T> in, mutable_array_ref<T> out,
+			 const parallel_options& opt = parallel_options()) {
+	parallel_inclusive_scan(in, out, std::plus<T>(), opt);
+}
+
+// Index of the first element satisfying pred, or in.size(). Chunks past an
+// earlier hit are skipped.
+template <typename T, class Pred>
+std::size_t parallel_find_if(array_ref<T> in, Pred pred,
+			     const parallel_options& opt = parallel_options()) {
+	using namespace parallel_detail;
+	chunking c = make_chunks(in.size(), opt);
+	std::atomic<std::size_t> found(in.size());
+	for_chunks(c, opt, [&](std::size_t i) {
+		const T* p = in.data();
+		std::size_t j = c.begin(i), e = c.end(i);
+		if (found.load(std::memory_order_relaxed) < j)
+			return;
+		for (; j < e; ++j)
+			if (pred(p[j]))
+				break;
+		if (j == e)
+			return;
+		std::size_t cur = found.load(std::memory_order_relaxed);
+		while (j < cur &&
+		       !found.compare_exchange_weak(cur, j,
+						    std::memory_order_relaxed))
+			;
+	});
+	return found.load();
+}
+
+template <typename T>
+std::size_t parallel_find(array_ref<T> in, const T& value,
+			  const parallel_options& opt = parallel_options()) {
+	return parallel_find_if(in, [&](const T& x) { return x == value; },
+				opt);
+}
+
+// Index of the first smallest/largest element, or in.size() if empty. The
+// value is found with a lane-wise fold, then its first position with
+// parallel_find_if, which stops early.
+template <typename T>
+std::size_t parallel_min_element(array_ref<T> in,
+				 const parallel_options& opt =
+					 parallel_options()) {
+	using namespace parallel_detail;
+	if (in.empty())
+		return in.size();
+	T best = parallel_reduce(in.slice(1), in[0], min_op(), opt);
+	return parallel_find_if(in, [&](const T& x) { return !(best < x); },
+				opt);
+}
+
+template <typename T>
+std::size_t parallel_max_element(array_ref<T> in,
+				 const parallel_options& opt =
+					 parallel_options()) {
+	using namespace parallel_detail;
+	if (in.empty())
+		return in.size();
+	T best = parallel_reduce(in.slice(1), in[0], max_op(), opt);
+	return parallel_find_if(in, [&](const T& x) { return !(x < best); },
+				opt);
+}
+
+}
+#endif
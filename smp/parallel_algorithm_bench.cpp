@@ -0,0 +1,147 @@
+// Scaling of the parallel algorithms with input size and thread count.
+//
+//   parallel_algorithm_bench [max_log2 [max_threads]]
+//
+// Sizes go from 2^10 floats up to 2^max_log2 (default 27, 512MB of input
+// plus as much again for the output). Pass 30 for the full 1G elements on a
+// machine with 8GB to spare. Build with -O2 -DNDEBUG -pthread, or -O3
+// -march=native to let the lane accumulators use AVX.
+#include "parallel_algorithm.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <numeric>
+#include <vector>
+
+using namespace cpputil;
+using bench_clock = std::chrono::steady_clock;
+volatile double bench_sink;
+
+template <typename F>
+double run(size_t elems, F f) {
+	unsigned rounds = 0;
+	double sink = 0;
+	auto start = bench_clock::now();
+	std::chrono::duration<double, std::nano> elapsed;
+	do {
+		sink += f();
+		++rounds;
+		elapsed = bench_clock::now() - start;
+	} while (elapsed.count() < 1e8 || rounds < 2);
+	bench_sink = sink;
+	return elapsed.count() / (double(rounds) * elems);
+}
+
+__attribute__((noinline)) float serial_sum(const float *p, size_t n) {
+	float s = 0;
+	for (size_t i = 0; i < n; ++i)
+		s += p[i];
+	return s;
+}
+
+int main(int argc, char **argv) {
+	unsigned max_log2 = argc > 1 ? atoi(argv[1]) : 27;
+	unsigned max_threads = argc > 2 ? atoi(argv[2])
+					: std::thread::hardware_concurrency();
+	max_threads = std::max(max_threads, 1u);
+
+	std::vector<float> in(size_t(1) << max_log2), out(in.size());
+	for (size_t i = 0; i < in.size(); ++i)
+		in[i] = float(i % 1000) * 0.001f;
+
+	std::vector<unsigned> threads;
+	for (unsigned t = 1; t < max_threads; t *= 2)
+		threads.push_back(t);
+	threads.push_back(max_threads);
+
+	printf("ns/elem; serial is a plain loop, the rest are parallel_* "
+	       "with N threads\n");
+	printf("%-14s %5s %9s", "op", "log2n", "serial");
+	for (unsigned t : threads)
+		printf(" %8uT", t);
+	printf(" %8s\n", "det");
+
+	for (unsigned lg = 10; lg <= max_log2; lg += lg < 20 ? 5 : 2) {
+		size_t n = size_t(1) << lg;
+		array_ref<float> a(in.data(), n);
+		mutable_array_ref<float> o(out.data(), n);
+		// Not present, so every search scans all of it.
+		float target = -1.0f;
+
+		struct row {
+			const char *name;
+			std::function<double()> serial;
+			std::function<double(const parallel_options &)> par;
+		} rows[] = {
+			{"sum",
+			 [&] { return serial_sum(a.data(), n); },
+			 [&](const parallel_options &opt) {
+				 return parallel_sum(a, opt);
+			 }},
+			{"transform",
+			 [&] {
+				 std::transform(a.begin(), a.end(), o.begin(),
+						[](float x) { return x * x; });
+				 return out[n / 2];
+			 },
+			 [&](const parallel_options &opt) {
+				 parallel_transform(a, o,
+						    [](float x) { return x * x; },
+						    opt);
+				 return out[n / 2];
+			 }},
+			{"count_if",
+			 [&] {
+				 return std::count_if(a.begin(), a.end(),
+						      [](float x) {
+							      return x > 0.5f;
+						      });
+			 },
+			 [&](const parallel_options &opt) {
+				 return parallel_count_if(
+					 a, [](float x) { return x > 0.5f; },
+					 opt);
+			 }},
+			{"min_element",
+			 [&] {
+				 return std::min_element(a.begin(), a.end()) -
+					a.begin();
+			 },
+			 [&](const parallel_options &opt) {
+				 return parallel_min_element(a, opt);
+			 }},
+			{"prefix_sum",
+			 [&] {
+				 std::partial_sum(a.begin(), a.end(), o.begin());
+				 return out[n - 1];
+			 },
+			 [&](const parallel_options &opt) {
+				 parallel_prefix_sum(a, o, opt);
+				 return out[n - 1];
+			 }},
+			{"find (absent)",
+			 [&] {
+				 return std::find(a.begin(), a.end(), target) -
+					a.begin();
+			 },
+			 [&](const parallel_options &opt) {
+				 return parallel_find(a, target, opt);
+			 }},
+		};
+
+		for (const row &r : rows) {
+			printf("%-14s %5u %9.3f", r.name, lg, run(n, r.serial));
+			for (unsigned t : threads) {
+				thread_pool pool(t);
+				parallel_options opt(&pool);
+				printf(" %9.3f", run(n, [&] { return r.par(opt); }));
+			}
+			// Fixed chunk boundaries cost a few more, smaller tasks.
+			thread_pool pool(max_threads);
+			parallel_options opt(&pool, 32 * 1024, true);
+			printf(" %8.3f\n", run(n, [&] { return r.par(opt); }));
+			fflush(stdout);
+		}
+	}
+}
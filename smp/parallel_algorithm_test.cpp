@@ -0,0 +1,118 @@
+#include "parallel_algorithm.h"
+#include "libcpp-util/util/test_check.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace cpputil;
+
+// Non-arithmetic, so it takes the plain loop instead of the lanes.
+struct span {
+	long lo, hi;
+};
+
+static span join(const span& a, const span& b) {
+	return span{std::min(a.lo, b.lo), std::max(a.hi, b.hi)};
+}
+
+// Every algorithm against its serial std:: counterpart, with a grain small
+// enough that most sizes split into many chunks.
+static void check_size(std::size_t n, const parallel_options& opt,
+		       std::mt19937& rng) {
+	std::vector<int> v(n);
+	for (int& x : v)
+		x = int(rng() % 1000) - 500;
+	array_ref<int> in(v);
+
+	CHECK(parallel_sum(in, opt) == std::accumulate(v.begin(), v.end(), 0));
+	CHECK(parallel_reduce(in, 7, std::plus<int>(), opt) ==
+	      std::accumulate(v.begin(), v.end(), 7));
+	std::vector<span> spans(n);
+	for (std::size_t i = 0; i < n; ++i)
+		spans[i] = span{v[i], v[i]};
+	span s = parallel_reduce(array_ref<span>(spans), span{0, 0}, join,
+				 opt);
+	int lo = 0, hi = 0;
+	for (int x : v)
+		lo = std::min(lo, x), hi = std::max(hi, x);
+	CHECK(s.lo == lo && s.hi == hi);
+
+	std::vector<long> sq(n + 1, -1);
+	parallel_transform(in, mutable_array_ref<long>(sq),
+			   [](int x) { return long(x) * x; }, opt);
+	for (std::size_t i = 0; i < n; ++i)
+		CHECK(sq[i] == long(v[i]) * v[i]);
+	CHECK(sq[n] == -1);
+
+	auto neg = [](int x) { return x < 0; };
+	CHECK(parallel_count_if(in, neg, opt) ==
+	      std::size_t(std::count_if(v.begin(), v.end(), neg)));
+
+	std::vector<int> expect(n), out(n);
+	std::partial_sum(v.begin(), v.end(), expect.begin());
+	parallel_prefix_sum(in, mutable_array_ref<int>(out), opt);
+	CHECK(out == expect);
+	std::vector<int> alias = v;
+	parallel_inclusive_scan(array_ref<int>(alias),
+				mutable_array_ref<int>(alias),
+				std::plus<int>(), opt);
+	CHECK(alias == expect);
+
+	// The first of several hits, wherever the chunks fall.
+	for (int value : {-500, 0, 499, 1000}) {
+		std::size_t first = std::size_t(
+			std::find(v.begin(), v.end(), value) - v.begin());
+		CHECK(parallel_find(in, value, opt) == first);
+	}
+	auto big = [](int x) { return x > 490; };
+	CHECK(parallel_find_if(in, big, opt) ==
+	      std::size_t(std::find_if(v.begin(), v.end(), big) - v.begin()));
+	CHECK(parallel_min_element(in, opt) ==
+	      std::size_t(std::min_element(v.begin(), v.end()) - v.begin()));
+	CHECK(parallel_max_element(in, opt) ==
+	      std::size_t(std::max_element(v.begin(), v.end()) - v.begin()));
+}
+
+static void test_against_serial() {
+	std::mt19937 rng(9);
+	for (unsigned threads : {1u, 2u, 4u}) {
+		thread_pool pool(threads);
+		for (bool det : {false, true}) {
+			parallel_options opt(&pool, 64, det);
+			for (std::size_t n :
+			     {0, 1, 7, 63, 64, 65, 1000, 100003})
+				check_size(n, opt, rng);
+		}
+	}
+	// The default pool and grain.
+	check_size(200000, parallel_options(), rng);
+}
+
+// Deterministic float sums are bit-identical whatever the pool size.
+static void test_deterministic() {
+	std::mt19937 rng(4);
+	std::uniform_real_distribution<float> d(-1e6f, 1e6f);
+	std::vector<float> v(250001);
+	for (float& x : v)
+		x = d(rng);
+	float sums[3];
+	unsigned threads[] = {1, 2, 4};
+	for (int i = 0; i < 3; ++i) {
+		thread_pool pool(threads[i]);
+		sums[i] = parallel_sum(array_ref<float>(v),
+				       parallel_options(&pool, 1000, true));
+	}
+	CHECK(std::memcmp(&sums[0], &sums[1], sizeof(float)) == 0);
+	CHECK(std::memcmp(&sums[0], &sums[2], sizeof(float)) == 0);
+}
+
+int main() {
+	test_against_serial();
+	test_deterministic();
+	printf("parallel_algorithm_test: all passed\n");
+	return 0;
+}
@@ -0,0 +1,197 @@
+//============================================================================
+//                                  libcpp-util
+//                   A simple odds-n-ends library for C++11
+//
+//         Licensed under modified BSD license. See LICENSE for details.
+//============================================================================
+
+#ifndef LIBCPP_UTIL_THREAD_POOL_H
+#define LIBCPP_UTIL_THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace cpputil {
+
+// A fixed set of worker threads pulling closures off one shared queue.
+// submit() hands back a future; post() is fire-and-forget. parallel_for()
+// is the fork-join primitive the parallel algorithms are built on: the
+// calling thread works on the loop too, so it is safe to call from inside a
+// task without starving the pool.
+//
+// The destructor runs everything already queued, then joins the workers.
+class thread_pool {
+private:
+	std::mutex lock;
+	std::condition_variable cv;
+	std::deque<std::function<void()>> tasks;
+	std::vector<std::thread> workers;
+	bool stopping;
+
+	thread_pool(const thread_pool&) = delete;
+	thread_pool& operator=(const thread_pool&) = delete;
+
+	static std::mutex& hooks_lock() {
+		static std::mutex m;
+		return m;
+	}
+
+	static std::vector<std::function<void()>>& start_hooks() {
+		static std::vector<std::function<void()>> hooks;
+		return hooks;
+	}
+
+	void worker_loop() {
+		std::vector<std::function<void()>> hooks;
+		{
+			std::lock_guard<std::mutex> l(hooks_lock());
+			hooks = start_hooks();
+		}
+		for (auto& hook : hooks)
+			hook();
+		for (;;) {
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> l(lock);
+				while (tasks.empty() && !stopping)
+					cv.wait(l);
+				if (tasks.empty())
+					return;
+				task = std::move(tasks.front());
+				tasks.pop_front();
+			}
+			task();
+		}
+	}
+
+	// Shared between parallel_for() and the helpers it posts. Helpers can
+	// start after the loop has finished, so this outlives the call.
+	struct loop_state {
+		std::atomic<std::size_t> next;
+		std::size_t n;
+		std::function<void(std::size_t)> fn;
+		std::mutex lock;
+		std::condition_variable cv;
+		std::size_t finished;
+		std::exception_ptr error;
+
+		explicit loop_state(std::size_t n) : next(0), n(n), finished(0) {
+		}
+
+		void run() {
+			std::size_t done = 0;
+			std::exception_ptr e;
+			for (std::size_t i; (i = next++) < n; ++done) {
+				try {
+					fn(i);
+				} catch (...) {
+					if (!e)
+						e = std::current_exception();
+				}
+			}
+			if (!done)
+				return;
+			std::lock_guard<std::mutex> l(lock);
+			if (e && !error)
+				error = e;
+			finished += done;
+			if (finished == n)
+				cv.notify_all();
+		}
+	};
+
+public:
+	explicit thread_pool(unsigned nthreads =
+				     std::thread::hardware_concurrency())
+		: stopping(false) {
+		nthreads = std::max(nthreads, 1u);
+		workers.reserve(nthreads);
+		for (unsigned i = 0; i < nthreads; ++i)
+			workers.emplace_back([this]() { worker_loop(); });
+	}
+
+	~thread_pool() {
+		{
+			std::lock_guard<std::mutex> l(lock);
+			stopping = true;
+		}
+		cv.notify_all();
+		for (auto& t : workers)
+			t.join();
+	}
+
+	unsigned size() const {
+		return static_cast<unsigned>(workers.size());
+	}
+
+	void post(std::function<void()> task) {
+		{
+			std::lock_guard<std::mutex> l(lock);
+			tasks.push_back(std::move(task));
+		}
+		cv.notify_one();
+	}
+
+	template <class F>
+	auto submit(F f) -> std::future<decltype(f())> {
+		typedef decltype(f()) result_type;
+		auto task = std::make_shared<std::packaged_task<result_type()>>(
+			std::move(f));
+		std::future<result_type> ret = task->get_future();
+		post([task]() { (*task)(); });
+		return ret;
+	}
+
+	// Calls fn(i) for every i in [0, n) across the pool and the calling
+	// thread, returning once all calls have. The first exception thrown by
+	// fn is rethrown here after the rest of the loop has run.
+	template <class F>
+	void parallel_for(std::size_t n, F fn) {
+		if (n == 0)
+			return;
+		if (n == 1) {
+			fn(0);
+			return;
+		}
+		auto state = std::make_shared<loop_state>(n);
+		state->fn = std::move(fn);
+		std::size_t helpers = std::min<std::size_t>(size(), n - 1);
+		for (std::size_t i = 0; i < helpers; ++i)
+			post([state]() { state->run(); });
+		state->run();
+
+		std::unique_lock<std::mutex> l(state->lock);
+		while (state->finished != n)
+			state->cv.wait(l);
+		if (state->error)
+			std::rethrow_exception(state->error);
+	}
+
+	// Runs hook at the start of every worker thread of every pool started
+	// from now on, before it takes any task: per-thread setup such as an
+	// alternate signal stack. Workers already running don't run it.
+	static void add_thread_start_hook(std::function<void()> hook) {
+		std::lock_guard<std::mutex> l(hooks_lock());
+		start_hooks().push_back(std::move(hook));
+	}
+
+	// Process-wide pool with one thread per CPU, started on first use.
+	static thread_pool& default_pool() {
+		static thread_pool pool;
+		return pool;
+	}
+};
+
+}
+#endif
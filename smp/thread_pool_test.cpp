@@ -0,0 +1,128 @@
+#include "thread_pool.h"
+#include "libcpp-util/util/test_check.h"
+#include <atomic>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace cpputil;
+
+static std::atomic<int> hooks_run(0);
+static thread_local bool hooked = false;
+
+// Values, void, references and exceptions all come back through the future.
+static void test_submit() {
+	thread_pool pool(2);
+	CHECK(pool.size() == 2);
+	std::future<int> a = pool.submit([] { return 42; });
+	std::future<std::string> b =
+		pool.submit([] { return std::string("forty-two"); });
+	std::atomic<int> ran(0);
+	std::future<void> c = pool.submit([&] { ++ran; });
+	static int target = 0;
+	std::future<int&> d = pool.submit([]() -> int& { return target; });
+	std::future<int> e =
+		pool.submit([]() -> int { throw std::runtime_error("x"); });
+	CHECK(a.get() == 42 && b.get() == "forty-two");
+	c.get();
+	CHECK(ran == 1 && &d.get() == &target);
+	bool thrown = false;
+	try {
+		e.get();
+	} catch (const std::runtime_error&) {
+		thrown = true;
+	}
+	CHECK(thrown);
+}
+
+// The destructor runs everything still queued.
+static void test_post_drains() {
+	std::atomic<int> count(0);
+	{
+		thread_pool pool(1);
+		for (int i = 0; i < 1000; ++i)
+			pool.post([&] { ++count; });
+	}
+	CHECK(count == 1000);
+}
+
+// Every index exactly once, for sizes around the number of threads.
+static void test_parallel_for() {
+	for (unsigned threads : {1u, 2u, 4u}) {
+		thread_pool pool(threads);
+		for (std::size_t n : {0, 1, 2, 3, 5, 100, 10000}) {
+			std::vector<std::atomic<int>> seen(n);
+			for (auto& s : seen)
+				s = 0;
+			pool.parallel_for(n, [&](std::size_t i) { ++seen[i]; });
+			for (auto& s : seen)
+				CHECK(s == 1);
+		}
+	}
+}
+
+// An exception is rethrown once the rest of the loop has run.
+static void test_parallel_for_throws() {
+	thread_pool pool(3);
+	std::atomic<int> ran(0);
+	bool thrown = false;
+	try {
+		pool.parallel_for(100, [&](std::size_t i) {
+			++ran;
+			if (i % 10 == 3)
+				throw std::runtime_error("loop");
+		});
+	} catch (const std::runtime_error&) {
+		thrown = true;
+	}
+	CHECK(thrown && ran == 100);
+}
+
+// Loops nested inside tasks of a one-thread pool finish: the caller works
+// on its own loop instead of waiting for a worker.
+static void test_nested() {
+	thread_pool pool(1);
+	std::atomic<int> total(0);
+	std::future<void> f = pool.submit([&] {
+		pool.parallel_for(10, [&](std::size_t) {
+			pool.parallel_for(10, [&](std::size_t) { ++total; });
+		});
+	});
+	f.get();
+	CHECK(total == 100);
+}
+
+// Hooks run once on each worker of pools started after they are added, on
+// that worker before its first task.
+static void test_start_hook() {
+	thread_pool before(1);
+	// Its worker is running before the hook goes in.
+	before.submit([] {}).get();
+	thread_pool::add_thread_start_hook([] {
+		hooked = true;
+		++hooks_run;
+	});
+	CHECK(!before.submit([] { return hooked; }).get());
+	CHECK(hooks_run == 0);
+	{
+		thread_pool after(3);
+		std::vector<std::future<bool>> f;
+		for (int i = 0; i < 30; ++i)
+			f.push_back(after.submit([] { return hooked; }));
+		for (auto& x : f)
+			CHECK(x.get());
+	}
+	CHECK(hooks_run == 3 && !hooked);
+}
+
+int main() {
+	test_submit();
+	test_post_drains();
+	test_parallel_for();
+	test_parallel_for_throws();
+	test_nested();
+	test_start_hook();
+	printf("thread_pool_test: all passed\n");
+	return 0;
+}
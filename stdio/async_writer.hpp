@@ -0,0 +1,352 @@
+#ifndef ASYNC_WRITER_HPP
+#define ASYNC_WRITER_HPP
+
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "libcpp-util/cxx14/string_ref.h"
+#include "libcpp-util/stdio/stdio_file.hpp"
+
+// Takes records from any number of threads and writes them to a descriptor
+// from a background thread, so callers never wait on the disk.
+//
+// Records are copied into a ring of buffers (two by default, hence double
+// buffering). A caller reserves space with one fetch_add on a word holding
+// the current buffer's sequence number and fill offset, copies its bytes in
+// and bumps the buffer's commit count; there are no locks on that path. The
+// caller whose reservation runs off the end of a buffer seals it and moves
+// everyone to the next one, and the background thread writes every sealed
+// buffer it has in one writev. A buffer that stays partly full is sealed by
+// the background thread after flush_interval.
+//
+// When every buffer is waiting to be written, write() either blocks until
+// one is free or, with overflow_policy drop, gives up and returns false.
+// Each record lands in the file whole; records from one thread keep their
+// order, and records from different threads interleave in reservation
+// order. Records bigger than a buffer bypass the ring: they are written
+// directly after a flush().
+class async_writer {
+public:
+	enum fsync_policy {
+		fsync_never,
+		// fdatasync before flush() returns.
+		fsync_on_flush,
+		// fdatasync after every batch the background thread writes.
+		fsync_every_write,
+	};
+
+	enum overflow_policy { block, drop };
+
+	struct options {
+		size_t buffer_size;
+		// A power of two, at least 2.
+		unsigned buffers;
+		fsync_policy sync;
+		overflow_policy overflow;
+		std::chrono::milliseconds flush_interval;
+
+		options(size_t buffer_size = 1 << 20, unsigned buffers = 2,
+			fsync_policy sync = fsync_never,
+			overflow_policy overflow = block,
+			std::chrono::milliseconds flush_interval =
+				std::chrono::milliseconds(100))
+			: buffer_size(buffer_size), buffers(buffers),
+			  sync(sync), overflow(overflow),
+			  flush_interval(flush_interval) {
+		}
+	};
+
+private:
+	// head is seq << off_bits | offset. Only the low bits of the sequence
+	// number fit; buffers divides 2^seq_bits, so they still pick the slot.
+	static const unsigned off_bits = 40;
+	static const unsigned seq_bits = 64 - off_bits;
+	static const uint64_t off_mask = (uint64_t(1) << off_bits) - 1;
+	static const uint64_t seq_mask = (uint64_t(1) << seq_bits) - 1;
+
+	struct buffer {
+		std::unique_ptr<char[]> data;
+		std::atomic<size_t> committed;
+		size_t size;	// Set when sealed.
+
+		buffer() : committed(0), size(0) {
+		}
+	};
+
+	int fd;
+	options opt;
+	size_t cap;
+	std::unique_ptr<buffer[]> bufs;
+	std::atomic<uint64_t> head;
+	std::atomic<int> err;
+	std::atomic<uint64_t> ndropped;
+
+	// The rest is under lock. Buffers [flushed, sealed) are waiting to be
+	// written; buffer sealed is being filled, unless advance_pending says
+	// it has not been handed out yet because its slot is still busy.
+	std::mutex lock;
+	std::condition_variable cv_work;
+	std::condition_variable cv_space;
+	uint64_t sealed;
+	uint64_t flushed;
+	uint64_t flush_target;
+	bool advance_pending;
+	bool stopping;
+	std::thread worker;
+
+	async_writer(const async_writer &) = delete;
+	async_writer &operator=(const async_writer &) = delete;
+
+	buffer &slot(uint64_t seq) {
+		return bufs[seq & (opt.buffers - 1)];
+	}
+
+	// Hands out buffer sealed once its previous contents are written.
+	void try_advance_locked() {
+		if (!advance_pending || sealed - flushed >= opt.buffers)
+			return;
+		slot(sealed).committed.store(0, std::memory_order_relaxed);
+		head.store((sealed & seq_mask) << off_bits,
+			   std::memory_order_release);
+		advance_pending = false;
+		cv_space.notify_all();
+	}
+
+	// Called by whoever pushed the offset of the current buffer past cap;
+	// off is where the data in it ends.
+	void seal(size_t off) {
+		std::lock_guard<std::mutex> l(lock);
+		slot(sealed).size = off;
+		++sealed;
+		advance_pending = true;
+		try_advance_locked();
+		cv_work.notify_one();
+	}
+
+	// Seals the current buffer from outside the write path. With
+	// only_if_data, an empty buffer is left alone.
+	void seal_current(bool only_if_data) {
+		uint64_t h = head.load(std::memory_order_relaxed);
+		size_t off = size_t(h & off_mask);
+		if (off > cap || (only_if_data && !off))
+			return;
+		h = head.fetch_add(cap + 1, std::memory_order_acq_rel);
+		if (size_t(h & off_mask) <= cap)
+			seal(size_t(h & off_mask));
+	}
+
+	// Waits for head to move off seq; false if the caller should drop.
+	bool wait_for_next(uint64_t seq) {
+		for (int i = 0; i < 64; ++i) {
+			if ((head.load(std::memory_order_acquire) >> off_bits) !=
+			    seq)
+				return true;
+			std::this_thread::yield();
+		}
+		std::unique_lock<std::mutex> l(lock);
+		if (opt.overflow == drop)
+			return (head.load(std::memory_order_acquire) >>
+				off_bits) != seq;
+		while ((head.load(std::memory_order_acquire) >> off_bits) == seq)
+			cv_space.wait(l);
+		return true;
+	}
+
+	bool write_all(struct iovec *iov, int n) {
+		while (n) {
+			ssize_t r = ::writev(fd, iov, n);
+			if (r < 0) {
+				if (errno == EINTR)
+					continue;
+				int expected = 0;
+				err.compare_exchange_strong(expected, errno);
+				return false;
+			}
+			size_t done = size_t(r);
+			while (n && done >= iov->iov_len) {
+				done -= iov->iov_len;
+				++iov;
+				--n;
+			}
+			if (n) {
+				iov->iov_base = static_cast<char *>(iov->iov_base) +
+						done;
+				iov->iov_len -= done;
+			}
+		}
+		return true;
+	}
+
+	void datasync() {
+		if (::fdatasync(fd) != 0) {
+			int expected = 0;
+			err.compare_exchange_strong(expected, errno);
+		}
+	}
+
+	void worker_loop() {
+		std::vector<struct iovec> iov(opt.buffers);
+		std::unique_lock<std::mutex> l(lock);
+		for (;;) {
+			if (flushed == sealed) {
+				if (flush_target > sealed) {
+					l.unlock();
+					seal_current(false);
+					l.lock();
+					continue;
+				}
+				if (stopping)
+					return;
+				if (!cv_work.wait_for(l, opt.flush_interval, [&] {
+					    return flushed != sealed ||
+						   flush_target > sealed ||
+						   stopping;
+				    })) {
+					l.unlock();
+					seal_current(true);
+					l.lock();
+				}
+				continue;
+			}
+			uint64_t first = flushed, last = sealed;
+			bool sync_now = opt.sync == fsync_every_write ||
+					(opt.sync == fsync_on_flush &&
+					 flush_target > first &&
+					 flush_target <= last);
+			l.unlock();
+
+			int n = 0;
+			for (uint64_t s = first; s != last; ++s) {
+				buffer &b = slot(s);
+				// Writers that reserved space before the seal
+				// may still be copying.
+				while (b.committed.load(std::memory_order_acquire) !=
+				       b.size)
+					std::this_thread::yield();
+				if (!b.size)
+					continue;
+				iov[n].iov_base = b.data.get();
+				iov[n].iov_len = b.size;
+				++n;
+			}
+			if (n && !err.load(std::memory_order_relaxed))
+				write_all(iov.data(), n);
+			if (sync_now)
+				datasync();
+
+			l.lock();
+			flushed = last;
+			try_advance_locked();
+			cv_space.notify_all();
+		}
+	}
+
+	void start() {
+		assert(opt.buffers >= 2 && !(opt.buffers & (opt.buffers - 1)) &&
+		       opt.buffers <= 1024 && "buffers must be a power of two");
+		assert(opt.buffer_size && opt.buffer_size < (size_t(1) << 32));
+		bufs.reset(new buffer[opt.buffers]);
+		for (unsigned i = 0; i < opt.buffers; ++i)
+			bufs[i].data.reset(new char[cap]);
+		worker = std::thread([this]() { worker_loop(); });
+	}
+
+	bool write_direct(const void *p, size_t n) {
+		flush();
+		struct iovec iov;
+		iov.iov_base = const_cast<void *>(p);
+		iov.iov_len = n;
+		return write_all(&iov, 1) && !err.load(std::memory_order_relaxed);
+	}
+
+public:
+	explicit async_writer(int fd, const options &o = options())
+		: fd(fd), opt(o), cap(o.buffer_size), head(0), err(0),
+		  ndropped(0), sealed(0), flushed(0), flush_target(0),
+		  advance_pending(false), stopping(false) {
+		start();
+	}
+
+	// Writes to f's descriptor; don't write to f directly until this is
+	// gone.
+	explicit async_writer(stdio_file &f, const options &o = options())
+		: async_writer((f.fflush(), f.fileno()), o) {
+	}
+
+	// Writes out everything accepted so far.
+	~async_writer() {
+		flush();
+		{
+			std::lock_guard<std::mutex> l(lock);
+			stopping = true;
+		}
+		cv_work.notify_one();
+		worker.join();
+	}
+
+	// Queues n bytes. False if the record was dropped or an earlier write
+	// to the descriptor failed (see error()).
+	bool write(const void *p, size_t n) {
+		if (!n)
+			return true;
+		if (n > cap)
+			return write_direct(p, n);
+		for (;;) {
+			uint64_t h = head.fetch_add(n, std::memory_order_acq_rel);
+			uint64_t seq = h >> off_bits;
+			size_t off = size_t(h & off_mask);
+			if (off + n <= cap) {
+				buffer &b = slot(seq);
+				std::memcpy(b.data.get() + off, p, n);
+				b.committed.fetch_add(n, std::memory_order_release);
+				return !err.load(std::memory_order_relaxed);
+			}
+			if (off <= cap)
+				seal(off);
+			if (!wait_for_next(seq)) {
+				ndropped.fetch_add(1, std::memory_order_relaxed);
+				return false;
+			}
+		}
+	}
+
+	bool write(string_ref s) {
+		return write(s.data(), s.size());
+	}
+
+	// Returns once everything written before the call is in the file,
+	// and with fsync_on_flush, on disk.
+	void flush() {
+		std::unique_lock<std::mutex> l(lock);
+		uint64_t target = sealed + 1;
+		if (flush_target < target)
+			flush_target = target;
+		cv_work.notify_one();
+		while (flushed < target)
+			cv_space.wait(l);
+	}
+
+	// errno of the first failed write or fdatasync, or 0.
+	int error() const {
+		return err.load(std::memory_order_relaxed);
+	}
+
+	// Records turned away under overflow_policy drop.
+	uint64_t dropped() const {
+		return ndropped.load(std::memory_order_relaxed);
+	}
+};
+#endif
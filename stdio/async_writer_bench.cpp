@@ -0,0 +1,102 @@
+// async_writer against writing log records straight to a stdio_file.
+//
+//   async_writer_bench [records_per_thread [path]]
+//
+// Each thread writes 100-byte records (default 500000 each) to path
+// (default ./async_writer_bench.tmp), timing every call. The interesting
+// columns are the tail latencies: fwrite is cheap until its buffer fills
+// and the caller does the write(2), and a logger that flushes per record
+// pays for the system call every time.
+#include "async_writer.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using bench_clock = std::chrono::steady_clock;
+
+template <typename F>
+static void run(const char *name, unsigned threads, size_t per_thread, F f) {
+	std::vector<std::vector<float>> lat(threads);
+	auto start = bench_clock::now();
+	std::vector<std::thread> th;
+	for (unsigned t = 0; t < threads; ++t) {
+		th.emplace_back([&, t] {
+			char rec[100];
+			memset(rec, 'a' + t, sizeof(rec));
+			rec[sizeof(rec) - 1] = '\n';
+			std::vector<float> &l = lat[t];
+			l.reserve(per_thread);
+			for (size_t i = 0; i < per_thread; ++i) {
+				auto s = bench_clock::now();
+				f(rec, sizeof(rec));
+				std::chrono::duration<float, std::nano> d =
+					bench_clock::now() - s;
+				l.push_back(d.count());
+			}
+		});
+	}
+	for (auto &t : th)
+		t.join();
+	std::chrono::duration<double> total = bench_clock::now() - start;
+
+	std::vector<float> all;
+	for (auto &l : lat)
+		all.insert(all.end(), l.begin(), l.end());
+	std::sort(all.begin(), all.end());
+	auto pct = [&](double p) { return all[size_t(p * (all.size() - 1))]; };
+	printf("%-28s %2uT %8.2f M/s  p50 %6.0f  p99 %8.0f  p99.99 %9.0f  "
+	       "max %9.0f ns\n",
+	       name, threads, all.size() / total.count() / 1e6, pct(0.5),
+	       pct(0.99), pct(0.9999), all.back());
+}
+
+int main(int argc, char **argv) {
+	size_t per_thread = argc > 1 ? atol(argv[1]) : 500000;
+	const char *path = argc > 2 ? argv[2] : "async_writer_bench.tmp";
+
+	for (unsigned threads : {1u, 4u}) {
+		size_t n = per_thread;
+		{
+			stdio_file f(path, "w");
+			run("stdio_file::fwrite", threads, n,
+			    [&](const char *p, size_t len) {
+				    f.fwrite(p, 1, len);
+			    });
+		}
+		{
+			stdio_file f(path, "w");
+			run("fwrite + fflush", threads, n / 10,
+			    [&](const char *p, size_t len) {
+				    f.fwrite(p, 1, len);
+				    f.fflush();
+			    });
+		}
+		{
+			stdio_file f(path, "w");
+			async_writer w(f);
+			run("async_writer", threads, n,
+			    [&](const char *p, size_t len) { w.write(p, len); });
+		}
+		{
+			stdio_file f(path, "w");
+			async_writer w(f, async_writer::options(1 << 16, 8));
+			run("async_writer 8x64K", threads, n,
+			    [&](const char *p, size_t len) { w.write(p, len); });
+		}
+		{
+			stdio_file f(path, "w");
+			async_writer w(f, async_writer::options(
+						  1 << 20, 2,
+						  async_writer::fsync_every_write));
+			run("async_writer fsync/batch", threads, n,
+			    [&](const char *p, size_t len) { w.write(p, len); });
+		}
+	}
+	unlink(path);
+}
@@ -0,0 +1,127 @@
+#include "async_writer.hpp"
+#include "libcpp-util/util/test_check.h"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+
+static const char *const path = "async_writer_test.tmp";
+
+static const unsigned producers = 4;
+static const unsigned records = 20000;
+
+// "<producer> <seq> <filler>\n", a length that varies with seq so records
+// straddle buffer ends at every offset. Every hundredth is too long for a
+// buffer and goes around the ring.
+static std::string make_record(unsigned p, unsigned seq, size_t cap) {
+	std::string r = std::to_string(p) + " " + std::to_string(seq) + " ";
+	size_t fill = seq % 100 == 99 ? cap + seq % 7 : seq * 7 % 61;
+	r.append(fill, char('a' + p));
+	r += '\n';
+	return r;
+}
+
+static std::string read_all(int fd, bool slow) {
+	std::string s;
+	char buf[65536];
+	ssize_t n;
+	while ((n = read(fd, buf, slow ? 4096 : sizeof(buf))) > 0) {
+		s.append(buf, size_t(n));
+		if (slow)
+			usleep(1000);
+	}
+	CHECK(n == 0);
+	return s;
+}
+// Producers write concurrently, one now and then flushing; afterwards the
+// output holds exactly the records write() accepted, each whole, in order
+// per producer. With slow, it goes to a pipe drained slowly enough that
+// the ring fills up; buffers must then stay small enough that every write
+// to the pipe is atomic.
+static void run(const async_writer::options &o, bool slow = false) {
+	int fds[2] = {-1, -1};
+	std::string data;
+	std::thread reader;
+	if (slow) {
+		CHECK(pipe(fds) == 0);
+		reader = std::thread([&] { data = read_all(fds[0], true); });
+	}
+	int fd = slow ? fds[1] : open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	CHECK(fd >= 0);
+	std::vector<std::vector<bool>> accepted(
+		producers, std::vector<bool>(records));
+	uint64_t dropped;
+	{
+		async_writer w(fd, o);
+		std::vector<std::thread> threads;
+		for (unsigned p = 0; p < producers; ++p) {
+			threads.emplace_back([&, p] {
+				size_t cap = o.buffer_size;
+				for (unsigned i = 0; i < records; ++i) {
+					std::string r = make_record(p, i, cap);
+					accepted[p][i] = w.write(r);
+					if (p == 0 && i % 5000 == 0)
+						w.flush();
+				}
+			});
+		}
+		for (auto &t : threads)
+			t.join();
+		dropped = w.dropped();
+		CHECK(w.error() == 0);
+	}
+	close(fd);
+	if (slow) {
+		reader.join();
+		close(fds[0]);
+	} else {
+		fd = open(path, O_RDONLY);
+		CHECK(fd >= 0);
+		data = read_all(fd, false);
+		close(fd);
+	}
+	std::vector<unsigned> next(producers, 0);
+	uint64_t got = 0;
+	for (size_t pos = 0; pos < data.size();) {
+		char *end;
+		unsigned long p = strtoul(data.c_str() + pos, &end, 10);
+		unsigned long seq = strtoul(end, &end, 10);
+		CHECK(*end == ' ');
+		CHECK(p < producers && seq < records && accepted[p][seq]);
+		CHECK(seq >= next[p]);
+		for (unsigned i = next[p]; i < seq; ++i)
+			CHECK(!accepted[p][i]);
+		std::string r = make_record(unsigned(p), unsigned(seq),
+					    o.buffer_size);
+		CHECK(data.compare(pos, r.size(), r) == 0);
+		pos += r.size();
+		next[p] = seq + 1;
+		++got;
+	}
+	uint64_t total_accepted = 0;
+	for (unsigned p = 0; p < producers; ++p) {
+		for (unsigned i = next[p]; i < records; ++i)
+			CHECK(!accepted[p][i]);
+		for (unsigned i = 0; i < records; ++i)
+			total_accepted += accepted[p][i];
+	}
+	CHECK(got == total_accepted);
+	CHECK(got + dropped == uint64_t(producers) * records);
+	CHECK(o.overflow == async_writer::drop ? dropped > 0 : dropped == 0);
+}
+
+int main() {
+	typedef async_writer::options options;
+	run(options(1 << 16));
+	run(options(256, 2));
+	run(options(1000, 8));
+	options drop(256, 2, async_writer::fsync_never, async_writer::drop,
+		     std::chrono::milliseconds(1));
+	run(drop, true);
+	unlink(path);
+	printf("async_writer_test: all passed\n");
+	return 0;
+}
@@ -0,0 +1,807 @@
+#ifndef COMPRESSED_STREAM_HPP
+#define COMPRESSED_STREAM_HPP
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "libcpp-util/cxx14/string_ref.h"
+#include "libcpp-util/smp/thread_pool.h"
+#include "libcpp-util/stdio/stdio_file.hpp"
+
+// Each codec is built in when its header is found, and then needs its
+// library at link time: -lz, -lzstd or -llz4. Define
+// COMPRESSED_STREAM_NO_ZLIB (_ZSTD, _LZ4) to leave one out anyway.
+#if defined(__has_include)
+#if __has_include(<zlib.h>) && !defined(COMPRESSED_STREAM_NO_ZLIB)
+#include <zlib.h>
+#define COMPRESSED_STREAM_HAVE_ZLIB 1
+#endif
+#if __has_include(<zstd.h>) && !defined(COMPRESSED_STREAM_NO_ZSTD)
+#include <zstd.h>
+#define COMPRESSED_STREAM_HAVE_ZSTD 1
+#endif
+#if __has_include(<lz4frame.h>) && !defined(COMPRESSED_STREAM_NO_LZ4)
+#include <lz4frame.h>
+#define COMPRESSED_STREAM_HAVE_LZ4 1
+#endif
+#endif
+
+// Streaming compression in and out of a stdio_file or a descriptor, in the
+// formats of the gzip, zstd and lz4 tools, so the output can be read back
+// with them and their output read here; no more piping through a child
+// process.
+//
+// compressed_writer cuts what it is given into blocks of block_size bytes
+// and compresses each as a complete frame (a gzip member for gzip). The
+// formats allow frames back to back, so the result is one ordinary stream,
+// at a small cost in ratio. Given a thread_pool, blocks are compressed on
+// it while the caller fills the next, and are written in order.
+//
+// compressed_reader decodes one stream, or several back to back, on the
+// calling thread. With codec::automatic it goes by the first bytes, and
+// passes through input in none of the three formats unchanged.
+//
+// open_compressed() wraps either in a stdio_file, so line_reader, print()
+// and the rest work on compressed data. Failures are reported as with
+// stdio_file: by return value, with the errno in error(). Corrupt input is
+// EBADMSG; a codec that isn't built in is ENOTSUP.
+enum class codec {
+	none,
+	gzip,
+	zstd,
+	lz4,
+	// Writing: the best one built in. Reading: whatever the data is.
+	automatic,
+};
+
+inline bool codec_available(codec c) {
+	switch (c) {
+	case codec::none:
+	case codec::automatic:
+		return true;
+	case codec::gzip:
+#ifdef COMPRESSED_STREAM_HAVE_ZLIB
+		return true;
+#else
+		return false;
+#endif
+	case codec::zstd:
+#ifdef COMPRESSED_STREAM_HAVE_ZSTD
+		return true;
+#else
+		return false;
+#endif
+	case codec::lz4:
+#ifdef COMPRESSED_STREAM_HAVE_LZ4
+		return true;
+#else
+		return false;
+#endif
+	}
+	return false;
+}
+
+struct compress_options {
+	codec method;
+	// 0 for the codec's default; otherwise as for the command line tool.
+	int level;
+	size_t block_size;
+	// Compress blocks here instead of on the writing thread.
+	cpputil::thread_pool *pool;
+
+	compress_options(codec method = codec::automatic, int level = 0,
+			 size_t block_size = 1 << 20,
+			 cpputil::thread_pool *pool = nullptr)
+		: method(method), level(level), block_size(block_size),
+		  pool(pool) {
+	}
+};
+
+namespace compress_detail {
+
+// Where compressed bytes come from or go: a FILE, through stdio_read_some()
+// and fwrite, or a descriptor.
+class endpoint {
+private:
+	FILE *F;
+	int fd;
+
+public:
+	explicit endpoint(FILE *F) : F(F), fd(-1) {
+	}
+	explicit endpoint(int fd) : F(nullptr), fd(fd) {
+	}
+
+	// As read(2), so a frame that has arrived is decoded without
+	// waiting for the buffer to fill.
+	ssize_t read(void *p, size_t n) {
+		if (F)
+			return stdio_read_some(F, p, n);
+		for (;;) {
+			ssize_t r = ::read(fd, p, n);
+			if (r >= 0 || errno != EINTR)
+				return r;
+		}
+	}
+
+	bool write(const void *p, size_t n) {
+		if (F) {
+			if (::fwrite(p, 1, n, F) == n)
+				return true;
+			if (!errno)
+				errno = EIO;
+			return false;
+		}
+		const char *b = static_cast<const char *>(p);
+		while (n) {
+			ssize_t r = ::write(fd, b, n);
+			if (r < 0) {
+				if (errno == EINTR)
+					continue;
+				return false;
+			}
+			b += r;
+			n -= size_t(r);
+		}
+		return true;
+	}
+
+	bool flush() {
+		return !F || ::fflush(F) == 0;
+	}
+};
+
+struct buffer {
+	std::unique_ptr<char[]> data;
+	size_t cap;
+	size_t size;
+
+	buffer() : cap(0), size(0) {
+	}
+
+	// Grows to at least n bytes, keeping the size in use.
+	void reserve(size_t n) {
+		if (n > cap) {
+			std::unique_ptr<char[]> bigger(new char[n]);
+			if (size)
+				std::memcpy(bigger.get(), data.get(), size);
+			data = std::move(bigger);
+			cap = n;
+		}
+	}
+};
+
+inline codec best_available() {
+#if defined(COMPRESSED_STREAM_HAVE_ZSTD)
+	return codec::zstd;
+#elif defined(COMPRESSED_STREAM_HAVE_LZ4)
+	return codec::lz4;
+#elif defined(COMPRESSED_STREAM_HAVE_ZLIB)
+	return codec::gzip;
+#else
+	return codec::none;
+#endif
+}
+
+#ifdef COMPRESSED_STREAM_HAVE_ZSTD
+// Setting up a context costs about as much as compressing a few KB, so
+// each thread keeps one.
+struct zstd_cctx {
+	ZSTD_CCtx *ctx;
+
+	zstd_cctx() : ctx(ZSTD_createCCtx()) {
+	}
+	~zstd_cctx() {
+		ZSTD_freeCCtx(ctx);
+	}
+};
+#endif
+
+// Compresses in into out as one complete frame.
+inline bool compress_block(codec c, int level, const buffer &in,
+			   buffer &out) {
+	(void)level;
+	// Nothing of the last block to keep when out grows.
+	out.size = 0;
+	switch (c) {
+	case codec::none:
+	case codec::automatic:
+		break;
+	case codec::gzip: {
+#ifdef COMPRESSED_STREAM_HAVE_ZLIB
+		z_stream z;
+		std::memset(&z, 0, sizeof(z));
+		// 16 + window bits asks for a gzip header.
+		if (deflateInit2(&z, level ? level : Z_DEFAULT_COMPRESSION,
+				 Z_DEFLATED, 16 + 15, 8,
+				 Z_DEFAULT_STRATEGY) != Z_OK)
+			return false;
+		out.reserve(deflateBound(&z, uLong(in.size)));
+		z.next_in = reinterpret_cast<Bytef *>(in.data.get());
+		z.avail_in = uInt(in.size);
+		z.next_out = reinterpret_cast<Bytef *>(out.data.get());
+		z.avail_out = uInt(out.cap);
+		int r = deflate(&z, Z_FINISH);
+		out.size = out.cap - z.avail_out;
+		deflateEnd(&z);
+		return r == Z_STREAM_END;
+#else
+		return false;
+#endif
+	}
+	case codec::zstd: {
+#ifdef COMPRESSED_STREAM_HAVE_ZSTD
+		static thread_local zstd_cctx cctx;
+		if (!cctx.ctx)
+			return false;
+		if (!level)
+			level = ZSTD_CLEVEL_DEFAULT;
+		out.reserve(ZSTD_compressBound(in.size));
+		size_t r = ZSTD_compressCCtx(cctx.ctx, out.data.get(), out.cap,
+					     in.data.get(), in.size, level);
+		if (ZSTD_isError(r))
+			return false;
+		out.size = r;
+		return true;
+#else
+		return false;
+#endif
+	}
+	case codec::lz4: {
+#ifdef COMPRESSED_STREAM_HAVE_LZ4
+		LZ4F_preferences_t prefs;
+		std::memset(&prefs, 0, sizeof(prefs));
+		prefs.compressionLevel = level;
+		prefs.frameInfo.contentSize = in.size;
+		out.reserve(LZ4F_compressFrameBound(in.size, &prefs));
+		size_t r = LZ4F_compressFrame(out.data.get(), out.cap,
+					      in.data.get(), in.size, &prefs);
+		if (LZ4F_isError(r))
+			return false;
+		out.size = r;
+		return true;
+#else
+		return false;
+#endif
+	}
+	}
+	out.reserve(in.size);
+	std::memcpy(out.data.get(), in.data.get(), in.size);
+	out.size = in.size;
+	return true;
+}
+
+// The streaming decoder for one codec. Frames may follow one another.
+class decoder {
+private:
+	codec c;
+	// Set while a frame is started but not finished.
+	bool mid_frame;
+#ifdef COMPRESSED_STREAM_HAVE_ZLIB
+	z_stream z;
+	bool z_init;
+#endif
+#ifdef COMPRESSED_STREAM_HAVE_ZSTD
+	ZSTD_DCtx *zd;
+#endif
+#ifdef COMPRESSED_STREAM_HAVE_LZ4
+	LZ4F_dctx *ld;
+#endif
+
+public:
+	decoder() : c(codec::none), mid_frame(false) {
+#ifdef COMPRESSED_STREAM_HAVE_ZLIB
+		z_init = false;
+#endif
+#ifdef COMPRESSED_STREAM_HAVE_ZSTD
+		zd = nullptr;
+#endif
+#ifdef COMPRESSED_STREAM_HAVE_LZ4
+		ld = nullptr;
+#endif
+	}
+
+	decoder(const decoder &) = delete;
+	decoder &operator=(const decoder &) = delete;
+
+	~decoder() {
+#ifdef COMPRESSED_STREAM_HAVE_ZLIB
+		if (z_init)
+			inflateEnd(&z);
+#endif
+#ifdef COMPRESSED_STREAM_HAVE_ZSTD
+		ZSTD_freeDCtx(zd);
+#endif
+#ifdef COMPRESSED_STREAM_HAVE_LZ4
+		if (ld)
+			LZ4F_freeDecompressionContext(ld);
+#endif
+	}
+
+	// Sets up for c; ENOTSUP if it isn't built in.
+	int init(codec c) {
+		this->c = c;
+		switch (c) {
+		case codec::none:
+			return 0;
+		case codec::gzip:
+#ifdef COMPRESSED_STREAM_HAVE_ZLIB
+			std::memset(&z, 0, sizeof(z));
+			// 16 + window bits: gzip only.
+			if (inflateInit2(&z, 16 + 15) != Z_OK)
+				return ENOMEM;
+			z_init = true;
+			return 0;
+#else
+			break;
+#endif
+		case codec::zstd:
+#ifdef COMPRESSED_STREAM_HAVE_ZSTD
+			zd = ZSTD_createDCtx();
+			return zd ? 0 : ENOMEM;
+#else
+			break;
+#endif
+		case codec::lz4:
+#ifdef COMPRESSED_STREAM_HAVE_LZ4
+			if (LZ4F_isError(LZ4F_createDecompressionContext(
+				    &ld, LZ4F_VERSION)))
+				return ENOMEM;
+			return 0;
+#else
+			break;
+#endif
+		case codec::automatic:
+			break;
+		}
+		return ENOTSUP;
+	}
+
+	// Decodes from in[0, *in_n) into out[0, *out_n), then sets *in_n and
+	// *out_n to how much was consumed and produced. False if the data is
+	// corrupt.
+	bool run(const char *in, size_t *in_n, char *out, size_t *out_n) {
+		switch (c) {
+		case codec::gzip: {
+#ifdef COMPRESSED_STREAM_HAVE_ZLIB
+			z.next_in = reinterpret_cast<Bytef *>(
+				const_cast<char *>(in));
+			z.avail_in = uInt(*in_n);
+			z.next_out = reinterpret_cast<Bytef *>(out);
+			z.avail_out = uInt(*out_n);
+			int r = inflate(&z, Z_NO_FLUSH);
+			*in_n -= z.avail_in;
+			*out_n -= z.avail_out;
+			if (r == Z_STREAM_END) {
+				// On to the next member, if there is one.
+				mid_frame = false;
+				return inflateReset(&z) == Z_OK;
+			}
+			if (*in_n)
+				mid_frame = true;
+			return r == Z_OK || r == Z_BUF_ERROR;
+#else
+			break;
+#endif
+		}
+		case codec::zstd: {
+#ifdef COMPRESSED_STREAM_HAVE_ZSTD
+			ZSTD_inBuffer ib = {in, *in_n, 0};
+			ZSTD_outBuffer ob = {out, *out_n, 0};
+			size_t r = ZSTD_decompressStream(zd, &ob, &ib);
+			*in_n = ib.pos;
+			*out_n = ob.pos;
+			if (ZSTD_isError(r))
+				return false;
+			// With nothing to go on, r is a hint even between
+			// frames.
+			if (*in_n || *out_n)
+				mid_frame = r != 0;
+			return true;
+#else
+			break;
+#endif
+		}
+		case codec::lz4: {
+#ifdef COMPRESSED_STREAM_HAVE_LZ4
+			size_t r = LZ4F_decompress(ld, out, out_n, in, in_n,
+						   nullptr);
+			if (LZ4F_isError(r))
+				return false;
+			if (*in_n || *out_n)
+				mid_frame = r != 0;
+			return true;
+#else
+			break;
+#endif
+		}
+		case codec::none:
+		case codec::automatic:
+			break;
+		}
+		size_t n = *in_n < *out_n ? *in_n : *out_n;
+		std::memcpy(out, in, n);
+		*in_n = *out_n = n;
+		return true;
+	}
+
+	// True if the input stopped partway through a frame.
+	bool truncated() const {
+		return mid_frame;
+	}
+};
+
+// The codec whose magic number starts p, or none.
+inline codec sniff(const unsigned char *p, size_t n) {
+	if (n >= 2 && p[0] == 0x1f && p[1] == 0x8b)
+		return codec::gzip;
+	if (n >= 4 && p[0] == 0x28 && p[1] == 0xb5 && p[2] == 0x2f &&
+	    p[3] == 0xfd)
+		return codec::zstd;
+	if (n >= 4 && p[0] == 0x04 && p[1] == 0x22 && p[2] == 0x4d &&
+	    p[3] == 0x18)
+		return codec::lz4;
+	return codec::none;
+}
+
+} // End namespace compress_detail
+
+class compressed_writer {
+private:
+	struct job {
+		compress_detail::buffer in;
+		compress_detail::buffer out;
+		std::future<bool> done;
+	};
+
+	compress_detail::endpoint dst;
+	compress_options opt;
+	compress_detail::buffer cur;
+	// Blocks on the pool, oldest first, and finished jobs to reuse.
+	std::deque<std::unique_ptr<job>> pending;
+	std::vector<std::unique_ptr<job>> spare;
+	uint64_t nin;
+	uint64_t nout;
+	bool any_output;
+	int err;
+
+	compressed_writer(const compressed_writer &) = delete;
+	compressed_writer &operator=(const compressed_writer &) = delete;
+
+	void init() {
+		if (opt.method == codec::automatic)
+			opt.method = compress_detail::best_available();
+		if (!codec_available(opt.method))
+			err = ENOTSUP;
+		if (!opt.block_size)
+			opt.block_size = 1;
+		cur.reserve(opt.block_size);
+	}
+
+	void emit(const compress_detail::buffer &out) {
+		if (err)
+			return;
+		if (!dst.write(out.data.get(), out.size))
+			err = errno ? errno : EIO;
+		nout += out.size;
+		any_output = true;
+	}
+
+	std::unique_ptr<job> get_job() {
+		if (spare.empty())
+			return std::unique_ptr<job>(new job);
+		std::unique_ptr<job> j = std::move(spare.back());
+		spare.pop_back();
+		return j;
+	}
+
+	// Writes out the oldest block on the pool, once it is done.
+	void retire() {
+		std::unique_ptr<job> j = std::move(pending.front());
+		pending.pop_front();
+		if (j->done.get())
+			emit(j->out);
+		else if (!err)
+			err = EIO;
+		spare.push_back(std::move(j));
+	}
+
+	void end_block() {
+		if (err || (!cur.size && any_output))
+			return;
+		if (!opt.pool || opt.method == codec::none) {
+			std::unique_ptr<job> j = get_job();
+			if (compress_detail::compress_block(
+				    opt.method, opt.level, cur, j->out))
+				emit(j->out);
+			else
+				err = EIO;
+			spare.push_back(std::move(j));
+			cur.size = 0;
+			return;
+		}
+		std::unique_ptr<job> j = get_job();
+		std::swap(j->in, cur);
+		cur.size = 0;
+		cur.reserve(opt.block_size);
+		job *p = j.get();
+		codec c = opt.method;
+		int level = opt.level;
+		p->done = opt.pool->submit([p, c, level]() {
+			return compress_detail::compress_block(c, level, p->in,
+							       p->out);
+		});
+		pending.push_back(std::move(j));
+		// Enough to keep every thread busy while the oldest is written.
+		while (pending.size() > 2 * size_t(opt.pool->size()))
+			retire();
+	}
+
+public:
+	explicit compressed_writer(
+		stdio_file &f, const compress_options &o = compress_options())
+		: dst(f.get_file()), opt(o), nin(0), nout(0),
+		  any_output(false), err(0) {
+		init();
+	}
+
+	explicit compressed_writer(
+		int fd, const compress_options &o = compress_options())
+		: dst(fd), opt(o), nin(0), nout(0), any_output(false), err(0) {
+		init();
+	}
+
+	// Ends the stream; see flush().
+	~compressed_writer() {
+		flush();
+	}
+
+	bool write(const void *p, size_t n) {
+		const char *b = static_cast<const char *>(p);
+		nin += n;
+		while (n && !err) {
+			size_t room = opt.block_size - cur.size;
+			size_t k = n < room ? n : room;
+			std::memcpy(cur.data.get() + cur.size, b, k);
+			cur.size += k;
+			b += k;
+			n -= k;
+			if (cur.size == opt.block_size)
+				end_block();
+		}
+		return !err;
+	}
+
+	bool write(string_ref s) {
+		return write(s.data(), s.size());
+	}
+
+	// Ends the current block early and writes out everything so far, so
+	// a reader sees complete data up to here. Writing may go on after.
+	bool flush() {
+		end_block();
+		while (!pending.empty())
+			retire();
+		if (!err && !dst.flush())
+			err = errno ? errno : EIO;
+		return !err;
+	}
+
+	codec method() const {
+		return opt.method;
+	}
+	uint64_t bytes_in() const {
+		return nin;
+	}
+	uint64_t bytes_out() const {
+		return nout;
+	}
+	int error() const {
+		return err;
+	}
+};
+
+class compressed_reader {
+private:
+	compress_detail::endpoint src;
+	compress_detail::decoder dec;
+	compress_detail::buffer in;
+	size_t pos;
+	bool at_eof;
+	bool started;
+	codec c;
+	int err;
+
+	compressed_reader(const compressed_reader &) = delete;
+	compressed_reader &operator=(const compressed_reader &) = delete;
+
+	// Reads more after what is buffered, moving it to the front first.
+	void refill() {
+		if (pos) {
+			std::memmove(in.data.get(), in.data.get() + pos,
+				     in.size - pos);
+			in.size -= pos;
+			pos = 0;
+		}
+		ssize_t r = src.read(in.data.get() + in.size, in.cap - in.size);
+		if (r < 0)
+			err = errno ? errno : EIO;
+		else if (r == 0)
+			at_eof = true;
+		else
+			in.size += size_t(r);
+	}
+
+	bool start() {
+		started = true;
+		if (c == codec::automatic) {
+			// Room for the longest magic number, whatever the
+			// buffer size.
+			in.reserve(4);
+			while (in.size < 4 && !at_eof && !err)
+				refill();
+			char *p = in.data.get();
+			c = compress_detail::sniff(
+				reinterpret_cast<unsigned char *>(p), in.size);
+		}
+		int e = dec.init(c);
+		if (e && !err)
+			err = e;
+		return !err;
+	}
+
+	void init(size_t bufsize) {
+		in.reserve(bufsize ? bufsize : 1);
+	}
+
+public:
+	explicit compressed_reader(stdio_file &f, codec c = codec::automatic,
+				   size_t bufsize = 1 << 18)
+		: src(f.get_file()), pos(0), at_eof(false), started(false),
+		  c(c), err(0) {
+		init(bufsize);
+	}
+
+	explicit compressed_reader(int fd, codec c = codec::automatic,
+				   size_t bufsize = 1 << 18)
+		: src(fd), pos(0), at_eof(false), started(false), c(c),
+		  err(0) {
+		init(bufsize);
+	}
+
+	// As read(2): up to n decompressed bytes, 0 at the end, or -1 on an
+	// error.
+	ssize_t read(void *p, size_t n) {
+		if (err || (!started && !start()))
+			return -1;
+		while (n) {
+			if (pos == in.size && !at_eof) {
+				refill();
+				if (err)
+					return -1;
+			}
+			size_t used = in.size - pos, made = n;
+			if (!dec.run(in.data.get() + pos, &used,
+				     static_cast<char *>(p), &made)) {
+				err = EBADMSG;
+				return -1;
+			}
+			pos += used;
+			if (made)
+				return ssize_t(made);
+			if (at_eof && pos == in.size) {
+				if (!dec.truncated())
+					return 0;
+				err = EBADMSG;
+				return -1;
+			}
+			// No progress: the decoder wants more input than is
+			// buffered.
+			if (!used) {
+				if (at_eof) {
+					err = EBADMSG;
+					return -1;
+				}
+				if (in.size == in.cap && pos == 0)
+					in.reserve(in.cap * 2);
+				refill();
+				if (err)
+					return -1;
+			}
+		}
+		return 0;
+	}
+
+	// The codec being read; automatic until the first read().
+	codec method() const {
+		return c;
+	}
+	int error() const {
+		return err;
+	}
+};
+
+#ifdef __GLIBC__
+namespace compress_detail {
+
+struct cookie {
+	stdio_file base;
+	std::unique_ptr<compressed_reader> r;
+	std::unique_ptr<compressed_writer> w;
+};
+
+inline ssize_t cookie_read(void *c, char *buf, size_t n) {
+	cookie *k = static_cast<cookie *>(c);
+	ssize_t r = k->r->read(buf, n);
+	if (r < 0)
+		errno = k->r->error();
+	return r;
+}
+
+inline ssize_t cookie_write(void *c, const char *buf, size_t n) {
+	cookie *k = static_cast<cookie *>(c);
+	if (k->w->write(buf, n))
+		return ssize_t(n);
+	errno = k->w->error();
+	return 0;
+}
+
+inline int cookie_close(void *c) {
+	cookie *k = static_cast<cookie *>(c);
+	int ret = 0;
+	if (k->w && !k->w->flush()) {
+		errno = k->w->error();
+		ret = EOF;
+	}
+	k->r.reset();
+	k->w.reset();
+	if (k->base.fclose() != 0)
+		ret = EOF;
+	delete k;
+	return ret;
+}
+
+} // End namespace compress_detail
+
+// Takes over f and returns a stdio_file through which what is written is
+// compressed into f ("w" or "a"), or what is read is decompressed from it
+// ("r"). Closing the result ends the stream and closes f. The result can't
+// seek. Null on failure.
+inline stdio_file
+open_compressed(stdio_file &&f, const char *mode,
+		const compress_options &o = compress_options()) {
+	using namespace compress_detail;
+	std::unique_ptr<cookie> k(new cookie);
+	k->base = std::move(f);
+	if (mode[0] == 'r')
+		k->r.reset(new compressed_reader(k->base, o.method));
+	else
+		k->w.reset(new compressed_writer(k->base, o));
+	if (k->w && k->w->error()) {
+		errno = k->w->error();
+		return stdio_file();
+	}
+	cookie_io_functions_t io;
+	io.read = cookie_read;
+	io.write = cookie_write;
+	io.seek = nullptr;
+	io.close = cookie_close;
+	FILE *F = ::fopencookie(k.get(), mode, io);
+	if (!F)
+		return stdio_file();
+	k.release();
+	return stdio_file(F);
+}
+#endif
+#endif
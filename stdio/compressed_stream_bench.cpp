@@ -0,0 +1,137 @@
+// Compressed streams against writing and reading the data as is.
+//
+//   compressed_stream_bench [size_mb [path]]
+//
+// Builds size_mb (default 256) of log lines, then for each codec built in
+// (link with -lz, -lzstd, -llz4 as found) writes them to path (default
+// ./compressed_stream_bench.tmp) on the calling thread and on
+// thread_pool::default_pool(), reads them back, and removes the file.
+// Throughput is of uncompressed bytes; reads see a warm page cache.
+#include "compressed_stream.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+
+#include <unistd.h>
+
+using bench_clock = std::chrono::steady_clock;
+
+static double seconds_since(bench_clock::time_point t0) {
+	return std::chrono::duration<double>(bench_clock::now() - t0).count();
+}
+
+static std::string make_log(size_t n) {
+	static const char *const levels[] = {"INFO", "INFO", "INFO", "WARN",
+					     "DEBUG"};
+	static const char *const paths[] = {"/api/v1/items", "/api/v1/users",
+					    "/healthz", "/api/v2/search"};
+	std::mt19937 rng(42);
+	std::string s;
+	s.reserve(n + 256);
+	char line[256];
+	unsigned long long t = 1700000000000ull;
+	while (s.size() < n) {
+		t += rng() % 50;
+		int k = snprintf(line, sizeof(line),
+				 "%llu %s req=%08x %s/%u status=%u "
+				 "latency_us=%u bytes=%u\n",
+				 t, levels[rng() % 5], unsigned(rng()),
+				 paths[rng() % 4], unsigned(rng() % 10000),
+				 rng() % 20 ? 200u : 500u,
+				 unsigned(rng() % 100000),
+				 unsigned(rng() % 65536));
+		s.append(line, size_t(k));
+	}
+	s.resize(n);
+	return s;
+}
+
+static const char *codec_name(codec c) {
+	switch (c) {
+	case codec::none:
+		return "uncompressed";
+	case codec::gzip:
+		return "gzip";
+	case codec::zstd:
+		return "zstd";
+	case codec::lz4:
+		return "lz4";
+	case codec::automatic:
+		break;
+	}
+	return "?";
+}
+
+int main(int argc, char **argv) {
+	size_t size_mb = argc > 1 ? strtoul(argv[1], nullptr, 10) : 256;
+	const char *path =
+		argc > 2 ? argv[2] : "./compressed_stream_bench.tmp";
+	std::string data = make_log(size_mb << 20);
+	cpputil::thread_pool &pool = cpputil::thread_pool::default_pool();
+
+	printf("%zu MB of logs, %u pool threads\n", size_mb, pool.size());
+	printf("%-14s %8s %14s %14s %14s\n", "", "ratio", "write MB/s",
+	       "pool MB/s", "read MB/s");
+	for (codec c : {codec::none, codec::lz4, codec::zstd, codec::gzip}) {
+		if (!codec_available(c)) {
+			printf("%-14s not built in\n", codec_name(c));
+			continue;
+		}
+		double wr[2];
+		uint64_t out = 0;
+		for (int par = 0; par < 2; ++par) {
+			unlink(path);
+			auto t0 = bench_clock::now();
+			stdio_file f(path, "w");
+			{
+				compressed_writer w(
+					f, compress_options(c, 0, 1 << 20,
+							    par ? &pool
+								: nullptr));
+				// Lines come in as a logger would hand them
+				// over.
+				for (size_t i = 0; i < data.size(); i += 4096) {
+					size_t n = std::min<size_t>(
+						4096, data.size() - i);
+					w.write(data.data() + i, n);
+				}
+				if (!w.flush()) {
+					fprintf(stderr, "%s: %s\n",
+						codec_name(c),
+						strerror(w.error()));
+					return 1;
+				}
+				out = w.bytes_out();
+			}
+			f.fclose();
+			wr[par] = data.size() / seconds_since(t0) / 1e6;
+		}
+
+		auto t0 = bench_clock::now();
+		stdio_file f(path, "r");
+		compressed_reader r(f, c);
+		std::unique_ptr<char[]> buf(new char[1 << 16]);
+		size_t got = 0;
+		bool same = true;
+		ssize_t n;
+		while ((n = r.read(buf.get(), 1 << 16)) > 0) {
+			same = same && !memcmp(buf.get(), data.data() + got,
+					       size_t(n));
+			got += size_t(n);
+		}
+		double rd = data.size() / seconds_since(t0) / 1e6;
+		if (n < 0 || got != data.size() || !same) {
+			fprintf(stderr, "%s: read back wrong\n", codec_name(c));
+			return 1;
+		}
+		printf("%-14s %8.2f %14.0f %14.0f %14.0f\n", codec_name(c),
+		       double(data.size()) / out, wr[0], wr[1], rd);
+	}
+	unlink(path);
+	return 0;
+}
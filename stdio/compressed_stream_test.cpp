@@ -0,0 +1,195 @@
+// Link with -lz, -lzstd and -llz4 as found; missing codecs are skipped.
+#include "compressed_stream.hpp"
+#include "libcpp-util/util/test_check.h"
+#include "line_reader.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char *const path = "compressed_stream_test.tmp";
+
+static std::string make_log(size_t n) {
+	std::mt19937 rng(5);
+	std::string s;
+	char line[160];
+	while (s.size() < n) {
+		int k = snprintf(line, sizeof(line),
+				 "12:%02u:%02u INFO id=%u path=/items/%u "
+				 "status=%u\n",
+				 unsigned(rng() % 60), unsigned(rng() % 60),
+				 unsigned(rng()), unsigned(rng() % 1000),
+				 unsigned(200 + rng() % 3 * 100));
+		s.append(line, size_t(k));
+	}
+	s.resize(n);
+	return s;
+}
+
+static std::string read_all(codec c, size_t bufsize = 1 << 18) {
+	stdio_file f(path, "r");
+	compressed_reader r(f, c, bufsize);
+	std::string out;
+	char buf[7777];
+	ssize_t n;
+	while ((n = r.read(buf, sizeof(buf))) > 0)
+		out.append(buf, size_t(n));
+	CHECK(n == 0 && r.error() == 0);
+	return out;
+}
+
+// Odd-sized writes and several block sizes, serial and on a pool, read back
+// both as the codec and by sniffing.
+static void check_round_trip(codec c, cpputil::thread_pool &pool,
+			     const std::string &data) {
+	for (size_t bs : {size_t(1000), size_t(1) << 20}) {
+		for (int par = 0; par < 2; ++par) {
+			{
+				stdio_file f(path, "w");
+				compressed_writer w(
+					f, compress_options(c, 0, bs,
+							    par ? &pool
+								: nullptr));
+				std::mt19937 rng(1);
+				for (size_t i = 0; i < data.size();) {
+					size_t k = rng() % 70000;
+					if (k > data.size() - i)
+						k = data.size() - i;
+					CHECK(w.write(data.data() + i, k));
+					i += k;
+				}
+				CHECK(w.flush());
+				CHECK(w.bytes_in() == data.size());
+				// Tiny blocks are all frame overhead.
+				if (c != codec::none && bs > 1000)
+					CHECK(w.bytes_out() < data.size() / 2);
+			}
+			CHECK(read_all(c) == data);
+			CHECK(read_all(codec::automatic) == data);
+		}
+	}
+}
+
+// Cut short, the stream must fail rather than end quietly.
+static void check_truncated(codec c, const std::string &data) {
+	{
+		stdio_file f(path, "w");
+		compressed_writer w(f, compress_options(c));
+		w.write(data);
+	}
+	struct stat st;
+	CHECK(stat(path, &st) == 0 && truncate(path, st.st_size - 5) == 0);
+	stdio_file f(path, "r");
+	compressed_reader r(f);
+	char buf[65536];
+	ssize_t n;
+	while ((n = r.read(buf, sizeof(buf))) > 0)
+		;
+	CHECK(n == -1 && r.error() == EBADMSG);
+}
+
+// A block flushed down a pipe is decoded while the writer still has it
+// open.
+static void check_pipe_block_before_eof(codec c) {
+	int p[2];
+	CHECK(pipe(p) == 0);
+	std::atomic<bool> got_first(false), closed(false);
+	std::thread writer([&] {
+		{
+			compressed_writer w(p[1], compress_options(c));
+			CHECK(w.write(string_ref("first\n")) && w.flush());
+			// Give up after a while, so a reader that waits for
+			// the end fails the check below rather than hanging.
+			for (int i = 0; i < 500 && !got_first; ++i)
+				std::this_thread::sleep_for(
+					std::chrono::milliseconds(10));
+			CHECK(w.write(string_ref("second\n")));
+		}
+		closed = true;
+		close(p[1]);
+	});
+	stdio_file f(p[0], "r");
+	compressed_reader r(f);
+	char buf[100];
+	CHECK(r.read(buf, sizeof(buf)) == 6 && !closed);
+	CHECK(std::string(buf, 6) == "first\n");
+	got_first = true;
+	std::string rest;
+	ssize_t n;
+	while ((n = r.read(buf, sizeof(buf))) > 0)
+		rest.append(buf, size_t(n));
+	CHECK(n == 0 && rest == "second\n");
+	writer.join();
+}
+
+// Growing a buffer keeps what is in it, and a reader whose buffer is too
+// small for anything still gets through.
+static void check_small_buffers(codec c, const std::string &data) {
+	compress_detail::buffer b;
+	b.reserve(3);
+	std::memcpy(b.data.get(), "abc", 3);
+	b.size = 3;
+	b.reserve(1000);
+	CHECK(b.cap == 1000 && b.size == 3);
+	CHECK(std::memcmp(b.data.get(), "abc", 3) == 0);
+
+	std::string some = data.substr(0, 100000);
+	{
+		stdio_file f(path, "w");
+		compressed_writer w(f, compress_options(c, 0, 10000));
+		CHECK(w.write(some) && w.flush());
+	}
+	CHECK(read_all(c, 1) == some);
+	CHECK(read_all(codec::automatic, 1) == some);
+	CHECK(read_all(codec::automatic, 3) == some);
+}
+
+static void check_stdio_adapter(cpputil::thread_pool &pool) {
+	{
+		stdio_file z = open_compressed(
+			stdio_file(path, "w"), "w",
+			compress_options(codec::automatic, 0, 1 << 16, &pool));
+		CHECK(z.get_file());
+		for (int i = 0; i < 100000; ++i)
+			z.print("line %d %s\n", i, "some text");
+	}
+	stdio_file z = open_compressed(stdio_file(path, "r"), "r");
+	line_reader lr(z);
+	string_ref line;
+	int i = 0;
+	while (lr.next(line)) {
+		char expect[64];
+		int k = snprintf(expect, sizeof(expect), "line %d some text",
+				 i++);
+		CHECK(line == string_ref(expect, size_t(k)));
+	}
+	CHECK(i == 100000 && !lr.error());
+}
+
+int main() {
+	cpputil::thread_pool pool(3);
+	std::string data = make_log(5 << 20);
+	for (codec c : {codec::none, codec::gzip, codec::zstd, codec::lz4}) {
+		if (!codec_available(c)) {
+			printf("codec %d not built in, skipped\n", int(c));
+			continue;
+		}
+		check_round_trip(c, pool, data);
+		check_small_buffers(c, data);
+		if (c != codec::none) {
+			check_truncated(c, data);
+			check_pipe_block_before_eof(c);
+		}
+	}
+	check_stdio_adapter(pool);
+	unlink(path);
+	printf("ok\n");
+	return 0;
+}
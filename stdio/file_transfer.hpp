@@ -0,0 +1,247 @@
+#ifndef FILE_TRANSFER_HPP
+#define FILE_TRANSFER_HPP
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#endif
+
+#include "libcpp-util/stdio/stdio_file.hpp"
+
+// Moves bytes from one descriptor to another without bringing them into
+// userspace where the kernel allows it:
+//
+//   copy_file_range  file to file; may share extents (reflink) or copy on
+//                    the server for NFS
+//   sendfile         file to anything, typically a socket
+//   splice           through a pipe, so either end may be anything
+//   read_write       a read(2)/write(2) loop through a 1MB buffer
+//
+// Both descriptors are read and written at their current offsets, which
+// advance by the amount moved, as with read(2)/write(2). automatic picks the
+// first method that suits the two descriptors and drops to the next if the
+// kernel or filesystem turns it down (ENOSYS, EINVAL, EXDEV, ...) before
+// anything has moved, ending with read_write. A file-to-file method moving
+// nothing at all is tried again further down the list too: procfs and sysfs
+// files claim to be empty, and copy_file_range believes them (Linux 5.3 to
+// 5.18), so only read(2) finds out how long they really are.
+//
+// The return value is the number of bytes moved, short if the input ends
+// first; or -1 with errno set if an error came before any bytes moved.
+enum class transfer_method {
+	automatic,
+	copy_file_range,
+	sendfile,
+	splice,
+	read_write,
+};
+
+namespace transfer_detail {
+
+// The most any of the zero-copy calls moves at once.
+static const size_t max_chunk = 0x7ffff000;
+
+inline size_t chunk(size_t n) {
+	return n < max_chunk ? n : max_chunk;
+}
+
+// Errors that mean "not for these descriptors" rather than a real failure.
+inline bool unsupported(int e) {
+	return e == ENOSYS || e == EINVAL || e == EXDEV || e == EOPNOTSUPP ||
+	       e == ENOTSUP || e == EBADF || e == ESPIPE;
+}
+
+// Runs step(remaining) until n bytes have moved, the input ends, or it
+// fails. *fallback is set if it failed in a way another method might not.
+template <class Step>
+ssize_t loop(size_t n, bool *fallback, Step step) {
+	size_t done = 0;
+	*fallback = false;
+	while (done < n) {
+		ssize_t r = step(n - done);
+		if (r > 0) {
+			done += size_t(r);
+		} else if (r == 0) {
+			break;
+		} else if (errno != EINTR) {
+			if (done)
+				break;
+			*fallback = unsupported(errno);
+			return -1;
+		}
+	}
+	return ssize_t(done);
+}
+
+inline ssize_t by_read_write(int in, int out, size_t n) {
+	const size_t bufsize = 1 << 20;
+	std::unique_ptr<char[]> buf(new char[bufsize]);
+	size_t done = 0;
+	while (done < n) {
+		size_t want = n - done < bufsize ? n - done : bufsize;
+		ssize_t r = ::read(in, buf.get(), want);
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r <= 0)
+			return done ? ssize_t(done) : r;
+		for (ssize_t off = 0; off < r;) {
+			ssize_t w = ::write(out, buf.get() + off,
+					    size_t(r - off));
+			if (w < 0 && errno == EINTR)
+				continue;
+			if (w < 0)
+				return done ? ssize_t(done) : -1;
+			off += w;
+			done += size_t(w);
+		}
+	}
+	return ssize_t(done);
+}
+
+#ifdef __linux__
+inline ssize_t by_copy_file_range(int in, int out, size_t n, bool *fallback) {
+#ifdef __NR_copy_file_range
+	return loop(n, fallback, [&](size_t left) {
+		return ssize_t(::syscall(__NR_copy_file_range, in, nullptr, out,
+					 nullptr, chunk(left), 0u));
+	});
+#else
+	(void)in;
+	(void)out;
+	(void)n;
+	*fallback = true;
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+inline ssize_t by_sendfile(int in, int out, size_t n, bool *fallback) {
+	return loop(n, fallback, [&](size_t left) {
+		return ::sendfile(out, in, nullptr, chunk(left));
+	});
+}
+
+inline bool is_pipe(int fd) {
+	struct stat st;
+	return ::fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode);
+}
+
+inline ssize_t by_splice(int in, int out, size_t n, bool *fallback) {
+	const unsigned flags = SPLICE_F_MOVE | SPLICE_F_MORE;
+	if (is_pipe(in) || is_pipe(out)) {
+		return loop(n, fallback, [&](size_t left) {
+			return ::splice(in, nullptr, out, nullptr, chunk(left),
+					flags);
+		});
+	}
+	// Neither end is a pipe, so go through one of our own.
+	int p[2];
+	if (::pipe2(p, O_CLOEXEC) != 0) {
+		*fallback = false;
+		return -1;
+	}
+	const size_t pipe_size = 1 << 20;
+	::fcntl(p[1], F_SETPIPE_SZ, int(pipe_size));
+	size_t done = 0;
+	int err = 0;
+	*fallback = false;
+	while (done < n) {
+		size_t want = n - done < pipe_size ? n - done : pipe_size;
+		ssize_t r = ::splice(in, nullptr, p[1], nullptr, want, flags);
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r <= 0) {
+			err = r < 0 ? errno : 0;
+			break;
+		}
+		// Whatever went into the pipe has to come out, or it is lost.
+		for (ssize_t left = r; left;) {
+			ssize_t w = ::splice(p[0], nullptr, out, nullptr,
+					     size_t(left), flags);
+			if (w < 0 && errno == EINTR)
+				continue;
+			if (w <= 0) {
+				err = w < 0 ? errno : EIO;
+				break;
+			}
+			left -= w;
+			done += size_t(w);
+		}
+		if (err)
+			break;
+	}
+	::close(p[0]);
+	::close(p[1]);
+	if (err && !done) {
+		*fallback = unsupported(err);
+		errno = err;
+		return -1;
+	}
+	return ssize_t(done);
+}
+#endif
+
+} // End namespace transfer_detail
+
+// Moves up to n bytes from in to out; by default until in ends.
+inline ssize_t transfer(int in, int out, size_t n = size_t(-1),
+			transfer_method m = transfer_method::automatic) {
+	using namespace transfer_detail;
+#ifdef __linux__
+	bool fallback = false;
+	ssize_t r;
+	switch (m) {
+	case transfer_method::copy_file_range:
+		return by_copy_file_range(in, out, n, &fallback);
+	case transfer_method::sendfile:
+		return by_sendfile(in, out, n, &fallback);
+	case transfer_method::splice:
+		return by_splice(in, out, n, &fallback);
+	case transfer_method::read_write:
+		return by_read_write(in, out, n);
+	case transfer_method::automatic:
+		break;
+	}
+	struct stat si, so;
+	if (::fstat(in, &si) != 0 || ::fstat(out, &so) != 0)
+		return -1;
+	if (S_ISFIFO(si.st_mode) || S_ISFIFO(so.st_mode)) {
+		r = by_splice(in, out, n, &fallback);
+		if (!fallback)
+			return r;
+	} else if (S_ISREG(si.st_mode)) {
+		if (S_ISREG(so.st_mode)) {
+			r = by_copy_file_range(in, out, n, &fallback);
+			if (!fallback && (r != 0 || !n))
+				return r;
+		}
+		r = by_sendfile(in, out, n, &fallback);
+		if (!fallback && (r != 0 || !n))
+			return r;
+	}
+#else
+	(void)m;
+#endif
+	return by_read_write(in, out, n);
+}
+
+// The same between stdio_files. Both are flushed first, which for the input
+// drops its read-ahead and puts the descriptor at the stream's position;
+// fseek(0, SEEK_CUR) on it before reading through stdio again.
+inline ssize_t transfer(stdio_file &in, stdio_file &out, size_t n = size_t(-1),
+			transfer_method m = transfer_method::automatic) {
+	if (in.fflush() != 0 || out.fflush() != 0)
+		return -1;
+	return transfer(in.fileno(), out.fileno(), n, m);
+}
+#endif
@@ -0,0 +1,101 @@
+// Each transfer_method copying files of 1MB and up, file to file and file
+// to a pipe with a reader on the other end (standing in for a socket).
+//
+//   file_transfer_bench [max_mb [dir]]
+//
+// Sizes go up by 4x from 1MB to max_mb (default 1024; 10240 for 10GB),
+// in dir (default .). The source is read from a warm page cache and the
+// destination is written to it; copy_file_range may not copy at all on a
+// filesystem with reflinks.
+#include "file_transfer.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+using bench_clock = std::chrono::steady_clock;
+
+static const struct {
+	const char *name;
+	transfer_method m;
+} methods[] = {
+	{"read_write", transfer_method::read_write},
+	{"copy_file_range", transfer_method::copy_file_range},
+	{"sendfile", transfer_method::sendfile},
+	{"splice", transfer_method::splice},
+	{"automatic", transfer_method::automatic},
+};
+
+static double to_file(const std::string &src, const std::string &dst,
+		      transfer_method m) {
+	int in = ::open(src.c_str(), O_RDONLY);
+	int out = ::open(dst.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	auto start = bench_clock::now();
+	ssize_t r = transfer(in, out, size_t(-1), m);
+	std::chrono::duration<double> d = bench_clock::now() - start;
+	::close(in);
+	::close(out);
+	::unlink(dst.c_str());
+	return r < 0 ? -1 : d.count();
+}
+
+static double to_pipe(const std::string &src, transfer_method m) {
+	int in = ::open(src.c_str(), O_RDONLY);
+	int p[2];
+	if (::pipe(p) != 0)
+		return -1;
+	::fcntl(p[1], F_SETPIPE_SZ, 1 << 20);
+	std::thread reader([&] {
+		std::vector<char> buf(1 << 20);
+		while (::read(p[0], buf.data(), buf.size()) > 0)
+			;
+	});
+	auto start = bench_clock::now();
+	ssize_t r = transfer(in, p[1], size_t(-1), m);
+	::close(p[1]);
+	reader.join();
+	std::chrono::duration<double> d = bench_clock::now() - start;
+	::close(p[0]);
+	::close(in);
+	return r < 0 ? -1 : d.count();
+}
+
+int main(int argc, char **argv) {
+	size_t max_mb = argc > 1 ? atol(argv[1]) : 1024;
+	std::string dir = argc > 2 ? argv[2] : ".";
+	std::string src = dir + "/file_transfer_bench.src";
+	std::string dst = dir + "/file_transfer_bench.dst";
+
+	printf("GB/s        ");
+	for (auto &m : methods)
+		printf(" %15s", m.name);
+	printf("\n");
+	for (size_t mb = 1; mb <= max_mb; mb *= 4) {
+		{
+			int fd = ::open(src.c_str(),
+					O_WRONLY | O_CREAT | O_TRUNC, 0644);
+			std::vector<char> block(1 << 20, 'x');
+			for (size_t i = 0; i < mb; ++i)
+				if (::write(fd, block.data(), block.size()) < 0)
+					perror("write");
+			::close(fd);
+		}
+		double bytes = double(mb << 20);
+		for (int kind = 0; kind < 2; ++kind) {
+			printf("%6zuMB %s", mb, kind ? "pipe" : "file");
+			for (auto &m : methods) {
+				double t = kind ? to_pipe(src, m.m)
+						: to_file(src, dst, m.m);
+				if (t < 0)
+					printf(" %15s", "unsupported");
+				else
+					printf(" %15.2f", bytes / t / 1e9);
+			}
+			printf("\n");
+			fflush(stdout);
+		}
+	}
+	::unlink(src.c_str());
+}
@@ -0,0 +1,148 @@
+#include "file_transfer.hpp"
+#include "libcpp-util/util/test_check.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <thread>
+
+static const char *const src_path = "file_transfer_test.src";
+static const char *const dst_path = "file_transfer_test.dst";
+
+static const struct {
+	const char *name;
+	transfer_method m;
+} methods[] = {
+	{"automatic", transfer_method::automatic},
+	{"copy_file_range", transfer_method::copy_file_range},
+	{"sendfile", transfer_method::sendfile},
+	{"splice", transfer_method::splice},
+	{"read_write", transfer_method::read_write},
+};
+
+static void write_file(const char *path, const std::string &data) {
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	CHECK(fd >= 0);
+	CHECK(write(fd, data.data(), data.size()) == ssize_t(data.size()));
+	close(fd);
+}
+
+static std::string read_fd(int fd) {
+	std::string s;
+	char buf[65536];
+	ssize_t n;
+	while ((n = read(fd, buf, sizeof(buf))) > 0)
+		s.append(buf, size_t(n));
+	CHECK(n == 0);
+	return s;
+}
+
+static std::string read_file(const char *path) {
+	int fd = open(path, O_RDONLY);
+	CHECK(fd >= 0);
+	std::string s = read_fd(fd);
+	close(fd);
+	return s;
+}
+
+// File to file, from and to the current offsets, whole and n at a time.
+static void test_file_to_file(transfer_method m, const std::string &data) {
+	write_file(src_path, data);
+	int in = open(src_path, O_RDONLY);
+	int out = open(dst_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	CHECK(in >= 0 && out >= 0);
+	CHECK(lseek(in, 10, SEEK_SET) == 10);
+	CHECK(write(out, "head", 4) == 4);
+	CHECK(transfer(in, out, 1000, m) == 1000);
+	CHECK(lseek(in, 0, SEEK_CUR) == 1010);
+	CHECK(transfer(in, out, size_t(-1), m) == ssize_t(data.size() - 1010));
+	CHECK(transfer(in, out, size_t(-1), m) == 0);
+	close(in);
+	close(out);
+	CHECK(read_file(dst_path) == "head" + data.substr(10));
+}
+
+// A pipe at either end, with the other end of it on another thread; sendfile
+// only writes to one.
+static void test_pipes(transfer_method m, const std::string &data) {
+	write_file(src_path, data);
+	int p[2];
+	CHECK(pipe(p) == 0);
+	int in = open(src_path, O_RDONLY);
+	CHECK(in >= 0);
+	std::string got;
+	std::thread reader([&] { got = read_fd(p[0]); });
+	CHECK(transfer(in, p[1], size_t(-1), m) == ssize_t(data.size()));
+	close(p[1]);
+	reader.join();
+	close(p[0]);
+	close(in);
+	CHECK(got == data);
+	if (m == transfer_method::sendfile)
+		return;
+
+	CHECK(pipe(p) == 0);
+	int out = open(dst_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	CHECK(out >= 0);
+	std::thread writer([&] {
+		for (size_t i = 0; i < data.size(); i += 100000) {
+			size_t k = std::min(data.size() - i, size_t(100000));
+			CHECK(write(p[1], data.data() + i, k) == ssize_t(k));
+		}
+		close(p[1]);
+	});
+	CHECK(transfer(p[0], out, size_t(-1), m) == ssize_t(data.size()));
+	writer.join();
+	close(p[0]);
+	close(out);
+	CHECK(read_file(dst_path) == data);
+}
+
+// procfs files say they are empty; automatic must still copy them.
+static void test_procfs() {
+	int in = open("/proc/self/mountinfo", O_RDONLY);
+	if (in < 0) {
+		printf("no /proc, skipped\n");
+		return;
+	}
+	std::string expect = read_fd(in);
+	CHECK(!expect.empty() && lseek(in, 0, SEEK_SET) == 0);
+	int out = open(dst_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	CHECK(out >= 0);
+	CHECK(transfer(in, out) == ssize_t(expect.size()));
+	close(in);
+	close(out);
+	CHECK(read_file(dst_path) == expect);
+}
+
+static void test_stdio() {
+	write_file(src_path, "first line\nthe rest\n");
+	stdio_file in(src_path, "r"), out(dst_path, "w");
+	char line[32];
+	CHECK(in.fgets(line, sizeof(line)));
+	CHECK(std::string(line) == "first line\n");
+	CHECK(out.fputs("copied: ") >= 0);
+	CHECK(transfer(in, out) == 9);
+	out.fclose();
+	CHECK(read_file(dst_path) == "copied: the rest\n");
+}
+
+int main() {
+	std::mt19937 rng(3);
+	std::string data(3 << 20, '\0');
+	for (char &c : data)
+		c = char(rng());
+	for (auto &m : methods) {
+		test_file_to_file(m.m, data);
+		// copy_file_range is for files alone.
+		if (m.m != transfer_method::copy_file_range)
+			test_pipes(m.m, data);
+	}
+	test_procfs();
+	test_stdio();
+	unlink(src_path);
+	unlink(dst_path);
+	printf("file_transfer_test: all passed\n");
+	return 0;
+}
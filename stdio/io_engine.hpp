@@ -0,0 +1,572 @@
+#ifndef IO_ENGINE_HPP
+#define IO_ENGINE_HPP
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "libcpp-util/smp/thread_pool.h"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#define IO_ENGINE_HAVE_URING 1
+#endif
+#endif
+
+// Asynchronous pread/pwrite/fsync against many descriptors at once. Each
+// operation completes with the result pread(2) and friends would have
+// returned, or -errno, handed to a callback or a future.
+//
+// Where the kernel has io_uring the engine drives one ring directly through
+// the system calls (no liburing needed): operations are queued as
+// submission entries and go to the kernel together on submit(), and a
+// thread of the engine's reaps completions. Elsewhere, or if the ring can't
+// be set up (old kernel, seccomp), each operation becomes a blocking call on
+// a thread_pool with one thread per queue slot. Should the ring fail later
+// on, the engine moves to the thread pool for good: operations the kernel
+// never took are run there, and so is everything issued afterwards. Either
+// way at most queue_depth operations are in flight; issuing more blocks
+// until one completes.
+//
+// Callbacks run on an engine thread, so they should be short. They may
+// issue further operations. Buffers must stay valid until completion.
+// Operations may be issued from several threads.
+class io_engine {
+public:
+	typedef std::function<void(ssize_t)> callback;
+
+private:
+	enum kind { k_read, k_write, k_fsync, k_fdatasync };
+
+	struct op {
+		callback cb;
+		struct iovec iov;
+		kind k;
+		int fd;
+		off_t offset;
+	};
+
+	unsigned depth;
+	std::mutex lock;
+	std::condition_variable cv;
+	unsigned in_flight;
+	// in_flight plus callbacks still running.
+	unsigned unfinished;
+	// Made on first use: up front without io_uring, else once it fails.
+	std::unique_ptr<cpputil::thread_pool> pool;
+	std::once_flag pool_once;
+
+#ifdef IO_ENGINE_HAVE_URING
+	int ring_fd;
+	void *sq_map;
+	size_t sq_map_len;
+	void *cq_map;
+	size_t cq_map_len;
+	struct io_uring_sqe *sqes;
+	size_t sqes_len;
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned sq_mask;
+	unsigned sq_entries;
+	unsigned *sq_array;
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned cq_mask;
+	struct io_uring_cqe *cqes;
+	// The kernel takes a timeout on waits (5.11 on).
+	bool timed_wait;
+	// Entries written to the ring but not yet passed to io_uring_enter.
+	unsigned pending;
+	std::mutex sq_lock;
+	std::thread reaper;
+	// Set once io_uring_enter has failed for good: from then on new
+	// operations go to the thread pool, and the reaper polls the
+	// completion ring for those already in the kernel.
+	std::atomic<int> ring_error;
+	std::atomic<bool> stopping;
+
+	static int uring_setup(unsigned entries, struct io_uring_params *p) {
+		return int(::syscall(__NR_io_uring_setup, entries, p));
+	}
+
+	int uring_enter(unsigned to_submit, unsigned min_complete,
+			unsigned flags, void *arg = nullptr, size_t argsz = 0) {
+		return int(::syscall(__NR_io_uring_enter, ring_fd, to_submit,
+				     min_complete, flags, arg, argsz));
+	}
+
+	template <typename T>
+	static T *at(void *base, unsigned off) {
+		return reinterpret_cast<T *>(static_cast<char *>(base) + off);
+	}
+
+	bool setup_ring(unsigned entries) {
+		struct io_uring_params p;
+		std::memset(&p, 0, sizeof(p));
+		ring_fd = uring_setup(entries, &p);
+		if (ring_fd < 0)
+			return false;
+		sq_map_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+		cq_map_len = p.cq_off.cqes +
+			     p.cq_entries * sizeof(struct io_uring_cqe);
+#ifdef IORING_FEAT_EXT_ARG
+		timed_wait = (p.features & IORING_FEAT_EXT_ARG) != 0;
+#else
+		timed_wait = false;
+#endif
+		if (p.features & IORING_FEAT_SINGLE_MMAP) {
+			if (cq_map_len > sq_map_len)
+				sq_map_len = cq_map_len;
+			cq_map_len = 0;
+		}
+		sq_map = ::mmap(nullptr, sq_map_len, PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_POPULATE, ring_fd,
+				IORING_OFF_SQ_RING);
+		cq_map = sq_map;
+		if (sq_map != MAP_FAILED && cq_map_len)
+			cq_map = ::mmap(nullptr, cq_map_len,
+					PROT_READ | PROT_WRITE,
+					MAP_SHARED | MAP_POPULATE, ring_fd,
+					IORING_OFF_CQ_RING);
+		sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+		void *s = MAP_FAILED;
+		if (sq_map != MAP_FAILED && cq_map != MAP_FAILED)
+			s = ::mmap(nullptr, sqes_len, PROT_READ | PROT_WRITE,
+				   MAP_SHARED | MAP_POPULATE, ring_fd,
+				   IORING_OFF_SQES);
+		if (s == MAP_FAILED) {
+			if (cq_map_len && cq_map != MAP_FAILED)
+				::munmap(cq_map, cq_map_len);
+			if (sq_map != MAP_FAILED)
+				::munmap(sq_map, sq_map_len);
+			::close(ring_fd);
+			ring_fd = -1;
+			return false;
+		}
+		sqes = static_cast<struct io_uring_sqe *>(s);
+		sq_head = at<unsigned>(sq_map, p.sq_off.head);
+		sq_tail = at<unsigned>(sq_map, p.sq_off.tail);
+		sq_mask = *at<unsigned>(sq_map, p.sq_off.ring_mask);
+		sq_entries = *at<unsigned>(sq_map, p.sq_off.ring_entries);
+		sq_array = at<unsigned>(sq_map, p.sq_off.array);
+		cq_head = at<unsigned>(cq_map, p.cq_off.head);
+		cq_tail = at<unsigned>(cq_map, p.cq_off.tail);
+		cq_mask = *at<unsigned>(cq_map, p.cq_off.ring_mask);
+		cqes = at<struct io_uring_cqe>(cq_map, p.cq_off.cqes);
+		pending = 0;
+		ring_error = 0;
+		stopping = false;
+		reaper = std::thread([this]() { reap_loop(); });
+		return true;
+	}
+
+	void teardown_ring() {
+		// A nop with no op attached tells the reaper to stop; if the
+		// ring is broken, so does the flag.
+		stopping = true;
+		if (!ring_error) {
+			queue_sqe(IORING_OP_NOP, -1, nullptr, 0, 0, nullptr);
+			submit();
+		}
+		reaper.join();
+		::munmap(sqes, sqes_len);
+		if (cq_map_len)
+			::munmap(cq_map, cq_map_len);
+		::munmap(sq_map, sq_map_len);
+		::close(ring_fd);
+	}
+
+	// Fills the next submission entry; the caller has a slot in flight.
+	// If the ring has failed, o goes to the thread pool instead.
+	void queue_sqe(unsigned char opcode, int fd, struct iovec *iov,
+		       uint64_t offset, unsigned fsync_flags, op *o) {
+		std::vector<op *> failed;
+		{
+			std::lock_guard<std::mutex> l(sq_lock);
+			while (!ring_error && sq_full())
+				submit_locked(failed);
+			if (!ring_error)
+				fill_sqe(opcode, fd, iov, offset, fsync_flags,
+					 o);
+			else if (o)
+				failed.push_back(o);
+		}
+		fall_back(failed);
+	}
+
+	void queue_op(op *o) {
+		uint64_t off = uint64_t(o->offset);
+		switch (o->k) {
+		case k_read:
+			queue_sqe(IORING_OP_READV, o->fd, &o->iov, off, 0, o);
+			break;
+		case k_write:
+			queue_sqe(IORING_OP_WRITEV, o->fd, &o->iov, off, 0, o);
+			break;
+		case k_fsync:
+			queue_sqe(IORING_OP_FSYNC, o->fd, nullptr, 0, 0, o);
+			break;
+		case k_fdatasync:
+			queue_sqe(IORING_OP_FSYNC, o->fd, nullptr, 0,
+				  IORING_FSYNC_DATASYNC, o);
+			break;
+		}
+	}
+
+	bool sq_full() const {
+		return *sq_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) ==
+		       sq_entries;
+	}
+
+	void fill_sqe(unsigned char opcode, int fd, struct iovec *iov,
+		      uint64_t offset, unsigned fsync_flags, op *o) {
+		unsigned tail = *sq_tail;
+		unsigned idx = tail & sq_mask;
+		struct io_uring_sqe *sqe = &sqes[idx];
+		std::memset(sqe, 0, sizeof(*sqe));
+		sqe->opcode = opcode;
+		sqe->fd = fd;
+		sqe->off = offset;
+		if (iov) {
+			sqe->addr = reinterpret_cast<uint64_t>(iov);
+			sqe->len = 1;
+		}
+		sqe->fsync_flags = fsync_flags;
+		sqe->user_data = reinterpret_cast<uint64_t>(o);
+		sq_array[idx] = idx;
+		__atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+		++pending;
+	}
+
+	// Passes the queued entries to the kernel. Once the ring is found
+	// unusable the entries are taken back instead and their ops put in
+	// failed, to go to the thread pool when sq_lock is let go.
+	void submit_locked(std::vector<op *> &failed) {
+		unsigned tries = 0;
+		while (pending && !ring_error) {
+			int r = uring_enter(pending, 0, 0);
+			if (r > 0) {
+				pending -= unsigned(r);
+				tries = 0;
+			} else if (r < 0 && errno == EINTR) {
+				continue;
+			} else if (r < 0 &&
+				   (errno == EAGAIN || errno == EBUSY) &&
+				   ++tries < 1000) {
+				// These pass once the reaper frees completions
+				// or memory frees up.
+				std::this_thread::sleep_for(
+					std::chrono::milliseconds(1));
+			} else {
+				// Taking nothing, or still busy after a second,
+				// counts as broken too.
+				ring_error = r < 0 ? errno : EIO;
+			}
+		}
+		if (ring_error && pending)
+			take_back_pending(failed);
+	}
+
+	void take_back_pending(std::vector<op *> &failed) {
+		unsigned tail = *sq_tail;
+		for (unsigned i = tail - pending; i != tail; ++i) {
+			op *o = reinterpret_cast<op *>(
+				sqes[sq_array[i & sq_mask]].user_data);
+			if (o)
+				failed.push_back(o);
+		}
+		__atomic_store_n(sq_tail, tail - pending, __ATOMIC_RELEASE);
+		pending = 0;
+	}
+
+	void fall_back(const std::vector<op *> &ops) {
+		for (op *o : ops)
+			run_blocking(o);
+	}
+
+	// Waits for a completion, for at most a tenth of a second where the
+	// kernel allows a timeout: once the ring has failed no completion
+	// may ever come, and teardown still needs the reaper to notice. On
+	// older kernels the wait is unbounded.
+	int uring_wait() {
+#ifdef IORING_ENTER_EXT_ARG
+		if (timed_wait) {
+			struct io_uring_getevents_arg arg;
+			struct __kernel_timespec ts;
+			std::memset(&arg, 0, sizeof(arg));
+			ts.tv_sec = 0;
+			ts.tv_nsec = 100 * 1000 * 1000;
+			arg.ts = reinterpret_cast<uint64_t>(&ts);
+			int r = uring_enter(0, 1,
+					    IORING_ENTER_GETEVENTS |
+						    IORING_ENTER_EXT_ARG,
+					    &arg, sizeof(arg));
+			return r < 0 && errno == ETIME ? 0 : r;
+		}
+#endif
+		return uring_enter(0, 1, IORING_ENTER_GETEVENTS);
+	}
+
+	// Sleeps in io_uring_enter until there is a completion. Should that
+	// fail other than for a signal, the completion ring is polled every
+	// millisecond from then on rather than the call retried in a spin.
+	void wait_for_completion() {
+		if (!ring_error) {
+			if (uring_wait() >= 0 || errno == EINTR)
+				return;
+			// EAGAIN and EBUSY pass once completions are reaped
+			// or memory frees up; wait a little either way.
+			if (errno != EAGAIN && errno != EBUSY)
+				ring_error = errno;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	void reap_loop() {
+		for (;;) {
+			unsigned head = *cq_head;
+			unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+			if (head == tail) {
+				if (ring_error && stopping)
+					return;
+				wait_for_completion();
+				continue;
+			}
+			bool stop = false;
+			for (; head != tail; ++head) {
+				struct io_uring_cqe *cqe = &cqes[head & cq_mask];
+				op *o = reinterpret_cast<op *>(cqe->user_data);
+				int res = cqe->res;
+				__atomic_store_n(cq_head, head + 1,
+						 __ATOMIC_RELEASE);
+				if (o)
+					complete(o, res);
+				else
+					stop = true;
+			}
+			if (stop)
+				return;
+			// Anything the callbacks issued goes out as one batch.
+			submit();
+		}
+	}
+#endif
+
+	// Set on engine threads while they run a callback.
+	static bool &in_callback() {
+		static thread_local bool flag = false;
+		return flag;
+	}
+
+	// Waits for a free slot in the queue. Callbacks don't wait, since
+	// they would be holding up the completions that free slots; they may
+	// take the queue a little past its depth instead.
+	void acquire_slot() {
+		std::unique_lock<std::mutex> l(lock);
+		if (in_flight >= depth && !in_callback()) {
+			// Whatever is queued has to go to the kernel for a slot
+			// to come back.
+			l.unlock();
+			submit();
+			l.lock();
+			while (in_flight >= depth)
+				cv.wait(l);
+		}
+		++in_flight;
+		++unfinished;
+	}
+
+	// Frees the slot before the callback, so the callback can issue more.
+	void complete(op *o, ssize_t res) {
+		std::unique_ptr<op> owned(o);
+		{
+			std::lock_guard<std::mutex> l(lock);
+			--in_flight;
+		}
+		cv.notify_all();
+		if (owned->cb) {
+			in_callback() = true;
+			owned->cb(res);
+			in_callback() = false;
+		}
+		{
+			std::lock_guard<std::mutex> l(lock);
+			--unfinished;
+		}
+		cv.notify_all();
+	}
+
+	cpputil::thread_pool &fallback_pool() {
+		std::call_once(pool_once, [this]() {
+			pool.reset(new cpputil::thread_pool(depth));
+		});
+		return *pool;
+	}
+
+	// Runs o as a blocking call on the thread pool.
+	void run_blocking(op *o) {
+		fallback_pool().post([this, o]() {
+			ssize_t r;
+			do {
+				switch (o->k) {
+				case k_read:
+					r = ::pread(o->fd, o->iov.iov_base,
+						    o->iov.iov_len, o->offset);
+					break;
+				case k_write:
+					r = ::pwrite(o->fd, o->iov.iov_base,
+						     o->iov.iov_len, o->offset);
+					break;
+				case k_fsync:
+					r = ::fsync(o->fd);
+					break;
+				default:
+					r = ::fdatasync(o->fd);
+					break;
+				}
+			} while (r < 0 && errno == EINTR);
+			complete(o, r < 0 ? -errno : r);
+		});
+	}
+
+	void issue(kind k, int fd, void *buf, size_t n, off_t offset,
+		   callback cb) {
+		acquire_slot();
+		op *o = new op;
+		o->cb = std::move(cb);
+		o->iov.iov_base = buf;
+		o->iov.iov_len = n;
+		o->k = k;
+		o->fd = fd;
+		o->offset = offset;
+#ifdef IO_ENGINE_HAVE_URING
+		if (ring_fd >= 0 && !ring_error) {
+			queue_op(o);
+			return;
+		}
+#endif
+		run_blocking(o);
+	}
+
+	std::future<ssize_t> issue(kind k, int fd, void *buf, size_t n,
+				   off_t offset) {
+		auto p = std::make_shared<std::promise<ssize_t>>();
+		std::future<ssize_t> f = p->get_future();
+		issue(k, fd, buf, n, offset,
+		      [p](ssize_t r) { p->set_value(r); });
+		return f;
+	}
+
+	io_engine(const io_engine &) = delete;
+	io_engine &operator=(const io_engine &) = delete;
+
+public:
+	// With force_fallback, the thread pool is used even where io_uring
+	// works, for comparison.
+	explicit io_engine(unsigned queue_depth = 64, bool force_fallback = false)
+		: depth(queue_depth ? queue_depth : 1), in_flight(0),
+		  unfinished(0) {
+#ifdef IO_ENGINE_HAVE_URING
+		ring_fd = -1;
+		ring_error = 0;
+		if (!force_fallback && setup_ring(depth))
+			return;
+#else
+		(void)force_fallback;
+#endif
+		fallback_pool();
+	}
+
+	~io_engine() {
+		drain();
+#ifdef IO_ENGINE_HAVE_URING
+		if (ring_fd >= 0)
+			teardown_ring();
+#endif
+	}
+
+	// False from the time the ring fails, if it does.
+	bool using_io_uring() const {
+#ifdef IO_ENGINE_HAVE_URING
+		return ring_fd >= 0 && !ring_error;
+#else
+		return false;
+#endif
+	}
+
+	unsigned queue_depth() const {
+		return depth;
+	}
+
+	// Queue an operation. With io_uring nothing reaches the kernel until
+	// submit() (or the queue fills), so issue a batch and submit once.
+	void read(int fd, void *buf, size_t n, off_t offset, callback cb) {
+		issue(k_read, fd, buf, n, offset, std::move(cb));
+	}
+	void write(int fd, const void *buf, size_t n, off_t offset,
+		   callback cb) {
+		issue(k_write, fd, const_cast<void *>(buf), n, offset,
+		      std::move(cb));
+	}
+	void fsync(int fd, callback cb) {
+		issue(k_fsync, fd, nullptr, 0, 0, std::move(cb));
+	}
+	void fdatasync(int fd, callback cb) {
+		issue(k_fdatasync, fd, nullptr, 0, 0, std::move(cb));
+	}
+
+	std::future<ssize_t> read(int fd, void *buf, size_t n, off_t offset) {
+		return issue(k_read, fd, buf, n, offset);
+	}
+	std::future<ssize_t> write(int fd, const void *buf, size_t n,
+				   off_t offset) {
+		return issue(k_write, fd, const_cast<void *>(buf), n, offset);
+	}
+	std::future<ssize_t> fsync(int fd) {
+		return issue(k_fsync, fd, nullptr, 0, 0);
+	}
+	std::future<ssize_t> fdatasync(int fd) {
+		return issue(k_fdatasync, fd, nullptr, 0, 0);
+	}
+
+	// Hands queued operations to the kernel.
+	void submit() {
+#ifdef IO_ENGINE_HAVE_URING
+		if (ring_fd >= 0) {
+			std::vector<op *> failed;
+			{
+				std::lock_guard<std::mutex> l(sq_lock);
+				submit_locked(failed);
+			}
+			fall_back(failed);
+		}
+#endif
+	}
+
+	// Submits, then waits for every operation issued so far, and any
+	// their callbacks issue, to complete.
+	void drain() {
+		submit();
+		std::unique_lock<std::mutex> l(lock);
+		while (unfinished)
+			cv.wait(l);
+	}
+};
+#endif
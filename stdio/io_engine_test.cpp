@@ -0,0 +1,148 @@
+#include "io_engine.hpp"
+#include "libcpp-util/util/test_check.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+static const char *const path = "io_engine_test.tmp";
+
+// With io_uring nothing goes to the kernel before submit(), so a future
+// waits for it; the thread pool starts each operation as it is issued.
+static void test_submit(io_engine &e) {
+	int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	CHECK(fd >= 0);
+	const char text[] = "hello, io_engine";
+	std::future<ssize_t> w = e.write(fd, text, sizeof(text), 0);
+	if (e.using_io_uring()) {
+		CHECK(w.wait_for(std::chrono::milliseconds(100)) ==
+		      std::future_status::timeout);
+		e.submit();
+	}
+	CHECK(w.wait_for(std::chrono::seconds(10)) ==
+	      std::future_status::ready);
+	CHECK(w.get() == ssize_t(sizeof(text)));
+	char back[sizeof(text)];
+	std::future<ssize_t> r = e.read(fd, back, sizeof(back), 0);
+	e.submit();
+	CHECK(r.get() == ssize_t(sizeof(text)));
+	CHECK(std::memcmp(back, text, sizeof(text)) == 0);
+	std::future<ssize_t> s = e.fdatasync(fd);
+	e.submit();
+	CHECK(s.get() == 0);
+	r = e.read(-1, back, sizeof(back), 0);
+	e.submit();
+	CHECK(r.get() == -EBADF);
+	close(fd);
+}
+
+// Many more operations than the queue is deep, from several threads, with
+// callbacks that issue more; drain() waits for the lot.
+static void test_chained(io_engine &e) {
+	int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	CHECK(fd >= 0);
+	const int threads = 4, per_thread = 200;
+	std::vector<uint32_t> out(threads * per_thread), in(out.size());
+	std::atomic<int> written(0), read(0);
+	std::vector<std::thread> issuers;
+	// Reads a word back once it is written.
+	auto read_back = [&](int i) {
+		e.read(fd, &in[i], 4, off_t(i) * 4, [&](ssize_t n) {
+			CHECK(n == 4);
+			++read;
+		});
+	};
+	for (int t = 0; t < threads; ++t)
+		issuers.emplace_back([&, t] {
+			for (int i = t * per_thread; i < (t + 1) * per_thread;
+			     ++i) {
+				out[i] = uint32_t(i) * 2654435761u;
+				e.write(fd, &out[i], 4, off_t(i) * 4,
+					[&, i](ssize_t n) {
+						CHECK(n == 4);
+						++written;
+						read_back(i);
+					});
+			}
+			e.submit();
+		});
+	for (auto &t : issuers)
+		t.join();
+	e.drain();
+	CHECK(written == threads * per_thread && read == written);
+	CHECK(in == out);
+	close(fd);
+}
+
+// The descriptor of the process's only io_uring instance, or -1.
+static int find_ring_fd() {
+	int found = -1;
+	for (int fd = 0; fd < 1024; ++fd) {
+		char link[64], target[64];
+		snprintf(link, sizeof(link), "/proc/self/fd/%d", fd);
+		ssize_t n = readlink(link, target, sizeof(target) - 1);
+		if (n < 0)
+			continue;
+		target[n] = '\0';
+		if (std::strcmp(target, "anon_inode:[io_uring]") == 0)
+			found = fd;
+	}
+	return found;
+}
+
+// The ring breaking under a running engine: the operation queued but not
+// yet submitted, and everything after, run on the thread pool instead.
+static void test_ring_failure() {
+	io_engine e(8);
+	if (!e.using_io_uring())
+		return;
+	int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	CHECK(fd >= 0);
+	const char text[] = "before and after";
+	std::future<ssize_t> w = e.write(fd, text, sizeof(text), 0);
+	e.submit();
+	CHECK(w.get() == ssize_t(sizeof(text)));
+
+	char back[sizeof(text)];
+	std::future<ssize_t> r = e.read(fd, back, sizeof(back), 0);
+	// Swapped for a descriptor io_uring_enter rejects; the number stays
+	// taken, so the engine closing it later is harmless.
+	int ring = find_ring_fd();
+	CHECK(ring >= 0);
+	int null = open("/dev/null", O_RDONLY);
+	CHECK(null >= 0 && dup2(null, ring) == ring);
+	close(null);
+	e.submit();
+	CHECK(r.get() == ssize_t(sizeof(text)));
+	CHECK(std::memcmp(back, text, sizeof(text)) == 0);
+	CHECK(!e.using_io_uring());
+	close(fd);
+
+	test_submit(e);
+	test_chained(e);
+}
+
+int main() {
+	for (bool fallback : {false, true}) {
+		io_engine e(8, fallback);
+		CHECK(e.queue_depth() == 8);
+		if (fallback)
+			CHECK(!e.using_io_uring());
+		else if (!e.using_io_uring())
+			printf("io_uring not available, only the fallback "
+			       "tested\n");
+		test_submit(e);
+		test_chained(e);
+	}
+	test_ring_failure();
+	unlink(path);
+	printf("io_engine_test: all passed\n");
+	return 0;
+}
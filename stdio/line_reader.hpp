@@ -0,0 +1,131 @@
+#ifndef LINE_READER_HPP
+#define LINE_READER_HPP
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+#include <unistd.h>
+
+#include "libcpp-util/cxx14/string_ref.h"
+#include "libcpp-util/stdio/stdio_file.hpp"
+
+// Reads text a line at a time through one large buffer. Each line comes back
+// as a string_ref into the buffer, without its '\n', and stays valid until
+// the next call to next(); nothing is copied unless a line straddles two
+// reads, in which case its start is moved to the front of the buffer once.
+// A line longer than the buffer grows it.
+//
+// Each refill waits for no more than one read(2) returns, so lines from a
+// pipe, socket or terminal come out as they arrive. Reading from a
+// stdio_file first takes whatever stdio had already buffered, then reads
+// its descriptor directly; the FILE can be read on from where the
+// line_reader stopped reading. A FILE with no descriptor (fopencookie,
+// fmemopen) is read through stdio, one buffer's worth at a time.
+class line_reader {
+private:
+	FILE *F;
+	int fd;
+	std::unique_ptr<char[]> buf;
+	size_t cap;
+	size_t pos;	// Start of the next line.
+	size_t scan;	// Where to resume looking for '\n'.
+	size_t end;	// End of valid data.
+	bool at_eof;
+	int err;
+
+	// Appends at most cap - end bytes; returns how many, 0 at the end.
+	size_t fill() {
+		for (;;) {
+			ssize_t n = F ? stdio_read_some(F, buf.get() + end,
+							cap - end)
+				      : ::read(fd, buf.get() + end, cap - end);
+			if (n >= 0)
+				return size_t(n);
+			if (errno != EINTR) {
+				err = errno;
+				return 0;
+			}
+		}
+	}
+
+	void refill() {
+		if (pos == end) {
+			pos = scan = end = 0;
+		} else if (pos != 0) {
+			std::memmove(buf.get(), buf.get() + pos, end - pos);
+			scan -= pos;
+			end -= pos;
+			pos = 0;
+		} else if (end == cap) {
+			std::unique_ptr<char[]> bigger(new char[cap * 2]);
+			std::memcpy(bigger.get(), buf.get(), end);
+			buf = std::move(bigger);
+			cap *= 2;
+		}
+		size_t n = fill();
+		end += n;
+		if (!n)
+			at_eof = true;
+	}
+
+	void init(size_t bufsize) {
+		cap = bufsize ? bufsize : 1;
+		buf.reset(new char[cap]);
+	}
+
+public:
+	explicit line_reader(stdio_file &f, size_t bufsize = 1 << 20)
+		: F(f.get_file()), fd(-1), cap(0), pos(0), scan(0), end(0),
+		  at_eof(false), err(0) {
+		init(bufsize);
+	}
+
+	explicit line_reader(int fd, size_t bufsize = 1 << 20)
+		: F(nullptr), fd(fd), cap(0), pos(0), scan(0), end(0),
+		  at_eof(false), err(0) {
+		init(bufsize);
+	}
+
+	line_reader(const line_reader &) = delete;
+	line_reader &operator=(const line_reader &) = delete;
+
+	// Sets line to the next line and returns true, or returns false at
+	// the end of input or on a read error. A final line with no '\n' is
+	// still returned.
+	bool next(string_ref &line) {
+		for (;;) {
+			const char *b = buf.get();
+			const char *nl = static_cast<const char *>(
+				std::memchr(b + scan, '\n', end - scan));
+			if (nl) {
+				size_t len = size_t(nl - b) - pos;
+				line = string_ref(b + pos, len);
+				pos = scan = pos + len + 1;
+				return true;
+			}
+			scan = end;
+			if (at_eof || err) {
+				if (pos == end)
+					return false;
+				line = string_ref(b + pos, end - pos);
+				pos = scan = end;
+				return true;
+			}
+			refill();
+		}
+	}
+
+	// The errno of a failed read, or 0 if next() stopped at end of input.
+	int error() const {
+		return err;
+	}
+
+	size_t buffer_size() const {
+		return cap;
+	}
+};
+#endif
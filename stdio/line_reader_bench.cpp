@@ -0,0 +1,117 @@
+// line_reader against the usual ways of reading lines.
+//
+//   line_reader_bench [size_mb [path]]
+//
+// Writes a text file of size_mb (default 1024) with lines of 10-120 bytes
+// at path (default ./line_reader_bench.tmp), reads it with each method, and
+// removes it. The file is read once untimed first, so all methods see a warm
+// page cache and the numbers are CPU cost per line.
+#include "line_reader.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using bench_clock = std::chrono::steady_clock;
+
+// Each reader returns a checksum of line lengths so nothing is optimized
+// away and the methods can be checked against each other.
+static size_t by_fgets(const char *path) {
+	stdio_file f(path, "r");
+	std::vector<char> buf(1 << 16);
+	size_t sum = 0;
+	while (f.fgets(buf.data(), int(buf.size())))
+		sum += strlen(buf.data()) - 1;
+	return sum;
+}
+
+static size_t by_getline(const char *path) {
+	stdio_file f(path, "r");
+	char *line = nullptr;
+	size_t cap = 0;
+	ssize_t n;
+	size_t sum = 0;
+	while ((n = ::getline(&line, &cap, f.get_file())) > 0)
+		sum += size_t(n) - 1;
+	free(line);
+	return sum;
+}
+
+static size_t by_std_getline(const char *path) {
+	std::ifstream in(path);
+	std::string line;
+	size_t sum = 0;
+	while (std::getline(in, line))
+		sum += line.size();
+	return sum;
+}
+
+static size_t by_line_reader_file(const char *path) {
+	stdio_file f(path, "r");
+	line_reader r(f);
+	string_ref line;
+	size_t sum = 0;
+	while (r.next(line))
+		sum += line.size();
+	return sum;
+}
+
+static size_t by_line_reader_fd(const char *path, size_t bufsize) {
+	int fd = ::open(path, O_RDONLY);
+	line_reader r(fd, bufsize);
+	string_ref line;
+	size_t sum = 0;
+	while (r.next(line))
+		sum += line.size();
+	::close(fd);
+	return sum;
+}
+
+template <typename F>
+static void run(const char *name, size_t bytes, F f) {
+	auto start = bench_clock::now();
+	size_t sum = f();
+	std::chrono::duration<double> d = bench_clock::now() - start;
+	printf("%-28s %8.0f MB/s  (%zu)\n", name, bytes / d.count() / 1e6, sum);
+}
+
+int main(int argc, char **argv) {
+	size_t size = size_t(argc > 1 ? atoi(argv[1]) : 1024) << 20;
+	const char *path = argc > 2 ? argv[2] : "line_reader_bench.tmp";
+
+	{
+		stdio_file f(path, "w");
+		if (!f.get_file()) {
+			perror(path);
+			return 1;
+		}
+		std::mt19937 rng(1);
+		std::string line;
+		for (size_t n = 0; n < size; n += line.size()) {
+			line.assign(10 + rng() % 110, 'x');
+			line.back() = '\n';
+			f.fwrite(line.data(), 1, line.size());
+		}
+	}
+	by_line_reader_fd(path, 1 << 20);
+
+	run("fgets", size, [&] { return by_fgets(path); });
+	run("getline", size, [&] { return by_getline(path); });
+	run("std::getline", size, [&] { return by_std_getline(path); });
+	run("line_reader(stdio_file)", size,
+	    [&] { return by_line_reader_file(path); });
+	run("line_reader(fd) 64K", size,
+	    [&] { return by_line_reader_fd(path, 1 << 16); });
+	run("line_reader(fd) 1M", size,
+	    [&] { return by_line_reader_fd(path, 1 << 20); });
+	run("line_reader(fd) 8M", size,
+	    [&] { return by_line_reader_fd(path, 8 << 20); });
+
+	unlink(path);
+}
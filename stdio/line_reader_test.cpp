@@ -0,0 +1,128 @@
+#include "line_reader.hpp"
+#include "libcpp-util/util/test_check.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+static bool next_is(line_reader &r, const char *expect) {
+	string_ref line;
+	return r.next(line) && std::string(line.data(), line.size()) == expect;
+}
+
+// A line written to a pipe comes out while the writer still has it open,
+// from a stdio_file and from a bare descriptor.
+static void test_pipe_line_before_eof(bool through_stdio) {
+	int p[2];
+	CHECK(pipe(p) == 0);
+	std::atomic<bool> got_first(false), closed(false);
+	std::thread writer([&] {
+		CHECK(write(p[1], "first\n", 6) == 6);
+		// Give up after a while, so a broken reader fails the check
+		// below rather than hanging.
+		for (int i = 0; i < 500 && !got_first; ++i)
+			std::this_thread::sleep_for(
+				std::chrono::milliseconds(10));
+		CHECK(write(p[1], "second\n", 7) == 7);
+		closed = true;
+		close(p[1]);
+	});
+	stdio_file f;
+	if (through_stdio)
+		CHECK(f.fdopen(p[0], "r"));
+	std::unique_ptr<line_reader> r(through_stdio
+					       ? new line_reader(f)
+					       : new line_reader(p[0]));
+	CHECK(next_is(*r, "first"));
+	CHECK(!closed);
+	got_first = true;
+	CHECK(next_is(*r, "second"));
+	string_ref line;
+	CHECK(!r->next(line) && r->error() == 0);
+	writer.join();
+	if (!through_stdio)
+		close(p[0]);
+}
+
+// What stdio had buffered before the line_reader came along is read first.
+static void test_stdio_read_ahead() {
+	int p[2];
+	CHECK(pipe(p) == 0);
+	CHECK(write(p[1], "abc\ndef\nghi", 11) == 11);
+	close(p[1]);
+	stdio_file f(p[0], "r");
+	CHECK(f.fgetc() == 'a');
+	line_reader r(f);
+	CHECK(next_is(r, "bc"));
+	CHECK(next_is(r, "def"));
+	CHECK(next_is(r, "ghi"));
+	string_ref line;
+	CHECK(!r.next(line));
+}
+
+// A regular file is read through stdio, so its offset stays right.
+static void test_read_some_offset() {
+	stdio_file f(tmpfile());
+	CHECK(f.get_file() && f.fputs("hello world") >= 0);
+	rewind(f.get_file());
+	CHECK(f.fgetc() == 'h');
+	char buf[64];
+	CHECK(stdio_read_some(f.get_file(), buf, 4) == 4);
+	CHECK(std::string(buf, 4) == "ello");
+	CHECK(stdio_read_some(f.get_file(), buf, sizeof(buf)) == 6);
+	CHECK(std::string(buf, 6) == " world" && ftell(f.get_file()) == 11);
+	CHECK(stdio_read_some(f.get_file(), buf, sizeof(buf)) == 0);
+	CHECK(fseek(f.get_file(), 6, SEEK_SET) == 0);
+	CHECK(stdio_read_some(f.get_file(), buf, sizeof(buf)) == 5);
+	CHECK(ftell(f.get_file()) == 11);
+}
+
+// Lines longer than the buffer grow it, and lines straddling reads come
+// out whole.
+static void test_small_buffer() {
+	stdio_file f(tmpfile());
+	CHECK(f.get_file());
+	std::vector<std::string> lines;
+	for (size_t len = 0; len < 100; ++len) {
+		lines.push_back(std::string(len, char('a' + len % 26)));
+		CHECK(fputs((lines.back() + "\n").c_str(), f.get_file()) >= 0);
+	}
+	CHECK(f.fflush() == 0);
+	rewind(f.get_file());
+	line_reader r(f, 3);
+	for (auto &l : lines)
+		CHECK(next_is(r, l.c_str()));
+	string_ref line;
+	CHECK(!r.next(line) && r.error() == 0);
+	CHECK(r.buffer_size() >= 100);
+}
+
+// A FILE with no descriptor underneath is read through stdio.
+static void test_no_descriptor() {
+	char text[] = "x\nyy\n\nzzz";
+	stdio_file f(fmemopen(text, sizeof(text) - 1, "r"));
+	CHECK(f.get_file());
+	line_reader r(f, 4);
+	CHECK(next_is(r, "x"));
+	CHECK(next_is(r, "yy"));
+	CHECK(next_is(r, ""));
+	CHECK(next_is(r, "zzz"));
+	string_ref line;
+	CHECK(!r.next(line));
+}
+
+int main() {
+	test_pipe_line_before_eof(true);
+	test_pipe_line_before_eof(false);
+	test_stdio_read_ahead();
+	test_read_some_offset();
+	test_small_buffer();
+	test_no_descriptor();
+	printf("line_reader_test: all passed\n");
+	return 0;
+}
@@ -0,0 +1,300 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "libcpp-util/cxx14/array_ref.h"
+#include "libcpp-util/cxx14/string_ref.h"
+
+// A whole file mapped into memory, handed out as string_ref or array_ref so
+// it can be processed in place instead of being read into a vector first.
+// Like stdio_file, failures are reported by return value with errno set;
+// nothing throws.
+//
+// The mapping stays valid after the descriptor is closed, so mapped_file
+// doesn't keep one. Views into it dangle once it is closed or destroyed.
+// Truncating the file underneath a mapping makes touching the lost pages
+// raise SIGBUS, as with any mmap.
+class mapped_file {
+public:
+	enum access_mode { read_only, read_write };
+
+	enum advice {
+		normal = MADV_NORMAL,
+		sequential = MADV_SEQUENTIAL,
+		random = MADV_RANDOM,
+		willneed = MADV_WILLNEED,
+		dontneed = MADV_DONTNEED,
+	};
+
+	// Or'ed into the flags given to open().
+	enum {
+		// Fault every page in up front, so the first pass doesn't pay
+		// for page faults one at a time. Ignored where unsupported.
+		populate = 1,
+	};
+
+private:
+	char *addr;
+	size_t len;
+	access_mode mode;
+	bool mapped;
+
+public:
+	mapped_file() : addr(nullptr), len(0), mode(read_only), mapped(false) {
+	}
+
+	// Check is_open() afterwards.
+	mapped_file(const char *path, access_mode m = read_only, int flags = 0)
+		: mapped_file() {
+		open(path, m, flags);
+	}
+
+	mapped_file(const mapped_file &) = delete;
+	mapped_file &operator=(const mapped_file &) = delete;
+
+	mapped_file(mapped_file &&rhs)
+		: addr(rhs.addr), len(rhs.len), mode(rhs.mode),
+		  mapped(rhs.mapped) {
+		rhs.addr = nullptr;
+		rhs.len = 0;
+		rhs.mapped = false;
+	}
+
+	mapped_file &operator=(mapped_file &&rhs) {
+		mapped_file tmp(std::move(rhs));
+		swap(tmp);
+		return *this;
+	}
+
+	~mapped_file() {
+		close();
+	}
+
+	void swap(mapped_file &rhs) {
+		std::swap(addr, rhs.addr);
+		std::swap(len, rhs.len);
+		std::swap(mode, rhs.mode);
+		std::swap(mapped, rhs.mapped);
+	}
+
+	// Maps all of path. With read_write and a nonzero size, the file is
+	// created if needed and resized to size bytes first, which is how to
+	// make a file to fill through the mapping.
+	bool open(const char *path, access_mode m = read_only, int flags = 0,
+		  size_t size = 0) {
+		close();
+		int oflags = m == read_write ? O_RDWR : O_RDONLY;
+		if (m == read_write && size)
+			oflags |= O_CREAT;
+		int fd = ::open(path, oflags | O_CLOEXEC, 0666);
+		if (fd < 0)
+			return false;
+		bool ok = map(fd, m, flags, size);
+		int saved = errno;
+		::close(fd);
+		errno = saved;
+		return ok;
+	}
+
+	// As open(), on a descriptor the caller keeps ownership of.
+	bool map(int fd, access_mode m = read_only, int flags = 0,
+		 size_t size = 0) {
+		close();
+		if (m == read_write && size) {
+			if (::ftruncate(fd, off_t(size)) != 0)
+				return false;
+		} else {
+			struct stat st;
+			if (::fstat(fd, &st) != 0)
+				return false;
+			size = size_t(st.st_size);
+		}
+		mode = m;
+		// mmap refuses zero lengths; an empty file is an open, empty
+		// mapping.
+		if (!size)
+			return mapped = true;
+		int prot = m == read_write ? PROT_READ | PROT_WRITE : PROT_READ;
+		int mflags = MAP_SHARED;
+#ifdef MAP_POPULATE
+		if (flags & populate)
+			mflags |= MAP_POPULATE;
+#else
+		(void)flags;
+#endif
+		void *p = ::mmap(nullptr, size, prot, mflags, fd, 0);
+		if (p == MAP_FAILED)
+			return false;
+		addr = static_cast<char *>(p);
+		len = size;
+		return mapped = true;
+	}
+
+	int close() {
+		int ret = 0;
+		if (addr)
+			ret = ::munmap(addr, len);
+		addr = nullptr;
+		len = 0;
+		mapped = false;
+		return ret;
+	}
+
+	bool is_open() const {
+		return mapped;
+	}
+
+	// Tells the kernel how [offset, offset + n) will be read, which sets
+	// its readahead. offset is rounded down to a page.
+	int advise(advice a, size_t offset = 0, size_t n = size_t(-1)) {
+		if (!addr)
+			return 0;
+		assert(offset <= len);
+		size_t page = size_t(::sysconf(_SC_PAGESIZE));
+		size_t start = offset & ~(page - 1);
+		n = std::min(n, len - offset) + (offset - start);
+		return ::madvise(addr + start, n, int(a));
+	}
+
+	// Writes dirty pages back to the file, waiting for them unless async.
+	int sync(bool async = false) {
+		if (!addr)
+			return 0;
+		return ::msync(addr, len, async ? MS_ASYNC : MS_SYNC);
+	}
+
+	size_t size() const {
+		return len;
+	}
+	bool empty() const {
+		return len == 0;
+	}
+	bool writable() const {
+		return mode == read_write;
+	}
+
+	const char *data() const {
+		return addr;
+	}
+	char *mutable_data() {
+		assert(writable() && "mapped_file is read-only");
+		return addr;
+	}
+
+	string_ref str() const {
+		return string_ref(addr, len);
+	}
+
+	// The contents as whole Ts; a partial T at the end is left out. The
+	// mapping is page aligned, so any T is suitably aligned.
+	template <typename T>
+	array_ref<T> as_array() const {
+		return array_ref<T>(reinterpret_cast<const T *>(addr),
+				    len / sizeof(T));
+	}
+
+	template <typename T>
+	mutable_array_ref<T> as_mutable_array() {
+		assert(writable() && "mapped_file is read-only");
+		return mutable_array_ref<T>(reinterpret_cast<T *>(addr),
+					    len / sizeof(T));
+	}
+};
+
+inline void swap(mapped_file &lhs, mapped_file &rhs) {
+	lhs.swap(rhs);
+}
+
+// Walks text a line at a time. Each line excludes its '\n'; a final line
+// without one is still a line, but a trailing '\n' doesn't make an empty
+// one.
+class line_iterator {
+public:
+	using iterator_category = std::forward_iterator_tag;
+	using value_type = string_ref;
+	using difference_type = ptrdiff_t;
+	using pointer = const string_ref *;
+	using reference = const string_ref &;
+
+private:
+	const char *next;
+	const char *end;
+	string_ref line;
+
+	void advance() {
+		if (next == end) {
+			next = nullptr;
+			return;
+		}
+		const char *nl = static_cast<const char *>(
+			std::memchr(next, '\n', size_t(end - next)));
+		const char *stop = nl ? nl : end;
+		line = string_ref(next, size_t(stop - next));
+		next = nl ? nl + 1 : end;
+	}
+
+public:
+	// The end iterator.
+	line_iterator() : next(nullptr), end(nullptr) {
+	}
+	explicit line_iterator(string_ref text)
+		: next(text.data()), end(text.data() + text.size()) {
+		advance();
+	}
+
+	reference operator*() const {
+		return line;
+	}
+	pointer operator->() const {
+		return &line;
+	}
+	line_iterator &operator++() {
+		advance();
+		return *this;
+	}
+	line_iterator operator++(int) {
+		line_iterator ret = *this;
+		advance();
+		return ret;
+	}
+
+	bool operator==(const line_iterator &rhs) const {
+		return next == rhs.next;
+	}
+	bool operator!=(const line_iterator &rhs) const {
+		return next != rhs.next;
+	}
+};
+
+// for (string_ref line : lines(file.str())) ...
+class line_range {
+private:
+	string_ref text;
+
+public:
+	explicit line_range(string_ref text) : text(text) {
+	}
+	line_iterator begin() const {
+		return line_iterator(text);
+	}
+	line_iterator end() const {
+		return line_iterator();
+	}
+};
+
+inline line_range lines(string_ref text) {
+	return line_range(text);
+}
+#endif
@@ -0,0 +1,183 @@
+// read() into a buffer versus mapped_file, sequential and random.
+//
+//   mapped_file_bench [size_mb [path]]
+//
+// Writes a text file of size_mb (default 256) at path (default
+// ./mapped_file_bench.tmp) and removes it afterwards. Every case runs warm,
+// from the page cache, and cold, after the file's pages have been dropped
+// with posix_fadvise; cold numbers are only meaningful on a real disk.
+#include "mapped_file.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using bench_clock = std::chrono::steady_clock;
+
+static const size_t page = 4096;
+static const size_t random_reads = 200000;
+
+static void drop_cache(const char *path) {
+	int fd = ::open(path, O_RDONLY);
+	::fdatasync(fd);
+	::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+	::close(fd);
+}
+
+static size_t count_lines(const char *p, size_t n) {
+	size_t lines = 0;
+	for (const char *end = p + n;
+	     (p = static_cast<const char *>(memchr(p, '\n', end - p)));
+	     ++p)
+		++lines;
+	return lines;
+}
+
+// The usual approach: slurp the whole file into a vector first.
+static size_t read_whole(const char *path) {
+	int fd = ::open(path, O_RDONLY);
+	std::vector<char> buf(size_t(::lseek(fd, 0, SEEK_END)));
+	for (size_t off = 0; off < buf.size();) {
+		ssize_t r = ::pread(fd, &buf[off], buf.size() - off, off);
+		if (r <= 0)
+			break;
+		off += size_t(r);
+	}
+	::close(fd);
+	return count_lines(buf.data(), buf.size());
+}
+
+// Streaming through a fixed 1MB buffer, which needs no memory for the whole
+// file but has to deal with lines crossing reads; counting doesn't care.
+static size_t read_chunked(const char *path) {
+	int fd = ::open(path, O_RDONLY);
+	std::vector<char> buf(1 << 20);
+	size_t lines = 0;
+	ssize_t r;
+	while ((r = ::read(fd, buf.data(), buf.size())) > 0)
+		lines += count_lines(buf.data(), size_t(r));
+	::close(fd);
+	return lines;
+}
+
+static size_t mmap_seq(const char *path, int flags, bool advise) {
+	mapped_file m(path, mapped_file::read_only, flags);
+	if (advise)
+		m.advise(mapped_file::sequential);
+	return count_lines(m.data(), m.size());
+}
+
+static size_t mmap_lines(const char *path) {
+	mapped_file m(path);
+	m.advise(mapped_file::sequential);
+	size_t bytes = 0;
+	for (string_ref l : lines(m.str()))
+		bytes += l.size();
+	return bytes;
+}
+
+static std::vector<size_t> random_offsets(size_t size) {
+	std::mt19937_64 rng(42);
+	std::vector<size_t> off(random_reads);
+	for (size_t &o : off)
+		o = rng() % (size - 64);
+	return off;
+}
+
+// 64 bytes at each offset, as an index lookup would.
+static size_t pread_random(const char *path, const std::vector<size_t> &off) {
+	int fd = ::open(path, O_RDONLY);
+	size_t sum = 0;
+	char buf[64];
+	for (size_t o : off)
+		if (::pread(fd, buf, sizeof(buf), o) > 0)
+			sum += (unsigned char)buf[0];
+	::close(fd);
+	return sum;
+}
+
+static size_t mmap_random(const char *path, const std::vector<size_t> &off,
+			  bool advise) {
+	mapped_file m(path);
+	if (advise)
+		m.advise(mapped_file::random);
+	size_t sum = 0;
+	for (size_t o : off)
+		sum += (unsigned char)m.data()[o];
+	return sum;
+}
+
+template <typename F>
+static void run(const char *name, const char *path, size_t bytes, size_t ops,
+		F f) {
+	double t[2];
+	size_t result = 0;
+	for (int cold = 0; cold < 2; ++cold) {
+		if (cold)
+			drop_cache(path);
+		else
+			f(); // Warm the cache.
+		auto start = bench_clock::now();
+		result = f();
+		std::chrono::duration<double> d = bench_clock::now() - start;
+		t[cold] = d.count();
+	}
+	if (ops)
+		printf("%-30s %9.0f %9.0f kops/s   (%zu)\n", name,
+		       ops / t[0] / 1e3, ops / t[1] / 1e3, result);
+	else
+		printf("%-30s %9.0f %9.0f MB/s     (%zu)\n", name,
+		       bytes / t[0] / 1e6, bytes / t[1] / 1e6, result);
+}
+
+int main(int argc, char **argv) {
+	size_t size = size_t(argc > 1 ? atoi(argv[1]) : 256) << 20;
+	const char *path = argc > 2 ? argv[2] : "mapped_file_bench.tmp";
+
+	{
+		FILE *f = fopen(path, "w");
+		if (!f) {
+			perror(path);
+			return 1;
+		}
+		std::mt19937 rng(1);
+		std::vector<char> line;
+		for (size_t n = 0; n < size;) {
+			line.assign(10 + rng() % 110, 'x');
+			line.back() = '\n';
+			fwrite(line.data(), 1, line.size(), f);
+			n += line.size();
+		}
+		fclose(f);
+	}
+	mapped_file probe(path);
+	size = probe.size();
+	probe.close();
+
+	printf("%zu MB file                       warm      cold\n",
+	       size >> 20);
+	run("read whole file", path, size, 0, [&] { return read_whole(path); });
+	run("read 1MB chunks", path, size, 0, [&] { return read_chunked(path); });
+	run("mmap", path, size, 0, [&] { return mmap_seq(path, 0, false); });
+	run("mmap + sequential", path, size, 0,
+	    [&] { return mmap_seq(path, 0, true); });
+	run("mmap + populate", path, size, 0,
+	    [&] { return mmap_seq(path, mapped_file::populate, false); });
+	run("mmap line_iterator", path, size, 0,
+	    [&] { return mmap_lines(path); });
+
+	std::vector<size_t> off = random_offsets(size);
+	run("pread 64B random", path, 0, off.size(),
+	    [&] { return pread_random(path, off); });
+	run("mmap random", path, 0, off.size(),
+	    [&] { return mmap_random(path, off, false); });
+	run("mmap + random advice", path, 0, off.size(),
+	    [&] { return mmap_random(path, off, true); });
+
+	unlink(path);
+}
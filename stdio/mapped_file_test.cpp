@@ -0,0 +1,141 @@
+#include "mapped_file.hpp"
+#include "libcpp-util/util/test_check.h"
+#include <cstdio>
+#include <string>
+#include <vector>
+
+static const char *const path = "mapped_file_test.tmp";
+
+static std::string str(string_ref s) {
+	return std::string(s.data(), s.size());
+}
+
+static void put_file(const std::string &s) {
+	int fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	CHECK(fd >= 0);
+	CHECK(write(fd, s.data(), s.size()) == ssize_t(s.size()));
+	::close(fd);
+}
+
+static std::vector<std::string> all_lines(string_ref text) {
+	std::vector<std::string> v;
+	for (string_ref line : lines(text))
+		v.push_back(str(line));
+	return v;
+}
+
+// Whether [p, p + n) is still mapped.
+static bool is_mapped(const char *p, size_t n) {
+	size_t page = size_t(sysconf(_SC_PAGESIZE));
+	unsigned char vec[16];
+	CHECK((n + page - 1) / page <= sizeof(vec));
+	return mincore(const_cast<char *>(p), n, vec) == 0;
+}
+
+// An empty file opens as an empty mapping that every call copes with.
+static void test_empty() {
+	put_file("");
+	mapped_file m(path);
+	CHECK(m.is_open() && m.empty() && m.size() == 0);
+	CHECK(m.str().empty() && m.as_array<int>().empty());
+	CHECK(all_lines(m.str()).empty());
+	CHECK(m.advise(mapped_file::sequential) == 0 && m.sync() == 0);
+	CHECK(m.close() == 0 && !m.is_open());
+	CHECK(m.open(path, mapped_file::read_write) && m.empty());
+
+	mapped_file missing("mapped_file_test.missing");
+	CHECK(!missing.is_open() && errno == ENOENT);
+}
+
+static void test_lines() {
+	typedef std::vector<std::string> v;
+	CHECK(all_lines("") == v());
+	CHECK(all_lines("\n") == v({""}));
+	CHECK(all_lines("one") == v({"one"}));
+	CHECK(all_lines("one\n") == v({"one"}));
+	CHECK(all_lines("one\ntwo") == v({"one", "two"}));
+	CHECK(all_lines("one\n\ntwo\n\n") == v({"one", "", "two", ""}));
+
+	// No trailing newline, from a file whose last byte ends a page, so
+	// a look past the end would fault.
+	size_t page = size_t(sysconf(_SC_PAGESIZE));
+	std::string text(page, 'x');
+	text[10] = '\n';
+	put_file(text);
+	mapped_file m(path, mapped_file::read_only, mapped_file::populate);
+	CHECK(m.size() == page);
+	v got = all_lines(m.str());
+	CHECK(got.size() == 2 && got[0] == text.substr(0, 10));
+	CHECK(got[1] == text.substr(11));
+
+	line_iterator it(m.str()), copy = it++;
+	CHECK(copy->size() == 10 && it->size() == page - 11);
+	CHECK(copy != it && ++copy == it && ++it == line_iterator());
+}
+
+// Writing through a read_write mapping reaches the file.
+static void test_write() {
+	unlink(path);
+	{
+		mapped_file m;
+		CHECK(m.open(path, mapped_file::read_write, 0,
+			     4 * sizeof(int)));
+		CHECK(m.writable() && m.size() == 4 * sizeof(int));
+		mutable_array_ref<int> a = m.as_mutable_array<int>();
+		for (size_t i = 0; i < a.size(); ++i)
+			a[i] = int(i * i);
+		CHECK(m.sync() == 0);
+	}
+	mapped_file m(path);
+	CHECK(!m.writable());
+	array_ref<int> a = m.as_array<int>();
+	CHECK(a.size() == 4 && a[3] == 9);
+	CHECK(m.advise(mapped_file::random, 5, 3) == 0);
+}
+
+// Ownership of the mapping moves with the object: moved-from objects are
+// closed and don't unmap, and close() and reassignment do.
+static void test_move() {
+	put_file("contents\n");
+	mapped_file a(path);
+	const char *p = a.data();
+	CHECK(is_mapped(p, a.size()));
+
+	mapped_file b(std::move(a));
+	CHECK(!a.is_open() && a.data() == nullptr && a.size() == 0);
+	CHECK(b.data() == p && str(b.str()) == "contents\n");
+	a.close();
+	CHECK(is_mapped(p, b.size()));
+
+	mapped_file c;
+	c = std::move(b);
+	CHECK(c.data() == p && !b.is_open());
+	c = std::move(c);
+	CHECK(c.data() == p && is_mapped(p, c.size()));
+
+	mapped_file d(path);
+	const char *q = d.data();
+	swap(c, d);
+	CHECK(c.data() == q && d.data() == p);
+	c = std::move(d);
+	CHECK(c.data() == p && !is_mapped(q, 9));
+
+	CHECK(c.close() == 0 && !c.is_open() && c.data() == nullptr);
+	CHECK(!is_mapped(p, 9));
+	CHECK(c.close() == 0);
+	{
+		mapped_file e(path);
+		q = e.data();
+	}
+	CHECK(!is_mapped(q, 9));
+}
+
+int main() {
+	test_empty();
+	test_lines();
+	test_write();
+	test_move();
+	unlink(path);
+	printf("mapped_file_test: all passed\n");
+	return 0;
+}
@@ -0,0 +1,503 @@
+#ifndef RECORD_IO_HPP
+#define RECORD_IO_HPP
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+
+#include "libcpp-util/cxx14/array_ref.h"
+#include "libcpp-util/cxx14/string_ref.h"
+#include "libcpp-util/stdio/mapped_file.hpp"
+#include "libcpp-util/stdio/stdio_file.hpp"
+#include "libcpp-util/util/crc32c.h"
+
+// Binary records in a stdio_file or a mapped_file, in one of two framings:
+//
+//   fixed_record_reader<T>   sizeof(T) bytes each, T trivially copyable
+//   varint_record_reader     a LEB128 length, then that many bytes
+//
+// and a writer for each. Readers take the input a large block at a time,
+// with one fread or straight from the mapping, and hand out views into it:
+// an array_ref<T> over every whole record available at once, or a
+// string_ref per varint record. Views stay valid until the next call on the
+// reader. A T read in place is never misaligned as long as alignof(T) <= 8.
+//
+// With record_options::checksum, writers group records into blocks of up
+// to block_size bytes, each behind an 8 byte header holding its length and
+// the CRC-32C of its contents (both little endian), and readers check every
+// block. A record never spans two blocks; one larger than block_size gets a
+// block to itself. Without checksums the file is just the records back to
+// back, so a file of fwrite'n structs reads as fixed records.
+//
+// As with stdio_file, nothing throws. Once a call fails, error() has its
+// errno: that of a failed read or write, or EBADMSG for a checksum mismatch
+// or input that ends partway through a record or block.
+struct record_options {
+	bool checksum;
+	// Bytes per checksummed block, and the size of each read or write.
+	size_t block_size;
+	// Longer varint records are taken as corruption rather than
+	// allocated for.
+	size_t max_record;
+
+	record_options(bool checksum = false, size_t block_size = 1 << 20,
+		       size_t max_record = size_t(1) << 30)
+		: checksum(checksum), block_size(block_size),
+		  max_record(max_record) {
+	}
+};
+
+namespace record_detail {
+
+static const size_t max_varint = 10;
+static const size_t header_size = 8;
+
+inline size_t put_varint(char *p, uint64_t v) {
+	size_t n = 0;
+	while (v >= 0x80) {
+		p[n++] = char(v | 0x80);
+		v >>= 7;
+	}
+	p[n++] = char(v);
+	return n;
+}
+
+// Decodes a varint at the start of [p, end) into *v and returns its length,
+// or 0 if it doesn't end within max_varint bytes or before end.
+inline size_t get_varint(const char *p, const char *end, uint64_t *v) {
+	uint64_t r = 0;
+	for (size_t i = 0; i < max_varint && p + i < end; ++i) {
+		unsigned char b = static_cast<unsigned char>(p[i]);
+		r |= uint64_t(b & 0x7f) << (7 * i);
+		if (!(b & 0x80)) {
+			*v = r;
+			return i + 1;
+		}
+	}
+	return 0;
+}
+
+inline void put_le32(char *p, uint32_t v) {
+	for (int i = 0; i < 4; ++i)
+		p[i] = char(v >> (8 * i));
+}
+
+inline uint32_t get_le32(const char *p) {
+	uint32_t v = 0;
+	for (int i = 0; i < 4; ++i)
+		v |= uint32_t(static_cast<unsigned char>(p[i])) << (8 * i);
+	return v;
+}
+
+// The reading half shared by both readers. Bytes [cur, lim) are ready to
+// decode: everything buffered, or with checksums, the rest of the current
+// block. [cur, end) is everything buffered.
+class input {
+private:
+	FILE *F; // Null when reading from memory.
+	std::unique_ptr<char[]> buf;
+	size_t cap;
+	const char *cur;
+	const char *lim;
+	const char *end;
+	record_options opt;
+	bool at_eof;
+	int err;
+
+	bool fail(int e) {
+		if (!err)
+			err = e;
+		return false;
+	}
+
+	// The input ran out: cleanly if nothing was left over.
+	bool cut_short() {
+		return cur == end ? false : fail(EBADMSG);
+	}
+
+	// Reads until at least want bytes are buffered from cur, moving them
+	// to the front first and growing the buffer if it is too small.
+	bool fill(size_t want) {
+		if (!F || at_eof || err)
+			return false;
+		size_t have = size_t(end - cur);
+		if (want > cap) {
+			size_t bigger = cap * 2 > want ? cap * 2 : want;
+			std::unique_ptr<char[]> b(new char[bigger]);
+			std::memcpy(b.get(), cur, have);
+			buf = std::move(b);
+			cap = bigger;
+		} else if (cur != buf.get()) {
+			std::memmove(buf.get(), cur, have);
+		}
+		cur = buf.get();
+		end = cur + have;
+		while (have < want) {
+			size_t n = ::fread(buf.get() + have, 1, cap - have, F);
+			if (!n) {
+				if (::ferror(F))
+					err = errno ? errno : EIO;
+				else
+					at_eof = true;
+				break;
+			}
+			have += n;
+		}
+		end = cur + have;
+		lim = opt.checksum ? cur : end;
+		return have >= want;
+	}
+
+	// Checks the block at cur and makes it current.
+	bool next_block() {
+		for (;;) {
+			if (size_t(end - cur) < header_size &&
+			    !fill(header_size))
+				return cut_short();
+			size_t len = get_le32(cur);
+			uint32_t crc = get_le32(cur + 4);
+			if (len > opt.block_size &&
+			    len > opt.max_record + max_varint)
+				return fail(EBADMSG);
+			if (size_t(end - cur) < header_size + len &&
+			    !fill(header_size + len))
+				return cut_short();
+			if (cpputil::crc32c(cur + header_size, len) != crc)
+				return fail(EBADMSG);
+			cur += header_size;
+			lim = cur + len;
+			if (len)
+				return true;
+		}
+	}
+
+public:
+	input(FILE *F, const record_options &o)
+		: F(F), cap(o.block_size ? o.block_size : 1), cur(nullptr),
+		  lim(nullptr), end(nullptr), opt(o), at_eof(false), err(0) {
+		buf.reset(new char[cap]);
+		cur = lim = end = buf.get();
+	}
+
+	input(string_ref data, const record_options &o)
+		: F(nullptr), cap(0), cur(data.data()),
+		  lim(o.checksum ? data.data() : data.data() + data.size()),
+		  end(data.data() + data.size()), opt(o), at_eof(true), err(0) {
+	}
+
+	input(const input &) = delete;
+	input &operator=(const input &) = delete;
+
+	// Makes at least n bytes ready at data(). False at the end of the
+	// input, and on an error, including running out with a partial
+	// record left.
+	bool ensure(size_t n) {
+		if (err)
+			return false;
+		if (!opt.checksum) {
+			if (size_t(end - cur) >= n || fill(n))
+				return true;
+			return cut_short();
+		}
+		if (cur == lim && !next_block())
+			return false;
+		return size_t(lim - cur) >= n || fail(EBADMSG);
+	}
+
+	const char *data() const {
+		return cur;
+	}
+	size_t avail() const {
+		return size_t(lim - cur);
+	}
+	void consume(size_t n) {
+		cur += n;
+	}
+
+	const record_options &options() const {
+		return opt;
+	}
+	bool corrupt() {
+		return fail(EBADMSG);
+	}
+	int error() const {
+		return err;
+	}
+};
+
+// The writing half shared by both writers. Records are gathered into
+// block_size bytes and written with one fwrite, behind a header if
+// checksummed.
+class output {
+private:
+	FILE *F;
+	std::unique_ptr<char[]> buf;
+	size_t cap;
+	size_t used;
+	record_options opt;
+	int err;
+
+	void write_out(const void *p, size_t n) {
+		if (!err && ::fwrite(p, 1, n, F) != n)
+			err = errno ? errno : EIO;
+	}
+
+public:
+	output(FILE *F, const record_options &o)
+		: F(F), cap(o.block_size ? o.block_size : 1), used(0), opt(o),
+		  err(0) {
+		buf.reset(new char[cap]);
+	}
+
+	output(const output &) = delete;
+	output &operator=(const output &) = delete;
+
+	~output() {
+		flush_block();
+	}
+
+	void flush_block() {
+		if (!used)
+			return;
+		if (opt.checksum) {
+			char h[header_size];
+			put_le32(h, uint32_t(used));
+			put_le32(h + 4, cpputil::crc32c(buf.get(), used));
+			write_out(h, sizeof(h));
+		}
+		write_out(buf.get(), used);
+		used = 0;
+		// Back to normal size after a record bigger than a block.
+		if (cap > opt.block_size && opt.block_size) {
+			buf.reset(new char[opt.block_size]);
+			cap = opt.block_size;
+		}
+	}
+
+	// Room for n bytes in the current block, which is written out first
+	// if they don't fit. A record bigger than a block grows the buffer
+	// to take it.
+	char *reserve(size_t n) {
+		if (cap - used < n) {
+			flush_block();
+			if (n > cap) {
+				buf.reset(new char[n]);
+				cap = n;
+			}
+		}
+		return buf.get() + used;
+	}
+	void commit(size_t n) {
+		used += n;
+	}
+	size_t room() const {
+		return cap - used;
+	}
+
+	// Without checksums, a run of records bigger than a block goes
+	// straight to the file.
+	bool write_through(const void *p, size_t n) {
+		if (opt.checksum || n < cap)
+			return false;
+		flush_block();
+		write_out(p, n);
+		return true;
+	}
+
+	bool flush() {
+		flush_block();
+		if (!err && ::fflush(F) != 0)
+			err = errno;
+		return !err;
+	}
+
+	int error() const {
+		return err;
+	}
+};
+
+} // End namespace record_detail
+
+template <class T>
+class fixed_record_reader {
+	static_assert(std::is_trivially_copyable<T>::value,
+		      "records are read as raw bytes");
+	static_assert(alignof(T) <= 8, "records are read in place");
+
+private:
+	record_detail::input in;
+
+public:
+	// Reads from f's current position.
+	explicit fixed_record_reader(stdio_file &f,
+				     const record_options &o = record_options())
+		: in(f.get_file(), o) {
+	}
+
+	// Reads the mapping in place; it must outlive the reader.
+	explicit fixed_record_reader(const mapped_file &m,
+				     const record_options &o = record_options())
+		: in(m.str(), o) {
+	}
+
+	explicit fixed_record_reader(string_ref data,
+				     const record_options &o = record_options())
+		: in(data, o) {
+	}
+
+	// The next run of whole records: all that are buffered, all in the
+	// current block, or for a mapping without checksums, the whole file.
+	// Empty at the end of the input or on an error.
+	array_ref<T> next() {
+		if (!in.ensure(sizeof(T)))
+			return array_ref<T>();
+		size_t n = in.avail() / sizeof(T);
+		const T *p = reinterpret_cast<const T *>(in.data());
+		in.consume(n * sizeof(T));
+		return array_ref<T>(p, n);
+	}
+
+	int error() const {
+		return in.error();
+	}
+};
+
+template <class T>
+class fixed_record_writer {
+	static_assert(std::is_trivially_copyable<T>::value,
+		      "records are written as raw bytes");
+
+private:
+	record_detail::output out;
+
+public:
+	// Writes at f's current position. Records are buffered until a block
+	// fills, flush() or destruction.
+	explicit fixed_record_writer(stdio_file &f,
+				     const record_options &o = record_options())
+		: out(f.get_file(), o) {
+	}
+
+	bool write(const T &rec) {
+		std::memcpy(out.reserve(sizeof(T)), &rec, sizeof(T));
+		out.commit(sizeof(T));
+		return !out.error();
+	}
+
+	bool write(array_ref<T> recs) {
+		const T *p = recs.data();
+		size_t left = recs.size();
+		if (out.write_through(p, left * sizeof(T)))
+			return !out.error();
+		while (left) {
+			size_t n = out.room() / sizeof(T);
+			if (!n) {
+				out.reserve(sizeof(T));
+				n = out.room() / sizeof(T);
+			}
+			if (n > left)
+				n = left;
+			size_t bytes = n * sizeof(T);
+			std::memcpy(out.reserve(bytes), p, bytes);
+			out.commit(bytes);
+			p += n;
+			left -= n;
+		}
+		return !out.error();
+	}
+
+	// Writes out the current block and flushes the stdio_file.
+	bool flush() {
+		return out.flush();
+	}
+
+	int error() const {
+		return out.error();
+	}
+};
+
+class varint_record_reader {
+private:
+	record_detail::input in;
+
+public:
+	explicit varint_record_reader(
+		stdio_file &f, const record_options &o = record_options())
+		: in(f.get_file(), o) {
+	}
+
+	explicit varint_record_reader(const mapped_file &m,
+				      const record_options &o =
+					      record_options())
+		: in(m.str(), o) {
+	}
+
+	explicit varint_record_reader(
+		string_ref data, const record_options &o = record_options())
+		: in(data, o) {
+	}
+
+	// Sets rec to the next record and returns true, or returns false at
+	// the end of the input or on an error.
+	bool next(string_ref &rec) {
+		using record_detail::max_varint;
+		if (!in.ensure(1))
+			return false;
+		uint64_t len;
+		size_t hl;
+		while (!(hl = record_detail::get_varint(
+				 in.data(), in.data() + in.avail(), &len))) {
+			if (in.avail() >= max_varint)
+				return in.corrupt();
+			if (!in.ensure(in.avail() + 1))
+				return false;
+		}
+		if (len > in.options().max_record)
+			return in.corrupt();
+		if (!in.ensure(hl + size_t(len)))
+			return false;
+		rec = string_ref(in.data() + hl, size_t(len));
+		in.consume(hl + size_t(len));
+		return true;
+	}
+
+	int error() const {
+		return in.error();
+	}
+};
+
+class varint_record_writer {
+private:
+	record_detail::output out;
+
+public:
+	explicit varint_record_writer(
+		stdio_file &f, const record_options &o = record_options())
+		: out(f.get_file(), o) {
+	}
+
+	bool write(const void *p, size_t n) {
+		char *dst = out.reserve(record_detail::max_varint + n);
+		size_t hl = record_detail::put_varint(dst, n);
+		std::memcpy(dst + hl, p, n);
+		out.commit(hl + n);
+		return !out.error();
+	}
+
+	bool write(string_ref rec) {
+		return write(rec.data(), rec.size());
+	}
+
+	bool flush() {
+		return out.flush();
+	}
+
+	int error() const {
+		return out.error();
+	}
+};
+#endif
@@ -0,0 +1,230 @@
+// Record readers and writers against an fread/fwrite per struct.
+//
+//   record_io_bench [size_mb [dir]]
+//
+// For 16 byte and 1KB records, writes size_mb (default 256) of records into
+// files in dir (default .) with each writer, reads them back with each
+// reader, and removes them. Reads follow the write of the same file, so they
+// see a warm page cache and the numbers are CPU cost per record. Every
+// reader sums the first 8 bytes of each record, and the sums must agree.
+#include "record_io.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+using bench_clock = std::chrono::steady_clock;
+
+template <size_t N>
+struct record {
+	uint64_t key;
+	char pad[N - sizeof(uint64_t)];
+};
+
+static double seconds_since(bench_clock::time_point t0) {
+	return std::chrono::duration<double>(bench_clock::now() - t0).count();
+}
+
+struct result {
+	const char *name;
+	double mbs[2];
+};
+
+static std::vector<result> results;
+
+static void report(size_t col, const char *name, size_t bytes, double s) {
+	for (auto &r : results)
+		if (std::string(r.name) == name) {
+			r.mbs[col] = bytes / s / 1e6;
+			return;
+		}
+	result r = {name, {0, 0}};
+	r.mbs[col] = bytes / s / 1e6;
+	results.push_back(r);
+}
+
+static void check(const char *name, uint64_t sum, uint64_t expect) {
+	if (sum != expect) {
+		fprintf(stderr, "%s: sum %llu, expected %llu\n", name,
+			(unsigned long long)sum, (unsigned long long)expect);
+		exit(1);
+	}
+}
+
+// Starts from no file, so no writer pays to truncate the last one's.
+static FILE *create(const std::string &path) {
+	unlink(path.c_str());
+	FILE *f = fopen(path.c_str(), "w");
+	if (!f) {
+		perror(path.c_str());
+		exit(1);
+	}
+	return f;
+}
+
+template <size_t N>
+static void run(size_t col, size_t size, const std::string &dir) {
+	typedef record<N> rec;
+	size_t count = size / N;
+	std::string raw = dir + "/record_io_bench.raw";
+	std::string crc = dir + "/record_io_bench.crc";
+	std::string var = dir + "/record_io_bench.var";
+	record_options checked(true);
+	rec r;
+	memset(&r, 'x', sizeof(r));
+	uint64_t expect = uint64_t(count) * (count - 1) / 2;
+
+	// Writers.
+	auto t0 = bench_clock::now();
+	{
+		stdio_file f(create(raw));
+		for (size_t i = 0; i < count; ++i) {
+			r.key = i;
+			f.fwrite(&r, sizeof(r), 1);
+		}
+	}
+	report(col, "fwrite per struct", size, seconds_since(t0));
+
+	t0 = bench_clock::now();
+	{
+		stdio_file f(create(raw));
+		fixed_record_writer<rec> w(f);
+		for (size_t i = 0; i < count; ++i) {
+			r.key = i;
+			w.write(r);
+		}
+	}
+	report(col, "fixed writer", size, seconds_since(t0));
+
+	t0 = bench_clock::now();
+	{
+		stdio_file f(create(crc));
+		fixed_record_writer<rec> w(f, checked);
+		for (size_t i = 0; i < count; ++i) {
+			r.key = i;
+			w.write(r);
+		}
+	}
+	report(col, "fixed writer crc", size, seconds_since(t0));
+
+	t0 = bench_clock::now();
+	{
+		stdio_file f(create(var));
+		varint_record_writer w(f);
+		for (size_t i = 0; i < count; ++i) {
+			r.key = i;
+			w.write(&r, sizeof(r));
+		}
+	}
+	report(col, "varint writer", size, seconds_since(t0));
+
+	// Readers.
+	t0 = bench_clock::now();
+	{
+		stdio_file f(raw.c_str(), "r");
+		uint64_t sum = 0;
+		while (f.fread(&r, sizeof(r), 1) == 1)
+			sum += r.key;
+		check("fread per struct", sum, expect);
+	}
+	report(col, "fread per struct", size, seconds_since(t0));
+
+	t0 = bench_clock::now();
+	{
+		stdio_file f(raw.c_str(), "r");
+		fixed_record_reader<rec> rd(f);
+		uint64_t sum = 0;
+		for (auto a = rd.next(); !a.empty(); a = rd.next())
+			for (const rec &x : a)
+				sum += x.key;
+		check("fixed reader", sum, expect);
+	}
+	report(col, "fixed reader", size, seconds_since(t0));
+
+	t0 = bench_clock::now();
+	{
+		stdio_file f(crc.c_str(), "r");
+		fixed_record_reader<rec> rd(f, checked);
+		uint64_t sum = 0;
+		for (auto a = rd.next(); !a.empty(); a = rd.next())
+			for (const rec &x : a)
+				sum += x.key;
+		check("fixed reader crc", sum, expect);
+	}
+	report(col, "fixed reader crc", size, seconds_since(t0));
+
+	t0 = bench_clock::now();
+	{
+		mapped_file m(raw.c_str());
+		fixed_record_reader<rec> rd(m);
+		uint64_t sum = 0;
+		for (auto a = rd.next(); !a.empty(); a = rd.next())
+			for (const rec &x : a)
+				sum += x.key;
+		check("fixed reader mmap", sum, expect);
+	}
+	report(col, "fixed reader mmap", size, seconds_since(t0));
+
+	t0 = bench_clock::now();
+	{
+		mapped_file m(crc.c_str());
+		fixed_record_reader<rec> rd(m, checked);
+		uint64_t sum = 0;
+		for (auto a = rd.next(); !a.empty(); a = rd.next())
+			for (const rec &x : a)
+				sum += x.key;
+		check("fixed reader mmap crc", sum, expect);
+	}
+	report(col, "fixed reader mmap crc", size, seconds_since(t0));
+
+	t0 = bench_clock::now();
+	{
+		stdio_file f(var.c_str(), "r");
+		varint_record_reader rd(f);
+		uint64_t sum = 0;
+		string_ref s;
+		while (rd.next(s)) {
+			uint64_t key;
+			memcpy(&key, s.data(), sizeof(key));
+			sum += key;
+		}
+		check("varint reader", sum, expect);
+	}
+	report(col, "varint reader", size, seconds_since(t0));
+
+	unlink(raw.c_str());
+	unlink(crc.c_str());
+	unlink(var.c_str());
+}
+
+int main(int argc, char **argv) {
+	size_t size_mb = argc > 1 ? strtoul(argv[1], nullptr, 10) : 256;
+	std::string dir = argc > 2 ? argv[2] : ".";
+	size_t size = size_mb << 20;
+
+	std::vector<char> buf(64 << 20, 'x');
+	auto t0 = bench_clock::now();
+	uint32_t c = cpputil::crc32c(buf.data(), buf.size());
+	double hw = seconds_since(t0);
+	t0 = bench_clock::now();
+	c ^= cpputil::crc32c_portable(buf.data(), buf.size());
+	double sw = seconds_since(t0);
+	if (c) {
+		fprintf(stderr, "crc32c and crc32c_portable disagree\n");
+		return 1;
+	}
+	printf("crc32c %.0f MB/s, portable %.0f MB/s\n", buf.size() / hw / 1e6,
+	       buf.size() / sw / 1e6);
+
+	run<16>(0, size, dir);
+	run<1024>(1, size, dir);
+
+	printf("%zu MB of records\n", size_mb);
+	printf("%-24s %10s %10s\n", "MB/s", "16B", "1KB");
+	for (auto &r : results)
+		printf("%-24s %10.0f %10.0f\n", r.name, r.mbs[0], r.mbs[1]);
+	return 0;
+}
@@ -0,0 +1,223 @@
+#include "record_io.hpp"
+#include "libcpp-util/util/test_check.h"
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+using namespace cpputil;
+
+static const char *const path = "record_io_test.tmp";
+
+static void test_crc32c() {
+	const char *kat = "123456789";
+	CHECK(crc32c(kat, 9) == 0xe3069283);
+	CHECK(crc32c_portable(kat, 9) == 0xe3069283);
+	CHECK(crc32c(kat, 0) == 0 && crc32c_portable(kat, 0) == 0);
+#ifdef CPPUTIL_CRC32C_SSE42
+	if (crc32c_detail::have_sse42())
+		CHECK(~crc32c_detail::update_sse42(
+			      ~0u, reinterpret_cast<const unsigned char *>(kat),
+			      9) == 0xe3069283);
+	else
+		printf("no SSE4.2, only the portable CRC-32C tested\n");
+#endif
+	// Every length and alignment the wide steps can trip over, whole
+	// and in two pieces.
+	std::mt19937 rng(7);
+	std::vector<unsigned char> buf(300);
+	for (auto &b : buf)
+		b = (unsigned char)rng();
+	for (size_t off = 0; off < 8; ++off) {
+		for (size_t n = 0; n + off <= 100; ++n) {
+			const unsigned char *p = buf.data() + off;
+			uint32_t whole = crc32c_portable(p, n);
+			CHECK(crc32c(p, n) == whole);
+			size_t k = n / 3;
+			CHECK(crc32c(p + k, n - k, crc32c(p, k)) == whole);
+			CHECK(crc32c_portable(p + k, n - k,
+					      crc32c_portable(p, k)) == whole);
+		}
+	}
+}
+
+static std::string file_contents() {
+	stdio_file f(path, "r");
+	std::string s;
+	char buf[4096];
+	size_t n;
+	while ((n = f.fread(buf, 1, sizeof(buf))) > 0)
+		s.append(buf, n);
+	return s;
+}
+
+static void put_file(const std::string &s) {
+	stdio_file f(path, "w");
+	CHECK(f.fwrite(s.data(), 1, s.size()) == s.size());
+}
+
+static std::vector<std::string> make_records() {
+	std::mt19937 rng(3);
+	std::vector<std::string> recs;
+	for (int i = 0; i < 500; ++i) {
+		// Mostly short, the odd one longer than a block.
+		size_t len = i % 100 == 99 ? 5000 : rng() % 300;
+		std::string r(len, '\0');
+		for (auto &c : r)
+			c = char(rng());
+		recs.push_back(r);
+	}
+	recs.push_back("");
+	return recs;
+}
+
+static void write_varint(const std::vector<std::string> &recs,
+			 const record_options &o) {
+	stdio_file f(path, "w");
+	varint_record_writer w(f, o);
+	for (auto &r : recs)
+		CHECK(w.write(r));
+	CHECK(w.flush());
+}
+
+// Reads every record, checking each against recs; returns how many came
+// out before the end, and the error.
+static size_t read_varint(varint_record_reader &r,
+			  const std::vector<std::string> &recs, int *err) {
+	size_t i = 0;
+	string_ref rec;
+	while (r.next(rec)) {
+		CHECK(i < recs.size());
+		CHECK(std::string(rec.data(), rec.size()) == recs[i]);
+		++i;
+	}
+	*err = r.error();
+	return i;
+}
+
+static void test_varint_round_trip() {
+	std::vector<std::string> recs = make_records();
+	for (bool checksum : {false, true}) {
+		record_options o(checksum, 1000);
+		write_varint(recs, o);
+		int err;
+		{
+			stdio_file f(path, "r");
+			varint_record_reader r(f, o);
+			CHECK(read_varint(r, recs, &err) == recs.size());
+			CHECK(err == 0);
+		}
+		mapped_file m(path);
+		varint_record_reader r(m, o);
+		CHECK(read_varint(r, recs, &err) == recs.size());
+		CHECK(err == 0);
+	}
+}
+
+struct point {
+	uint32_t id;
+	int16_t x, y;
+	double value;
+};
+
+static void test_fixed_round_trip() {
+	std::vector<point> pts(10000);
+	for (size_t i = 0; i < pts.size(); ++i)
+		pts[i] = point{uint32_t(i), int16_t(i), int16_t(-i), i * 0.5};
+	for (bool checksum : {false, true}) {
+		record_options o(checksum, 1000);
+		{
+			stdio_file f(path, "w");
+			fixed_record_writer<point> w(f, o);
+			CHECK(w.write(pts[0]));
+			CHECK(w.write(array_ref<point>(&pts[1], 9)));
+			CHECK(w.write(array_ref<point>(&pts[10],
+						       pts.size() - 10)));
+			CHECK(w.flush());
+		}
+		stdio_file f(path, "r");
+		fixed_record_reader<point> r(f, o);
+		size_t i = 0;
+		for (array_ref<point> run; (run = r.next()).size();) {
+			for (const point &p : run) {
+				CHECK(i < pts.size() && p.id == pts[i].id);
+				CHECK(p.y == pts[i].y &&
+				      p.value == pts[i].value);
+				++i;
+			}
+		}
+		CHECK(i == pts.size() && r.error() == 0);
+	}
+}
+
+// Every cut through the file either ends cleanly at a boundary or is
+// reported; with checksums every flipped bit is.
+static void test_damage() {
+	std::vector<std::string> recs;
+	for (int i = 0; i < 40; ++i)
+		recs.push_back(std::string(size_t(i), char('a' + i)));
+	for (bool checksum : {false, true}) {
+		record_options o(checksum, 200);
+		write_varint(recs, o);
+		std::string whole = file_contents();
+		// Where records, or with checksums blocks, end: a cut there
+		// is clean.
+		std::vector<bool> boundary(whole.size() + 1);
+		boundary[0] = true;
+		if (checksum) {
+			using record_detail::get_le32;
+			for (size_t p = 0; p < whole.size();) {
+				p += 8 + get_le32(whole.data() + p);
+				boundary[p] = true;
+			}
+		} else {
+			varint_record_reader r(string_ref(whole), o);
+			string_ref rec;
+			while (r.next(rec))
+				boundary[size_t(rec.data() + rec.size() -
+						whole.data())] = true;
+		}
+		for (size_t cut = 0; cut < whole.size(); ++cut) {
+			std::string part = whole.substr(0, cut);
+			varint_record_reader r(string_ref(part), o);
+			int err;
+			size_t n = read_varint(r, recs, &err);
+			CHECK(boundary[cut] ? err == 0 : err == EBADMSG);
+			CHECK(n < recs.size());
+		}
+		// Truncated on disk too, read through stdio.
+		put_file(whole.substr(0, whole.size() - 1));
+		{
+			stdio_file f(path, "r");
+			varint_record_reader r(f, o);
+			int err;
+			read_varint(r, recs, &err);
+			CHECK(err == EBADMSG);
+		}
+		if (!checksum)
+			continue;
+		for (size_t pos = 0; pos < whole.size(); ++pos) {
+			for (int bit = 0; bit < 8; bit += 3) {
+				std::string bad = whole;
+				bad[pos] ^= char(1 << bit);
+				varint_record_reader r(string_ref(bad), o);
+				string_ref rec;
+				while (r.next(rec))
+					;
+				CHECK(r.error() == EBADMSG);
+			}
+		}
+	}
+}
+
+int main() {
+	test_crc32c();
+	test_varint_round_trip();
+	test_fixed_round_trip();
+	test_damage();
+	unlink(path);
+	printf("record_io_test: all passed\n");
+	return 0;
+}
@@ -1,16 +1,282 @@
 #ifndef STDIO_FILE_HPP
 #define STDIO_FILE_HPP
 
+#include <algorithm>
+#include <cerrno>
 #include <cstdio>
 #include <cstdlib>
 #include <cstdarg>
+#include <memory>
 #include <utility>
 
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "libcpp-util/str/format.h"
+#include "libcpp-util/str/scan.h"
+
+// Sink and source for the formatter and scanner in str/, on a FILE whose lock
+// the caller already holds, so each character costs a buffer pointer bump
+// rather than a lock round trip.
+class unlocked_file_sink {
+private:
+	FILE *F;
+	bool failed;
+
+public:
+	explicit unlocked_file_sink(FILE *F) : F(F), failed(false) {
+	}
+
+	void append(const char *p, size_t n) {
+		// Short runs are cheaper a char at a time than through
+		// fwrite's bookkeeping.
+		if (n <= 8) {
+			for (size_t i = 0; i < n; ++i)
+				if (putc_unlocked(p[i], F) == EOF)
+					failed = true;
+			return;
+		}
+#ifdef __GLIBC__
+		if (::fwrite_unlocked(p, 1, n, F) != n)
+#else
+		if (::fwrite(p, 1, n, F) != n)
+#endif
+			failed = true;
+	}
+	void fill(size_t n, char c) {
+		while (n--)
+			if (putc_unlocked(c, F) == EOF)
+				failed = true;
+	}
+	bool ok() const {
+		return !failed;
+	}
+};
+
+class unlocked_file_source {
+private:
+	FILE *F;
+
+public:
+	explicit unlocked_file_source(FILE *F) : F(F) {
+	}
+
+	int get() {
+		return getc_unlocked(F);
+	}
+	void unget(int c) {
+		// The lock is recursive, so this is safe to call with it held.
+		::ungetc(c, F);
+	}
+};
+
+// How many bytes F has read ahead and not yet handed out, or -1 where this
+// C library's FILE isn't known. This looks inside the FILE, which no
+// standard call offers (musl's __freadahead is not in glibc or the BSDs);
+// the field names are the libraries' own and have been stable for decades,
+// and anywhere else the answer is -1 and callers go through stdio. The
+// caller must hold F's lock, or another thread's read can move the
+// pointers in between.
+inline ssize_t stdio_read_ahead(FILE *F) {
+#if defined(__GLIBC__)
+	return F->_IO_read_end - F->_IO_read_ptr;
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || \
+	defined(__OpenBSD__) || defined(__DragonFly__)
+	return F->_r > 0 ? F->_r : 0;
+#else
+	(void)F;
+	return -1;
+#endif
+}
+
+// As read(2) on F: up to n bytes, 0 at the end, or -1 with errno set,
+// waiting for no more than one read of what is underneath. fread() asked
+// for more than stdio holds keeps reading until it has it all, which on a
+// pipe or socket waits for the writer to close. So this takes what stdio
+// holds with fread(), and once that is gone reads a pipe, socket or
+// terminal through F's descriptor itself; those have no offset for stdio
+// to lose track of, and F can still be read from where this left off. A
+// regular file never waits, so it is read with fread() and ftell() stays
+// right. A FILE with no descriptor (fopencookie, fmemopen) is made to read
+// once with getc(), and what that brought taken. F's lock is held
+// throughout, so other threads' stdio calls on F wait rather than race.
+inline ssize_t stdio_read_some(FILE *F, void *buf, size_t n) {
+	struct file_lock {
+		FILE *F;
+		explicit file_lock(FILE *F) : F(F) {
+			::flockfile(F);
+		}
+		~file_lock() {
+			::funlockfile(F);
+		}
+	};
+
+	char *p = static_cast<char *>(buf);
+	if (!n)
+		return 0;
+	file_lock lock(F);
+	ssize_t ahead = stdio_read_ahead(F);
+	if (ahead > 0)
+		return ssize_t(::fread(p, 1, std::min(size_t(ahead), n), F));
+	int fd = ::fileno(F);
+	struct stat st;
+	if (ahead == 0 && fd >= 0 && ::fstat(fd, &st) == 0 &&
+	    !S_ISREG(st.st_mode)) {
+		for (;;) {
+			ssize_t r = ::read(fd, p, n);
+			if (r >= 0 || errno != EINTR)
+				return r;
+		}
+	}
+	if (ahead == 0 && fd >= 0) {
+		size_t got = ::fread(p, 1, n, F);
+		if (got || !::ferror(F))
+			return ssize_t(got);
+		if (!errno)
+			errno = EIO;
+		return -1;
+	}
+	int c = ::getc(F);
+	if (c == EOF) {
+		if (!::ferror(F))
+			return 0;
+		if (!errno)
+			errno = EIO;
+		return -1;
+	}
+	p[0] = char(c);
+	ssize_t more = stdio_read_ahead(F);
+	if (more >= 0)
+		return 1 + ssize_t(::fread(p + 1, 1,
+					   std::min(size_t(more), n - 1), F));
+	// A C library whose buffer can't be seen: to the end of the line a
+	// byte at a time, which is as far as stdio reads ahead on a terminal.
+	size_t got = 1;
+	while (c != '\n' && got < n && (c = ::getc(F)) != EOF)
+		p[got++] = char(c);
+	return ssize_t(got);
+}
+
 class stdio_file {
 private:
 	FILE *F;
+	// The stream's buffer, if tune_buffer() set one.
+	std::unique_ptr<char[]> buf;
 
 public:
+	// Holds the stream's lock for its lifetime and offers the *_unlocked
+	// calls, which skip the lock round trip each stdio call otherwise
+	// makes; for tight getc/putc loops, where that lock is most of the
+	// cost. The lock is recursive, so the stdio_file may still be used
+	// directly on the same thread meanwhile, and other threads wait. A
+	// view must not outlive its stdio_file.
+	class locked_view {
+	private:
+		FILE *F;
+
+	public:
+		explicit locked_view(FILE *F) : F(F) {
+			if (F)
+				::flockfile(F);
+		}
+
+		locked_view(locked_view &&rhs) : F(rhs.F) {
+			rhs.F = nullptr;
+		}
+
+		locked_view(const locked_view &) = delete;
+		locked_view &operator=(const locked_view &) = delete;
+
+		~locked_view() {
+			if (F)
+				::funlockfile(F);
+		}
+
+		FILE *get_file() {
+			return F;
+		}
+
+		// getc_unlocked and putc_unlocked may be macros, so
+		// unqualified.
+		int getc() {
+			return getc_unlocked(F);
+		}
+		int putc(int c) {
+			return putc_unlocked(c, F);
+		}
+		int ungetc(int c) {
+			return ::ungetc(c, F);
+		}
+
+#ifdef __GLIBC__
+		size_t fread(void *ptr, size_t size, size_t n) {
+			return ::fread_unlocked(ptr, size, n, F);
+		}
+		size_t fwrite(const void *ptr, size_t size, size_t n) {
+			return ::fwrite_unlocked(ptr, size, n, F);
+		}
+		char *fgets(char *s, int n) {
+			return ::fgets_unlocked(s, n, F);
+		}
+		int fputs(const char *s) {
+			return ::fputs_unlocked(s, F);
+		}
+		int fflush() {
+			return ::fflush_unlocked(F);
+		}
+		int feof() {
+			return ::feof_unlocked(F);
+		}
+		int ferror() {
+			return ::ferror_unlocked(F);
+		}
+		void clearerr() {
+			::clearerr_unlocked(F);
+		}
+#else
+		// Only glibc has these unlocked; the locked calls just take
+		// the lock we hold once more.
+		size_t fread(void *ptr, size_t size, size_t n) {
+			return ::fread(ptr, size, n, F);
+		}
+		size_t fwrite(const void *ptr, size_t size, size_t n) {
+			return ::fwrite(ptr, size, n, F);
+		}
+		char *fgets(char *s, int n) {
+			return ::fgets(s, n, F);
+		}
+		int fputs(const char *s) {
+			return ::fputs(s, F);
+		}
+		int fflush() {
+			return ::fflush(F);
+		}
+		int feof() {
+			return ::feof(F);
+		}
+		int ferror() {
+			return ::ferror(F);
+		}
+		void clearerr() {
+			::clearerr(F);
+		}
+#endif
+
+		// As stdio_file::print and ::scan, without locking again.
+		template <typename Format, typename... Ts>
+		int print(const Format &fmt, const Ts &... ts) {
+			unlocked_file_sink sink(F);
+			int ret = cpputil::format_to(sink, fmt, ts...);
+			return sink.ok() ? ret : -1;
+		}
+		template <typename Format, typename... Ts>
+		int scan(const Format &fmt, Ts &... ts) {
+			unlocked_file_source source(F);
+			return cpputil::scan_from(source, fmt, ts...);
+		}
+	};
+
 	// Ctors/dtor
 	constexpr stdio_file() : F(nullptr) {
 	}
@@ -33,11 +299,13 @@ public:
 		return *this;
 	}
 
-	stdio_file(stdio_file &&rhs) : F(rhs.release()) {
+	stdio_file(stdio_file &&rhs) : F(rhs.F), buf(std::move(rhs.buf)) {
+		rhs.F = nullptr;
 	}
 
 	stdio_file &operator=(stdio_file &&rhs) {
-		reset(rhs.release());
+		stdio_file tmp(std::move(rhs));
+		swap(tmp);
 		return *this;
 	}
 
@@ -45,9 +313,12 @@ public:
 		fclose();
 	}
 
+	// A buffer from tune_buffer() has to outlive the FILE, so it goes
+	// with it and is never freed.
 	FILE *release() {
 		FILE *ret = F;
 		F = nullptr;
+		buf.release();
 		return ret;
 	}
 
@@ -58,6 +329,7 @@ public:
 
 	void swap(stdio_file &rhs) {
 		std::swap(F, rhs.F);
+		std::swap(buf, rhs.buf);
 	}
 
 	// Following is the stdio interface, wrapped.
@@ -71,18 +343,24 @@ public:
 		return F != nullptr;
 	}
 
+	// The stream is gone afterwards even if this fails, so F and its
+	// buffer go with it either way.
 	int fclose() {
 		if (!F)
 			return EOF;
 		int ret = ::fclose(F);
-		if (ret != EOF)
-			F = nullptr;
+		F = nullptr;
+		buf.reset();
 		return ret;
 	}
 
 	FILE *get_file() {
 		return F;
 	}
+
+	locked_view lock() {
+		return locked_view(get_file());
+	}
 	int getc() {
 		// Don't use getc because it might be a macro and we want to
 		// qualify the call.
@@ -154,34 +432,51 @@ public:
 		return ::setvbuf(get_file(), buf, mode, size);
 	}
 
+	__attribute__((format(printf, 2, 3)))
 	int printf(const char *fmt, ...) {
 		va_list ap;
 		va_start(ap, fmt);
-		int ret = fprintf(get_file(), fmt, ap);
+		int ret = vprintf(fmt, ap);
 		va_end(ap);
 		return ret;
 	}
 	int vprintf(const char *fmt, va_list ap) {
-		return vfprintf(get_file(), fmt, ap);
+		return ::vfprintf(get_file(), fmt, ap);
 	}
 
+	__attribute__((format(scanf, 2, 3)))
 	int scanf(const char *fmt, ...) {
 		va_list ap;
 		va_start(ap, fmt);
-		int ret = fscanf(get_file(), fmt, ap);
+		int ret = vscanf(fmt, ap);
 		va_end(ap);
 		return ret;
 	}
 	int vscanf(const char *fmt, va_list ap) {
-		return vfscanf(get_file(), fmt, ap);
+		return ::vfscanf(get_file(), fmt, ap);
 	}
 
-	stdio_file *freopen(const char *path, const char *mode,
-		       	const stdio_file& f) {
-		FILE* newF = freopen(path, mode, get_file());
-		if (newF)
-			F = newF; // Old file is now closed.
-		return newF;
+	// Type-safe printf through str/format.h, formatted straight into the
+	// stream's buffer under one flockfile. fmt is a string, checked as it
+	// runs, or CPPUTIL_FMT("..."), checked at compile time. Returns the
+	// number of chars written, or -1 on a bad format or a write error; as
+	// with fprintf, output before the error stays written.
+	template <typename Format, typename... Ts>
+	int print(const Format &fmt, const Ts &... ts) {
+		return lock().print(fmt, ts...);
+	}
+
+	// Type-safe scanf through str/scan.h, under one flockfile. Arguments
+	// are taken by reference. Returns what fscanf would.
+	template <typename Format, typename... Ts>
+	int scan(const Format &fmt, Ts &... ts) {
+		return lock().scan(fmt, ts...);
+	}
+
+	// The old stream is closed whether or not path opens.
+	stdio_file *freopen(const char *path, const char *mode) {
+		F = ::freopen(path, mode, get_file());
+		return F ? this : nullptr;
 	}
 
 	int ungetc(int c) {
@@ -192,10 +487,39 @@ public:
 	int fileno() {
 		return ::fileno(get_file());
 	}
+
+	// A buffer size for fd: st_blksize, rounded up to whole blocks of at
+	// least 64KB for files and block devices, where one larger read or
+	// write costs less than several small ones. Pipes, sockets and
+	// terminals keep st_blksize.
+	static size_t preferred_buffer_size(int fd) {
+		struct stat st;
+		if (::fstat(fd, &st) != 0 || st.st_blksize <= 0)
+			return BUFSIZ;
+		size_t blk = size_t(st.st_blksize);
+		if (!S_ISREG(st.st_mode) && !S_ISBLK(st.st_mode))
+			return blk;
+		const size_t min_size = 64 * 1024;
+		return (min_size + blk - 1) / blk * blk;
+	}
+
+	// Gives the stream a buffer of size bytes, preferred_buffer_size() by
+	// default, owned by this stdio_file. glibc sizes its own buffer from
+	// st_blksize alone, typically 4KB. As with setvbuf, call it before
+	// any other I/O on the stream.
+	int tune_buffer(size_t size = 0, int mode = _IOFBF) {
+		if (!size)
+			size = preferred_buffer_size(fileno());
+		std::unique_ptr<char[]> b(new char[size]);
+		int ret = setvbuf(b.get(), mode, size);
+		if (ret == 0)
+			buf = std::move(b);
+		return ret;
+	}
 #endif
 };
 
-void swap(stdio_file &lhs, stdio_file &rhs) {
+inline void swap(stdio_file &lhs, stdio_file &rhs) {
 	lhs.swap(rhs);
 }
 #endif
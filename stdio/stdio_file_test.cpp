@@ -0,0 +1,194 @@
+#include "stdio_file.hpp"
+#include "libcpp-util/util/test_check.h"
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+
+static const char *const path = "stdio_file_test.tmp";
+
+// Buffers of this size are counted as they are made and freed, to see
+// where tune_buffer()'s buffer goes.
+static const size_t odd_size = 12345;
+static void *odd_buffers[4];
+static int live_buffers;
+
+void *operator new[](size_t n) {
+	void *p = ::operator new(n);
+	if (n == odd_size) {
+		for (void *&b : odd_buffers) {
+			if (!b) {
+				b = p;
+				break;
+			}
+		}
+		++live_buffers;
+	}
+	return p;
+}
+
+void operator delete[](void *p) noexcept {
+	for (void *&b : odd_buffers) {
+		if (p && b == p) {
+			b = nullptr;
+			--live_buffers;
+		}
+	}
+	::operator delete(p);
+}
+
+void operator delete[](void *p, std::size_t) noexcept {
+	::operator delete[](p);
+}
+
+static std::string file_contents() {
+	stdio_file f(path, "r");
+	std::string s;
+	char buf[4096];
+	size_t n;
+	while ((n = f.fread(buf, 1, sizeof(buf))) > 0)
+		s.append(buf, n);
+	return s;
+}
+
+static off_t file_size() {
+	struct stat st;
+	CHECK(stat(path, &st) == 0);
+	return st.st_size;
+}
+
+// Whether another thread could take f's lock right now.
+static bool lock_free(FILE *F) {
+	bool ok = false;
+	std::thread t([&] {
+		if (ftrylockfile(F) == 0) {
+			ok = true;
+			funlockfile(F);
+		}
+	});
+	t.join();
+	return ok;
+}
+
+static void test_locked_view() {
+	{
+		stdio_file f(path, "w");
+		{
+			stdio_file::locked_view v = f.lock();
+			CHECK(!lock_free(f.get_file()));
+			CHECK(v.putc('a') == 'a' && v.fputs("bc\n") >= 0);
+			CHECK(v.fwrite("def\n", 1, 4) == 4);
+			CHECK(v.print(CPPUTIL_FMT("%d %s\n"), 42, "x") == 5);
+			// Recursive: the stdio_file itself still works.
+			CHECK(f.fputs("direct\n") >= 0);
+			stdio_file::locked_view moved(std::move(v));
+			CHECK(v.get_file() == nullptr);
+			CHECK(!lock_free(f.get_file()));
+			CHECK(moved.fflush() == 0 && !moved.ferror());
+		}
+		CHECK(lock_free(f.get_file()));
+	}
+	CHECK(file_contents() == "abc\ndef\n42 x\ndirect\n");
+
+	stdio_file f(path, "r");
+	stdio_file::locked_view v = f.lock();
+	CHECK(v.getc() == 'a' && v.ungetc('A') == 'A' && v.getc() == 'A');
+	char line[16];
+	CHECK(v.fgets(line, sizeof(line)) && std::string(line) == "bc\n");
+	char four[4];
+	CHECK(v.fread(four, 1, 4) == 4 && std::string(four, 4) == "def\n");
+	int n;
+	CHECK(v.scan(CPPUTIL_FMT("%d"), n) == 1 && n == 42);
+	while (v.getc() != EOF)
+		;
+	CHECK(v.feof());
+	v.clearerr();
+	CHECK(!v.feof());
+
+	stdio_file none;
+	stdio_file::locked_view empty = none.lock();
+	CHECK(empty.get_file() == nullptr);
+}
+
+static void test_preferred_buffer_size() {
+	stdio_file f(path, "w");
+	struct stat st;
+	CHECK(fstat(f.fileno(), &st) == 0);
+	size_t blk = size_t(st.st_blksize);
+	size_t n = stdio_file::preferred_buffer_size(f.fileno());
+	CHECK(n >= 64 * 1024 && n % blk == 0 && n < 64 * 1024 + blk);
+
+	int p[2];
+	CHECK(pipe(p) == 0);
+	CHECK(fstat(p[0], &st) == 0);
+	CHECK(stdio_file::preferred_buffer_size(p[0]) == size_t(st.st_blksize));
+	close(p[0]);
+	close(p[1]);
+	CHECK(stdio_file::preferred_buffer_size(-1) == BUFSIZ);
+}
+
+// The default buffer is the preferred size: that much is held back
+// until a flush. A line buffered one goes out at each newline.
+static void test_tune_buffer() {
+	stdio_file f(path, "w");
+	CHECK(f.tune_buffer() == 0);
+	size_t n = stdio_file::preferred_buffer_size(f.fileno());
+	std::string data(n - 1, 'x');
+	CHECK(f.fwrite(data.data(), 1, data.size()) == data.size());
+	CHECK(file_size() == 0);
+	CHECK(f.fflush() == 0 && file_size() == off_t(n - 1));
+
+	stdio_file g(path, "w");
+	CHECK(g.tune_buffer(256, _IOLBF) == 0);
+	CHECK(g.fputs("no newline yet") >= 0 && file_size() == 0);
+	CHECK(g.fputs("\n") >= 0 && file_size() == 15);
+}
+
+// The buffer belongs to whichever stdio_file holds the stream, and goes
+// when the stream is closed, however that happens.
+static void test_buffer_ownership() {
+	{
+		stdio_file a(path, "w");
+		CHECK(a.tune_buffer(odd_size) == 0 && live_buffers == 1);
+		CHECK(a.fputs("through a ") >= 0);
+		stdio_file b(std::move(a));
+		a.fclose();
+		CHECK(live_buffers == 1);
+		stdio_file c(path, "r");
+		c.swap(b);
+		CHECK(b.fclose() == 0 && live_buffers == 1);
+		stdio_file d;
+		d = std::move(c);
+		CHECK(d.fputs("moved buffer\n") >= 0 && live_buffers == 1);
+		CHECK(d.fclose() == 0 && live_buffers == 0);
+	}
+	CHECK(file_contents() == "through a moved buffer\n");
+
+	{
+		stdio_file a(path, "w");
+		CHECK(a.tune_buffer(odd_size) == 0 && live_buffers == 1);
+	}
+	CHECK(live_buffers == 0);
+
+	// With its descriptor closed underneath, the final flush fails, but
+	// the stream and buffer are still gone and not closed again.
+	stdio_file a(path, "w");
+	CHECK(a.tune_buffer(odd_size) == 0 && a.fputs("lost") >= 0);
+	close(a.fileno());
+	CHECK(a.fclose() == EOF && a.get_file() == nullptr);
+	CHECK(live_buffers == 0);
+	CHECK(a.fclose() == EOF);
+}
+
+int main() {
+	test_locked_view();
+	test_preferred_buffer_size();
+	test_tune_buffer();
+	test_buffer_ownership();
+	unlink(path);
+	printf("stdio_file_test: all passed\n");
+	return 0;
+}
@@ -0,0 +1,99 @@
+// stdio_file::print against fprintf.
+//
+//   stdio_print_bench [lines [path]]
+//
+// Writes lines (default 100M) formatted lines to path (default /dev/null, so
+// only formatting and buffering are measured) with each method, and reports
+// ns per line. Two line shapes: integers and a string, and the same with a
+// %.3f float.
+#include "stdio_file.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+using bench_clock = std::chrono::steady_clock;
+
+static const char *const names[] = {"alpha", "beta", "gamma", "delta"};
+
+// Integer and string fields, which print formats itself.
+static void ints_fprintf(stdio_file &f, long n) {
+	for (long i = 0; i < n; ++i)
+		::fprintf(f.get_file(), "%ld %s %u %lx\n", i, names[i & 3],
+			  unsigned(i * 7), i * 31);
+}
+
+static void ints_stdio_printf(stdio_file &f, long n) {
+	for (long i = 0; i < n; ++i)
+		f.printf("%ld %s %u %lx\n", i, names[i & 3], unsigned(i * 7),
+			 i * 31);
+}
+
+static void ints_print(stdio_file &f, long n) {
+	for (long i = 0; i < n; ++i)
+		f.print("%d %s %u %x\n", i, names[i & 3], unsigned(i * 7),
+			i * 31);
+}
+
+static void ints_print_ct(stdio_file &f, long n) {
+	for (long i = 0; i < n; ++i)
+		f.print(CPPUTIL_FMT("%d %s %u %x\n"), i, names[i & 3],
+			unsigned(i * 7), i * 31);
+}
+
+// A fixed precision float, which print hands to snprintf.
+static void float_fprintf(stdio_file &f, long n) {
+	for (long i = 0; i < n; ++i)
+		::fprintf(f.get_file(), "%ld %s %.3f\n", i, names[i & 3],
+			  i * 0.25);
+}
+
+static void float_stdio_printf(stdio_file &f, long n) {
+	for (long i = 0; i < n; ++i)
+		f.printf("%ld %s %.3f\n", i, names[i & 3], i * 0.25);
+}
+
+static void float_print(stdio_file &f, long n) {
+	for (long i = 0; i < n; ++i)
+		f.print("%d %s %.3f\n", i, names[i & 3], i * 0.25);
+}
+
+static void float_print_ct(stdio_file &f, long n) {
+	for (long i = 0; i < n; ++i)
+		f.print(CPPUTIL_FMT("%d %s %.3f\n"), i, names[i & 3], i * 0.25);
+}
+
+int main(int argc, char **argv) {
+	long lines = argc > 1 ? atol(argv[1]) : 100000000;
+	const char *path = argc > 2 ? argv[2] : "/dev/null";
+
+	struct {
+		const char *name;
+		void (*fn)(stdio_file &, long);
+	} methods[] = {
+		{"ints fprintf", ints_fprintf},
+		{"ints stdio_file::printf", ints_stdio_printf},
+		{"ints print", ints_print},
+		{"ints print CPPUTIL_FMT", ints_print_ct},
+		{"float fprintf", float_fprintf},
+		{"float stdio_file::printf", float_stdio_printf},
+		{"float print", float_print},
+		{"float print CPPUTIL_FMT", float_print_ct},
+	};
+
+	printf("%ld lines to %s\n", lines, path);
+	printf("%-28s %10s %10s\n", "method", "seconds", "ns/line");
+	for (auto &m : methods) {
+		stdio_file f(path, "w");
+		if (!f.get_file()) {
+			perror(path);
+			return 1;
+		}
+		auto t0 = bench_clock::now();
+		m.fn(f, lines);
+		f.fflush();
+		double s = std::chrono::duration<double>(bench_clock::now() - t0)
+				   .count();
+		printf("%-28s %10.2f %10.1f\n", m.name, s, s * 1e9 / lines);
+	}
+	return 0;
+}
@@ -0,0 +1,144 @@
+// stdio_file against its locked_view, and the default stdio buffer against
+// tune_buffer().
+//
+//   stdio_unlocked_bench [size_mb [path]]
+//
+// Writes size_mb (default 256) at path (default ./stdio_unlocked_bench.tmp)
+// a byte at a time and in 64 byte and 4KB blocks, reads it back the same
+// ways, and removes it. Reads follow a write of the same file, so they see a
+// warm page cache.
+#include "stdio_file.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <unistd.h>
+
+using bench_clock = std::chrono::steady_clock;
+
+enum mode { locked, unlocked };
+
+// Writers start from no file, so none of them pays to truncate the last
+// one's.
+static stdio_file open_file(const char *path, const char *m, bool tuned) {
+	if (*m == 'w')
+		unlink(path);
+	stdio_file f(path, m);
+	if (!f.get_file()) {
+		perror(path);
+		exit(1);
+	}
+	if (tuned)
+		f.tune_buffer();
+	return f;
+}
+
+static size_t write_bytes(const char *path, size_t size, mode md, bool tuned) {
+	stdio_file f = open_file(path, "w", tuned);
+	if (md == locked) {
+		for (size_t i = 0; i < size; ++i)
+			f.putc(int(i & 0x7f));
+	} else {
+		auto v = f.lock();
+		for (size_t i = 0; i < size; ++i)
+			v.putc(int(i & 0x7f));
+	}
+	return size;
+}
+
+static size_t read_bytes(const char *path, size_t, mode md, bool tuned) {
+	stdio_file f = open_file(path, "r", tuned);
+	size_t sum = 0;
+	int c;
+	if (md == locked) {
+		while ((c = f.getc()) != EOF)
+			sum += size_t(c);
+	} else {
+		auto v = f.lock();
+		while ((c = v.getc()) != EOF)
+			sum += size_t(c);
+	}
+	return sum;
+}
+
+template <size_t Block>
+static size_t write_blocks(const char *path, size_t size, mode md,
+			   bool tuned) {
+	stdio_file f = open_file(path, "w", tuned);
+	char block[Block];
+	for (size_t i = 0; i < Block; ++i)
+		block[i] = char(i & 0x7f);
+	if (md == locked) {
+		for (size_t n = 0; n < size; n += Block)
+			f.fwrite(block, 1, Block);
+	} else {
+		auto v = f.lock();
+		for (size_t n = 0; n < size; n += Block)
+			v.fwrite(block, 1, Block);
+	}
+	return size;
+}
+
+template <size_t Block>
+static size_t read_blocks(const char *path, size_t, mode md, bool tuned) {
+	stdio_file f = open_file(path, "r", tuned);
+	char block[Block];
+	size_t sum = 0, n;
+	if (md == locked) {
+		while ((n = f.fread(block, 1, Block)) > 0)
+			sum += size_t(block[n - 1]);
+	} else {
+		auto v = f.lock();
+		while ((n = v.fread(block, 1, Block)) > 0)
+			sum += size_t(block[n - 1]);
+	}
+	return sum;
+}
+
+int main(int argc, char **argv) {
+	size_t size_mb = argc > 1 ? strtoul(argv[1], nullptr, 10) : 256;
+	const char *path = argc > 2 ? argv[2] : "./stdio_unlocked_bench.tmp";
+	size_t size = size_mb << 20;
+
+	struct {
+		const char *name;
+		size_t (*fn)(const char *, size_t, mode, bool);
+	} tests[] = {
+		{"write byte", write_bytes},
+		{"read byte", read_bytes},
+		{"write 64B", write_blocks<64>},
+		{"read 64B", read_blocks<64>},
+		{"write 4KB", write_blocks<4096>},
+		{"read 4KB", read_blocks<4096>},
+	};
+
+	{
+		stdio_file f = open_file(path, "w", false);
+		printf("%zu MB at %s, tuned buffer %zu bytes\n", size_mb, path,
+		       stdio_file::preferred_buffer_size(f.fileno()));
+	}
+	printf("%-12s %14s %14s %14s\n", "MB/s", "locked", "unlocked",
+	       "unlocked+tuned");
+	for (auto &t : tests) {
+		printf("%-12s", t.name);
+		size_t check = 0;
+		for (int run = 0; run < 3; ++run) {
+			mode md = run == 0 ? locked : unlocked;
+			auto t0 = bench_clock::now();
+			size_t r = t.fn(path, size, md, run == 2);
+			double s = std::chrono::duration<double>(
+					   bench_clock::now() - t0)
+					   .count();
+			if (run && r != check) {
+				fprintf(stderr, "%s: results differ\n", t.name);
+				return 1;
+			}
+			check = r;
+			printf(" %14.0f", size / s / 1e6);
+		}
+		printf("\n");
+	}
+	unlink(path);
+	return 0;
+}
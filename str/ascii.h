@@ -0,0 +1,242 @@
+//============================================================================
+//                                  libcpp-util
+//                   A simple odds-n-ends library for C++11
+//
+//         Licensed under modified BSD license. See LICENSE for details.
+//============================================================================
+
+#ifndef LIBCPP_UTIL_ASCII_H
+#define LIBCPP_UTIL_ASCII_H
+
+#include "libcpp-util/cxx14/string_ref.h"
+#include "libcpp-util/util/hash.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Locale-independent ASCII case folding, case-insensitive comparison and
+// hashing, and whitespace trimming over string_ref. Bytes >= 0x80 are left
+// alone, which is what protocol text (HTTP headers, MIME types, DNS names)
+// wants. Nothing here allocates.
+//
+// Bulk conversion and equality work 16 bytes at a time with SSE2. Everything
+// else folds 8 bytes at a time in a uint64_t, which is as fast for the short
+// strings these are usually called on.
+namespace cpputil {
+
+namespace ascii_detail {
+
+static const std::uint64_t ones = 0x0101010101010101ull;
+
+inline std::uint64_t load64(const char *p) {
+	std::uint64_t v;
+	std::memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+// Sets 0x20 in every byte of v that is in [lo, hi].
+inline std::uint64_t case_bit(std::uint64_t v, unsigned char lo,
+			      unsigned char hi) {
+	std::uint64_t low7 = v & (0x7f * ones);
+	// The high bit of each byte says whether it is >= lo, then > hi. Both
+	// sums stay below 0x100 per byte, so nothing carries across.
+	std::uint64_t ge_lo = low7 + (0x80 - lo) * ones;
+	std::uint64_t gt_hi = low7 + (0x7f - hi) * ones;
+	std::uint64_t in = (ge_lo ^ gt_hi) & ~v & (0x80 * ones);
+	return in >> 2;
+}
+
+inline std::uint64_t lower64(std::uint64_t v) {
+	return v | case_bit(v, 'A', 'Z');
+}
+
+inline std::uint64_t upper64(std::uint64_t v) {
+	return v ^ case_bit(v, 'a', 'z');
+}
+
+#ifdef __SSE2__
+// 0x20 in every byte in [lo, lo + 25]; signed compare after biasing.
+inline __m128i case_bit(__m128i v, char lo) {
+	__m128i biased = _mm_add_epi8(v, _mm_set1_epi8((char)(0x80 - lo)));
+	__m128i in = _mm_cmplt_epi8(biased, _mm_set1_epi8((char)(0x80 + 26)));
+	return _mm_and_si128(in, _mm_set1_epi8(0x20));
+}
+
+inline __m128i lower128(__m128i v) {
+	return _mm_or_si128(v, case_bit(v, 'A'));
+}
+#endif
+
+template <bool Upper>
+inline void convert(char *out, const char *in, std::size_t n) {
+	std::size_t i = 0;
+#ifdef __SSE2__
+	for (; i + 16 <= n; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+		v = Upper ? _mm_xor_si128(v, case_bit(v, 'a'))
+			  : _mm_or_si128(v, case_bit(v, 'A'));
+		_mm_storeu_si128((__m128i *)(out + i), v);
+	}
+#endif
+	for (; i + 8 <= n; i += 8) {
+		std::uint64_t v = load64(in + i);
+		v = Upper ? upper64(v) : lower64(v);
+		std::memcpy(out + i, &v, sizeof(v));
+	}
+	for (; i < n; ++i) {
+		unsigned char c = in[i];
+		if (unsigned(c - (Upper ? 'a' : 'A')) < 26)
+			c ^= 0x20;
+		out[i] = static_cast<char>(c);
+	}
+}
+
+// Up to 8 bytes, no reads past the end.
+inline std::uint64_t load_tail(const char *p, std::size_t n) {
+	return hash_detail::load_tail(
+		reinterpret_cast<const unsigned char *>(p), n);
+}
+
+} // End namespace ascii_detail
+
+inline char ascii_tolower(char c) {
+	return unsigned(static_cast<unsigned char>(c) - 'A') < 26 ? c ^ 0x20 : c;
+}
+
+inline char ascii_toupper(char c) {
+	return unsigned(static_cast<unsigned char>(c) - 'a') < 26 ? c ^ 0x20 : c;
+}
+
+inline bool ascii_isspace(char c) {
+	return c == ' ' || unsigned(static_cast<unsigned char>(c) - '\t') < 5;
+}
+
+// Writes s.size() bytes to out, which may be s.data() itself.
+inline void ascii_tolower(char *out, string_ref s) {
+	ascii_detail::convert<false>(out, s.data(), s.size());
+}
+
+inline void ascii_toupper(char *out, string_ref s) {
+	ascii_detail::convert<true>(out, s.data(), s.size());
+}
+
+inline void ascii_tolower(std::string &s) {
+	ascii_detail::convert<false>(&s[0], s.data(), s.size());
+}
+
+inline void ascii_toupper(std::string &s) {
+	ascii_detail::convert<true>(&s[0], s.data(), s.size());
+}
+
+inline bool ascii_iequals(string_ref a, string_ref b) {
+	using namespace ascii_detail;
+	if (a.size() != b.size())
+		return false;
+	const char *p = a.data(), *q = b.data();
+	std::size_t n = a.size(), i = 0;
+#ifdef __SSE2__
+	for (; i + 16 <= n; i += 16) {
+		__m128i x = lower128(_mm_loadu_si128((const __m128i *)(p + i)));
+		__m128i y = lower128(_mm_loadu_si128((const __m128i *)(q + i)));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) != 0xffff)
+			return false;
+	}
+#endif
+	for (; i + 8 <= n; i += 8) {
+		if (lower64(load64(p + i)) != lower64(load64(q + i)))
+			return false;
+	}
+	return lower64(load_tail(p + i, n - i)) ==
+	       lower64(load_tail(q + i, n - i));
+}
+
+// Orders as if both strings were lowercased first.
+inline int ascii_icompare(string_ref a, string_ref b) {
+	using namespace ascii_detail;
+	const char *p = a.data(), *q = b.data();
+	std::size_t n = a.size() < b.size() ? a.size() : b.size();
+	std::size_t i = 0;
+	// Skip the common prefix a word at a time, then settle it bytewise.
+	for (; i + 8 <= n; i += 8) {
+		if (lower64(load64(p + i)) != lower64(load64(q + i)))
+			break;
+	}
+	for (; i < n; ++i) {
+		unsigned char x = ascii_tolower(p[i]);
+		unsigned char y = ascii_tolower(q[i]);
+		if (x != y)
+			return x < y ? -1 : 1;
+	}
+	return a.size() < b.size() ? -1 : a.size() > b.size();
+}
+
+// Equal to hash_bytes() of the lowercased string, without making it.
+inline std::uint64_t ascii_ihash(string_ref s, std::uint64_t seed = 0) {
+	using namespace ascii_detail;
+	using hash_detail::mix;
+	using hash_detail::k0;
+	using hash_detail::k1;
+	using hash_detail::k2;
+	const char *p = s.data();
+	std::size_t len = s.size(), n = len;
+	std::uint64_t h = seed ^ k0 ^ (len * k2);
+	for (; n >= 16; p += 16, n -= 16)
+		h = mix(lower64(load64(p)) ^ k1, lower64(load64(p + 8)) ^ h);
+	std::uint64_t a = 0, b = 0;
+	if (n >= 8) {
+		a = lower64(load64(p));
+		b = lower64(load_tail(p + 8, n - 8));
+	} else {
+		a = lower64(load_tail(p, n));
+	}
+	return mix(mix(a ^ k1, b ^ h) ^ k0, len ^ k2);
+}
+
+// Strips leading/trailing ' ', \t, \n, \v, \f and \r.
+inline string_ref ascii_ltrim(string_ref s) {
+	std::size_t i = 0;
+	while (i < s.size() && ascii_isspace(s.data()[i]))
+		++i;
+	return string_ref(s.data() + i, s.size() - i);
+}
+
+inline string_ref ascii_rtrim(string_ref s) {
+	std::size_t n = s.size();
+	while (n && ascii_isspace(s.data()[n - 1]))
+		--n;
+	return string_ref(s.data(), n);
+}
+
+inline string_ref ascii_trim(string_ref s) {
+	return ascii_rtrim(ascii_ltrim(s));
+}
+
+// Function objects for containers keyed case-insensitively, e.g.
+// sorted_vector<std::string, ascii_iless> or
+// std::unordered_map<std::string, T, ascii_ihasher, ascii_iequal_to>.
+struct ascii_iless {
+	bool operator()(string_ref a, string_ref b) const {
+		return ascii_icompare(a, b) < 0;
+	}
+};
+
+struct ascii_iequal_to {
+	bool operator()(string_ref a, string_ref b) const {
+		return ascii_iequals(a, b);
+	}
+};
+
+struct ascii_ihasher {
+	std::size_t operator()(string_ref s) const {
+		return static_cast<std::size_t>(ascii_ihash(s));
+	}
+};
+
+}
+#endif
@@ -0,0 +1,146 @@
+#include "ascii.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <string>
+#include <strings.h>
+#include <unordered_map>
+#include <vector>
+
+using namespace cpputil;
+using bench_clock = std::chrono::steady_clock;
+
+// Header names as they arrive, in whatever case the client felt like.
+static const char *const header_names[] = {
+	"Host", "Accept", "Cookie", "Referer", "Connection", "User-Agent",
+	"Content-Type", "Content-Length", "Accept-Encoding", "Accept-Language",
+	"X-Forwarded-For", "Cache-Control", "If-None-Match",
+	"X-Request-Id-With-A-Rather-Long-Vendor-Specific-Suffix",
+};
+
+std::string random_case(std::mt19937 &mt, std::string s) {
+	for (char &c : s)
+		if (mt() % 2)
+			c = ascii_toupper(c);
+	return s;
+}
+
+// Strings of exactly len bytes, with pairs equal up to case.
+struct corpus {
+	std::vector<std::string> a, b;
+};
+
+corpus make_corpus(size_t len, size_t n) {
+	std::mt19937 mt(len);
+	corpus c;
+	for (size_t i = 0; i < n; ++i) {
+		std::string s;
+		while (s.size() < len)
+			s += header_names[mt() % 14];
+		s.resize(len);
+		c.a.push_back(random_case(mt, s));
+		c.b.push_back(random_case(mt, s));
+	}
+	return c;
+}
+
+template <typename F>
+void run(size_t len, const char *name, size_t n, F f) {
+	unsigned rounds = 0;
+	size_t sink = 0;
+	auto start = bench_clock::now();
+	std::chrono::duration<double, std::nano> elapsed;
+	do {
+		for (size_t i = 0; i < n; ++i)
+			sink += f(i);
+		++rounds;
+		elapsed = bench_clock::now() - start;
+	} while (elapsed.count() < 1e8);
+	printf("%4zu  %-28s %7.2f ns/op  (%zu)\n", len, name,
+	       elapsed.count() / (rounds * n), sink % 10);
+}
+
+int main() {
+	const size_t n = 4096;
+	for (size_t len : {4, 8, 12, 16, 24, 32, 48, 64}) {
+		corpus c = make_corpus(len, n);
+		std::vector<char> out(len);
+
+		run(len, "strncasecmp ==", n, [&](size_t i) {
+			return (size_t)!strncasecmp(c.a[i].data(), c.b[i].data(),
+						    len);
+		});
+		run(len, "ascii_iequals", n, [&](size_t i) {
+			return (size_t)ascii_iequals(c.a[i], c.b[i]);
+		});
+		run(len, "strcasecmp order", n, [&](size_t i) {
+			return (size_t)(strcasecmp(c.a[i].c_str(),
+						   c.b[(i + 1) % n].c_str()) < 0);
+		});
+		run(len, "ascii_icompare", n, [&](size_t i) {
+			return (size_t)(ascii_icompare(c.a[i], c.b[(i + 1) % n]) <
+					0);
+		});
+		run(len, "std::transform(tolower)", n, [&](size_t i) {
+			std::transform(c.a[i].begin(), c.a[i].end(),
+				       out.begin(), ::tolower);
+			return (size_t)out[0];
+		});
+		run(len, "ascii_tolower", n, [&](size_t i) {
+			ascii_tolower(out.data(), c.a[i]);
+			return (size_t)out[0];
+		});
+		run(len, "lowercase + std::hash", n, [&](size_t i) {
+			std::string s = c.a[i];
+			ascii_tolower(s);
+			return std::hash<std::string>()(s);
+		});
+		run(len, "ascii_ihash", n,
+		    [&](size_t i) { return (size_t)ascii_ihash(c.a[i]); });
+		printf("\n");
+	}
+
+	// A typical lookup: known headers in a case-insensitive table.
+	std::unordered_map<std::string, int, ascii_ihasher, ascii_iequal_to>
+		table;
+	std::unordered_map<std::string, int> lowered;
+	for (int i = 0; i < 14; ++i) {
+		std::string s = header_names[i];
+		table[s] = i;
+		ascii_tolower(s);
+		lowered[s] = i;
+	}
+	std::mt19937 mt(7);
+	std::vector<std::string> lookups;
+	for (size_t i = 0; i < n; ++i)
+		lookups.push_back(random_case(mt, header_names[mt() % 14]));
+	run(0, "map: lowercase then find", n, [&](size_t i) {
+		std::string s = lookups[i];
+		ascii_tolower(s);
+		return (size_t)lowered.find(s)->second;
+	});
+	run(0, "map: ascii_ihasher find", n, [&](size_t i) {
+		return (size_t)table.find(lookups[i])->second;
+	});
+
+	// Header values with the optional whitespace around them.
+	std::vector<std::string> values;
+	for (size_t i = 0; i < n; ++i)
+		values.push_back(std::string(mt() % 3, ' ') + "gzip, deflate" +
+				 std::string(mt() % 2, '\t') + "\r\n");
+	run(0, "isspace trim", n, [&](size_t i) {
+		const std::string &s = values[i];
+		size_t b = 0, e = s.size();
+		while (b < e && isspace((unsigned char)s[b]))
+			++b;
+		while (e > b && isspace((unsigned char)s[e - 1]))
+			--e;
+		return e - b;
+	});
+	run(0, "ascii_trim", n,
+	    [&](size_t i) { return ascii_trim(values[i]).size(); });
+	return 0;
+}
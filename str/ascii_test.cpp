@@ -0,0 +1,153 @@
+#include "ascii.h"
+#include "libcpp-util/util/test_check.h"
+#include <cstdio>
+#include <random>
+#include <string>
+
+using namespace cpputil;
+
+// The scalar definitions everything is checked against.
+static char ref_lower(char c) {
+	return c >= 'A' && c <= 'Z' ? char(c + 32) : c;
+}
+
+static char ref_upper(char c) {
+	return c >= 'a' && c <= 'z' ? char(c - 32) : c;
+}
+
+static bool ref_space(char c) {
+	return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' ||
+	       c == '\r';
+}
+
+static std::string ref_lower(const std::string &s) {
+	std::string r = s;
+	for (char &c : r)
+		c = ref_lower(c);
+	return r;
+}
+
+static int ref_icompare(const std::string &a, const std::string &b) {
+	std::string x = ref_lower(a), y = ref_lower(b);
+	for (size_t i = 0; i < x.size() && i < y.size(); ++i) {
+		unsigned char c = x[i], d = y[i];
+		if (c != d)
+			return c < d ? -1 : 1;
+	}
+	return x.size() < y.size() ? -1 : x.size() > y.size();
+}
+
+static std::string str(string_ref s) {
+	return std::string(s.data(), s.size());
+}
+
+static int sign(int v) {
+	return (v > 0) - (v < 0);
+}
+
+// Mostly the bytes either side of the letter ranges, with and without the
+// high bit, so a kernel that gets a bound or the sign wrong shows.
+static char random_byte(std::mt19937 &rng) {
+	static const unsigned char edges[] = {
+		'@', 'A', 'M', 'Z', '[', '`', 'a', 'm', 'z', '{', ' ', '\t',
+		'\r', '\v', 0x00, 0x7f, 0x80, 0xc0, 0xc1, 0xda, 0xdb, 0xe0,
+		0xe1, 0xfa, 0xfb, 0xff, 0xa0, 0x89};
+	if (rng() % 4 == 0)
+		return char(rng());
+	return char(edges[rng() % sizeof(edges)]);
+}
+
+static void check_one(const char *p, size_t n, std::mt19937 &rng) {
+	std::string s(p, n), lower = ref_lower(s), upper = s;
+	for (char &c : upper)
+		c = ref_upper(c);
+	string_ref r(p, n);
+
+	std::string out(n + 1, '#');
+	ascii_tolower(&out[0], r);
+	CHECK(out.substr(0, n) == lower && out[n] == '#');
+	ascii_toupper(&out[0], r);
+	CHECK(out.substr(0, n) == upper && out[n] == '#');
+	std::string in_place = s;
+	ascii_tolower(in_place);
+	CHECK(in_place == lower);
+	ascii_toupper(in_place);
+	CHECK(in_place == upper);
+
+	CHECK(ascii_ihash(r) == hash_bytes(lower.data(), n));
+	CHECK(ascii_ihash(r, 99) == hash_bytes(lower.data(), n, 99));
+	CHECK(ascii_iequals(r, upper) && ascii_iequals(lower, r));
+	CHECK(ascii_icompare(r, upper) == 0);
+
+	// Changed at one byte, and cut short.
+	for (size_t i = 0; i < n; ++i) {
+		std::string t = s;
+		t[i] = random_byte(rng);
+		bool eq = ref_lower(t) == lower;
+		CHECK(ascii_iequals(r, t) == eq && ascii_iequals(t, r) == eq);
+		CHECK(sign(ascii_icompare(r, t)) == ref_icompare(s, t));
+		CHECK(sign(ascii_icompare(t, r)) == ref_icompare(t, s));
+		if (eq)
+			CHECK(ascii_ihash(t) == ascii_ihash(r));
+	}
+	if (n) {
+		std::string shorter = s.substr(0, n - 1);
+		CHECK(!ascii_iequals(r, shorter));
+		CHECK(ascii_icompare(r, shorter) == 1);
+		CHECK(ascii_icompare(shorter, r) == -1);
+	}
+
+	size_t b = 0, e = n;
+	while (b < n && ref_space(s[b]))
+		++b;
+	while (e > b && ref_space(s[e - 1]))
+		--e;
+	string_ref t = ascii_trim(r);
+	CHECK(t.data() == p + b && t.size() == e - b);
+	string_ref lt = ascii_ltrim(r);
+	CHECK(lt.data() == p + b && lt.size() == n - b);
+	size_t re = n;
+	while (re && ref_space(s[re - 1]))
+		--re;
+	string_ref rt = ascii_rtrim(r);
+	CHECK(rt.data() == p && rt.size() == re);
+}
+
+// Every length up to 64 at every alignment within 16 bytes.
+static void test_kernels() {
+	std::mt19937 rng(11);
+	char buf[16 + 64 + 16];
+	for (int round = 0; round < 8; ++round) {
+		for (size_t n = 0; n <= 64; ++n) {
+			for (size_t off = 0; off < 16; ++off) {
+				for (char &c : buf)
+					c = random_byte(rng);
+				check_one(buf + off, n, rng);
+			}
+		}
+	}
+}
+
+// Whitespace runs around text; all space; none.
+static void test_trim() {
+	CHECK(str(ascii_trim(" \t\r\n\v\f")) == "");
+	CHECK(str(ascii_trim("")) == "");
+	CHECK(str(ascii_trim("  a b  ")) == "a b");
+	CHECK(str(ascii_ltrim("\nx ")) == "x ");
+	CHECK(str(ascii_rtrim(" x\n")) == " x");
+	// Not whitespace here: NUL, 0x85 (NEL) and 0xa0 (NBSP).
+	CHECK(ascii_trim(string_ref("\0x\0", 3)).size() == 3);
+	CHECK(str(ascii_trim("\x85x\xa0")) == "\x85x\xa0");
+}
+
+int main() {
+	for (int c = 0; c < 256; ++c) {
+		CHECK(ascii_tolower(char(c)) == ref_lower(char(c)));
+		CHECK(ascii_toupper(char(c)) == ref_upper(char(c)));
+		CHECK(ascii_isspace(char(c)) == ref_space(char(c)));
+	}
+	test_kernels();
+	test_trim();
+	printf("ascii_test: all passed\n");
+	return 0;
+}
@@ -0,0 +1,348 @@
+//============================================================================
+//                                  libcpp-util
+//                   A simple odds-n-ends library for C++11
+//
+//         Licensed under modified BSD license. See LICENSE for details.
+//============================================================================
+
+#ifndef LIBCPP_UTIL_CT_FORMAT_H
+#define LIBCPP_UTIL_CT_FORMAT_H
+
+#include "libcpp-util/str/format.h"
+
+#include <cstddef>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+
+// Format strings parsed at compile time. Wrapping a literal in CPPUTIL_FMT
+// turns it into a type, so each call site gets a formatter with the literal
+// runs, conversion specs and argument types baked in:
+//
+//	strprintf(s, CPPUTIL_FMT("%s:%d took %5.2f ms"), host, port, ms);
+//
+// Argument count and types are checked against the conversions with
+// static_assert, more strictly than the runtime formatter: %d wants an
+// integer, %f a floating point value, %p a pointer or string. %s takes any
+// argument the runtime formatter can print and prints it the natural way;
+// other types fail to compile. Dynamic width/precision (*) is not
+// supported, and literals are limited to ct_format_max_length characters.
+
+namespace cpputil {
+
+static const std::size_t ct_format_max_length = 256;
+
+template <char... Cs>
+struct ct_string {
+	static constexpr char value[] = { Cs..., '\0' };
+};
+
+template <char... Cs>
+constexpr char ct_string<Cs...>::value[];
+
+namespace ct_format_detail {
+
+template <std::size_t N>
+constexpr char char_at(const char (&s)[N], std::size_t i) {
+	return N > ct_format_max_length + 1
+		       ? throw std::length_error("CPPUTIL_FMT literal too long")
+		       : (i < N ? s[i] : '\0');
+}
+
+constexpr bool is_flag(char c) {
+	return c == '-' || c == '+' || c == ' ' || c == '#' || c == '0';
+}
+constexpr unsigned flag_bit(char c) {
+	return c == '-' ? format_spec::left
+	     : c == '+' ? format_spec::plus
+	     : c == ' ' ? format_spec::space
+	     : c == '#' ? format_spec::alt
+	     : format_spec::zero;
+}
+constexpr bool is_digit(char c) {
+	return c >= '0' && c <= '9';
+}
+constexpr bool is_length_modifier(char c) {
+	return c == 'h' || c == 'l' || c == 'L' || c == 'q' || c == 'j' ||
+	       c == 'z' || c == 't';
+}
+
+constexpr unsigned flags_end(const char *s, unsigned i) {
+	return is_flag(s[i]) ? flags_end(s, i + 1) : i;
+}
+constexpr unsigned parse_flags(const char *s, unsigned i) {
+	return is_flag(s[i]) ? flag_bit(s[i]) | parse_flags(s, i + 1) : 0;
+}
+constexpr unsigned digits_end(const char *s, unsigned i) {
+	return is_digit(s[i]) ? digits_end(s, i + 1) : i;
+}
+constexpr int parse_int(const char *s, unsigned i, int acc) {
+	return is_digit(s[i]) ? parse_int(s, i + 1, acc * 10 + (s[i] - '0'))
+			      : acc;
+}
+constexpr unsigned length_end(const char *s, unsigned i) {
+	return is_length_modifier(s[i]) ? length_end(s, i + 1) : i;
+}
+constexpr unsigned precision_end(const char *s, unsigned i) {
+	return s[i] == '.' ? digits_end(s, i + 1) : i;
+}
+
+// Index of the conversion character of the spec starting at the '%' at p.
+constexpr unsigned conv_pos(const char *s, unsigned p) {
+	return length_end(s,
+		precision_end(s, digits_end(s, flags_end(s, p + 1))));
+}
+constexpr unsigned spec_end(const char *s, unsigned p) {
+	return s[conv_pos(s, p)] ? conv_pos(s, p) + 1 : conv_pos(s, p);
+}
+
+constexpr unsigned next_percent(const char *s, unsigned i) {
+	return (!s[i] || s[i] == '%') ? i : next_percent(s, i + 1);
+}
+constexpr unsigned spec_pos(const char *s, unsigned k, unsigned i) {
+	return k == 0 ? next_percent(s, i)
+		      : spec_pos(s, k - 1, spec_end(s, next_percent(s, i)));
+}
+constexpr unsigned count_specs(const char *s, unsigned i) {
+	return s[next_percent(s, i)]
+		       ? 1 + count_specs(s, spec_end(s, next_percent(s, i)))
+		       : 0;
+}
+constexpr unsigned literal_end(const char *s, unsigned i) {
+	return s[i] ? literal_end(s, i + 1) : i;
+}
+
+// Number of arguments consumed by the first k specs; %% takes none.
+constexpr unsigned arg_index(const char *s, unsigned k) {
+	return k == 0 ? 0
+		      : arg_index(s, k - 1) +
+				(s[conv_pos(s, spec_pos(s, k - 1, 0))] != '%');
+}
+
+enum arg_class {
+	integral_class,
+	floating_class,
+	string_class,
+	pointer_class,
+	other_class
+};
+
+// The string types format_arg takes.
+template <typename D>
+struct is_string
+	: std::integral_constant<bool,
+		std::is_same<D, const char *>::value ||
+		std::is_same<D, char *>::value ||
+		std::is_same<D, string_ref>::value> {
+};
+template <typename A>
+struct is_string<std::basic_string<char, std::char_traits<char>, A>>
+	: std::true_type {
+};
+
+template <typename T, typename D = typename std::decay<T>::type>
+struct classify
+	: std::integral_constant<arg_class,
+		std::is_integral<D>::value ? integral_class
+	      : std::is_floating_point<D>::value ? floating_class
+	      : is_string<D>::value ? string_class
+	      : (std::is_pointer<D>::value ||
+		 std::is_same<D, std::nullptr_t>::value) ? pointer_class
+	      : other_class> {
+};
+
+constexpr bool is_integral_conv(char c) {
+	return c == 'd' || c == 'i' || c == 'u' || c == 'x' || c == 'X' ||
+	       c == 'o' || c == 'c';
+}
+constexpr bool is_floating_conv(char c) {
+	return c == 'f' || c == 'F' || c == 'e' || c == 'E' || c == 'g' ||
+	       c == 'G' || c == 'a' || c == 'A';
+}
+constexpr bool accepts(char conv, arg_class cls) {
+	return cls == other_class ? false
+	     : is_integral_conv(conv) ? cls == integral_class
+	     : is_floating_conv(conv) ? cls == floating_class
+	     : conv == 's' ? true
+	     : conv == 'p' ? (cls == pointer_class || cls == string_class)
+	     : false;
+}
+
+// Everything known about the K'th conversion of Str.
+template <class Str, unsigned K>
+struct spec_at {
+	static constexpr unsigned pos = spec_pos(Str::value, K, 0);
+	static constexpr unsigned width_pos = flags_end(Str::value, pos + 1);
+	static constexpr unsigned width_end = digits_end(Str::value, width_pos);
+	static constexpr unsigned conv_index = conv_pos(Str::value, pos);
+
+	static constexpr unsigned flags = parse_flags(Str::value, pos + 1);
+	static constexpr int width = parse_int(Str::value, width_pos, 0);
+	static constexpr int precision =
+		Str::value[width_end] == '.'
+			? parse_int(Str::value, width_end + 1, 0) : -1;
+	static constexpr char conv = Str::value[conv_index];
+	static constexpr bool dynamic = Str::value[width_pos] == '*' ||
+		(Str::value[width_end] == '.' &&
+		 Str::value[width_end + 1] == '*');
+	static constexpr unsigned end = spec_end(Str::value, pos);
+	static constexpr unsigned arg = arg_index(Str::value, K);
+
+	static format_spec spec() {
+		format_spec s;
+		s.flags = flags;
+		s.width = width;
+		s.precision = precision;
+		s.conv = conv;
+		return s;
+	}
+};
+
+// End of the spec before the K'th one, i.e. where its literal run starts.
+template <class Str, unsigned K>
+struct literal_start
+	: std::integral_constant<unsigned, spec_at<Str, K - 1>::end> {
+};
+template <class Str>
+struct literal_start<Str, 0> : std::integral_constant<unsigned, 0> {
+};
+
+template <class Sink, typename T>
+std::size_t write_typed(Sink &out, const format_spec &spec, const T &v,
+		std::integral_constant<arg_class, integral_class>) {
+	format_arg arg(v);
+	switch (spec.conv) {
+	case 'c': {
+		char c = static_cast<char>(arg.as_signed());
+		return format_detail::write_padded(out, spec, &c, 1);
+	}
+	case 'd':
+	case 'i': {
+		long long x = arg.as_signed();
+		return format_detail::write_integer(out, spec,
+				x < 0 ? 0ull - x : x, x < 0);
+	}
+	case 's':
+		return format_detail::write_natural(out, spec, arg);
+	default:
+		return format_detail::write_integer(out, spec,
+				arg.as_unsigned(), false);
+	}
+}
+
+template <class Sink, typename T>
+std::size_t write_typed(Sink &out, const format_spec &spec, const T &v,
+		std::integral_constant<arg_class, floating_class>) {
+	if (spec.conv == 's')
+		return format_detail::write_natural(out, spec, format_arg(v));
+	int n = format_detail::write_float(out, spec, static_cast<double>(v));
+	return n < 0 ? 0 : n;
+}
+
+template <class Sink, typename T, arg_class C>
+std::size_t write_typed(Sink &out, const format_spec &spec, const T &v,
+		std::integral_constant<arg_class, C>) {
+	if (spec.conv == 'p')
+		return format_detail::write_pointer(out, spec,
+				format_arg(v).as_pointer());
+	return format_detail::write_natural(out, spec, format_arg(v));
+}
+
+template <class Str, unsigned K, unsigned N>
+struct formatter {
+	typedef spec_at<Str, K> spec;
+	static constexpr unsigned prev = literal_start<Str, K>::value;
+
+	static_assert(!spec::dynamic,
+		"CPPUTIL_FMT: '*' width/precision is not supported");
+	static_assert(spec::conv == '%' || is_integral_conv(spec::conv) ||
+			      is_floating_conv(spec::conv) ||
+			      spec::conv == 's' || spec::conv == 'p',
+		"CPPUTIL_FMT: unknown or unsupported conversion");
+
+	template <class Sink, class Tuple>
+	static std::size_t write_spec(Sink &out, const Tuple &,
+				      std::true_type) {
+		out.append("%", 1);
+		return 1;
+	}
+
+	template <class Sink, class Tuple>
+	static std::size_t write_spec(Sink &out, const Tuple &args,
+				      std::false_type) {
+		typedef typename std::tuple_element<spec::arg, Tuple>::type
+			arg_type;
+		typedef classify<arg_type> cls;
+		static_assert(accepts(spec::conv, cls::value),
+			"CPPUTIL_FMT: argument type does not match conversion");
+		return write_typed(out, spec::spec(), std::get<spec::arg>(args),
+				   std::integral_constant<arg_class,
+							  cls::value>());
+	}
+
+	template <class Sink, class Tuple>
+	static std::size_t run(Sink &out, const Tuple &args) {
+		std::size_t n = spec::pos - prev;
+		if (n)
+			out.append(Str::value + prev, n);
+		n += write_spec(out, args, std::integral_constant<bool,
+						spec::conv == '%'>());
+		return n + formatter<Str, K + 1, N>::run(out, args);
+	}
+};
+
+template <class Str, unsigned N>
+struct formatter<Str, N, N> {
+	static constexpr unsigned prev = literal_start<Str, N>::value;
+
+	template <class Sink, class Tuple>
+	static std::size_t run(Sink &out, const Tuple &) {
+		std::size_t n = literal_end(Str::value, prev) - prev;
+		if (n)
+			out.append(Str::value + prev, n);
+		return n;
+	}
+};
+
+} // End namespace ct_format_detail
+
+// Same contract as format_to(), except that errors in the format or the
+// arguments fail to compile.
+template <class Sink, char... Cs, typename... Ts>
+int format_to(Sink &out, ct_string<Cs...>, const Ts &... ts) {
+	typedef ct_string<Cs...> str;
+	using namespace ct_format_detail;
+	static constexpr unsigned nspecs = count_specs(str::value, 0);
+	static_assert(arg_index(str::value, nspecs) == sizeof...(Ts),
+		"CPPUTIL_FMT: argument count does not match format string");
+	std::tuple<const Ts &...> args(ts...);
+	return static_cast<int>(formatter<str, 0, nspecs>::run(out, args));
+}
+
+}
+
+#define CPPUTIL_FMT_CHAR(s, i) ::cpputil::ct_format_detail::char_at(s, i)
+#define CPPUTIL_FMT_CHARS16(s, i)                                             \
+	CPPUTIL_FMT_CHAR(s, i + 0), CPPUTIL_FMT_CHAR(s, i + 1),               \
+	CPPUTIL_FMT_CHAR(s, i + 2), CPPUTIL_FMT_CHAR(s, i + 3),               \
+	CPPUTIL_FMT_CHAR(s, i + 4), CPPUTIL_FMT_CHAR(s, i + 5),               \
+	CPPUTIL_FMT_CHAR(s, i + 6), CPPUTIL_FMT_CHAR(s, i + 7),               \
+	CPPUTIL_FMT_CHAR(s, i + 8), CPPUTIL_FMT_CHAR(s, i + 9),               \
+	CPPUTIL_FMT_CHAR(s, i + 10), CPPUTIL_FMT_CHAR(s, i + 11),             \
+	CPPUTIL_FMT_CHAR(s, i + 12), CPPUTIL_FMT_CHAR(s, i + 13),             \
+	CPPUTIL_FMT_CHAR(s, i + 14), CPPUTIL_FMT_CHAR(s, i + 15)
+#define CPPUTIL_FMT_CHARS256(s)                                               \
+	CPPUTIL_FMT_CHARS16(s, 0), CPPUTIL_FMT_CHARS16(s, 16),                \
+	CPPUTIL_FMT_CHARS16(s, 32), CPPUTIL_FMT_CHARS16(s, 48),               \
+	CPPUTIL_FMT_CHARS16(s, 64), CPPUTIL_FMT_CHARS16(s, 80),               \
+	CPPUTIL_FMT_CHARS16(s, 96), CPPUTIL_FMT_CHARS16(s, 112),              \
+	CPPUTIL_FMT_CHARS16(s, 128), CPPUTIL_FMT_CHARS16(s, 144),             \
+	CPPUTIL_FMT_CHARS16(s, 160), CPPUTIL_FMT_CHARS16(s, 176),             \
+	CPPUTIL_FMT_CHARS16(s, 192), CPPUTIL_FMT_CHARS16(s, 208),             \
+	CPPUTIL_FMT_CHARS16(s, 224), CPPUTIL_FMT_CHARS16(s, 240)
+
+// Turns a string literal into a ct_string, i.e. a format parsed at compile
+// time.
+#define CPPUTIL_FMT(s) (::cpputil::ct_string<CPPUTIL_FMT_CHARS256(s)>())
+
+#endif
@@ -0,0 +1,95 @@
+#include "ct_format.h"
+#include "libcpp-util/util/test_check.h"
+#include "libcpp-util/str/strprintf.h"
+#include <cstdio>
+#include <string>
+
+using namespace cpputil;
+using namespace cpputil::ct_format_detail;
+
+// The checks format_to() makes with static_assert, made here directly so
+// the ones that must fail can be tested too.
+#define NARGS(s)                                                            \
+	(arg_index(decltype(CPPUTIL_FMT(s))::value,                          \
+		   count_specs(decltype(CPPUTIL_FMT(s))::value, 0)))
+
+static_assert(NARGS("") == 0 && NARGS("plain") == 0, "");
+static_assert(NARGS("%%") == 0 && NARGS("100%% %d") == 1, "");
+static_assert(NARGS("%d%s%-08.3f%p%%%c") == 5, "");
+static_assert(NARGS("%lld %zu %hhx") == 3, "");
+
+template <typename T>
+constexpr bool ok(char conv) {
+	return accepts(conv, classify<T>::value);
+}
+
+struct opaque {};
+struct custom_allocator : std::allocator<char> {};
+
+static_assert(ok<int>('d') && ok<unsigned long long>('x') &&
+		      ok<char>('c') && ok<bool>('u') && ok<short>('o'),
+	      "");
+static_assert(!ok<double>('d') && !ok<const char *>('d') &&
+		      !ok<void *>('x') && !ok<opaque>('d'),
+	      "");
+static_assert(ok<double>('f') && ok<float>('g') && ok<long double>('a'),
+	      "");
+static_assert(!ok<int>('f') && !ok<std::string>('e'), "");
+static_assert(ok<int>('s') && ok<double>('s') && ok<char *>('s') &&
+		      ok<std::string>('s') && ok<string_ref>('s') &&
+		      ok<void *>('s') && ok<std::nullptr_t>('s') &&
+		      ok<char[4]>('s'),
+	      "");
+static_assert(ok<std::basic_string<char, std::char_traits<char>,
+				   custom_allocator>>('s'),
+	      "");
+static_assert(!ok<opaque>('s') && !ok<opaque *>('d'), "");
+static_assert(ok<int *>('p') && ok<std::nullptr_t>('p') &&
+		      ok<const char *>('p') && !ok<int>('p') &&
+		      !ok<double>('p'),
+	      "");
+
+static void check_same(const std::string &expect, int n,
+		       const std::string &got) {
+	if (got != expect)
+		fprintf(stderr, "got \"%s\", expected \"%s\"\n", got.c_str(),
+			expect.c_str());
+	CHECK(got == expect && n == int(got.size()));
+}
+
+// Every accepted conversion formats as the runtime formatter does.
+#define SAME(fmt, ...)                                                      \
+	do {                                                                \
+		std::string s, expect = astrprintf(fmt, __VA_ARGS__);       \
+		int n = strprintf(s, CPPUTIL_FMT(fmt), __VA_ARGS__);        \
+		check_same(expect, n, s);                                   \
+	} while (0)
+
+static void test_output() {
+	int x = 42;
+	std::string str = "str";
+	SAME("%d|%i|%5d|%-5d|%05d|%+d|% d", -7, 7, 42, 42, -42, 3, 3);
+	SAME("%u %x %X %#x %o %#o %.5u", 3000000000u, 255, 255, 255, 8, 8, 9u);
+	SAME("%lld %llu %hhd %zu %ld", -(1ll << 40), ~0ull, 'a', size_t(5),
+	     -9l);
+	SAME("%c%c%3c%-3c|", 'a', 66, 'c', 'd');
+	SAME("%f %.3f %10.2e %-10.3g| %a %G", 3.14159, -1.0005, 2.5e-7, 1e20,
+	     1.0, 1e-10);
+	SAME("%s %s %s %s %s", 1, -2.5, "lit", str, string_ref("ref"));
+	SAME("%5s|%-5s|%.2s", "ab", "cd", "efgh");
+	SAME("%s %s %s", 'x', true, 0.1f);
+	SAME("%p %p %p", &x, nullptr, "lit");
+	SAME("100%% of %d%%", 5);
+	SAME("%s", "no args but this");
+	std::string s;
+	CHECK(strprintf(s, CPPUTIL_FMT("")) == 0 && s.empty());
+	CHECK(strprintf(s, CPPUTIL_FMT("just text")) == 9 && s == "just text");
+	CHECK(strappendf(s, CPPUTIL_FMT("%d-%s"), 1, "a") == 3 &&
+	      s == "just text1-a");
+}
+
+int main() {
+	test_output();
+	printf("ct_format_test: all passed\n");
+	return 0;
+}
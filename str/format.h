@@ -0,0 +1,1012 @@
+//============================================================================
+//                                  libcpp-util
+//                   A simple odds-n-ends library for C++11
+//
+//         Licensed under modified BSD license. See LICENSE for details.
+//============================================================================
+
+#ifndef LIBCPP_UTIL_FORMAT_H
+#define LIBCPP_UTIL_FORMAT_H
+
+#include "libcpp-util/cxx14/string_ref.h"
+
+#include <climits>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+// Type-safe printf-style formatting. The format string follows printf, but the
+// arguments are captured with their real C++ types, so the formatter knows
+// what it has been handed instead of trusting the conversion specifier.
+// Integers, strings, characters and pointers are formatted directly into the
+// destination in a single pass. Floating point conversions with printf
+// semantics (%f, %e, %g, %a) still go through snprintf, once, into a stack
+// buffer, since exact rounding at an arbitrary precision needs bignums.
+//
+// As an extension, %s accepts any argument and prints its natural
+// representation. For floating point that is the shortest string which reads
+// back as the same double, which is what you almost always want in a log line.
+
+namespace cpputil {
+
+namespace format_detail {
+
+inline const char *digit_pairs() {
+	static const char pairs[] =
+		"00010203040506070809"
+		"10111213141516171819"
+		"20212223242526272829"
+		"30313233343536373839"
+		"40414243444546474849"
+		"50515253545556575859"
+		"60616263646566676869"
+		"70717273747576777879"
+		"80818283848586878889"
+		"90919293949596979899";
+	return pairs;
+}
+
+// All of these write backwards from end and return the first character.
+inline char *format_decimal(char *end, std::uint64_t v) {
+	const char *pairs = digit_pairs();
+	while (v >= 100) {
+		unsigned idx = static_cast<unsigned>(v % 100) * 2;
+		v /= 100;
+		end -= 2;
+		std::memcpy(end, pairs + idx, 2);
+	}
+	if (v < 10) {
+		*--end = static_cast<char>('0' + v);
+		return end;
+	}
+	end -= 2;
+	std::memcpy(end, pairs + v * 2, 2);
+	return end;
+}
+
+inline char *format_hex(char *end, std::uint64_t v, bool upper) {
+	const char *digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+	do {
+		*--end = digits[v & 0xf];
+		v >>= 4;
+	} while (v);
+	return end;
+}
+
+inline char *format_octal(char *end, std::uint64_t v) {
+	do {
+		*--end = static_cast<char>('0' + (v & 7));
+		v >>= 3;
+	} while (v);
+	return end;
+}
+
+// Grisu2 (Loitsch, "Printing Floating-Point Numbers Quickly and Accurately
+// with Integers"). Always produces a string that round-trips, and the shortest
+// such string for all but about 0.3% of inputs, which get one digit more.
+struct diy_fp {
+	std::uint64_t f;
+	int e;
+
+	diy_fp() : f(0), e(0) {
+	}
+	diy_fp(std::uint64_t f, int e) : f(f), e(e) {
+	}
+
+	static diy_fp from_double(double d) {
+		std::uint64_t bits;
+		std::memcpy(&bits, &d, sizeof(bits));
+		int biased_e = static_cast<int>((bits >> 52) & 0x7ff);
+		std::uint64_t significand = bits & ((1ull << 52) - 1);
+		if (biased_e)
+			return diy_fp(significand | (1ull << 52),
+				      biased_e - 1075);
+		return diy_fp(significand, -1074);
+	}
+
+	diy_fp operator-(const diy_fp &rhs) const {
+		return diy_fp(f - rhs.f, e);
+	}
+
+	diy_fp operator*(const diy_fp &rhs) const {
+#if defined(__SIZEOF_INT128__)
+		unsigned __int128 p = static_cast<unsigned __int128>(f) * rhs.f;
+		std::uint64_t h = static_cast<std::uint64_t>(p >> 64);
+		std::uint64_t l = static_cast<std::uint64_t>(p);
+		if (l & (1ull << 63))
+			h++; // Round
+		return diy_fp(h, e + rhs.e + 64);
+#else
+		const std::uint64_t M32 = 0xffffffffu;
+		std::uint64_t a = f >> 32, b = f & M32;
+		std::uint64_t c = rhs.f >> 32, d = rhs.f & M32;
+		std::uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+		std::uint64_t tmp = (bd >> 32) + (ad & M32) + (bc & M32);
+		tmp += 1u << 31; // Round
+		return diy_fp(ac + (ad >> 32) + (bc >> 32) + (tmp >> 32),
+			      e + rhs.e + 64);
+#endif
+	}
+
+	diy_fp normalize() const {
+		diy_fp res = *this;
+		while (!(res.f & (1ull << 63))) {
+			res.f <<= 1;
+			res.e--;
+		}
+		return res;
+	}
+
+	// Computes the normalized boundaries m- and m+ of the rounding
+	// interval around this value.
+	void normalized_boundaries(diy_fp &minus, diy_fp &plus) const {
+		diy_fp pl = diy_fp((f << 1) + 1, e - 1).normalize();
+		diy_fp mi = (f == (1ull << 52)) ? diy_fp((f << 2) - 1, e - 2)
+						: diy_fp((f << 1) - 1, e - 1);
+		mi.f <<= mi.e - pl.e;
+		mi.e = pl.e;
+		plus = pl;
+		minus = mi;
+	}
+};
+
+// Normalized 64-bit approximations of 10^k for k = -348, -340, ..., 340.
+inline diy_fp cached_power(int e, int &K) {
+	static const struct {
+		std::uint64_t f;
+		int e;
+	} powers[] = {
+		{ 0xFA8FD5A0081C0288ull, -1220 },
+		{ 0xBAAEE17FA23EBF76ull, -1193 },
+		{ 0x8B16FB203055AC76ull, -1166 },
+		{ 0xCF42894A5DCE35EAull, -1140 },
+		{ 0x9A6BB0AA55653B2Dull, -1113 },
+		{ 0xE61ACF033D1A45DFull, -1087 },
+		{ 0xAB70FE17C79AC6CAull, -1060 },
+		{ 0xFF77B1FCBEBCDC4Full, -1034 },
+		{ 0xBE5691EF416BD60Cull, -1007 },
+		{ 0x8DD01FAD907FFC3Cull, -980 },
+		{ 0xD3515C2831559A83ull, -954 },
+		{ 0x9D71AC8FADA6C9B5ull, -927 },
+		{ 0xEA9C227723EE8BCBull, -901 },
+		{ 0xAECC49914078536Dull, -874 },
+		{ 0x823C12795DB6CE57ull, -847 },
+		{ 0xC21094364DFB5637ull, -821 },
+		{ 0x9096EA6F3848984Full, -794 },
+		{ 0xD77485CB25823AC7ull, -768 },
+		{ 0xA086CFCD97BF97F4ull, -741 },
+		{ 0xEF340A98172AACE5ull, -715 },
+		{ 0xB23867FB2A35B28Eull, -688 },
+		{ 0x84C8D4DFD2C63F3Bull, -661 },
+		{ 0xC5DD44271AD3CDBAull, -635 },
+		{ 0x936B9FCEBB25C996ull, -608 },
+		{ 0xDBAC6C247D62A584ull, -582 },
+		{ 0xA3AB66580D5FDAF6ull, -555 },
+		{ 0xF3E2F893DEC3F126ull, -529 },
+		{ 0xB5B5ADA8AAFF80B8ull, -502 },
+		{ 0x87625F056C7C4A8Bull, -475 },
+		{ 0xC9BCFF6034C13053ull, -449 },
+		{ 0x964E858C91BA2655ull, -422 },
+		{ 0xDFF9772470297EBDull, -396 },
+		{ 0xA6DFBD9FB8E5B88Full, -369 },
+		{ 0xF8A95FCF88747D94ull, -343 },
+		{ 0xB94470938FA89BCFull, -316 },
+		{ 0x8A08F0F8BF0F156Bull, -289 },
+		{ 0xCDB02555653131B6ull, -263 },
+		{ 0x993FE2C6D07B7FACull, -236 },
+		{ 0xE45C10C42A2B3B06ull, -210 },
+		{ 0xAA242499697392D3ull, -183 },
+		{ 0xFD87B5F28300CA0Eull, -157 },
+		{ 0xBCE5086492111AEBull, -130 },
+		{ 0x8CBCCC096F5088CCull, -103 },
+		{ 0xD1B71758E219652Cull, -77 },
+		{ 0x9C40000000000000ull, -50 },
+		{ 0xE8D4A51000000000ull, -24 },
+		{ 0xAD78EBC5AC620000ull, 3 },
+		{ 0x813F3978F8940984ull, 30 },
+		{ 0xC097CE7BC90715B3ull, 56 },
+		{ 0x8F7E32CE7BEA5C70ull, 83 },
+		{ 0xD5D238A4ABE98068ull, 109 },
+		{ 0x9F4F2726179A2245ull, 136 },
+		{ 0xED63A231D4C4FB27ull, 162 },
+		{ 0xB0DE65388CC8ADA8ull, 189 },
+		{ 0x83C7088E1AAB65DBull, 216 },
+		{ 0xC45D1DF942711D9Aull, 242 },
+		{ 0x924D692CA61BE758ull, 269 },
+		{ 0xDA01EE641A708DEAull, 295 },
+		{ 0xA26DA3999AEF774Aull, 322 },
+		{ 0xF209787BB47D6B85ull, 348 },
+		{ 0xB454E4A179DD1877ull, 375 },
+		{ 0x865B86925B9BC5C2ull, 402 },
+		{ 0xC83553C5C8965D3Dull, 428 },
+		{ 0x952AB45CFA97A0B3ull, 455 },
+		{ 0xDE469FBD99A05FE3ull, 481 },
+		{ 0xA59BC234DB398C25ull, 508 },
+		{ 0xF6C69A72A3989F5Cull, 534 },
+		{ 0xB7DCBF5354E9BECEull, 561 },
+		{ 0x88FCF317F22241E2ull, 588 },
+		{ 0xCC20CE9BD35C78A5ull, 614 },
+		{ 0x98165AF37B2153DFull, 641 },
+		{ 0xE2A0B5DC971F303Aull, 667 },
+		{ 0xA8D9D1535CE3B396ull, 694 },
+		{ 0xFB9B7CD9A4A7443Cull, 720 },
+		{ 0xBB764C4CA7A44410ull, 747 },
+		{ 0x8BAB8EEFB6409C1Aull, 774 },
+		{ 0xD01FEF10A657842Cull, 800 },
+		{ 0x9B10A4E5E9913129ull, 827 },
+		{ 0xE7109BFBA19C0C9Dull, 853 },
+		{ 0xAC2820D9623BF429ull, 880 },
+		{ 0x80444B5E7AA7CF85ull, 907 },
+		{ 0xBF21E44003ACDD2Dull, 933 },
+		{ 0x8E679C2F5E44FF8Full, 960 },
+		{ 0xD433179D9C8CB841ull, 986 },
+		{ 0x9E19DB92B4E31BA9ull, 1013 },
+		{ 0xEB96BF6EBADF77D9ull, 1039 },
+		{ 0xAF87023B9BF0EE6Bull, 1066 },
+	};
+
+	// Pick the power such that the product's exponent lands in
+	// [-60, -32], which lets digit generation run in 64-bit integers.
+	double dk = (-61 - e) * 0.30102999566398114 + 347;
+	int k = static_cast<int>(dk);
+	if (dk - k > 0.0)
+		k++;
+	unsigned index = static_cast<unsigned>((k >> 3) + 1);
+	K = -(-348 + static_cast<int>(index << 3));
+	return diy_fp(powers[index].f, powers[index].e);
+}
+
+inline void grisu_round(char *buf, int len, std::uint64_t delta,
+			std::uint64_t rest, std::uint64_t ten_kappa,
+			std::uint64_t wp_w) {
+	while (rest < wp_w && delta - rest >= ten_kappa &&
+	       (rest + ten_kappa < wp_w ||
+		wp_w - rest > rest + ten_kappa - wp_w)) {
+		buf[len - 1]--;
+		rest += ten_kappa;
+	}
+}
+
+inline unsigned count_decimal_digits(std::uint32_t n) {
+	if (n < 10) return 1;
+	if (n < 100) return 2;
+	if (n < 1000) return 3;
+	if (n < 10000) return 4;
+	if (n < 100000) return 5;
+	if (n < 1000000) return 6;
+	if (n < 10000000) return 7;
+	if (n < 100000000) return 8;
+	if (n < 1000000000) return 9;
+	return 10;
+}
+
+inline void digit_gen(const diy_fp &W, const diy_fp &Mp, std::uint64_t delta,
+		      char *buf, int &len, int &K) {
+	static const std::uint32_t pow10[] = {
+		1, 10, 100, 1000, 10000, 100000, 1000000, 10000000,
+		100000000, 1000000000
+	};
+	const diy_fp one(1ull << -Mp.e, Mp.e);
+	const diy_fp wp_w = Mp - W;
+	std::uint32_t p1 = static_cast<std::uint32_t>(Mp.f >> -one.e);
+	std::uint64_t p2 = Mp.f & (one.f - 1);
+	int kappa = static_cast<int>(count_decimal_digits(p1));
+	len = 0;
+
+	while (kappa > 0) {
+		std::uint32_t div = pow10[kappa - 1];
+		std::uint32_t d = p1 / div;
+		p1 %= div;
+		if (d || len)
+			buf[len++] = static_cast<char>('0' + d);
+		kappa--;
+		std::uint64_t tmp =
+			(static_cast<std::uint64_t>(p1) << -one.e) + p2;
+		if (tmp <= delta) {
+			K += kappa;
+			grisu_round(buf, len, delta, tmp,
+				    static_cast<std::uint64_t>(pow10[kappa])
+					<< -one.e,
+				    wp_w.f);
+			return;
+		}
+	}
+
+	// Past 19 fractional digits the scaled margin no longer fits, and
+	// the rounding step has nothing left to do anyway.
+	static const std::uint64_t frac_pow10[] = {
+		1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull,
+		10000000ull, 100000000ull, 1000000000ull, 10000000000ull,
+		100000000000ull, 1000000000000ull, 10000000000000ull,
+		100000000000000ull, 1000000000000000ull,
+		10000000000000000ull, 100000000000000000ull,
+		1000000000000000000ull, 10000000000000000000ull
+	};
+	for (;;) {
+		p2 *= 10;
+		delta *= 10;
+		char d = static_cast<char>(p2 >> -one.e);
+		if (d || len)
+			buf[len++] = static_cast<char>('0' + d);
+		p2 &= one.f - 1;
+		kappa--;
+		if (p2 < delta) {
+			K += kappa;
+			grisu_round(buf, len, delta, p2, one.f,
+				    -kappa < 20 ? wp_w.f * frac_pow10[-kappa]
+						: 0);
+			return;
+		}
+	}
+}
+
+// v must be finite and positive. Produces digits such that
+// v == buf[0..len) * 10^K after reading back.
+inline void grisu2(double v, char *buf, int &len, int &K) {
+	const diy_fp fp = diy_fp::from_double(v);
+	diy_fp minus, plus;
+	fp.normalized_boundaries(minus, plus);
+
+	const diy_fp c_mk = cached_power(plus.e, K);
+	const diy_fp W = fp.normalize() * c_mk;
+	diy_fp Wp = plus * c_mk;
+	diy_fp Wm = minus * c_mk;
+	Wm.f++;
+	Wp.f--;
+	digit_gen(W, Wp, Wp.f - Wm.f, buf, len, K);
+}
+
+inline char *write_exponent(char *out, int e) {
+	*out++ = 'e';
+	if (e < 0) {
+		*out++ = '-';
+		e = -e;
+	} else {
+		*out++ = '+';
+	}
+	char tmp[4];
+	char *end = tmp + sizeof(tmp);
+	char *p = format_decimal(end, static_cast<unsigned>(e));
+	if (end - p < 2)
+		*--p = '0';
+	std::memcpy(out, p, end - p);
+	return out + (end - p);
+}
+
+} // End namespace format_detail
+
+// Longest output of format_shortest(), e.g. "-2.2250738585072014e-308".
+static const std::size_t shortest_double_max = 32;
+
+// Writes the shortest representation of v that reads back as v. Uses %g
+// layout rules: plain decimal when the exponent is in [-4, 17), scientific
+// otherwise, and no trailing zeros or decimal point. out must have room for
+// shortest_double_max chars. Returns the end of the output; nothing is NUL
+// terminated.
+//
+// Grisu2 can't always tell when a shorter string would do: for about 0.3%
+// of random doubles (669 of 200000 in format_test) the output is one digit
+// longer than necessary. It still reads back as v exactly.
+inline char *format_shortest(char *out, double v) {
+	if (v != v) {
+		std::memcpy(out, "nan", 3);
+		return out + 3;
+	}
+	if (std::signbit(v)) {
+		*out++ = '-';
+		v = -v;
+	}
+	if (v == 0) {
+		*out++ = '0';
+		return out;
+	}
+	if (v > 1.7976931348623157e308) {
+		std::memcpy(out, "inf", 3);
+		return out + 3;
+	}
+
+	char digits[20];
+	int len, K;
+	format_detail::grisu2(v, digits, len, K);
+
+	// Position of the decimal point relative to the first digit.
+	const int kk = len + K;
+	if (kk > 0 && kk <= 17) {
+		if (K >= 0) {
+			std::memcpy(out, digits, len);
+			std::memset(out + len, '0', K);
+			return out + kk;
+		}
+		std::memcpy(out, digits, kk);
+		out[kk] = '.';
+		std::memcpy(out + kk + 1, digits + kk, len - kk);
+		return out + len + 1;
+	}
+	if (kk > -4 && kk <= 0) {
+		out[0] = '0';
+		out[1] = '.';
+		std::memset(out + 2, '0', -kk);
+		std::memcpy(out + 2 - kk, digits, len);
+		return out + 2 - kk + len;
+	}
+	*out++ = digits[0];
+	if (len > 1) {
+		*out++ = '.';
+		std::memcpy(out, digits + 1, len - 1);
+		out += len - 1;
+	}
+	return format_detail::write_exponent(out, kk - 1);
+}
+
+// Sink which appends to a std::string. Any class with the same two members
+// can be used as a formatting destination.
+class string_sink {
+private:
+	std::string &s;
+
+public:
+	explicit string_sink(std::string &s) : s(s) {
+	}
+
+	void append(const char *p, std::size_t n) {
+		s.append(p, n);
+	}
+	void fill(std::size_t n, char c) {
+		s.append(n, c);
+	}
+};
+
+// Collects output in a stack buffer and only touches the string when the
+// buffer fills up or on flush(), so short messages cost a single append. In
+// replace mode the first flush assigns rather than appends; as long as the
+// output fits in the buffer, arguments may point into the destination string.
+template <std::size_t N = 256>
+class buffered_string_sink {
+private:
+	std::string &s;
+	std::size_t len;
+	bool replace;
+	char buf[N];
+
+	buffered_string_sink(const buffered_string_sink &) = delete;
+	buffered_string_sink &operator=(const buffered_string_sink &) = delete;
+
+public:
+	explicit buffered_string_sink(std::string &s, bool replace = false)
+		: s(s), len(0), replace(replace) {
+	}
+
+	void append(const char *p, std::size_t n) {
+		if (n > N - len) {
+			flush();
+			if (n >= N) {
+				s.append(p, n);
+				return;
+			}
+		}
+		std::memcpy(buf + len, p, n);
+		len += n;
+	}
+	void fill(std::size_t n, char c) {
+		if (n > N - len) {
+			flush();
+			if (n >= N) {
+				s.append(n, c);
+				return;
+			}
+		}
+		std::memset(buf + len, c, n);
+		len += n;
+	}
+
+	void flush() {
+		if (replace) {
+			s.assign(buf, len);
+			replace = false;
+		} else if (len) {
+			s.append(buf, len);
+		}
+		len = 0;
+	}
+	// Drops anything not yet flushed.
+	void discard() {
+		len = 0;
+	}
+};
+
+// A single type-erased argument. The constructors are implicit on purpose;
+// an argument of an unsupported type is a compile error rather than garbage
+// at runtime.
+class format_arg {
+public:
+	enum kind_type : unsigned char {
+		none_kind,
+		signed_kind,
+		unsigned_kind,
+		double_kind,
+		char_kind,
+		cstring_kind,
+		string_kind,
+		pointer_kind
+	};
+
+private:
+	struct string_type {
+		const char *data;
+		std::size_t len;
+	};
+
+	kind_type kind_;
+	unsigned char size_; // sizeof the original integer
+
+	union {
+		long long i;
+		unsigned long long u;
+		double d;
+		const void *p;
+		const char *cs;
+		string_type s;
+	};
+
+	template <typename T>
+	void init_signed(T v) {
+		kind_ = signed_kind;
+		size_ = sizeof(T);
+		i = v;
+	}
+	template <typename T>
+	void init_unsigned(T v) {
+		kind_ = unsigned_kind;
+		size_ = sizeof(T);
+		u = v;
+	}
+
+public:
+	format_arg() : kind_(none_kind), size_(0), u(0) {
+	}
+
+	format_arg(bool v) { init_signed<int>(v); }
+	format_arg(signed char v) { init_signed(v); }
+	format_arg(short v) { init_signed(v); }
+	format_arg(int v) { init_signed(v); }
+	format_arg(long v) { init_signed(v); }
+	format_arg(long long v) { init_signed(v); }
+	format_arg(unsigned char v) { init_unsigned(v); }
+	format_arg(unsigned short v) { init_unsigned(v); }
+	format_arg(unsigned v) { init_unsigned(v); }
+	format_arg(unsigned long v) { init_unsigned(v); }
+	format_arg(unsigned long long v) { init_unsigned(v); }
+
+	format_arg(char c) : kind_(char_kind), size_(1), i(c) {
+	}
+	format_arg(float v) : kind_(double_kind), size_(0), d(v) {
+	}
+	format_arg(double v) : kind_(double_kind), size_(0), d(v) {
+	}
+	// NB: Formatted at double precision.
+	format_arg(long double v)
+		: kind_(double_kind), size_(0), d(static_cast<double>(v)) {
+	}
+
+	format_arg(const char *str) : kind_(cstring_kind), size_(0), cs(str) {
+	}
+	format_arg(char *str) : kind_(cstring_kind), size_(0), cs(str) {
+	}
+	template <typename Allocator>
+	format_arg(const std::basic_string<char, std::char_traits<char>,
+					   Allocator> &str)
+		: kind_(string_kind), size_(0) {
+		s.data = str.data();
+		s.len = str.size();
+	}
+	format_arg(string_ref str) : kind_(string_kind), size_(0) {
+		s.data = str.data();
+		s.len = str.size();
+	}
+
+	template <typename T>
+	format_arg(T *ptr) : kind_(pointer_kind), size_(0), p(ptr) {
+	}
+	format_arg(std::nullptr_t) : kind_(pointer_kind), size_(0), p(nullptr) {
+	}
+
+	kind_type kind() const {
+		return kind_;
+	}
+	unsigned size() const {
+		return size_;
+	}
+
+	// Value interpreted as a signed integer of the argument's width, i.e.
+	// what printf would see for %d.
+	long long as_signed() const {
+		if (kind_ == signed_kind || kind_ == char_kind || size_ >= 8)
+			return i;
+		unsigned shift = 64 - size_ * CHAR_BIT;
+		return static_cast<long long>(u << shift) >> shift;
+	}
+	// Value interpreted as an unsigned integer of the argument's width,
+	// i.e. what printf would see for %u or %x.
+	unsigned long long as_unsigned() const {
+		if (size_ >= 8)
+			return u;
+		return u & ((1ull << (size_ * CHAR_BIT)) - 1);
+	}
+	double as_double() const {
+		switch (kind_) {
+		case signed_kind:
+		case char_kind:
+			return static_cast<double>(i);
+		case unsigned_kind:
+			return static_cast<double>(u);
+		default:
+			return d;
+		}
+	}
+	const void *as_pointer() const {
+		return p;
+	}
+	string_ref as_string() const {
+		if (kind_ == cstring_kind)
+			return cs ? string_ref(cs) : string_ref("(null)", 6);
+		return string_ref(s.data, s.len);
+	}
+	bool is_integral() const {
+		return kind_ == signed_kind || kind_ == unsigned_kind ||
+		       kind_ == char_kind;
+	}
+	bool is_string() const {
+		return kind_ == cstring_kind || kind_ == string_kind;
+	}
+};
+
+struct format_spec {
+	enum {
+		left = 1,
+		plus = 2,
+		space = 4,
+		alt = 8,
+		zero = 16
+	};
+	unsigned flags;
+	int width;
+	int precision; // -1 if none given
+	char conv;
+
+	format_spec() : flags(0), width(0), precision(-1), conv(0) {
+	}
+};
+
+namespace format_detail {
+
+template <class Sink>
+std::size_t write_padded(Sink &out, const format_spec &spec, const char *p,
+			 std::size_t n) {
+	if (spec.precision >= 0 && static_cast<std::size_t>(spec.precision) < n)
+		n = spec.precision;
+	std::size_t pad = static_cast<std::size_t>(spec.width) > n
+				  ? spec.width - n : 0;
+	if (pad && !(spec.flags & format_spec::left))
+		out.fill(pad, ' ');
+	out.append(p, n);
+	if (pad && (spec.flags & format_spec::left))
+		out.fill(pad, ' ');
+	return n + pad;
+}
+
+template <class Sink>
+std::size_t write_integer(Sink &out, const format_spec &spec,
+			  unsigned long long magnitude, bool negative) {
+	char buf[24];
+	char *end = buf + sizeof(buf);
+	char *p = end;
+	char prefix[2];
+	std::size_t prefix_len = 0;
+
+	if (spec.precision != 0 || magnitude != 0) {
+		switch (spec.conv) {
+		case 'x':
+		case 'X':
+			p = format_hex(end, magnitude, spec.conv == 'X');
+			break;
+		case 'o':
+			p = format_octal(end, magnitude);
+			break;
+		default:
+			p = format_decimal(end, magnitude);
+			break;
+		}
+	}
+
+	std::size_t ndigits = end - p;
+	std::size_t zeros = 0;
+	if (spec.precision > 0 &&
+	    static_cast<std::size_t>(spec.precision) > ndigits)
+		zeros = spec.precision - ndigits;
+
+	switch (spec.conv) {
+	case 'd':
+	case 'i':
+		if (negative)
+			prefix[prefix_len++] = '-';
+		else if (spec.flags & format_spec::plus)
+			prefix[prefix_len++] = '+';
+		else if (spec.flags & format_spec::space)
+			prefix[prefix_len++] = ' ';
+		break;
+	case 'x':
+	case 'X':
+		if ((spec.flags & format_spec::alt) && magnitude) {
+			prefix[prefix_len++] = '0';
+			prefix[prefix_len++] = spec.conv;
+		}
+		break;
+	case 'o':
+		if ((spec.flags & format_spec::alt) && !zeros &&
+		    (ndigits == 0 || *p != '0'))
+			zeros = 1;
+		break;
+	}
+
+	std::size_t len = prefix_len + zeros + ndigits;
+	std::size_t pad = static_cast<std::size_t>(spec.width) > len
+				  ? spec.width - len : 0;
+	if (pad && !(spec.flags & format_spec::left)) {
+		if ((spec.flags & format_spec::zero) && spec.precision < 0) {
+			zeros += pad;
+		} else {
+			out.fill(pad, ' ');
+		}
+	}
+	if (prefix_len)
+		out.append(prefix, prefix_len);
+	if (zeros)
+		out.fill(zeros, '0');
+	out.append(p, ndigits);
+	if (pad && (spec.flags & format_spec::left))
+		out.fill(pad, ' ');
+	return len + pad;
+}
+
+template <class Sink>
+std::size_t write_pointer(Sink &out, const format_spec &spec, const void *ptr) {
+	format_spec s = spec;
+	s.precision = -1;
+	if (!ptr)
+		return write_padded(out, s, "(nil)", 5);
+	char buf[2 + 16];
+	char *end = buf + sizeof(buf);
+	char *p = format_hex(end, reinterpret_cast<std::uintptr_t>(ptr), false);
+	*--p = 'x';
+	*--p = '0';
+	return write_padded(out, s, p, end - p);
+}
+
+// Defers to the C library, which is the only thing that gets rounding at
+// arbitrary precision exactly right.
+template <class Sink>
+int write_float(Sink &out, const format_spec &spec, double v) {
+	char fmt[16];
+	char *f = fmt;
+	*f++ = '%';
+	if (spec.flags & format_spec::left) *f++ = '-';
+	if (spec.flags & format_spec::plus) *f++ = '+';
+	if (spec.flags & format_spec::space) *f++ = ' ';
+	if (spec.flags & format_spec::alt) *f++ = '#';
+	if (spec.flags & format_spec::zero) *f++ = '0';
+	*f++ = '*';
+	*f++ = '.';
+	*f++ = '*';
+	*f++ = spec.conv;
+	*f = '\0';
+
+	char buf[128];
+	int n = std::snprintf(buf, sizeof(buf), fmt, spec.width,
+			      spec.precision, v);
+	if (n < 0)
+		return n;
+	if (static_cast<std::size_t>(n) < sizeof(buf)) {
+		out.append(buf, n);
+		return n;
+	}
+	std::string big(n + 1, '\0');
+	std::snprintf(&big[0], big.size(), fmt, spec.width, spec.precision, v);
+	out.append(big.data(), n);
+	return n;
+}
+
+// %s of something that isn't a string: print it the obvious way.
+template <class Sink>
+std::size_t write_natural(Sink &out, const format_spec &spec,
+			  const format_arg &arg) {
+	char buf[shortest_double_max];
+	char *end = buf + sizeof(buf);
+	char *p;
+	switch (arg.kind()) {
+	case format_arg::char_kind:
+		buf[0] = static_cast<char>(arg.as_signed());
+		return write_padded(out, spec, buf, 1);
+	case format_arg::signed_kind: {
+		long long v = arg.as_signed();
+		p = format_decimal(end, v < 0 ? 0ull - v : v);
+		if (v < 0)
+			*--p = '-';
+		return write_padded(out, spec, p, end - p);
+	}
+	case format_arg::unsigned_kind:
+		p = format_decimal(end, arg.as_unsigned());
+		return write_padded(out, spec, p, end - p);
+	case format_arg::double_kind:
+		end = format_shortest(buf, arg.as_double());
+		return write_padded(out, spec, buf, end - buf);
+	case format_arg::pointer_kind:
+		return write_pointer(out, spec, arg.as_pointer());
+	default: {
+		string_ref s = arg.as_string();
+		return write_padded(out, spec, s.data(), s.size());
+	}
+	}
+}
+
+} // End namespace format_detail
+
+// Formats into out according to fmt. Returns the number of characters
+// written, or -1 if the format is malformed, refers to more arguments than
+// were given, or asks for a conversion the argument can't satisfy (e.g. %d of
+// a string). Not supported: %n and positional (%1$d) arguments.
+template <class Sink>
+int vformat_to(Sink &out, const char *fmt, const format_arg *args,
+	       unsigned nargs) {
+	using namespace format_detail;
+	std::size_t count = 0;
+	unsigned argi = 0;
+
+	for (;;) {
+		const char *lit = fmt;
+		while (*fmt && *fmt != '%')
+			fmt++;
+		if (fmt != lit) {
+			out.append(lit, fmt - lit);
+			count += fmt - lit;
+		}
+		if (!*fmt)
+			break;
+		fmt++; // Skip the '%'
+
+		if (*fmt == '%') {
+			out.append(fmt, 1);
+			count++;
+			fmt++;
+			continue;
+		}
+
+		format_spec spec;
+		for (;; fmt++) {
+			switch (*fmt) {
+			case '-': spec.flags |= format_spec::left; continue;
+			case '+': spec.flags |= format_spec::plus; continue;
+			case ' ': spec.flags |= format_spec::space; continue;
+			case '#': spec.flags |= format_spec::alt; continue;
+			case '0': spec.flags |= format_spec::zero; continue;
+			}
+			break;
+		}
+
+		if (*fmt == '*') {
+			if (argi >= nargs || !args[argi].is_integral())
+				return -1;
+			long long w = args[argi++].as_signed();
+			if (w < 0) {
+				spec.flags |= format_spec::left;
+				w = -w;
+			}
+			spec.width = static_cast<int>(w);
+			fmt++;
+		} else {
+			while (*fmt >= '0' && *fmt <= '9')
+				spec.width = spec.width * 10 + (*fmt++ - '0');
+		}
+
+		if (*fmt == '.') {
+			fmt++;
+			if (*fmt == '*') {
+				if (argi >= nargs || !args[argi].is_integral())
+					return -1;
+				long long p = args[argi++].as_signed();
+				spec.precision = p < 0 ? -1 : static_cast<int>(p);
+				fmt++;
+			} else {
+				spec.precision = 0;
+				while (*fmt >= '0' && *fmt <= '9')
+					spec.precision = spec.precision * 10 +
+							 (*fmt++ - '0');
+			}
+		}
+
+		// We know the real types, so length modifiers are noise.
+		while (*fmt && std::strchr("hlLqjzt", *fmt))
+			fmt++;
+
+		spec.conv = *fmt++;
+		if (argi >= nargs)
+			return -1;
+		const format_arg &arg = args[argi++];
+
+		switch (spec.conv) {
+		case 'd':
+		case 'i':
+			if (!arg.is_integral())
+				return -1;
+			{
+				long long v = arg.as_signed();
+				count += write_integer(out, spec,
+						v < 0 ? 0ull - v : v, v < 0);
+			}
+			break;
+		case 'u':
+		case 'x':
+		case 'X':
+		case 'o':
+			if (!arg.is_integral())
+				return -1;
+			count += write_integer(out, spec, arg.as_unsigned(),
+					       false);
+			break;
+		case 'c': {
+			if (!arg.is_integral())
+				return -1;
+			char c = static_cast<char>(arg.as_signed());
+			spec.precision = -1;
+			count += write_padded(out, spec, &c, 1);
+			break;
+		}
+		case 's':
+			count += write_natural(out, spec, arg);
+			break;
+		case 'p':
+			if (arg.kind() != format_arg::pointer_kind &&
+			    arg.kind() != format_arg::cstring_kind)
+				return -1;
+			count += write_pointer(out, spec, arg.as_pointer());
+			break;
+		case 'f':
+		case 'F':
+		case 'e':
+		case 'E':
+		case 'g':
+		case 'G':
+		case 'a':
+		case 'A': {
+			if (arg.kind() != format_arg::double_kind &&
+			    !arg.is_integral())
+				return -1;
+			int n = write_float(out, spec, arg.as_double());
+			if (n < 0)
+				return -1;
+			count += n;
+			break;
+		}
+		default:
+			return -1;
+		}
+	}
+
+	if (count > static_cast<std::size_t>(INT_MAX))
+		return -1;
+	return static_cast<int>(count);
+}
+
+template <class Sink, typename... Ts>
+int format_to(Sink &out, const char *fmt, const Ts &... ts) {
+	// Extra element so that the array is never zero-sized.
+	const format_arg args[sizeof...(Ts) + 1] = { format_arg(ts)...,
+						      format_arg() };
+	return vformat_to(out, fmt, args, sizeof...(Ts));
+}
+
+}
+#endif
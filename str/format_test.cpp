@@ -0,0 +1,147 @@
+#include "strprintf.h"
+#include "libcpp-util/util/test_check.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <string>
+
+using namespace cpputil;
+
+// astrprintf agrees with snprintf.
+template <typename T>
+static bool same_as_libc(const char *fmt, T v) {
+	char buf[128];
+	int n = snprintf(buf, sizeof(buf), fmt, v);
+	return astrprintf(fmt, v) == std::string(buf, n);
+}
+
+// Number of significant digits in the mantissa of a shortest string.
+static unsigned significant_digits(const char *s) {
+	unsigned n = 0;
+	bool leading = true;
+	for (; *s && *s != 'e'; ++s) {
+		if (*s < '0' || *s > '9')
+			continue;
+		if (leading && *s == '0')
+			continue;
+		leading = false;
+		n++;
+	}
+	return n;
+}
+
+static void check_shortest(double d, unsigned &longer) {
+	char buf[shortest_double_max + 1];
+	*format_shortest(buf, d) = '\0';
+	CHECK(strtod(buf, nullptr) == d);
+	// Grisu2 is allowed to be a digit longer than necessary on rare
+	// inputs; track how often.
+	char ref[32];
+	for (int p = 1; p <= 17; ++p) {
+		snprintf(ref, sizeof(ref), "%.*g", p, d);
+		if (strtod(ref, nullptr) == d) {
+			if (significant_digits(buf) > (unsigned)p)
+				longer++;
+			break;
+		}
+	}
+}
+
+int main(int argc, char *argv[]) {
+	const char *int_fmts[] = {
+		"%d", "%5d", "%-5d|", "%05d", "%+d", "% d", "%.3d", "%8.3d",
+		"%-+8.3d|", "%.0d", "%x", "%#x", "%#08X", "%o", "%#o",
+		"%#.0o", "%u", "%c", "[%3c]", "%lld"
+	};
+	const long long int_vals[] = {
+		0, 1, -1, 7, 42, -42, 123456789, -2147483647LL - 1,
+		2147483647, 65
+	};
+
+	puts("Integers");
+	for (const char *fmt : int_fmts) {
+		for (long long v : int_vals) {
+			if (!strcmp(fmt, "%lld"))
+				CHECK(same_as_libc(fmt, v));
+			else
+				CHECK(same_as_libc(fmt, static_cast<int>(v)));
+		}
+	}
+	CHECK(same_as_libc("%llu",
+			   std::numeric_limits<unsigned long long>::max()));
+	CHECK(same_as_libc("%lld", std::numeric_limits<long long>::min()));
+	CHECK(same_as_libc("%hhx", static_cast<unsigned char>(200)));
+
+	puts("Strings and pointers");
+	CHECK(astrprintf("%s, %s!", "Hello", std::string("world")) ==
+	      "Hello, world!");
+	CHECK(astrprintf("[%-6s][%6s][%.2s]", "ab", string_ref("cd"), "efg") ==
+	      "[ab    ][    cd][ef]");
+	CHECK(astrprintf("%s", (const char *)nullptr) == "(null)");
+	CHECK(astrprintf("%p", nullptr) == "(nil)");
+	CHECK(astrprintf("100%% %s", 1) == "100% 1");
+	CHECK(astrprintf("%*d|%-*d|", 4, 1, 3, 2) == "   1|2  |");
+
+	puts("Floating point");
+	char expect[64];
+	snprintf(expect, sizeof(expect), "%f %.3e %10.2f %g", 3.14159, 2.5e-7,
+		 -1.005, 1e20);
+	CHECK(astrprintf("%f %.3e %10.2f %g", 3.14159, 2.5e-7, -1.005, 1e20) ==
+	      expect);
+	CHECK(astrprintf("%s %s %s %s", 0.1, 1.5, 100.0, -0.0) ==
+	      "0.1 1.5 100 -0");
+	CHECK(astrprintf("%s %s %s", 1e21, 1.25e-5, 0.001) ==
+	      "1e+21 1.25e-05 0.001");
+	CHECK(astrprintf("%s %s", 1.0 / 0.0, 0.0 / 0.0) == "inf nan");
+
+	puts("Append and aliasing");
+	std::string a = "abc";
+	strappendf(a, "%d", 12);
+	strappendf(a, CPPUTIL_FMT("-%s"), 'x');
+	CHECK(a == "abc12-x");
+	strprintf(a, "[%s]", a);
+	CHECK(a == "[abc12-x]");
+	std::string big(1000, 'y');
+	strappendf(a, "%s", big);
+	CHECK(a.size() == 1009 && a.compare(0, 9, "[abc12-x]") == 0);
+
+	puts("Type errors");
+	std::string s;
+	s = "keep";
+	CHECK(strappendf(s, "%d", "not a number") == -1 && s == "keep");
+	CHECK(strprintf(s, "%d", "not a number") == -1 && s.empty());
+	CHECK(strprintf(s, "%d %d", 1) == -1 && strprintf(s, "%n", 1) == -1);
+
+	puts("Shortest round trip");
+	std::mt19937_64 mt(argc > 1 ? std::stoul(argv[1]) : 5489u);
+	unsigned longer = 0;
+	const unsigned iterations = 200000;
+	for (unsigned i = 0; i < iterations; ++i) {
+		uint64_t bits = mt();
+		double d;
+		memcpy(&d, &bits, sizeof(d));
+		if (d != d || d - d != 0)
+			continue;
+		check_shortest(d, longer);
+	}
+	for (double d : { 5e-324, 2.2250738585072014e-308,
+			  1.7976931348623157e308, 0.3, 2.0 / 3, 9007199254740993.0 })
+		check_shortest(d, longer);
+	// Floats widened to double need all 17 digits, which takes digit
+	// generation deepest into the fraction.
+	for (unsigned i = 0; i < 10000; ++i) {
+		uint32_t bits = uint32_t(mt());
+		float f;
+		memcpy(&f, &bits, sizeof(f));
+		if (f != f || f - f != 0)
+			continue;
+		check_shortest(f, longer);
+	}
+	check_shortest(0.1f, longer);
+	printf("%u of %u not shortest\n", longer, iterations);
+	CHECK(longer < iterations / 100);
+	printf("format_test: all passed\n");
+	return 0;
+}
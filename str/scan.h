@@ -0,0 +1,485 @@
+//============================================================================
+//                                  libcpp-util
+//                   A simple odds-n-ends library for C++11
+//
+//         Licensed under modified BSD license. See LICENSE for details.
+//============================================================================
+
+#ifndef LIBCPP_UTIL_SCAN_H
+#define LIBCPP_UTIL_SCAN_H
+
+#include "libcpp-util/cxx14/string_ref.h"
+#include "libcpp-util/str/ct_format.h"
+
+#include <cerrno>
+#include <climits>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+// Type-safe scanf. The format follows scanf, but the arguments are taken by
+// reference with their real types, so %d fills a short or a long long alike
+// and length modifiers are ignored. A conversion the argument can't hold
+// (%d into a std::string, %s into an int) is an error rather than memory
+// corruption, and with CPPUTIL_FMT the argument count is checked at compile
+// time.
+//
+// Supported: whitespace and literal matching, %d %i %u %x %X %o, %f %e %g
+// %a (decimal only, no inf/nan/hex), %s into std::string or a char array,
+// %c into a char, %% and %*... to skip a field, and field widths. Not
+// supported: %[, %n, %p and positional arguments.
+//
+// Input comes from a source, any class with these two members:
+//
+//	int get();		// next char as unsigned char, or EOF
+//	void unget(int c);	// push back the char get() just returned
+namespace cpputil {
+
+// A single type-erased destination.
+class scan_arg {
+public:
+	enum kind_type : unsigned char {
+		none_kind,
+		signed_kind,
+		unsigned_kind,
+		float_kind,
+		char_kind,
+		string_kind,
+		buffer_kind
+	};
+
+private:
+	kind_type kind_;
+	unsigned char size_; // sizeof the destination number
+	void *p;
+	std::size_t cap; // buffer_kind: size of the array
+
+	template <typename T>
+	void init(kind_type k, T &v) {
+		kind_ = k;
+		size_ = sizeof(T);
+		p = &v;
+		cap = 0;
+	}
+
+public:
+	scan_arg() : kind_(none_kind), size_(0), p(nullptr), cap(0) {
+	}
+
+	scan_arg(signed char &v) { init(signed_kind, v); }
+	scan_arg(short &v) { init(signed_kind, v); }
+	scan_arg(int &v) { init(signed_kind, v); }
+	scan_arg(long &v) { init(signed_kind, v); }
+	scan_arg(long long &v) { init(signed_kind, v); }
+	scan_arg(unsigned char &v) { init(unsigned_kind, v); }
+	scan_arg(unsigned short &v) { init(unsigned_kind, v); }
+	scan_arg(unsigned &v) { init(unsigned_kind, v); }
+	scan_arg(unsigned long &v) { init(unsigned_kind, v); }
+	scan_arg(unsigned long long &v) { init(unsigned_kind, v); }
+	scan_arg(float &v) { init(float_kind, v); }
+	scan_arg(double &v) { init(float_kind, v); }
+	scan_arg(long double &v) { init(float_kind, v); }
+	scan_arg(char &v) { init(char_kind, v); }
+	scan_arg(std::string &v) { init(string_kind, v); }
+	// NUL terminated; a longer word is cut off at N - 1 chars.
+	template <std::size_t N>
+	scan_arg(char (&v)[N]) : kind_(buffer_kind), size_(0), p(v), cap(N) {
+		static_assert(N > 0, "Can't scan into an empty array");
+	}
+
+	kind_type kind() const {
+		return kind_;
+	}
+
+	// Stores v if it fits the destination's width.
+	bool store_signed(long long v) const {
+		switch (size_) {
+		case 1:
+			if (v < SCHAR_MIN || v > SCHAR_MAX)
+				return false;
+			*static_cast<signed char *>(p) =
+				static_cast<signed char>(v);
+			return true;
+		case 2:
+			if (v < SHRT_MIN || v > SHRT_MAX)
+				return false;
+			*static_cast<short *>(p) = static_cast<short>(v);
+			return true;
+		case 4:
+			if (v < INT_MIN || v > INT_MAX)
+				return false;
+			*static_cast<int *>(p) = static_cast<int>(v);
+			return true;
+		default:
+			// long or long long; copy rather than pick a type.
+			std::memcpy(p, &v, sizeof(v));
+			return true;
+		}
+	}
+	// A minus sign negates in the destination type, as strtoul does in
+	// unsigned long; the magnitude still has to fit.
+	bool store_unsigned(unsigned long long v, bool neg) const {
+		unsigned long long r = neg ? 0ull - v : v;
+		switch (size_) {
+		case 1:
+			if (v > UCHAR_MAX)
+				return false;
+			*static_cast<unsigned char *>(p) =
+				static_cast<unsigned char>(r);
+			return true;
+		case 2:
+			if (v > USHRT_MAX)
+				return false;
+			*static_cast<unsigned short *>(p) =
+				static_cast<unsigned short>(r);
+			return true;
+		case 4:
+			if (v > UINT_MAX)
+				return false;
+			*static_cast<unsigned *>(p) = static_cast<unsigned>(r);
+			return true;
+		default:
+			std::memcpy(p, &r, sizeof(r));
+			return true;
+		}
+	}
+	// Parses a NUL terminated float at the destination's precision.
+	bool store_float(const char *s) const {
+		char *end;
+		errno = 0;
+		if (size_ == sizeof(float))
+			*static_cast<float *>(p) = std::strtof(s, &end);
+		else if (size_ == sizeof(double))
+			*static_cast<double *>(p) = std::strtod(s, &end);
+		else
+			*static_cast<long double *>(p) = std::strtold(s, &end);
+		return end != s && errno != ERANGE;
+	}
+	char &as_char() const {
+		return *static_cast<char *>(p);
+	}
+	std::string &as_string() const {
+		return *static_cast<std::string *>(p);
+	}
+	char *buffer() const {
+		return static_cast<char *>(p);
+	}
+	std::size_t capacity() const {
+		return cap;
+	}
+};
+
+// Reads from a string_ref.
+class string_scan_source {
+private:
+	const char *p;
+	const char *end;
+
+public:
+	explicit string_scan_source(string_ref s)
+		: p(s.data()), end(s.data() + s.size()) {
+	}
+
+	int get() {
+		return p == end ? EOF : static_cast<unsigned char>(*p++);
+	}
+	void unget(int c) {
+		if (c != EOF)
+			--p;
+	}
+	// The part of the input not consumed yet.
+	string_ref rest() const {
+		return string_ref(p, end - p);
+	}
+};
+
+namespace scan_detail {
+
+inline bool is_space(int c) {
+	return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+inline int digit_value(int c) {
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'z')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'Z')
+		return c - 'A' + 10;
+	return 99;
+}
+
+// Skips whitespace; returns the first other char, already pushed back.
+template <class Source>
+int skip_space(Source &in) {
+	int c;
+	while (is_space(c = in.get()))
+		;
+	in.unget(c);
+	return c;
+}
+
+// Reads an integer of at most width chars in base (0: by prefix, as %i).
+// Returns false if there were no digits or the value overflowed.
+template <class Source>
+bool scan_integer(Source &in, unsigned width, int base, bool &neg,
+		  unsigned long long &v) {
+	unsigned n = 0;
+	int c = in.get();
+	neg = false;
+	if ((c == '-' || c == '+') && n < width) {
+		neg = c == '-';
+		++n;
+		c = in.get();
+	}
+	bool any = false;
+	if (c == '0' && n < width && (base == 0 || base == 16)) {
+		any = true;
+		++n;
+		c = in.get();
+		if ((c == 'x' || c == 'X') && n < width) {
+			base = 16;
+			++n;
+			c = in.get();
+		} else if (base == 0) {
+			base = 8;
+		}
+	} else if (base == 0) {
+		base = 10;
+	}
+	bool overflow = false;
+	v = 0;
+	for (int d; n < width && (d = digit_value(c)) < base; ++n) {
+		if (v > (ULLONG_MAX - d) / base)
+			overflow = true;
+		v = v * base + d;
+		any = true;
+		c = in.get();
+	}
+	in.unget(c);
+	return any && !overflow;
+}
+
+inline bool store_integer(const scan_arg &arg, bool neg,
+			  unsigned long long v) {
+	if (arg.kind() == scan_arg::unsigned_kind)
+		return arg.store_unsigned(v, neg);
+	if (neg ? v > 0ull - static_cast<unsigned long long>(LLONG_MIN)
+		: v > static_cast<unsigned long long>(LLONG_MAX))
+		return false;
+	return arg.store_signed(neg ? static_cast<long long>(0ull - v)
+				    : static_cast<long long>(v));
+}
+
+// Collects a decimal float, [+-]digits[.digits][e[+-]digits], into buf.
+template <class Source>
+bool scan_float(Source &in, unsigned width, char *buf, std::size_t size) {
+	std::size_t n = 0;
+	int c = in.get();
+	auto take = [&]() {
+		if (n + 1 < size)
+			buf[n] = static_cast<char>(c);
+		++n;
+		c = in.get();
+	};
+	bool digits = false;
+	if ((c == '-' || c == '+') && n < width)
+		take();
+	while (n < width && c >= '0' && c <= '9') {
+		take();
+		digits = true;
+	}
+	if (n < width && c == '.') {
+		take();
+		while (n < width && c >= '0' && c <= '9') {
+			take();
+			digits = true;
+		}
+	}
+	if (digits && n < width && (c == 'e' || c == 'E')) {
+		take();
+		if (n < width && (c == '-' || c == '+'))
+			take();
+		while (n < width && c >= '0' && c <= '9')
+			take();
+	}
+	in.unget(c);
+	if (n + 1 > size)
+		return false;
+	buf[n] = '\0';
+	return digits;
+}
+
+constexpr unsigned count_args(const char *s, unsigned i) {
+	return !s[i] ? 0
+	     : s[i] != '%' ? count_args(s, i + 1)
+	     : s[i + 1] == '%' || s[i + 1] == '*' ? count_args(s, i + 2)
+	     : 1 + count_args(s, i + 1);
+}
+
+} // End namespace scan_detail
+
+// Scans in according to fmt. Returns the number of arguments assigned,
+// which is short of nargs if the input stops matching; EOF if the input
+// ends before the first conversion; or -1 if the format is malformed,
+// refers to more arguments than were given, or asks for a conversion the
+// argument can't hold.
+template <class Source>
+int vscan_from(Source &in, const char *fmt, const scan_arg *args,
+	       unsigned nargs) {
+	using namespace scan_detail;
+	int assigned = 0;
+	unsigned argi = 0;
+	for (; *fmt; ++fmt) {
+		if (is_space(static_cast<unsigned char>(*fmt))) {
+			skip_space(in);
+			continue;
+		}
+		if (*fmt != '%' || fmt[1] == '%') {
+			if (*fmt == '%') {
+				++fmt;
+				skip_space(in);
+			}
+			int c = in.get();
+			if (c != static_cast<unsigned char>(*fmt)) {
+				in.unget(c);
+				return c == EOF && !assigned ? EOF : assigned;
+			}
+			continue;
+		}
+		++fmt;
+		bool skip = *fmt == '*';
+		if (skip)
+			++fmt;
+		unsigned width = 0;
+		while (*fmt >= '0' && *fmt <= '9')
+			width = width * 10 + (*fmt++ - '0');
+		while (*fmt && std::strchr("hlLqjzt", *fmt))
+			++fmt;
+		char conv = *fmt;
+		if (!conv)
+			return -1;
+
+		const scan_arg *arg = nullptr;
+		if (!skip) {
+			if (argi >= nargs)
+				return -1;
+			arg = &args[argi++];
+		}
+		if (conv != 'c' && skip_space(in) == EOF)
+			return assigned ? assigned : EOF;
+
+		switch (conv) {
+		case 'd':
+		case 'i':
+		case 'u':
+		case 'x':
+		case 'X':
+		case 'o': {
+			if (arg && arg->kind() != scan_arg::signed_kind &&
+			    arg->kind() != scan_arg::unsigned_kind)
+				return -1;
+			int base = conv == 'i' ? 0
+				 : conv == 'o' ? 8
+				 : conv == 'x' || conv == 'X' ? 16 : 10;
+			bool neg;
+			unsigned long long v;
+			if (!scan_integer(in, width ? width : UINT_MAX, base,
+					  neg, v))
+				return assigned;
+			if (arg && !store_integer(*arg, neg, v))
+				return assigned;
+			break;
+		}
+		case 'f':
+		case 'F':
+		case 'e':
+		case 'E':
+		case 'g':
+		case 'G':
+		case 'a':
+		case 'A': {
+			if (arg && arg->kind() != scan_arg::float_kind)
+				return -1;
+			char buf[128];
+			if (!scan_float(in, width ? width : UINT_MAX, buf,
+					sizeof(buf)))
+				return assigned;
+			if (arg && !arg->store_float(buf))
+				return assigned;
+			break;
+		}
+		case 's': {
+			if (arg && arg->kind() != scan_arg::string_kind &&
+			    arg->kind() != scan_arg::buffer_kind)
+				return -1;
+			std::size_t limit = width ? width : std::size_t(-1);
+			std::size_t n = 0;
+			if (arg && arg->kind() == scan_arg::string_kind)
+				arg->as_string().clear();
+			int c = EOF;
+			while (n < limit && (c = in.get()) != EOF &&
+			       !is_space(c)) {
+				if (!arg) {
+				} else if (arg->kind() == scan_arg::string_kind) {
+					arg->as_string() += static_cast<char>(c);
+				} else if (n + 1 < arg->capacity()) {
+					arg->buffer()[n] = static_cast<char>(c);
+				}
+				++n;
+			}
+			if (n < limit)
+				in.unget(c);
+			if (arg && arg->kind() == scan_arg::buffer_kind)
+				arg->buffer()[n < arg->capacity()
+						      ? n
+						      : arg->capacity() - 1] =
+					'\0';
+			break;
+		}
+		case 'c': {
+			if (arg && arg->kind() != scan_arg::char_kind)
+				return -1;
+			int c = in.get();
+			if (c == EOF)
+				return assigned ? assigned : EOF;
+			if (arg)
+				arg->as_char() = static_cast<char>(c);
+			break;
+		}
+		default:
+			return -1;
+		}
+		if (arg)
+			++assigned;
+	}
+	return assigned;
+}
+
+template <class Source, typename... Ts>
+int scan_from(Source &in, const char *fmt, Ts &... ts) {
+	// Extra element so that the array is never zero-sized.
+	const scan_arg args[sizeof...(Ts) + 1] = { scan_arg(ts)..., scan_arg() };
+	return vscan_from(in, fmt, args, sizeof...(Ts));
+}
+
+// With CPPUTIL_FMT, the argument count is checked at compile time.
+template <class Source, char... Cs, typename... Ts>
+int scan_from(Source &in, ct_string<Cs...>, Ts &... ts) {
+	typedef ct_string<Cs...> str;
+	static_assert(scan_detail::count_args(str::value, 0) == sizeof...(Ts),
+		"CPPUTIL_FMT: argument count does not match format string");
+	return scan_from(in, str::value, ts...);
+}
+
+// sscanf over a string_ref, which needn't be NUL terminated.
+template <typename Format, typename... Ts>
+int sscan(string_ref s, const Format &fmt, Ts &... ts) {
+	string_scan_source in(s);
+	return scan_from(in, fmt, ts...);
+}
+
+}
+#endif
@@ -0,0 +1,111 @@
+#include "scan.h"
+#include "libcpp-util/util/test_check.h"
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+using namespace cpputil;
+
+// Integers in each conversion agree with sscanf.
+static void check_integers() {
+	const char *inputs[] = {"0",   "42",  "-17",     "+8",
+				"0x1f", "0X7F", "077", "  \t12", "9z"};
+	for (const char *in : inputs) {
+		int a = -1, b = -1;
+		CHECK(sscan(in, "%d", a) == sscanf(in, "%d", &b) && a == b);
+		CHECK(sscan(in, "%i", a) == sscanf(in, "%i", &b) && a == b);
+		unsigned x = 1, y = 1;
+		CHECK(sscan(in, "%x", x) == sscanf(in, "%x", &y) && x == y);
+		CHECK(sscan(in, "%o", x) == sscanf(in, "%o", &y) && x == y);
+	}
+	int i;
+	CHECK(sscan("2147483647", "%d", i) == 1 && i == INT_MAX);
+	CHECK(sscan("-2147483648", "%d", i) == 1 && i == INT_MIN);
+	long l;
+	CHECK(sscan("-9223372036854775808", "%ld", l) == 1 && l == LONG_MIN);
+	unsigned long long ull;
+	CHECK(sscan("18446744073709551615", "%llu", ull) == 1 &&
+	      ull == ULLONG_MAX);
+}
+
+// Unlike sscanf, a value that does not fit its destination is a matching
+// failure rather than undefined behaviour.
+static void check_ranges() {
+	short s = 5;
+	CHECK(sscan("70000", "%hd", s) == 0 && s == 5);
+	unsigned char uc = 5;
+	CHECK(sscan("256", "%d", uc) == 0 && uc == 5);
+	CHECK(sscan("255", "%d", uc) == 1 && uc == 255);
+	long l = 5;
+	CHECK(sscan("9223372036854775808", "%ld", l) == 0 && l == 5);
+	unsigned u = 5;
+	CHECK(sscan("4294967296", "%u", u) == 0 && u == 5);
+}
+
+static void check_floats() {
+	double d;
+	float f;
+	long double ld;
+	CHECK(sscan("3.25e2", "%lf", d) == 1 && d == 325);
+	CHECK(sscan("-1.5", "%f", f) == 1 && f == -1.5f);
+	CHECK(sscan("0.1", "%Lf", ld) == 1 && ld == 0.1L);
+	CHECK(sscan("1e-3,", "%lf,", d) == 1 && d == 1e-3);
+	// A float field goes into an integer only if asked for one.
+	int i;
+	CHECK(sscan("2.5", "%f", i) == -1);
+}
+
+static void check_strings() {
+	std::string s;
+	char buf[4];
+	char c;
+	CHECK(sscan("  hello world", "%s", s) == 1 && s == "hello");
+	CHECK(sscan("abcdef", "%s", buf) == 1 && !strcmp(buf, "abc"));
+	CHECK(sscan("abcdef", "%2s%s", buf, s) == 2 && !strcmp(buf, "ab") &&
+	      s == "cdef");
+	CHECK(sscan(" x", "%c", c) == 1 && c == ' ');
+	CHECK(sscan(" x", " %c", c) == 1 && c == 'x');
+}
+
+static void check_format() {
+	int a = 0;
+	unsigned b = 0;
+	CHECK(sscan("12345", "%3d%u", a, b) == 2 && a == 123 && b == 45);
+	CHECK(sscan("x=5", "x=%d", a) == 1 && a == 5);
+	CHECK(sscan("y=5", "x=%d", a) == 0);
+	CHECK(sscan("1 2", "%*d %d", a) == 1 && a == 2);
+	CHECK(sscan("50%", "%d%%", a) == 1 && a == 50);
+	CHECK(sscan("", "%d", a) == EOF);
+	CHECK(sscan("   ", "%d", a) == EOF);
+	CHECK(sscan("7", "%d %d", a, b) == 1);
+	CHECK(sscan("9 8", CPPUTIL_FMT("%d %u"), a, b) == 2 && a == 9 &&
+	      b == 8);
+
+	// Errors in the format or the arguments.
+	std::string s;
+	CHECK(sscan("abc", "%d", s) == -1);
+	CHECK(sscan("1", "%d %d", a) == -1);
+	CHECK(sscan("1", "%q", a) == -1);
+}
+
+static void check_source() {
+	string_scan_source in("10 20 30");
+	int a, b;
+	CHECK(scan_from(in, "%d", a) == 1 && a == 10);
+	CHECK(scan_from(in, "%d %d", a, b) == 2 && a == 20 && b == 30);
+	CHECK(in.rest().empty());
+	CHECK(scan_from(in, "%d", a) == EOF);
+}
+
+int main() {
+	check_integers();
+	check_ranges();
+	check_floats();
+	check_strings();
+	check_format();
+	check_source();
+	printf("ok\n");
+	return 0;
+}
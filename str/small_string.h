@@ -0,0 +1,414 @@
+//============================================================================
+//                                  libcpp-util
+//                   A simple odds-n-ends library for C++11
+//
+//         Licensed under modified BSD license. See LICENSE for details.
+//============================================================================
+
+#ifndef LIBCPP_UTIL_SMALL_STRING_H
+#define LIBCPP_UTIL_SMALL_STRING_H
+
+#include "libcpp-util/cxx14/string_ref.h"
+#include "libcpp-util/util/hash.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace cpputil {
+
+// A string with room for N characters inline, which is enough for most
+// identifiers, keys and numbers without touching the allocator (std::string
+// in libstdc++ holds 15). The allocator is a template parameter so the rare
+// longer strings can come from an arena, e.g. objstack_allocator<char, ...>.
+//
+// data_ always points at the characters, either at the inline buffer or the
+// heap, so access is branch-free. cap_ is 0 while inline. Allocators are
+// never propagated on assignment; a string keeps the one it was built with.
+template <typename charT, std::size_t N = 23,
+	  class Alloc = std::allocator<charT>>
+class basic_small_string : private Alloc {
+public:
+	typedef charT value_type;
+	typedef std::char_traits<charT> traits_type;
+	typedef Alloc allocator_type;
+	typedef std::size_t size_type;
+	typedef std::ptrdiff_t difference_type;
+	typedef charT &reference;
+	typedef const charT &const_reference;
+	typedef charT *pointer;
+	typedef const charT *const_pointer;
+	typedef charT *iterator;
+	typedef const charT *const_iterator;
+	typedef std::reverse_iterator<iterator> reverse_iterator;
+	typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+	static constexpr size_type npos = size_type(-1);
+
+private:
+	typedef std::allocator_traits<Alloc> alloc_traits;
+
+	charT *data_;
+	size_type size_;
+	size_type cap_;
+	charT buf_[N + 1];
+
+	bool is_inline() const {
+		return data_ == buf_;
+	}
+	Alloc &alloc() {
+		return *this;
+	}
+
+	void release() {
+		if (!is_inline())
+			alloc_traits::deallocate(alloc(), data_, cap_ + 1);
+		data_ = buf_;
+		cap_ = 0;
+	}
+
+	// Grows to hold at least n characters, keeping the contents.
+	void grow(size_type n) {
+		size_type new_cap = std::max(n, 2 * capacity());
+		charT *p = alloc_traits::allocate(alloc(), new_cap + 1);
+		traits_type::copy(p, data_, size_ + 1);
+		release();
+		data_ = p;
+		cap_ = new_cap;
+	}
+
+	void init(const charT *s, size_type n) {
+		data_ = buf_;
+		size_ = 0;
+		cap_ = 0;
+		if (n > N) {
+			data_ = alloc_traits::allocate(alloc(), n + 1);
+			cap_ = n;
+		}
+		traits_type::copy(data_, s, n);
+		data_[n] = charT();
+		size_ = n;
+	}
+
+	// Takes rhs's storage, leaving it empty. Allocators must be equal.
+	void steal(basic_small_string &rhs) {
+		if (rhs.is_inline()) {
+			data_ = buf_;
+			cap_ = 0;
+			traits_type::copy(buf_, rhs.buf_, rhs.size_ + 1);
+		} else {
+			data_ = rhs.data_;
+			cap_ = rhs.cap_;
+			rhs.data_ = rhs.buf_;
+			rhs.cap_ = 0;
+		}
+		size_ = rhs.size_;
+		rhs.size_ = 0;
+		rhs.buf_[0] = charT();
+	}
+
+public:
+	// construct/copy/destroy
+	explicit basic_small_string(const Alloc &a = Alloc())
+		: Alloc(a), data_(buf_), size_(0), cap_(0) {
+		buf_[0] = charT();
+	}
+	basic_small_string(const charT *s, size_type n,
+			   const Alloc &a = Alloc())
+		: Alloc(a) {
+		init(s, n);
+	}
+	basic_small_string(const charT *s, const Alloc &a = Alloc())
+		: Alloc(a) {
+		init(s, traits_type::length(s));
+	}
+	basic_small_string(basic_string_ref<charT> s, const Alloc &a = Alloc())
+		: Alloc(a) {
+		init(s.data(), s.size());
+	}
+	template <typename A>
+	basic_small_string(const std::basic_string<charT, traits_type, A> &s,
+			   const Alloc &a = Alloc())
+		: Alloc(a) {
+		init(s.data(), s.size());
+	}
+	basic_small_string(size_type n, charT c, const Alloc &a = Alloc())
+		: Alloc(a), data_(buf_), size_(0), cap_(0) {
+		buf_[0] = charT();
+		append(n, c);
+	}
+	basic_small_string(const basic_small_string &rhs)
+		: Alloc(alloc_traits::select_on_container_copy_construction(
+			  rhs.get_allocator())) {
+		init(rhs.data_, rhs.size_);
+	}
+	basic_small_string(const basic_small_string &rhs, const Alloc &a)
+		: Alloc(a) {
+		init(rhs.data_, rhs.size_);
+	}
+	// The allocator is copied, not moved: rhs stays usable, and allocators
+	// like objstack_allocator are left empty by a move.
+	basic_small_string(basic_small_string &&rhs) noexcept
+		: Alloc(rhs.alloc()) {
+		steal(rhs);
+	}
+	~basic_small_string() {
+		release();
+	}
+
+	basic_small_string &operator=(const basic_small_string &rhs) {
+		if (this != &rhs)
+			assign(rhs.data_, rhs.size_);
+		return *this;
+	}
+	basic_small_string &operator=(basic_small_string &&rhs) {
+		if (this == &rhs)
+			return *this;
+		if (alloc() == rhs.alloc()) {
+			release();
+			steal(rhs);
+		} else {
+			assign(rhs.data_, rhs.size_);
+		}
+		return *this;
+	}
+	basic_small_string &operator=(basic_string_ref<charT> s) {
+		return assign(s.data(), s.size());
+	}
+	basic_small_string &operator=(const charT *s) {
+		return assign(s, traits_type::length(s));
+	}
+
+	basic_small_string &assign(const charT *s, size_type n) {
+		if (n > capacity()) {
+			// s may point into us; copy before releasing.
+			charT *p = alloc_traits::allocate(alloc(), n + 1);
+			traits_type::copy(p, s, n);
+			release();
+			data_ = p;
+			cap_ = n;
+		} else {
+			traits_type::move(data_, s, n);
+		}
+		data_[n] = charT();
+		size_ = n;
+		return *this;
+	}
+
+	allocator_type get_allocator() const {
+		return *this;
+	}
+
+	// iterators
+	iterator begin() { return data_; }
+	iterator end() { return data_ + size_; }
+	const_iterator begin() const { return data_; }
+	const_iterator end() const { return data_ + size_; }
+	const_iterator cbegin() const { return data_; }
+	const_iterator cend() const { return data_ + size_; }
+	reverse_iterator rbegin() { return reverse_iterator(end()); }
+	reverse_iterator rend() { return reverse_iterator(begin()); }
+	const_reverse_iterator rbegin() const {
+		return const_reverse_iterator(end());
+	}
+	const_reverse_iterator rend() const {
+		return const_reverse_iterator(begin());
+	}
+
+	// capacity
+	size_type size() const { return size_; }
+	size_type length() const { return size_; }
+	bool empty() const { return size_ == 0; }
+	size_type capacity() const { return is_inline() ? N : cap_; }
+	static constexpr size_type inline_capacity() { return N; }
+	bool is_small() const { return is_inline(); }
+
+	void reserve(size_type n) {
+		if (n > capacity())
+			grow(n);
+	}
+	void resize(size_type n, charT c = charT()) {
+		if (n > size_)
+			append(n - size_, c);
+		else
+			truncate(n);
+	}
+	void truncate(size_type n) {
+		size_ = n;
+		data_[n] = charT();
+	}
+	void clear() {
+		truncate(0);
+	}
+	void shrink_to_fit() {
+		if (is_inline() || size_ == cap_)
+			return;
+		if (size_ <= N) {
+			charT *p = data_;
+			size_type cap = cap_;
+			traits_type::copy(buf_, p, size_ + 1);
+			data_ = buf_;
+			cap_ = 0;
+			alloc_traits::deallocate(alloc(), p, cap + 1);
+		} else {
+			charT *p = alloc_traits::allocate(alloc(), size_ + 1);
+			traits_type::copy(p, data_, size_ + 1);
+			release();
+			data_ = p;
+			cap_ = size_;
+		}
+	}
+
+	// element access
+	reference operator[](size_type i) { return data_[i]; }
+	const_reference operator[](size_type i) const { return data_[i]; }
+	reference at(size_type i) {
+		return i >= size_ ? throw std::out_of_range("at(): bad index")
+				  : data_[i];
+	}
+	const_reference at(size_type i) const {
+		return i >= size_ ? throw std::out_of_range("at(): bad index")
+				  : data_[i];
+	}
+	reference front() { return data_[0]; }
+	const_reference front() const { return data_[0]; }
+	reference back() { return data_[size_ - 1]; }
+	const_reference back() const { return data_[size_ - 1]; }
+	charT *data() { return data_; }
+	const charT *data() const { return data_; }
+	const charT *c_str() const { return data_; }
+
+	// modifiers
+	basic_small_string &append(const charT *s, size_type n) {
+		if (n > capacity() - size_) {
+			// s may point into us.
+			if (s >= data_ && s <= data_ + size_) {
+				size_type off = s - data_;
+				grow(size_ + n);
+				s = data_ + off;
+			} else {
+				grow(size_ + n);
+			}
+		}
+		traits_type::copy(data_ + size_, s, n);
+		size_ += n;
+		data_[size_] = charT();
+		return *this;
+	}
+	basic_small_string &append(size_type n, charT c) {
+		if (n > capacity() - size_)
+			grow(size_ + n);
+		traits_type::assign(data_ + size_, n, c);
+		size_ += n;
+		data_[size_] = charT();
+		return *this;
+	}
+	basic_small_string &append(basic_string_ref<charT> s) {
+		return append(s.data(), s.size());
+	}
+	basic_small_string &operator+=(basic_string_ref<charT> s) {
+		return append(s.data(), s.size());
+	}
+	basic_small_string &operator+=(const charT *s) {
+		return append(s, traits_type::length(s));
+	}
+	basic_small_string &operator+=(charT c) {
+		push_back(c);
+		return *this;
+	}
+	void push_back(charT c) {
+		if (size_ == capacity())
+			grow(size_ + 1);
+		data_[size_++] = c;
+		data_[size_] = charT();
+	}
+	void pop_back() {
+		truncate(size_ - 1);
+	}
+
+	void swap(basic_small_string &rhs) {
+		basic_small_string tmp(std::move(rhs));
+		rhs = std::move(*this);
+		*this = std::move(tmp);
+	}
+
+	// conversions
+	operator basic_string_ref<charT>() const {
+		return basic_string_ref<charT>(data_, size_);
+	}
+	basic_string_ref<charT> ref() const {
+		return basic_string_ref<charT>(data_, size_);
+	}
+	std::basic_string<charT> str() const {
+		return std::basic_string<charT>(data_, size_);
+	}
+
+	int compare(basic_string_ref<charT> s) const {
+		int r = traits_type::compare(data_, s.data(),
+					     std::min(size_, s.size()));
+		if (r)
+			return r;
+		return size_ < s.size() ? -1 : size_ > s.size();
+	}
+};
+
+template <typename charT, std::size_t N, class Alloc>
+constexpr typename basic_small_string<charT, N, Alloc>::size_type
+	basic_small_string<charT, N, Alloc>::npos;
+
+typedef basic_small_string<char> small_string;
+
+template <typename charT, std::size_t N, class A>
+bool operator==(const basic_small_string<charT, N, A> &x,
+		basic_string_ref<charT> y) {
+	return x.size() == y.size() &&
+	       !std::char_traits<charT>::compare(x.data(), y.data(), x.size());
+}
+template <typename charT, std::size_t N, class A>
+bool operator==(const basic_small_string<charT, N, A> &x,
+		const basic_small_string<charT, N, A> &y) {
+	return x == y.ref();
+}
+template <typename charT, std::size_t N, class A>
+bool operator==(const basic_small_string<charT, N, A> &x, const charT *y) {
+	return x == basic_string_ref<charT>(y);
+}
+template <typename charT, std::size_t N, class A>
+bool operator!=(const basic_small_string<charT, N, A> &x,
+		const basic_small_string<charT, N, A> &y) {
+	return !(x == y);
+}
+template <typename charT, std::size_t N, class A>
+bool operator!=(const basic_small_string<charT, N, A> &x,
+		basic_string_ref<charT> y) {
+	return !(x == y);
+}
+template <typename charT, std::size_t N, class A>
+bool operator<(const basic_small_string<charT, N, A> &x,
+	       const basic_small_string<charT, N, A> &y) {
+	return x.compare(y) < 0;
+}
+
+template <typename charT, std::size_t N, class A>
+void swap(basic_small_string<charT, N, A> &x,
+	  basic_small_string<charT, N, A> &y) {
+	x.swap(y);
+}
+
+}
+
+namespace std {
+template <typename charT, std::size_t N, class A>
+struct hash<cpputil::basic_small_string<charT, N, A>> {
+	size_t operator()(const cpputil::basic_small_string<charT, N, A> &s)
+		const {
+		return static_cast<size_t>(cpputil::hash_bytes(
+			s.data(), s.size() * sizeof(charT)));
+	}
+};
+}
+#endif
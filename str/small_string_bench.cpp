@@ -0,0 +1,50 @@
+#include "small_string.h"
+#include "libcpp-util/mem/objstack_allocator.h"
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace cpputil;
+using bench_clock = std::chrono::steady_clock;
+
+typedef basic_small_string<char, 23, objstack_allocator<char, 64 * 1024>>
+	arena_small_string;
+
+// Builds a batch of strings of the given length from two halves, the way a
+// key is put together from a prefix and an id, then destroys them all. Each
+// batch gets a fresh allocator, so for objstack freeing is dropping the arena.
+template <typename S>
+void run(const char *name, size_t len) {
+	const size_t batch = 1024;
+	const unsigned rounds = 2000;
+	std::string src(len, 'k');
+	size_t half = len / 2;
+	size_t checksum = 0;
+
+	auto start = bench_clock::now();
+	for (unsigned r = 0; r < rounds; ++r) {
+		typename S::allocator_type alloc;
+		std::vector<S> v;
+		v.reserve(batch);
+		for (size_t i = 0; i < batch; ++i) {
+			v.push_back(S(src.data(), half, alloc));
+			v.back().append(src.data() + half, len - half);
+		}
+		checksum += v[r % batch].size();
+	}
+	std::chrono::duration<double, std::nano> elapsed =
+		bench_clock::now() - start;
+	printf("%5zu  %-22s %8.1f ns/string  (%zu)\n", len, name,
+	       elapsed.count() / (rounds * batch), checksum);
+}
+
+int main() {
+	for (size_t len : {0, 8, 15, 16, 23, 24, 32, 64, 128}) {
+		run<std::string>("std::string", len);
+		run<small_string>("small_string", len);
+		run<arena_small_string>("small_string/objstack", len);
+		printf("\n");
+	}
+	return 0;
+}
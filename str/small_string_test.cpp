@@ -0,0 +1,171 @@
+#include "small_string.h"
+#include "libcpp-util/util/test_check.h"
+#include <cstdio>
+#include <map>
+#include <string>
+
+using namespace cpputil;
+
+// Counts what is outstanding per allocator id, so a string freeing through
+// the wrong allocator, or not at all, shows up as an imbalance.
+static std::map<int, long> outstanding;
+
+template <typename T>
+struct counting_allocator {
+	typedef T value_type;
+	int id;
+
+	explicit counting_allocator(int id = 0) : id(id) {
+	}
+	template <typename U>
+	counting_allocator(const counting_allocator<U> &rhs) : id(rhs.id) {
+	}
+	T *allocate(std::size_t n) {
+		outstanding[id] += long(n);
+		return static_cast<T *>(::operator new(n * sizeof(T)));
+	}
+	void deallocate(T *p, std::size_t n) {
+		outstanding[id] -= long(n);
+		CHECK(outstanding[id] >= 0);
+		::operator delete(p);
+	}
+	bool operator==(const counting_allocator &rhs) const {
+		return id == rhs.id;
+	}
+	bool operator!=(const counting_allocator &rhs) const {
+		return id != rhs.id;
+	}
+};
+
+typedef basic_small_string<char, 15, counting_allocator<char>> counted;
+
+static bool balanced() {
+	for (auto &o : outstanding)
+		if (o.second)
+			return false;
+	return true;
+}
+
+// The inline buffer holds exactly N, and one more goes to the heap.
+static void test_boundary() {
+	const size_t N = small_string::inline_capacity();
+	std::string full(N, 'x');
+	small_string s(full);
+	CHECK(s.is_small() && s.size() == N && s.capacity() == N);
+	CHECK(s == full.c_str() && s.c_str()[N] == '\0');
+	s.push_back('y');
+	CHECK(!s.is_small() && s.size() == N + 1 && s.capacity() >= N + 1);
+	CHECK(s == (full + "y").c_str());
+	s.pop_back();
+	s.shrink_to_fit();
+	CHECK(s.is_small() && s == full.c_str());
+
+	small_string t(std::string(N + 1, 'z'));
+	CHECK(!t.is_small() && t.capacity() == N + 1);
+	small_string u(N, 'a');
+	CHECK(u.is_small());
+	u.append(1, 'b');
+	CHECK(!u.is_small() && u.back() == 'b' && u.size() == N + 1);
+	small_string v;
+	v.assign(full.data(), N);
+	CHECK(v.is_small());
+	v += "!";
+	CHECK(!v.is_small() && v.size() == N + 1);
+	v.resize(3);
+	CHECK(v == "xxx" && !v.is_small());
+}
+
+// Appending or assigning a string's own bytes, inline, at the boundary
+// and when that makes it grow.
+static void test_aliasing() {
+	for (size_t len = 0; len < 40; ++len) {
+		std::string ref;
+		for (size_t i = 0; i < len; ++i)
+			ref += char('a' + i % 26);
+		small_string s(ref);
+		s.append(s.data(), s.size());
+		CHECK(s == (ref + ref).c_str());
+		s = ref.c_str();
+		s.append(s.data() + len / 2, len - len / 2);
+		CHECK(s == (ref + ref.substr(len / 2)).c_str());
+		s = ref.c_str();
+		s.assign(s.data() + len / 3, len - len / 3);
+		CHECK(s == ref.substr(len / 3).c_str());
+		s = ref.c_str();
+		s = s.ref();
+		CHECK(s == ref.c_str());
+		s = s;
+		CHECK(s == ref.c_str());
+	}
+}
+
+// Moves and swaps between inline and heap strings leave both sides whole,
+// and the moved-from string empty and reusable.
+static void test_move_swap() {
+	const char *shorts = "short";
+	const char *longs = "a string too long to be kept inline";
+	small_string a(shorts), b(longs);
+	const char *heap = b.data();
+	swap(a, b);
+	CHECK(a == longs && b == shorts && a.data() == heap && b.is_small());
+	a.swap(b);
+	CHECK(a == shorts && b == longs && b.data() == heap);
+	b.swap(b);
+	CHECK(b == longs);
+
+	small_string c(std::move(b));
+	CHECK(c == longs && c.data() == heap);
+	CHECK(b.empty() && b.is_small() && *b.c_str() == '\0');
+	small_string d(std::move(a));
+	CHECK(d == shorts && d.is_small() && a.empty());
+
+	b = std::move(d);
+	CHECK(b == shorts && d.empty());
+	b = std::move(c);
+	CHECK(b == longs && b.data() == heap && c.empty());
+	b = std::move(b);
+	CHECK(b == longs);
+	c += "reused after a move";
+	CHECK(c == "reused after a move");
+}
+
+// Strings keep the allocator they were built with: moves take rhs's,
+// assignment keeps its own, and every allocation goes back where it came
+// from.
+static void test_allocators() {
+	typedef counting_allocator<char> A;
+	{
+		const char *longs = "long enough for the heap";
+		counted one(longs, A(1)), two("small", A(2));
+		CHECK(outstanding[1] > 0 && outstanding[2] == 0);
+		counted copy(one);
+		CHECK(copy.get_allocator().id == 1);
+		counted other(one, A(3));
+		CHECK(other.get_allocator().id == 3 && outstanding[3] > 0);
+
+		two = one;
+		CHECK(two.get_allocator().id == 2 && two == longs);
+		CHECK(outstanding[2] > 0);
+		counted moved(std::move(other));
+		CHECK(moved.get_allocator().id == 3 && other.empty());
+		// Unequal allocators: copied, not stolen.
+		two = std::move(moved);
+		CHECK(two.get_allocator().id == 2 && two == longs);
+		CHECK(moved == longs && moved.get_allocator().id == 3);
+		one.swap(moved);
+		CHECK(one.get_allocator().id == 1 && one == longs);
+		counted same(A(1));
+		same = std::move(one);
+		CHECK(same == longs && one.empty());
+	}
+	CHECK(balanced());
+}
+
+int main() {
+	test_boundary();
+	test_aliasing();
+	test_move_swap();
+	test_allocators();
+	printf("small_string_test: all passed\n");
+	return 0;
+}
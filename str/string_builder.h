@@ -0,0 +1,181 @@
+//============================================================================
+//                                  libcpp-util
+//                   A simple odds-n-ends library for C++11
+//
+//         Licensed under modified BSD license. See LICENSE for details.
+//============================================================================
+
+#ifndef LIBCPP_UTIL_STRING_BUILDER_H
+#define LIBCPP_UTIL_STRING_BUILDER_H
+
+#include "libcpp-util/cxx14/string_ref.h"
+#include "libcpp-util/mem/objstack_allocator.h"
+
+#include <cerrno>
+#include <climits>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace cpputil {
+
+// Builds a string out of pieces without making it contiguous. The builder
+// keeps a list of fragments: append_ref() records a reference to memory owned
+// by the caller, append() copies into arena chunks owned by the builder.
+// Consecutive copies land next to each other in the arena and are merged into
+// a single fragment. The result can be written out with writev() without ever
+// being assembled, or flattened once with str().
+//
+// Memory passed to append_ref() must stay alive and unmodified until the
+// builder is cleared or destroyed. Tiny references are copied anyway since
+// an iovec per handful of bytes costs more than the memcpy.
+template <unsigned ChunkSize = 4096>
+class basic_string_builder {
+private:
+	std::vector<string_ref> frags;
+	objstack<ChunkSize> arena;
+	// Copies too large for an arena chunk get their own allocation.
+	std::vector<std::unique_ptr<char[]>> large;
+	std::size_t total;
+	// End of the most recent copy into the arena, to detect when the next
+	// copy directly follows it.
+	const char *arena_end;
+
+	basic_string_builder(const basic_string_builder &) = delete;
+	basic_string_builder &operator=(const basic_string_builder &) = delete;
+
+	char *copy_space(std::size_t n) {
+		if (n > ChunkSize) {
+			large.emplace_back(new char[n]);
+			return large.back().get();
+		}
+		return static_cast<char *>(arena.allocate(n, 1));
+	}
+
+public:
+	static constexpr std::size_t copy_threshold = 64;
+
+	basic_string_builder() : total(0), arena_end(nullptr) {
+	}
+	basic_string_builder(basic_string_builder &&) = default;
+	basic_string_builder &operator=(basic_string_builder &&) = default;
+
+	// Copies s into storage owned by the builder.
+	basic_string_builder &append(string_ref s) {
+		if (s.empty())
+			return *this;
+		char *p = copy_space(s.size());
+		std::memcpy(p, s.data(), s.size());
+		if (p == arena_end && !frags.empty()) {
+			string_ref &last = frags.back();
+			last = string_ref(last.data(), last.size() + s.size());
+		} else {
+			frags.push_back(string_ref(p, s.size()));
+		}
+		arena_end = s.size() > ChunkSize ? nullptr : p + s.size();
+		total += s.size();
+		return *this;
+	}
+
+	basic_string_builder &append(char c) {
+		return append(string_ref(&c, 1));
+	}
+
+	// References s without copying it.
+	basic_string_builder &append_ref(string_ref s) {
+		if (s.size() < copy_threshold)
+			return append(s);
+		frags.push_back(s);
+		arena_end = nullptr;
+		total += s.size();
+		return *this;
+	}
+
+	std::size_t size() const {
+		return total;
+	}
+	bool empty() const {
+		return total == 0;
+	}
+	const std::vector<string_ref> &fragments() const {
+		return frags;
+	}
+
+	void clear() {
+		frags.clear();
+		arena = objstack<ChunkSize>();
+		large.clear();
+		total = 0;
+		arena_end = nullptr;
+	}
+
+	void append_to(std::string &s) const {
+		s.reserve(s.size() + total);
+		for (const string_ref &f : frags)
+			s.append(f.data(), f.size());
+	}
+
+	std::string str() const {
+		std::string ret;
+		append_to(ret);
+		return ret;
+	}
+
+	// Fills iov with up to n iovecs describing the bytes from fragment
+	// index frag, offset off onwards. Returns the number used.
+	std::size_t to_iovecs(struct iovec *iov, std::size_t n,
+			      std::size_t frag = 0, std::size_t off = 0) const {
+		std::size_t i = 0;
+		for (; i < n && frag < frags.size(); ++i, ++frag, off = 0) {
+			iov[i].iov_base = const_cast<char *>(frags[frag].data()) + off;
+			iov[i].iov_len = frags[frag].size() - off;
+		}
+		return i;
+	}
+
+	// Writes everything to fd, retrying on short writes and EINTR. Returns
+	// the number of bytes written, or -1 with errno set. The builder is
+	// left intact either way.
+	ssize_t writev(int fd) const {
+#ifdef IOV_MAX
+		static const std::size_t batch = IOV_MAX < 1024 ? IOV_MAX : 1024;
+#else
+		static const std::size_t batch = 16;
+#endif
+		struct iovec iov[batch];
+		std::size_t frag = 0, off = 0;
+		std::size_t written = 0;
+		while (frag < frags.size()) {
+			std::size_t n = to_iovecs(iov, batch, frag, off);
+			ssize_t ret = ::writev(fd, iov, n);
+			if (ret < 0) {
+				if (errno == EINTR)
+					continue;
+				return -1;
+			}
+			written += ret;
+			// Skip past what made it out.
+			std::size_t done = ret + off;
+			while (frag < frags.size() &&
+			       done >= frags[frag].size()) {
+				done -= frags[frag].size();
+				frag++;
+			}
+			off = done;
+		}
+		return written;
+	}
+};
+
+template <unsigned ChunkSize>
+constexpr std::size_t basic_string_builder<ChunkSize>::copy_threshold;
+
+typedef basic_string_builder<> string_builder;
+
+}
+#endif
@@ -0,0 +1,79 @@
+#include "string_builder.h"
+#include "string_utils.h"
+#include <chrono>
+#include <cstdio>
+#include <fcntl.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using namespace cpputil;
+using bench_clock = std::chrono::steady_clock;
+
+// A response: a few short header lines, then the body as 4 KiB blocks that
+// already live in memory (say a cache), each followed by a short separator.
+struct response {
+	std::vector<std::string> headers;
+	std::vector<std::string> blocks;
+};
+
+response make_response(size_t payload) {
+	response r;
+	for (unsigned i = 0; i < 8; ++i)
+		r.headers.push_back("X-Header-" + std::to_string(i) +
+				    ": some value\r\n");
+	for (size_t done = 0; done < payload; done += 4096)
+		r.blocks.push_back(std::string(4096, 'a' + r.blocks.size() % 26));
+	return r;
+}
+
+template <typename F>
+void run(const char *name, size_t payload, unsigned iterations, F f) {
+	size_t total = 0;
+	auto start = bench_clock::now();
+	for (unsigned i = 0; i < iterations; ++i)
+		total += f();
+	std::chrono::duration<double, std::micro> elapsed =
+		bench_clock::now() - start;
+	double us = elapsed.count() / iterations;
+	printf("%8zu KiB  %-22s %10.2f us/op %8.2f GB/s\n", payload / 1024, name,
+	       us, total / iterations / us / 1e3);
+}
+
+int main() {
+	int fd = open("/dev/null", O_WRONLY);
+	const char sep[] = "\r\n";
+
+	for (size_t payload = 1024; payload <= (1 << 20); payload *= 4) {
+		response r = make_response(payload);
+		unsigned iterations = (64u << 20) / payload;
+
+		run("std::string + write", payload, iterations, [&]() {
+			std::string out;
+			for (const auto &h : r.headers)
+				concat_in_place(out, h);
+			for (const auto &b : r.blocks)
+				concat_in_place(out, b, sep);
+			return (size_t)write(fd, out.data(), out.size());
+		});
+		run("builder str + write", payload, iterations, [&]() {
+			string_builder sb;
+			for (const auto &h : r.headers)
+				sb.append(h);
+			for (const auto &b : r.blocks)
+				sb.append_ref(b).append(sep);
+			std::string out = sb.str();
+			return (size_t)write(fd, out.data(), out.size());
+		});
+		run("builder writev", payload, iterations, [&]() {
+			string_builder sb;
+			for (const auto &h : r.headers)
+				sb.append(h);
+			for (const auto &b : r.blocks)
+				sb.append_ref(b).append(sep);
+			return (size_t)sb.writev(fd);
+		});
+	}
+	close(fd);
+	return 0;
+}
@@ -0,0 +1,128 @@
+#include "string_builder.h"
+#include "libcpp-util/util/test_check.h"
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace cpputil;
+
+static std::string str(string_ref s) {
+	return std::string(s.data(), s.size());
+}
+
+// What the iovecs describe, concatenated.
+static std::string join(const struct iovec *iov, std::size_t n) {
+	std::string s;
+	for (std::size_t i = 0; i < n; ++i)
+		s.append(static_cast<const char *>(iov[i].iov_base),
+			 iov[i].iov_len);
+	return s;
+}
+
+// Copies run together in one fragment; references stay where they are
+// unless they are tiny; copies bigger than a chunk still come out whole.
+static void test_fragments() {
+	std::string big(100, 'r'), huge(10000, 'h');
+	string_builder sb;
+	sb.append("ab").append('c').append(string_ref("de"));
+	CHECK(sb.fragments().size() == 1 && str(sb.fragments()[0]) == "abcde");
+	sb.append_ref(big);
+	CHECK(sb.fragments().size() == 2);
+	CHECK(sb.fragments()[1].data() == big.data());
+	std::string tiny = "tiny";
+	sb.append_ref(tiny).append("!");
+	CHECK(sb.fragments().size() == 3);
+	CHECK(str(sb.fragments()[2]) == "tiny!");
+	sb.append(huge).append("tail");
+	sb.append(string_ref());
+	std::string expect = "abcde" + big + "tiny!" + huge + "tail";
+	CHECK(sb.size() == expect.size() && !sb.empty());
+	CHECK(sb.str() == expect);
+	std::string prefixed = "pre:";
+	sb.append_to(prefixed);
+	CHECK(prefixed == "pre:" + expect);
+
+	string_builder moved(std::move(sb));
+	CHECK(moved.str() == expect);
+	moved.clear();
+	CHECK(moved.empty() && moved.fragments().empty() && moved.str() == "");
+	moved.append("again");
+	CHECK(moved.str() == "again");
+}
+
+// Fragments that don't merge: each reference sits between two copies.
+static std::string build(string_builder &sb, std::size_t n,
+			 std::vector<std::string> &refs) {
+	std::string expect;
+	refs.clear();
+	for (std::size_t i = 0; i < n; ++i)
+		refs.push_back(std::string(64 + i % 50, char('a' + i % 26)));
+	for (std::size_t i = 0; i < n; ++i) {
+		std::string sep = std::to_string(i) + ",";
+		sb.append(sep).append_ref(refs[i]);
+		expect += sep + refs[i];
+	}
+	return expect;
+}
+
+// The iovec export covers every byte once, from any fragment and offset,
+// and stops at the count given.
+static void test_iovecs() {
+	string_builder sb;
+	std::vector<std::string> refs;
+	std::string expect = build(sb, 20, refs);
+	const std::vector<string_ref> &f = sb.fragments();
+	CHECK(f.size() == 40);
+	struct iovec iov[64];
+	CHECK(sb.to_iovecs(iov, 64) == 40 && join(iov, 40) == expect);
+	CHECK(sb.to_iovecs(iov, 5) == 5);
+	std::size_t before = 0;
+	for (std::size_t i = 0; i < 5; ++i)
+		before += f[i].size();
+	CHECK(join(iov, 5) == expect.substr(0, before));
+	std::size_t skip = before + 3;
+	std::size_t n = sb.to_iovecs(iov, 64, 5, 3);
+	CHECK(n == 35 && join(iov, n) == expect.substr(skip));
+	CHECK(sb.to_iovecs(iov, 64, 40) == 0 && sb.to_iovecs(iov, 0) == 0);
+}
+
+static std::string read_all(int fd) {
+	std::string s;
+	char buf[65536];
+	ssize_t n;
+	while ((n = read(fd, buf, sizeof(buf))) > 0)
+		s.append(buf, size_t(n));
+	CHECK(n == 0);
+	return s;
+}
+
+// More fragments than one writev takes, into a pipe a reader drains; what
+// comes out matches str().
+static void test_writev() {
+	string_builder sb;
+	std::vector<std::string> refs;
+	std::string expect = build(sb, 3000, refs);
+	CHECK(sb.str() == expect);
+	int p[2];
+	CHECK(pipe(p) == 0);
+	std::string got;
+	std::thread reader([&] { got = read_all(p[0]); });
+	CHECK(sb.writev(p[1]) == ssize_t(expect.size()));
+	close(p[1]);
+	reader.join();
+	close(p[0]);
+	CHECK(got == expect);
+
+	string_builder empty;
+	CHECK(empty.writev(1) == 0);
+	CHECK(sb.writev(-1) == -1 && errno == EBADF);
+}
+
+int main() {
+	test_fragments();
+	test_iovecs();
+	test_writev();
+	printf("string_builder_test: all passed\n");
+	return 0;
+}
@@ -0,0 +1,302 @@
+//============================================================================
+//                                  libcpp-util
+//                   A simple odds-n-ends library for C++11
+//
+//         Licensed under modified BSD license. See LICENSE for details.
+//============================================================================
+
+#ifndef LIBCPP_UTIL_STRING_INTERNER_H
+#define LIBCPP_UTIL_STRING_INTERNER_H
+
+#include "libcpp-util/cxx14/string_ref.h"
+#include "libcpp-util/mem/objstack_allocator.h"
+#include "libcpp-util/util/hash.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace cpputil {
+
+namespace intern_detail {
+// Lives in the arena, immediately followed by the NUL terminated bytes.
+struct record {
+	std::uint64_t hash;
+	std::uint32_t id;
+	std::uint32_t len;
+
+	const char *data() const {
+		return reinterpret_cast<const char *>(this + 1);
+	}
+};
+}
+
+// Handle to an interned string. Two handles from the same interner compare
+// equal iff the strings are equal, and that comparison is a pointer compare.
+// The bytes stay put for as long as the interner lives.
+class interned_string {
+private:
+	const intern_detail::record *r;
+
+public:
+	constexpr interned_string() : r(nullptr) {
+	}
+	explicit interned_string(const intern_detail::record *r) : r(r) {
+	}
+
+	const char *data() const {
+		return r ? r->data() : "";
+	}
+	const char *c_str() const {
+		return data();
+	}
+	std::size_t size() const {
+		return r ? r->len : 0;
+	}
+	bool empty() const {
+		return size() == 0;
+	}
+	// Dense, starting from 1 in the order strings were first interned, so
+	// it can index a side table. 0 means no string.
+	std::uint32_t id() const {
+		return r ? r->id : 0;
+	}
+	std::uint64_t hash() const {
+		return r ? r->hash : 0;
+	}
+
+	string_ref ref() const {
+		return string_ref(data(), size());
+	}
+	operator string_ref() const {
+		return ref();
+	}
+	explicit operator bool() const {
+		return r != nullptr;
+	}
+
+	bool operator==(interned_string rhs) const {
+		return r == rhs.r;
+	}
+	bool operator!=(interned_string rhs) const {
+		return r != rhs.r;
+	}
+	// Arbitrary but consistent, for ordered containers.
+	bool operator<(interned_string rhs) const {
+		return std::less<const intern_detail::record *>()(r, rhs.r);
+	}
+};
+
+// Deduplicates strings into an arena. Thread-safe: the table is split into
+// Shards independently locked open-addressing tables, each with its own
+// objstack arena, so threads interning different strings rarely contend.
+// Ids come from one atomic counter, taken only for new strings, and
+// lookup() finds them in a table of chunks doubling in size, read without
+// locks.
+template <unsigned Shards = 64, unsigned ChunkSize = 64 * 1024>
+class basic_string_interner {
+private:
+	static_assert((Shards & (Shards - 1)) == 0,
+		      "Shard count must be a power of two");
+	typedef intern_detail::record record;
+
+	struct shard {
+		std::mutex lock;
+		std::vector<const record *> slots; // Power of two size
+		std::size_t count;
+		objstack<ChunkSize> arena;
+		std::vector<std::unique_ptr<char[]>> large;
+		std::size_t bytes;
+
+		shard() : slots(16), count(0), bytes(0) {
+		}
+
+		void grow() {
+			std::vector<const record *> bigger(slots.size() * 2);
+			std::size_t mask = bigger.size() - 1;
+			for (const record *r : slots) {
+				if (!r)
+					continue;
+				std::size_t i = (r->hash >> 8) & mask;
+				while (bigger[i])
+					i = (i + 1) & mask;
+				bigger[i] = r;
+			}
+			slots.swap(bigger);
+		}
+
+		record *allocate(std::size_t len) {
+			std::size_t n = sizeof(record) + len + 1;
+			bytes += n;
+			if (n > ChunkSize) {
+				large.emplace_back(new char[n]);
+				return reinterpret_cast<record *>(
+					large.back().get());
+			}
+			return static_cast<record *>(
+				arena.allocate(n, alignof(record)));
+		}
+	};
+
+	std::unique_ptr<shard[]> shards;
+
+	// Record for id 1 + i is in chunk k = log2(i / first_chunk + 1), of
+	// first_chunk << k entries, enough chunks to hold every 32-bit id.
+	static const unsigned first_chunk_bits = 10;
+	static const std::size_t first_chunk = std::size_t(1)
+					       << first_chunk_bits;
+	static const unsigned chunks = 33 - first_chunk_bits;
+	typedef std::atomic<const record *> id_slot;
+
+	std::atomic<std::uint32_t> last_id;
+	std::atomic<id_slot *> by_id[chunks];
+
+	static unsigned chunk_of(std::size_t i, std::size_t *offset) {
+		std::size_t m = i + first_chunk;
+		unsigned top = 63 - __builtin_clzll(m);
+		*offset = m - (std::size_t(1) << top);
+		return top - first_chunk_bits;
+	}
+
+	void publish(std::uint32_t id, const record *r) {
+		std::size_t offset;
+		unsigned k = chunk_of(id - 1, &offset);
+		id_slot *c = by_id[k].load(std::memory_order_acquire);
+		if (!c) {
+			std::size_t n = first_chunk << k;
+			id_slot *fresh = new id_slot[n];
+			for (std::size_t j = 0; j < n; ++j)
+				fresh[j].store(nullptr,
+					       std::memory_order_relaxed);
+			if (by_id[k].compare_exchange_strong(
+				    c, fresh, std::memory_order_acq_rel))
+				c = fresh;
+			else
+				delete[] fresh;
+		}
+		c[offset].store(r, std::memory_order_release);
+	}
+
+	shard &shard_for(std::uint64_t hash) {
+		return shards[hash & (Shards - 1)];
+	}
+
+	basic_string_interner(const basic_string_interner &) = delete;
+	basic_string_interner &
+	operator=(const basic_string_interner &) = delete;
+
+public:
+	basic_string_interner() : shards(new shard[Shards]), last_id(0) {
+		for (unsigned k = 0; k < chunks; ++k)
+			by_id[k].store(nullptr, std::memory_order_relaxed);
+	}
+
+	~basic_string_interner() {
+		for (unsigned k = 0; k < chunks; ++k)
+			delete[] by_id[k].load(std::memory_order_relaxed);
+	}
+
+	// Returns the unique handle for s, adding it if needed.
+	interned_string intern(string_ref s) {
+		const std::uint64_t hash = hash_bytes(s.data(), s.size());
+		shard &sh = shard_for(hash);
+		std::lock_guard<std::mutex> guard(sh.lock);
+
+		std::size_t mask = sh.slots.size() - 1;
+		std::size_t i = (hash >> 8) & mask;
+		for (; sh.slots[i]; i = (i + 1) & mask) {
+			const record *r = sh.slots[i];
+			if (r->hash == hash && r->len == s.size() &&
+			    !std::memcmp(r->data(), s.data(), s.size()))
+				return interned_string(r);
+		}
+
+		record *r = sh.allocate(s.size());
+		r->hash = hash;
+		r->len = static_cast<std::uint32_t>(s.size());
+		r->id = last_id.fetch_add(1, std::memory_order_relaxed) + 1;
+		char *data = reinterpret_cast<char *>(r + 1);
+		std::memcpy(data, s.data(), s.size());
+		data[s.size()] = '\0';
+
+		publish(r->id, r);
+		sh.slots[i] = r;
+		if (++sh.count * 2 > sh.slots.size())
+			sh.grow();
+		return interned_string(r);
+	}
+
+	// Returns the handle for s if it has been interned, or a null handle.
+	interned_string find(string_ref s) {
+		const std::uint64_t hash = hash_bytes(s.data(), s.size());
+		shard &sh = shard_for(hash);
+		std::lock_guard<std::mutex> guard(sh.lock);
+		std::size_t mask = sh.slots.size() - 1;
+		for (std::size_t i = (hash >> 8) & mask; sh.slots[i];
+		     i = (i + 1) & mask) {
+			const record *r = sh.slots[i];
+			if (r->hash == hash && r->len == s.size() &&
+			    !std::memcmp(r->data(), s.data(), s.size()))
+				return interned_string(r);
+		}
+		return interned_string();
+	}
+
+	// Handle for an id returned by interned_string::id(), or a null handle.
+	interned_string lookup(std::uint32_t id) {
+		if (id == 0 || id > last_id.load(std::memory_order_relaxed))
+			return interned_string();
+		std::size_t offset;
+		unsigned k = chunk_of(id - 1, &offset);
+		id_slot *c = by_id[k].load(std::memory_order_acquire);
+		if (!c)
+			return interned_string();
+		// Null too for an id whose intern() hasn't returned yet.
+		return interned_string(
+			c[offset].load(std::memory_order_acquire));
+	}
+
+	std::size_t size() {
+		std::size_t n = 0;
+		for (unsigned i = 0; i < Shards; ++i) {
+			std::lock_guard<std::mutex> guard(shards[i].lock);
+			n += shards[i].count;
+		}
+		return n;
+	}
+
+	// Bytes taken by records and hash tables. Doesn't count the unused
+	// tail of each arena chunk.
+	std::size_t memory_usage() {
+		std::size_t n = 0;
+		for (unsigned i = 0; i < Shards; ++i) {
+			shard &sh = shards[i];
+			std::lock_guard<std::mutex> guard(sh.lock);
+			n += sh.bytes +
+			     sh.slots.capacity() * sizeof(const record *);
+		}
+		for (unsigned k = 0; k < chunks; ++k)
+			if (by_id[k].load(std::memory_order_relaxed))
+				n += (first_chunk << k) * sizeof(id_slot);
+		return n;
+	}
+};
+
+typedef basic_string_interner<> string_interner;
+
+}
+
+namespace std {
+template <>
+struct hash<cpputil::interned_string> {
+	size_t operator()(cpputil::interned_string s) const {
+		return static_cast<size_t>(s.hash());
+	}
+};
+}
+#endif
@@ -0,0 +1,90 @@
+#include "string_interner.h"
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace cpputil;
+using bench_clock = std::chrono::steady_clock;
+
+// Hostname and metric-name looking identifiers, drawn from a vocabulary so
+// that most of the stream is duplicates.
+std::vector<std::string> make_stream(size_t n, size_t vocabulary) {
+	std::vector<std::string> words;
+	for (size_t i = 0; i < vocabulary; ++i) {
+		if (i % 2)
+			words.push_back("web-" + std::to_string(i) +
+					".dc1.prod.example.com");
+		else
+			words.push_back("service.requests.latency.p99.shard_" +
+					std::to_string(i));
+	}
+	std::mt19937 mt(42);
+	// Skewed towards the front, like real traffic.
+	std::geometric_distribution<size_t> dist(8.0 / vocabulary);
+	std::vector<std::string> stream;
+	stream.reserve(n);
+	for (size_t i = 0; i < n; ++i)
+		stream.push_back(words[dist(mt) % vocabulary]);
+	return stream;
+}
+
+int main(int argc, char *argv[]) {
+	size_t n = argc > 1 ? std::stoul(argv[1]) : 4000000;
+	size_t vocabulary = argc > 2 ? std::stoul(argv[2]) : 100000;
+	std::vector<std::string> stream = make_stream(n, vocabulary);
+
+	for (unsigned threads = 1; threads <= 16; threads *= 2) {
+		string_interner interner;
+		std::vector<std::thread> workers;
+		auto start = bench_clock::now();
+		for (unsigned t = 0; t < threads; ++t) {
+			workers.emplace_back([&, t]() {
+				size_t begin = n * t / threads;
+				size_t end = n * (t + 1) / threads;
+				for (size_t i = begin; i < end; ++i)
+					interner.intern(stream[i]);
+			});
+		}
+		for (auto &w : workers)
+			w.join();
+		std::chrono::duration<double> elapsed =
+			bench_clock::now() - start;
+		printf("%2u threads: %7.2f M interns/s (%zu unique)\n", threads,
+		       n / elapsed.count() / 1e6, interner.size());
+	}
+
+	// Memory: a std::string per occurrence versus a handle per occurrence
+	// plus one arena copy per unique string.
+	string_interner interner;
+	std::vector<interned_string> handles;
+	handles.reserve(n);
+	size_t string_bytes = 0;
+	for (const auto &s : stream) {
+		handles.push_back(interner.intern(s));
+		string_bytes += sizeof(std::string);
+		if (s.capacity() > 15) // Past the SSO buffer
+			string_bytes += s.capacity() + 1;
+	}
+	size_t interned_bytes =
+		handles.size() * sizeof(interned_string) + interner.memory_usage();
+	printf("%zu strings, %zu unique: std::string %.1f MiB, interned %.1f "
+	       "MiB\n", n, interner.size(), string_bytes / 1048576.0,
+	       interned_bytes / 1048576.0);
+
+	// Equality is a pointer compare.
+	size_t same = 0;
+	auto start = bench_clock::now();
+	for (size_t i = 1; i < n; ++i)
+		same += handles[i] == handles[i - 1];
+	std::chrono::duration<double, std::nano> h = bench_clock::now() - start;
+	start = bench_clock::now();
+	for (size_t i = 1; i < n; ++i)
+		same += stream[i] == stream[i - 1];
+	std::chrono::duration<double, std::nano> s = bench_clock::now() - start;
+	printf("compare: handle %.2f ns, std::string %.2f ns (%zu equal)\n",
+	       h.count() / n, s.count() / n, same);
+	return 0;
+}
@@ -0,0 +1,94 @@
+#include "string_interner.h"
+#include "libcpp-util/util/test_check.h"
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace cpputil;
+
+static std::string str(interned_string s) {
+	return std::string(s.data(), s.size());
+}
+
+static void test_basics() {
+	string_interner in;
+	CHECK(!in.find("a") && in.size() == 0);
+	interned_string a = in.intern("alpha"), b = in.intern("beta");
+	std::string copy = "alpha";
+	CHECK(in.intern(copy) == a && a != b);
+	CHECK(in.intern(copy).data() == a.data());
+	CHECK(in.find("alpha") == a && !in.find("gamma"));
+	CHECK(str(a) == "alpha" && b.size() == 4 && b.c_str()[4] == '\0');
+	CHECK(a.id() == 1 && b.id() == 2);
+	CHECK(in.lookup(1) == a && in.lookup(2) == b);
+	CHECK(!in.lookup(0) && !in.lookup(3));
+
+	interned_string none;
+	CHECK(!none && none.id() == 0 && none.empty() && *none.c_str() == 0);
+	interned_string empty = in.intern("");
+	CHECK(empty && empty.empty() && empty != none);
+	CHECK(in.intern(string_ref("al", 2)) != a);
+
+	// Longer than an arena chunk.
+	std::string big(100000, 'x');
+	interned_string l = in.intern(big);
+	CHECK(str(l) == big && in.intern(big) == l);
+	CHECK(in.size() == 5 && in.lookup(l.id()) == l);
+}
+
+// Threads interning overlapping sets get the same handle for each string,
+// and the ids are 1..n with no gaps, each mapping back to its string.
+static void test_threads() {
+	basic_string_interner<4> in;
+	const int threads = 4, words = 5000;
+	std::vector<std::vector<interned_string>> got(threads);
+	std::vector<std::thread> workers;
+	for (int t = 0; t < threads; ++t)
+		workers.emplace_back([&, t] {
+			// Each thread starts at a different word.
+			for (int i = 0; i < words; ++i) {
+				int w = (i + t * words / threads) % words;
+				got[t].push_back(in.intern(
+					"word-" + std::to_string(w)));
+			}
+		});
+	for (auto &w : workers)
+		w.join();
+	CHECK(in.size() == size_t(words));
+	std::vector<int> seen(words + 1);
+	for (int t = 0; t < threads; ++t) {
+		for (int i = 0; i < words; ++i) {
+			int w = (i + t * words / threads) % words;
+			interned_string s = got[t][i];
+			CHECK(s == got[0][w]);
+			CHECK(str(s) == "word-" + std::to_string(w));
+			CHECK(s.id() >= 1 && s.id() <= uint32_t(words));
+			CHECK(in.lookup(s.id()) == s);
+			++seen[s.id()];
+		}
+	}
+	for (int id = 1; id <= words; ++id)
+		CHECK(seen[id] == threads);
+	CHECK(!in.lookup(words + 1));
+}
+
+// Ids far enough along to need several chunks of the id table.
+static void test_many_ids() {
+	basic_string_interner<1> in;
+	const uint32_t n = 100000;
+	for (uint32_t i = 1; i <= n; ++i)
+		CHECK(in.intern(std::to_string(i)).id() == i);
+	for (uint32_t i = 1; i <= n; ++i)
+		CHECK(str(in.lookup(i)) == std::to_string(i));
+	CHECK(!in.lookup(n + 1));
+	CHECK(in.memory_usage() > n * sizeof(void *));
+}
+
+int main() {
+	test_basics();
+	test_threads();
+	test_many_ids();
+	printf("string_interner_test: all passed\n");
+	return 0;
+}
@@ -9,47 +9,91 @@
 #define LIBCPP_UTIL_STRPRINTF_H
 
 #include "libcpp-util/cxx14/string_ref.h"
+#include "libcpp-util/str/ct_format.h"
+#include "libcpp-util/str/format.h"
 #include <string>
 #include <cstdarg>
 #include <cstdio>
 #include <utility>
 
 namespace cpputil {
-inline int vstrprintf(std::string& s, const char* fmt, va_list ap) {
+
+// Formats into a stack buffer first and only grows the string and formats a
+// second time when the output doesn't fit. The append variants add to the end
+// of s instead of replacing its contents.
+inline int vstrprintf_common(std::string& s, const char* fmt, va_list ap,
+		bool append) {
 	// Conformance of implementation to sprintf semantics is paramount
-	// (besides the buffer overflow parts). That said, this can be
-	// implemented MUCH more efficiently. Also sorry MSVC. Come back with
+	// (besides the buffer overflow parts). Also sorry MSVC. Come back with
 	// C99.
+	char buf[256];
 	va_list ap2;
 	va_copy(ap2, ap);
-	int count = std::vsnprintf(nullptr, 0, fmt, ap);
-	if (count >= 0) {
-		s.resize(count + 1);
-		std::vsnprintf((char*)s.data(), s.size(), fmt, ap2);
+	int count = std::vsnprintf(buf, sizeof(buf), fmt, ap);
+	if (count >= 0 && static_cast<size_t>(count) < sizeof(buf)) {
+		if (append)
+			s.append(buf, count);
+		else
+			s.assign(buf, count);
+	} else if (count >= 0) {
+		// NB: Arguments must not point into s past this point.
+		size_t old = append ? s.size() : 0;
+		s.resize(old + count + 1);
+		std::vsnprintf(&s[old], count + 1, fmt, ap2);
+		s.resize(old + count);
 	}
 	va_end(ap2);
 	return count;
 }
 
-inline int vstrprintf_private(std::string& s, const char* fmt, ...) {
-	int ret;
-	va_list ap;
-	va_start(ap, fmt);
-	ret = vstrprintf(s, fmt, ap);
-	va_end(ap);
-	return ret;
+inline int vstrprintf(std::string& s, const char* fmt, va_list ap) {
+	return vstrprintf_common(s, fmt, ap, false);
 }
 
-template <typename... Ts>
-int strprintf(std::string& s, const char* fmt, Ts&&... ts) {
-	int count = std::vsnprintf(nullptr, 0, fmt, ts...);
-	if (count >= 0) {
-		s.resize(count + 1);
-		std::vsnprintf((char*)s.data(), s.size(), fmt, ts...);
+inline int vstrappendf(std::string& s, const char* fmt, va_list ap) {
+	return vstrprintf_common(s, fmt, ap, true);
+}
+
+// The variadic versions know the argument types, so they go through the
+// type-safe formatter in format.h, which writes the output in a single pass
+// via a stack buffer. On failure they return -1; strprintf leaves s empty and
+// strappendf leaves it as it was.
+template <typename Format, typename... Ts>
+int strprintf_common(std::string& s, bool append, const Format& fmt,
+		const Ts&... ts) {
+	size_t old = s.size();
+	buffered_string_sink<> sink(s, !append);
+	int count = format_to(sink, fmt, ts...);
+	if (count < 0) {
+		sink.discard();
+		s.resize(append ? old : 0);
+		return count;
 	}
+	sink.flush();
 	return count;
 }
 
+template <typename... Ts>
+int strprintf(std::string& s, const char* fmt, const Ts&... ts) {
+	return strprintf_common(s, false, fmt, ts...);
+}
+
+template <typename... Ts>
+int strappendf(std::string& s, const char* fmt, const Ts&... ts) {
+	return strprintf_common(s, true, fmt, ts...);
+}
+
+// Format parsed at compile time, see ct_format.h.
+template <char... Cs, typename... Ts>
+int strprintf(std::string& s, ct_string<Cs...> fmt, const Ts&... ts) {
+	return strprintf_common(s, false, fmt, ts...);
+}
+
+template <char... Cs, typename... Ts>
+int strappendf(std::string& s, ct_string<Cs...> fmt, const Ts&... ts) {
+	return strprintf_common(s, true, fmt, ts...);
+}
+
 inline std::string vstrprintf(const char* fmt, va_list ap) {
 	std::string ret;
 	vstrprintf(ret, fmt, ap);
@@ -57,9 +101,16 @@ inline std::string vstrprintf(const char* fmt, va_list ap) {
 }
 
 template <typename... Ts>
-std::string astrprintf(const char* fmt, Ts&&... ts) {
+std::string astrprintf(const char* fmt, const Ts&... ts) {
+	std::string ret;
+	strprintf(ret, fmt, ts...);
+	return ret;
+}
+
+template <char... Cs, typename... Ts>
+std::string astrprintf(ct_string<Cs...> fmt, const Ts&... ts) {
 	std::string ret;
-	vstrprintf_private(ret, fmt, std::forward<Ts>(ts)...);
+	strprintf(ret, fmt, ts...);
 	return ret;
 }
 
@@ -0,0 +1,181 @@
+#include "strprintf.h"
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace cpputil;
+using bench_clock = std::chrono::steady_clock;
+
+// The original implementation: measure with vsnprintf, then format again.
+int old_strprintf(std::string &s, const char *fmt, ...) {
+	va_list ap, ap2;
+	va_start(ap, fmt);
+	va_copy(ap2, ap);
+	int count = std::vsnprintf(nullptr, 0, fmt, ap);
+	if (count >= 0) {
+		s.resize(count + 1);
+		std::vsnprintf(&s[0], s.size(), fmt, ap2);
+	}
+	va_end(ap2);
+	va_end(ap);
+	return count;
+}
+
+int new_strprintf(std::string &s, const char *fmt, ...) {
+	va_list ap;
+	va_start(ap, fmt);
+	int ret = vstrprintf(s, fmt, ap);
+	va_end(ap);
+	return ret;
+}
+
+int new_strappendf(std::string &s, const char *fmt, ...) {
+	va_list ap;
+	va_start(ap, fmt);
+	int ret = vstrappendf(s, fmt, ap);
+	va_end(ap);
+	return ret;
+}
+
+template <typename F>
+void run(const char *name, unsigned iterations, F f) {
+	size_t total = 0;
+	auto start = bench_clock::now();
+	for (unsigned i = 0; i < iterations; ++i)
+		total += f(i);
+	std::chrono::duration<double, std::nano> elapsed =
+		bench_clock::now() - start;
+	printf("%-28s %8.1f ns/op  (%zu bytes)\n", name,
+	       elapsed.count() / iterations, total);
+}
+
+// Per-call latency percentiles. Includes the cost of reading the clock.
+template <typename F>
+void latency(const char *name, unsigned iterations, F f) {
+	std::vector<double> samples(iterations);
+	for (unsigned i = 0; i < iterations; ++i) {
+		auto start = bench_clock::now();
+		f(i);
+		std::chrono::duration<double, std::nano> elapsed =
+			bench_clock::now() - start;
+		samples[i] = elapsed.count();
+	}
+	std::sort(samples.begin(), samples.end());
+	printf("%-28s p50 %8.1f ns  p99 %8.1f ns  p99.9 %8.1f ns\n", name,
+	       samples[iterations / 2], samples[iterations * 99 / 100],
+	       samples[iterations * 999 / 1000]);
+}
+
+int main(int argc, char *argv[]) {
+	unsigned iterations = argc > 1 ? std::stoul(argv[1]) : 2000000;
+	const std::string host = "backend-17.example.com";
+	std::string s;
+
+	puts("Integers: \"%d %u %x %lld\"");
+	run("vsnprintf x2", iterations, [&](unsigned i) {
+		old_strprintf(s, "%d %u %x %lld", (int)i, i * 7u, i,
+			      (long long)i * 1000003);
+		return s.size();
+	});
+	run("strprintf", iterations, [&](unsigned i) {
+		strprintf(s, "%d %u %x %lld", (int)i, i * 7u, i,
+			  (long long)i * 1000003);
+		return s.size();
+	});
+	run("ostringstream", iterations, [&](unsigned i) {
+		std::ostringstream os;
+		os << (int)i << ' ' << i * 7u << ' ' << std::hex << i << ' '
+		   << std::dec << (long long)i * 1000003;
+		s = os.str();
+		return s.size();
+	});
+
+	puts("Doubles, shortest round-trip: \"%.17g\" vs \"%s\"");
+	run("vsnprintf x2 (%.17g)", iterations, [&](unsigned i) {
+		old_strprintf(s, "%.17g", i * 0.1);
+		return s.size();
+	});
+	run("strprintf (%s)", iterations, [&](unsigned i) {
+		strprintf(s, "%s", i * 0.1);
+		return s.size();
+	});
+	run("ostringstream (prec 17)", iterations, [&](unsigned i) {
+		std::ostringstream os;
+		os.precision(17);
+		os << i * 0.1;
+		s = os.str();
+		return s.size();
+	});
+
+	puts("Log line: \"%s:%d request %u took %s ms status=%s\"");
+	run("vsnprintf x2", iterations, [&](unsigned i) {
+		old_strprintf(s, "%s:%d request %u took %.17g ms status=%s",
+			      host.c_str(), 8080, i, i * 0.25, "OK");
+		return s.size();
+	});
+	run("strprintf", iterations, [&](unsigned i) {
+		strprintf(s, "%s:%d request %u took %s ms status=%s", host,
+			  8080, i, i * 0.25, "OK");
+		return s.size();
+	});
+	run("strprintf CPPUTIL_FMT", iterations, [&](unsigned i) {
+		strprintf(s, CPPUTIL_FMT("%s:%d request %u took %s ms status=%s"),
+			  host, 8080, i, i * 0.25, "OK");
+		return s.size();
+	});
+	run("ostringstream", iterations, [&](unsigned i) {
+		std::ostringstream os;
+		os.precision(17);
+		os << host << ':' << 8080 << " request " << i << " took "
+		   << i * 0.25 << " ms status=" << "OK";
+		s = os.str();
+		return s.size();
+	});
+
+	puts("Log line, printf floats: \"[%5s] %-12s %08x %6.2f%%\"");
+	run("vsnprintf x2", iterations, [&](unsigned i) {
+		old_strprintf(s, "[%5s] %-12s %08x %6.2f%%", "WARN",
+			      host.c_str(), i, i * 0.001);
+		return s.size();
+	});
+	run("strprintf", iterations, [&](unsigned i) {
+		strprintf(s, "[%5s] %-12s %08x %6.2f%%", "WARN", host, i,
+			  i * 0.001);
+		return s.size();
+	});
+	run("strprintf CPPUTIL_FMT", iterations, [&](unsigned i) {
+		strprintf(s, CPPUTIL_FMT("[%5s] %-12s %08x %6.2f%%"), "WARN",
+			  host, i, i * 0.001);
+		return s.size();
+	});
+
+	const std::string big(2000, 'x');
+	puts("Latency, short (~40 chars) and long (~2 KiB) vstrprintf output");
+	latency("short vsnprintf x2", iterations, [&](unsigned i) {
+		old_strprintf(s, "%s:%d request %u status=%s", host.c_str(),
+			      8080, i, "OK");
+	});
+	latency("short stack buffer", iterations, [&](unsigned i) {
+		new_strprintf(s, "%s:%d request %u status=%s", host.c_str(),
+			      8080, i, "OK");
+	});
+	latency("short stack buffer, append", iterations, [&](unsigned i) {
+		s.clear();
+		new_strappendf(s, "%s:%d request %u status=%s", host.c_str(),
+			       8080, i, "OK");
+	});
+	latency("long vsnprintf x2", iterations, [&](unsigned i) {
+		old_strprintf(s, "%s %u", big.c_str(), i);
+	});
+	latency("long stack buffer", iterations, [&](unsigned i) {
+		new_strprintf(s, "%s %u", big.c_str(), i);
+	});
+	latency("long strprintf", iterations, [&](unsigned i) {
+		strprintf(s, "%s %u", big, i);
+	});
+	return 0;
+}
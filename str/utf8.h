@@ -0,0 +1,541 @@
+//============================================================================
+//                                  libcpp-util
+//                   A simple odds-n-ends library for C++11
+//
+//         Licensed under modified BSD license. See LICENSE for details.
+//============================================================================
+
+#ifndef LIBCPP_UTIL_UTF8_H
+#define LIBCPP_UTIL_UTF8_H
+
+#include "libcpp-util/cxx14/array_ref.h"
+#include "libcpp-util/cxx14/string_ref.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define CPPUTIL_UTF8_SIMD 1
+#include <immintrin.h>
+#endif
+
+// UTF-8 validation and UTF-8 <-> UTF-16/UTF-32 transcoding.
+//
+// Validation follows the lookup algorithm from simdjson (Keiser & Lemire,
+// "Validating UTF-8 In Less Than One Instruction Per Byte"): three 16-entry
+// table lookups classify every pair of adjacent bytes, and a saturating
+// subtract checks the 3rd and 4th bytes of long sequences. It runs with
+// SSSE3, picked at runtime, and falls back to a scalar decoder elsewhere.
+//
+// The transcoders take a caller-provided output buffer and never allocate.
+// Runs of ASCII are widened/narrowed 16 bytes at a time with SSE2; everything
+// else goes through the scalar decoder, which validates as it goes. They
+// return the number of code units written, or utf_error if the input is
+// malformed (overlong forms, surrogates, code points past U+10FFFF, truncated
+// or unpaired sequences), in which case the output is garbage.
+namespace cpputil {
+
+static constexpr std::size_t utf_error = std::size_t(-1);
+
+namespace utf8_detail {
+
+inline bool is_cont(unsigned char c) {
+	return (c & 0xc0) == 0x80;
+}
+
+// Decodes one code point starting at p[*i], advancing *i. Returns -1 on
+// malformed input.
+inline std::int32_t decode(const unsigned char *p, std::size_t n,
+			   std::size_t *i) {
+	std::size_t k = *i;
+	unsigned char c = p[k];
+	if (c < 0x80) {
+		*i = k + 1;
+		return c;
+	}
+	if (c < 0xc2)
+		return -1;
+	if (c < 0xe0) {
+		if (k + 1 >= n || !is_cont(p[k + 1]))
+			return -1;
+		*i = k + 2;
+		return ((c & 0x1f) << 6) | (p[k + 1] & 0x3f);
+	}
+	if (c < 0xf0) {
+		if (k + 2 >= n || !is_cont(p[k + 1]) || !is_cont(p[k + 2]))
+			return -1;
+		// No overlong forms, no surrogates.
+		if ((c == 0xe0 && p[k + 1] < 0xa0) ||
+		    (c == 0xed && p[k + 1] > 0x9f))
+			return -1;
+		*i = k + 3;
+		return ((c & 0x0f) << 12) | ((p[k + 1] & 0x3f) << 6) |
+		       (p[k + 2] & 0x3f);
+	}
+	if (c < 0xf5) {
+		if (k + 3 >= n || !is_cont(p[k + 1]) || !is_cont(p[k + 2]) ||
+		    !is_cont(p[k + 3]))
+			return -1;
+		// No overlong forms, nothing past U+10FFFF.
+		if ((c == 0xf0 && p[k + 1] < 0x90) ||
+		    (c == 0xf4 && p[k + 1] > 0x8f))
+			return -1;
+		*i = k + 4;
+		return ((c & 0x07) << 18) | ((p[k + 1] & 0x3f) << 12) |
+		       ((p[k + 2] & 0x3f) << 6) | (p[k + 3] & 0x3f);
+	}
+	return -1;
+}
+
+// Index of the first non-ASCII byte at or after i, 8 bytes at a time.
+inline std::size_t skip_ascii(const unsigned char *p, std::size_t n,
+			      std::size_t i) {
+	for (; i + 8 <= n; i += 8) {
+		std::uint64_t v;
+		std::memcpy(&v, p + i, 8);
+		if (v & 0x8080808080808080ull)
+			break;
+	}
+	while (i < n && p[i] < 0x80)
+		++i;
+	return i;
+}
+
+inline bool validate_scalar(const unsigned char *p, std::size_t n) {
+	std::size_t i = 0;
+	while ((i = skip_ascii(p, n, i)) < n) {
+		if (decode(p, n, &i) < 0)
+			return false;
+	}
+	return true;
+}
+
+#ifdef CPPUTIL_UTF8_SIMD
+
+enum : std::uint8_t {
+	TOO_SHORT = 1 << 0,  // Lead byte not followed by a continuation
+	TOO_LONG = 1 << 1,   // ASCII followed by a continuation
+	OVERLONG_3 = 1 << 2,
+	TOO_LARGE = 1 << 3,
+	SURROGATE = 1 << 4,
+	OVERLONG_2 = 1 << 5,
+	TOO_LARGE_1000 = 1 << 6,
+	OVERLONG_4 = 1 << 6,
+	TWO_CONTS = 1 << 7, // Two continuations, must be in a 3/4 byte seq
+	CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS,
+};
+
+struct ssse3_state {
+	__m128i error;
+	__m128i prev_input;
+	// Non-zero where a block ended in the middle of a sequence.
+	__m128i prev_incomplete;
+};
+
+__attribute__((target("ssse3"))) inline __m128i
+high_nibbles(__m128i v) {
+	return _mm_and_si128(_mm_srli_epi16(v, 4), _mm_set1_epi8(0x0f));
+}
+
+__attribute__((target("ssse3"))) inline void
+check_block(ssse3_state &s, __m128i input) {
+	if (!_mm_movemask_epi8(input)) {
+		// All ASCII; only an unfinished sequence from before can fail.
+		s.error = _mm_or_si128(s.error, s.prev_incomplete);
+		s.prev_incomplete = _mm_setzero_si128();
+		s.prev_input = input;
+		return;
+	}
+
+	const __m128i byte_1_high_tbl = _mm_setr_epi8(
+		// 0_______ ________ <ASCII in byte 1>
+		TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+		TOO_LONG, TOO_LONG,
+		// 10______ ________ <continuation in byte 1>
+		TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+		// 1100____ ________ <two byte lead in byte 1>
+		TOO_SHORT | OVERLONG_2,
+		// 1101____ ________ <two byte lead in byte 1>
+		TOO_SHORT,
+		// 1110____ ________ <three byte lead in byte 1>
+		TOO_SHORT | OVERLONG_3 | SURROGATE,
+		// 1111____ ________ <four+ byte lead in byte 1>
+		(char)(TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4));
+	const __m128i byte_1_low_tbl = _mm_setr_epi8(
+		// ____0000 ________
+		(char)(CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4),
+		// ____0001 ________
+		(char)(CARRY | OVERLONG_2),
+		// ____001_ ________
+		(char)CARRY, (char)CARRY,
+		// ____0100 ________
+		(char)(CARRY | TOO_LARGE),
+		// ____0101 ________ and up
+		(char)(CARRY | TOO_LARGE | TOO_LARGE_1000),
+		(char)(CARRY | TOO_LARGE | TOO_LARGE_1000),
+		(char)(CARRY | TOO_LARGE | TOO_LARGE_1000),
+		(char)(CARRY | TOO_LARGE | TOO_LARGE_1000),
+		(char)(CARRY | TOO_LARGE | TOO_LARGE_1000),
+		(char)(CARRY | TOO_LARGE | TOO_LARGE_1000),
+		(char)(CARRY | TOO_LARGE | TOO_LARGE_1000),
+		(char)(CARRY | TOO_LARGE | TOO_LARGE_1000),
+		// ____1101 ________
+		(char)(CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE),
+		(char)(CARRY | TOO_LARGE | TOO_LARGE_1000),
+		(char)(CARRY | TOO_LARGE | TOO_LARGE_1000));
+	const __m128i byte_2_high_tbl = _mm_setr_epi8(
+		// ________ 0_______ <ASCII in byte 2>
+		TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+		TOO_SHORT, TOO_SHORT, TOO_SHORT,
+		// ________ 1000____
+		(char)(TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 |
+		       TOO_LARGE_1000 | OVERLONG_4),
+		// ________ 1001____
+		(char)(TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 |
+		       TOO_LARGE),
+		// ________ 101_____
+		(char)(TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE |
+		       TOO_LARGE),
+		(char)(TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE |
+		       TOO_LARGE),
+		// ________ 11______
+		TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT);
+
+	__m128i prev1 = _mm_alignr_epi8(input, s.prev_input, 15);
+	__m128i special = _mm_and_si128(
+		_mm_and_si128(
+			_mm_shuffle_epi8(byte_1_high_tbl, high_nibbles(prev1)),
+			_mm_shuffle_epi8(byte_1_low_tbl,
+					 _mm_and_si128(prev1,
+						       _mm_set1_epi8(0x0f)))),
+		_mm_shuffle_epi8(byte_2_high_tbl, high_nibbles(input)));
+
+	// Bytes two and three places after a 3 or 4 byte lead must be
+	// continuations; TWO_CONTS in special says where continuations are.
+	__m128i prev2 = _mm_alignr_epi8(input, s.prev_input, 14);
+	__m128i prev3 = _mm_alignr_epi8(input, s.prev_input, 13);
+	__m128i is_third = _mm_subs_epu8(prev2, _mm_set1_epi8(0xe0 - 0x80));
+	__m128i is_fourth = _mm_subs_epu8(prev3, _mm_set1_epi8(0xf0 - 0x80));
+	__m128i must23 = _mm_and_si128(_mm_or_si128(is_third, is_fourth),
+				       _mm_set1_epi8((char)0x80));
+	s.error = _mm_or_si128(s.error, _mm_xor_si128(must23, special));
+
+	const __m128i max_value = _mm_setr_epi8(
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		(char)(0xf0 - 1), (char)(0xe0 - 1), (char)(0xc0 - 1));
+	s.prev_incomplete = _mm_subs_epu8(input, max_value);
+	s.prev_input = input;
+}
+
+__attribute__((target("ssse3"))) inline bool
+any_set(__m128i v) {
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128())) !=
+	       0xffff;
+}
+
+__attribute__((target("ssse3"))) inline bool
+validate_ssse3(const unsigned char *p, std::size_t n) {
+	ssse3_state s;
+	s.error = _mm_setzero_si128();
+	s.prev_input = _mm_setzero_si128();
+	s.prev_incomplete = _mm_setzero_si128();
+
+	std::size_t i = 0;
+	for (; i + 64 <= n; i += 64) {
+		check_block(s, _mm_loadu_si128((const __m128i *)(p + i)));
+		check_block(s, _mm_loadu_si128((const __m128i *)(p + i + 16)));
+		check_block(s, _mm_loadu_si128((const __m128i *)(p + i + 32)));
+		check_block(s, _mm_loadu_si128((const __m128i *)(p + i + 48)));
+		// Bail out early on bad input rather than scanning it all.
+		if (any_set(s.error))
+			return false;
+	}
+	for (; i + 16 <= n; i += 16)
+		check_block(s, _mm_loadu_si128((const __m128i *)(p + i)));
+	if (i < n) {
+		// Zero padding reads as ASCII, which also catches a sequence
+		// cut off by the end of the input.
+		unsigned char tail[16] = {0};
+		std::memcpy(tail, p + i, n - i);
+		check_block(s, _mm_loadu_si128((const __m128i *)tail));
+	}
+	s.error = _mm_or_si128(s.error, s.prev_incomplete);
+	return !any_set(s.error);
+}
+
+inline bool have_ssse3() {
+	static const bool ok = __builtin_cpu_supports("ssse3");
+	return ok;
+}
+
+#endif // CPPUTIL_UTF8_SIMD
+
+#ifdef __SSE2__
+// Widens 16 ASCII bytes at a time into out, while they last. Returns the
+// number of bytes consumed.
+inline std::size_t widen_ascii(const unsigned char *p, std::size_t n,
+			       char16_t *out) {
+	std::size_t i = 0;
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 16 <= n; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+		if (_mm_movemask_epi8(v))
+			break;
+		_mm_storeu_si128((__m128i *)(out + i), _mm_unpacklo_epi8(v, zero));
+		_mm_storeu_si128((__m128i *)(out + i + 8),
+				 _mm_unpackhi_epi8(v, zero));
+	}
+	return i;
+}
+
+inline std::size_t widen_ascii(const unsigned char *p, std::size_t n,
+			       char32_t *out) {
+	std::size_t i = 0;
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 16 <= n; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+		if (_mm_movemask_epi8(v))
+			break;
+		__m128i lo = _mm_unpacklo_epi8(v, zero);
+		__m128i hi = _mm_unpackhi_epi8(v, zero);
+		_mm_storeu_si128((__m128i *)(out + i),
+				 _mm_unpacklo_epi16(lo, zero));
+		_mm_storeu_si128((__m128i *)(out + i + 4),
+				 _mm_unpackhi_epi16(lo, zero));
+		_mm_storeu_si128((__m128i *)(out + i + 8),
+				 _mm_unpacklo_epi16(hi, zero));
+		_mm_storeu_si128((__m128i *)(out + i + 12),
+				 _mm_unpackhi_epi16(hi, zero));
+	}
+	return i;
+}
+
+// Narrows 16 code units at a time into out while they are all ASCII.
+inline std::size_t narrow_ascii(const char16_t *p, std::size_t n, char *out) {
+	std::size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(p + i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(p + i + 8));
+		__m128i high = _mm_and_si128(_mm_or_si128(a, b),
+					     _mm_set1_epi16((short)0xff80));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi16(
+			    high, _mm_setzero_si128())) != 0xffff)
+			break;
+		_mm_storeu_si128((__m128i *)(out + i), _mm_packus_epi16(a, b));
+	}
+	return i;
+}
+
+inline std::size_t narrow_ascii(const char32_t *p, std::size_t n, char *out) {
+	std::size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m128i v[4];
+		__m128i any = _mm_setzero_si128();
+		for (int k = 0; k < 4; ++k) {
+			v[k] = _mm_loadu_si128((const __m128i *)(p + i + 4 * k));
+			any = _mm_or_si128(any, v[k]);
+		}
+		if (_mm_movemask_epi8(_mm_cmpeq_epi32(
+			    _mm_and_si128(any, _mm_set1_epi32(~0x7f)),
+			    _mm_setzero_si128())) != 0xffff)
+			break;
+		__m128i lo = _mm_packs_epi32(v[0], v[1]);
+		__m128i hi = _mm_packs_epi32(v[2], v[3]);
+		_mm_storeu_si128((__m128i *)(out + i), _mm_packus_epi16(lo, hi));
+	}
+	return i;
+}
+#else
+template <typename T>
+inline std::size_t widen_ascii(const unsigned char *, std::size_t, T *) {
+	return 0;
+}
+template <typename T>
+inline std::size_t narrow_ascii(const T *, std::size_t, char *) {
+	return 0;
+}
+#endif // __SSE2__
+
+inline char *put_utf8(char32_t c, char *out) {
+	if (c < 0x80) {
+		*out++ = static_cast<char>(c);
+	} else if (c < 0x800) {
+		*out++ = static_cast<char>(0xc0 | (c >> 6));
+		*out++ = static_cast<char>(0x80 | (c & 0x3f));
+	} else if (c < 0x10000) {
+		*out++ = static_cast<char>(0xe0 | (c >> 12));
+		*out++ = static_cast<char>(0x80 | ((c >> 6) & 0x3f));
+		*out++ = static_cast<char>(0x80 | (c & 0x3f));
+	} else {
+		*out++ = static_cast<char>(0xf0 | (c >> 18));
+		*out++ = static_cast<char>(0x80 | ((c >> 12) & 0x3f));
+		*out++ = static_cast<char>(0x80 | ((c >> 6) & 0x3f));
+		*out++ = static_cast<char>(0x80 | (c & 0x3f));
+	}
+	return out;
+}
+
+} // End namespace utf8_detail
+
+inline bool utf8_valid(string_ref s) {
+	const unsigned char *p =
+		reinterpret_cast<const unsigned char *>(s.data());
+#ifdef CPPUTIL_UTF8_SIMD
+	if (utf8_detail::have_ssse3())
+		return utf8_detail::validate_ssse3(p, s.size());
+#endif
+	return utf8_detail::validate_scalar(p, s.size());
+}
+
+inline bool utf8_valid(array_ref<unsigned char> s) {
+	return utf8_valid(string_ref(
+		reinterpret_cast<const char *>(s.data()), s.size()));
+}
+
+// Sizes of the output for valid input. Use the input size (times 3 from
+// UTF-16, times 4 from UTF-32) as a bound instead to avoid the extra pass.
+inline std::size_t utf32_length_from_utf8(string_ref s) {
+	std::size_t n = 0;
+	for (std::size_t i = 0; i < s.size(); ++i)
+		n += (s.data()[i] & 0xc0) != 0x80;
+	return n;
+}
+
+inline std::size_t utf16_length_from_utf8(string_ref s) {
+	std::size_t n = 0;
+	for (std::size_t i = 0; i < s.size(); ++i) {
+		unsigned char c = s.data()[i];
+		// 4 byte sequences become surrogate pairs.
+		n += ((c & 0xc0) != 0x80) + (c >= 0xf0);
+	}
+	return n;
+}
+
+inline std::size_t utf8_length_from_utf16(u16string_ref s) {
+	std::size_t n = 0;
+	for (std::size_t i = 0; i < s.size(); ++i) {
+		char16_t c = s.data()[i];
+		// A surrogate pair counts 2 + 2.
+		n += 1 + (c >= 0x80) + (c >= 0x800 && (c < 0xd800 || c > 0xdfff));
+	}
+	return n;
+}
+
+inline std::size_t utf8_length_from_utf32(u32string_ref s) {
+	std::size_t n = 0;
+	for (std::size_t i = 0; i < s.size(); ++i) {
+		char32_t c = s.data()[i];
+		n += 1 + (c >= 0x80) + (c >= 0x800) + (c >= 0x10000);
+	}
+	return n;
+}
+
+// out must have room for s.size() code units.
+inline std::size_t utf8_to_utf16(string_ref s, char16_t *out) {
+	using namespace utf8_detail;
+	const unsigned char *p =
+		reinterpret_cast<const unsigned char *>(s.data());
+	const std::size_t n = s.size();
+	char16_t *o = out;
+	std::size_t i = 0;
+	while (i < n) {
+		std::size_t k = widen_ascii(p + i, n - i, o);
+		i += k;
+		o += k;
+		for (; i < n && p[i] < 0x80; ++i)
+			*o++ = p[i];
+		// Decode up to the next ASCII run.
+		while (i < n && p[i] >= 0x80) {
+			std::int32_t c = decode(p, n, &i);
+			if (c < 0)
+				return utf_error;
+			if (c >= 0x10000) {
+				c -= 0x10000;
+				*o++ = static_cast<char16_t>(0xd800 + (c >> 10));
+				*o++ = static_cast<char16_t>(0xdc00 + (c & 0x3ff));
+			} else {
+				*o++ = static_cast<char16_t>(c);
+			}
+		}
+	}
+	return o - out;
+}
+
+// out must have room for s.size() code units.
+inline std::size_t utf8_to_utf32(string_ref s, char32_t *out) {
+	using namespace utf8_detail;
+	const unsigned char *p =
+		reinterpret_cast<const unsigned char *>(s.data());
+	const std::size_t n = s.size();
+	char32_t *o = out;
+	std::size_t i = 0;
+	while (i < n) {
+		std::size_t k = widen_ascii(p + i, n - i, o);
+		i += k;
+		o += k;
+		for (; i < n && p[i] < 0x80; ++i)
+			*o++ = p[i];
+		while (i < n && p[i] >= 0x80) {
+			std::int32_t c = decode(p, n, &i);
+			if (c < 0)
+				return utf_error;
+			*o++ = static_cast<char32_t>(c);
+		}
+	}
+	return o - out;
+}
+
+// out must have room for 3 * s.size() bytes.
+inline std::size_t utf16_to_utf8(u16string_ref s, char *out) {
+	using namespace utf8_detail;
+	const char16_t *p = s.data();
+	const std::size_t n = s.size();
+	char *o = out;
+	std::size_t i = 0;
+	while (i < n) {
+		std::size_t k = narrow_ascii(p + i, n - i, o);
+		i += k;
+		o += k;
+		for (; i < n && p[i] < 0x80; ++i)
+			*o++ = static_cast<char>(p[i]);
+		while (i < n && p[i] >= 0x80) {
+			char32_t c = p[i++];
+			if (c >= 0xd800 && c <= 0xdfff) {
+				if (c > 0xdbff || i == n || p[i] < 0xdc00 ||
+				    p[i] > 0xdfff)
+					return utf_error;
+				c = 0x10000 + ((c - 0xd800) << 10) +
+				    (p[i++] - 0xdc00);
+			}
+			o = put_utf8(c, o);
+		}
+	}
+	return o - out;
+}
+
+// out must have room for 4 * s.size() bytes.
+inline std::size_t utf32_to_utf8(u32string_ref s, char *out) {
+	using namespace utf8_detail;
+	const char32_t *p = s.data();
+	const std::size_t n = s.size();
+	char *o = out;
+	std::size_t i = 0;
+	while (i < n) {
+		std::size_t k = narrow_ascii(p + i, n - i, o);
+		i += k;
+		o += k;
+		for (; i < n && p[i] < 0x80; ++i)
+			*o++ = static_cast<char>(p[i]);
+		while (i < n && p[i] >= 0x80) {
+			char32_t c = p[i++];
+			if (c > 0x10ffff || (c >= 0xd800 && c <= 0xdfff))
+				return utf_error;
+			o = put_utf8(c, o);
+		}
+	}
+	return o - out;
+}
+
+}
+#endif
@@ -0,0 +1,87 @@
+#include "utf8.h"
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace cpputil;
+using bench_clock = std::chrono::steady_clock;
+
+// Text drawn mostly from one block, with ASCII spaces and punctuation mixed
+// in the way real documents have them.
+std::string make_corpus(char32_t lo, char32_t hi, unsigned ascii_percent,
+			size_t n) {
+	std::mt19937 mt(42);
+	std::string s;
+	char buf[4];
+	while (s.size() < n) {
+		char32_t c;
+		if (mt() % 100 < ascii_percent)
+			c = 0x20 + mt() % 0x5f;
+		else
+			c = lo + mt() % (hi - lo + 1);
+		s.append(buf, utf8_detail::put_utf8(c, buf));
+	}
+	return s;
+}
+
+template <typename F>
+void run(const char *corpus, const char *name, size_t bytes, F f) {
+	unsigned iterations = 0;
+	size_t sink = 0;
+	auto start = bench_clock::now();
+	std::chrono::duration<double> elapsed;
+	do {
+		sink += f();
+		++iterations;
+		elapsed = bench_clock::now() - start;
+	} while (elapsed.count() < 0.2);
+	printf("%-8s %-24s %7.2f GB/s  (%zu)\n", corpus, name,
+	       bytes * iterations / elapsed.count() / 1e9, sink % 10);
+}
+
+int main(int argc, char *argv[]) {
+	size_t n = argc > 1 ? std::stoul(argv[1]) : (1 << 20);
+	struct {
+		const char *name;
+		std::string text;
+	} corpora[] = {
+		{"ascii", make_corpus(0x20, 0x7e, 100, n)},
+		{"latin", make_corpus(0xc0, 0xff, 80, n)},
+		{"cjk", make_corpus(0x4e00, 0x9fff, 10, n)},
+		{"emoji", make_corpus(0x1f600, 0x1f64f, 20, n)},
+	};
+
+	std::vector<char16_t> u16(n + 16);
+	std::vector<char32_t> u32(n + 16);
+	std::vector<char> u8(4 * n + 64);
+	for (auto &c : corpora) {
+		const std::string &s = c.text;
+		const unsigned char *p =
+			reinterpret_cast<const unsigned char *>(s.data());
+		run(c.name, "validate scalar", s.size(), [&]() {
+			return (size_t)utf8_detail::validate_scalar(p, s.size());
+		});
+		run(c.name, "validate", s.size(),
+		    [&]() { return (size_t)utf8_valid(s); });
+		run(c.name, "utf8 -> utf16", s.size(),
+		    [&]() { return utf8_to_utf16(s, u16.data()); });
+		run(c.name, "utf8 -> utf32", s.size(),
+		    [&]() { return utf8_to_utf32(s, u32.data()); });
+
+		// Reverse directions, still reported per UTF-8 byte.
+		size_t n16 = utf8_to_utf16(s, u16.data());
+		size_t n32 = utf8_to_utf32(s, u32.data());
+		run(c.name, "utf16 -> utf8", s.size(), [&]() {
+			return utf16_to_utf8(u16string_ref(u16.data(), n16),
+					     u8.data());
+		});
+		run(c.name, "utf32 -> utf8", s.size(), [&]() {
+			return utf32_to_utf8(u32string_ref(u32.data(), n32),
+					     u8.data());
+		});
+		printf("\n");
+	}
+	return 0;
+}
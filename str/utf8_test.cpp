@@ -0,0 +1,138 @@
+#include "utf8.h"
+#include "libcpp-util/util/test_check.h"
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace cpputil;
+
+static bool valid_scalar(const std::string &s) {
+	return utf8_detail::validate_scalar(
+		reinterpret_cast<const unsigned char *>(s.data()), s.size());
+}
+
+static bool valid_simd(const std::string &s) {
+#ifdef CPPUTIL_UTF8_SIMD
+	if (utf8_detail::have_ssse3())
+		return utf8_detail::validate_ssse3(
+			reinterpret_cast<const unsigned char *>(s.data()),
+			s.size());
+#endif
+	return valid_scalar(s);
+}
+
+// Both validators must agree, wherever in a block the bytes land.
+static void check_valid(const std::string &s, bool expect) {
+	for (size_t pad = 0; pad < 20; ++pad) {
+		std::string t = std::string(pad, 'a') + s;
+		CHECK(valid_scalar(t) == expect);
+		CHECK(valid_simd(t) == expect);
+	}
+}
+
+void test_edges() {
+	check_valid("", true);
+	check_valid("plain ascii", true);
+	check_valid("\xc2\x80", true);         // U+0080
+	check_valid("\xdf\xbf", true);         // U+07FF
+	check_valid("\xe0\xa0\x80", true);     // U+0800
+	check_valid("\xed\x9f\xbf", true);     // U+D7FF
+	check_valid("\xee\x80\x80", true);     // U+E000
+	check_valid("\xef\xbf\xbf", true);     // U+FFFF
+	check_valid("\xf0\x90\x80\x80", true); // U+10000
+	check_valid("\xf4\x8f\xbf\xbf", true); // U+10FFFF
+
+	check_valid("\x80", false);             // Lone continuation
+	check_valid("\xc0\x80", false);         // Overlong 2
+	check_valid("\xc1\xbf", false);         // Overlong 2
+	check_valid("\xe0\x9f\xbf", false);     // Overlong 3
+	check_valid("\xed\xa0\x80", false);     // Surrogate
+	check_valid("\xf0\x8f\xbf\xbf", false); // Overlong 4
+	check_valid("\xf4\x90\x80\x80", false); // Past U+10FFFF
+	check_valid("\xf5\x80\x80\x80", false);
+	check_valid("\xff", false);
+	check_valid("\xc2", false); // Truncated at the end
+	check_valid("\xe0\xa0", false);
+	check_valid("\xf0\x90\x80", false);
+	check_valid("\xc2x", false);
+	check_valid("\xe0\xa0\x80\x80", false); // Too long
+}
+
+std::string random_text(std::mt19937 &mt, size_t n) {
+	static const char32_t ranges[][2] = {
+		{0x20, 0x7e}, {0x80, 0x7ff}, {0x800, 0xd7ff},
+		{0xe000, 0xffff}, {0x10000, 0x10ffff},
+	};
+	std::string s;
+	std::vector<char> buf(4);
+	while (s.size() < n) {
+		const char32_t *r = ranges[mt() % 5];
+		char32_t c = r[0] + mt() % (r[1] - r[0] + 1);
+		char *e = utf8_detail::put_utf8(c, buf.data());
+		s.append(buf.data(), e);
+	}
+	return s;
+}
+
+void test_random() {
+	std::mt19937 mt(1);
+	for (unsigned iter = 0; iter < 20000; ++iter) {
+		std::string s = random_text(mt, mt() % 200);
+		CHECK(valid_scalar(s) && valid_simd(s));
+
+		// Round trips.
+		std::vector<char16_t> u16(s.size() + 1);
+		std::vector<char32_t> u32(s.size() + 1);
+		size_t n16 = utf8_to_utf16(s, u16.data());
+		size_t n32 = utf8_to_utf32(s, u32.data());
+		CHECK(n16 == utf16_length_from_utf8(s));
+		CHECK(n32 == utf32_length_from_utf8(s));
+		std::string back(3 * n16 + 1, '\0');
+		size_t n = utf16_to_utf8(u16string_ref(u16.data(), n16), &back[0]);
+		CHECK(n == utf8_length_from_utf16(u16string_ref(u16.data(), n16)));
+		CHECK(std::string(back.data(), n) == s);
+		back.assign(4 * n32 + 1, '\0');
+		n = utf32_to_utf8(u32string_ref(u32.data(), n32), &back[0]);
+		CHECK(n == utf8_length_from_utf32(u32string_ref(u32.data(), n32)));
+		CHECK(std::string(back.data(), n) == s);
+
+		// Corrupt a byte; the scalar decoder is the reference.
+		if (!s.empty()) {
+			s[mt() % s.size()] = static_cast<char>(mt());
+			bool expect = valid_scalar(s);
+			CHECK(valid_simd(s) == expect);
+			CHECK((utf8_to_utf16(s, u16.data()) != utf_error) ==
+			      expect);
+			CHECK((utf8_to_utf32(s, u32.data()) != utf_error) ==
+			      expect);
+		}
+	}
+}
+
+void test_bad_utf16_32() {
+	char out[64];
+	const char16_t lone_high[] = {'a', 0xd800, 'b'};
+	const char16_t lone_low[] = {0xdc00};
+	const char16_t pair[] = {0xd83d, 0xde00};
+	CHECK(utf16_to_utf8(u16string_ref(lone_high, 3), out) == utf_error);
+	CHECK(utf16_to_utf8(u16string_ref(lone_low, 1), out) == utf_error);
+	CHECK(utf16_to_utf8(u16string_ref(pair, 1), out) == utf_error);
+	CHECK(utf16_to_utf8(u16string_ref(pair, 2), out) == 4);
+	CHECK(std::string(out, 4) == "\xf0\x9f\x98\x80");
+	const char32_t big[] = {0x110000};
+	const char32_t surrogate[] = {0xdfff};
+	CHECK(utf32_to_utf8(u32string_ref(big, 1), out) == utf_error);
+	CHECK(utf32_to_utf8(u32string_ref(surrogate, 1), out) == utf_error);
+}
+
+int main() {
+	test_edges();
+	puts("edges ok");
+	test_random();
+	puts("random ok");
+	test_bad_utf16_32();
+	puts("utf16/32 errors ok");
+	return 0;
+}
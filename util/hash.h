@@ -0,0 +1,95 @@
+//============================================================================
+//                                  libcpp-util
+//                   A simple odds-n-ends library for C++11
+//
+//         Licensed under modified BSD license. See LICENSE for details.
+//============================================================================
+
+#ifndef LIBCPP_UTIL_HASH_H
+#define LIBCPP_UTIL_HASH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace cpputil {
+
+namespace hash_detail {
+
+static const std::uint64_t k0 = 0xa0761d6478bd642full;
+static const std::uint64_t k1 = 0xe7037ed1a0b428dbull;
+static const std::uint64_t k2 = 0x8ebc6af09c88c6e3ull;
+
+inline std::uint64_t load64(const unsigned char *p) {
+	std::uint64_t v;
+	std::memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+// Up to 8 bytes, no reads past the end. A variable length memcpy is a
+// library call, so build the word from two overlapping loads instead.
+inline std::uint64_t load_tail(const unsigned char *p, std::size_t n) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	if (n >= 4) {
+		std::uint32_t lo, hi;
+		std::memcpy(&lo, p, sizeof(lo));
+		std::memcpy(&hi, p + n - 4, sizeof(hi));
+		return lo | (static_cast<std::uint64_t>(hi) << (8 * (n - 4)));
+	}
+	if (n == 0)
+		return 0;
+	return p[0] | (static_cast<std::uint64_t>(p[n / 2]) << (8 * (n / 2))) |
+	       (static_cast<std::uint64_t>(p[n - 1]) << (8 * (n - 1)));
+#else
+	std::uint64_t v = 0;
+	std::memcpy(&v, p, n);
+	return v;
+#endif
+}
+
+// 64x64->128 multiply, folded back to 64 bits.
+inline std::uint64_t mix(std::uint64_t a, std::uint64_t b) {
+#if defined(__SIZEOF_INT128__)
+	unsigned __int128 r = static_cast<unsigned __int128>(a) * b;
+	return static_cast<std::uint64_t>(r) ^
+	       static_cast<std::uint64_t>(r >> 64);
+#else
+	std::uint64_t ha = a >> 32, hb = b >> 32;
+	std::uint64_t la = a & 0xffffffffu, lb = b & 0xffffffffu;
+	std::uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+	std::uint64_t t = rl + (rm0 << 32);
+	std::uint64_t c = t < rl;
+	std::uint64_t lo = t + (rm1 << 32);
+	c += lo < t;
+	std::uint64_t hi = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+	return lo ^ hi;
+#endif
+}
+
+} // End namespace hash_detail
+
+// Fast non-cryptographic hash of a byte range, 16 bytes per step. Not
+// stable across versions of this library; don't persist it.
+inline std::uint64_t hash_bytes(const void *data, std::size_t len,
+				std::uint64_t seed = 0) {
+	using namespace hash_detail;
+	const unsigned char *p = static_cast<const unsigned char *>(data);
+	std::uint64_t h = seed ^ k0 ^ (len * k2);
+	std::size_t n = len;
+	while (n >= 16) {
+		h = mix(load64(p) ^ k1, load64(p + 8) ^ h);
+		p += 16;
+		n -= 16;
+	}
+	std::uint64_t a = 0, b = 0;
+	if (n >= 8) {
+		a = load64(p);
+		b = load_tail(p + 8, n - 8);
+	} else {
+		a = load_tail(p, n);
+	}
+	return mix(mix(a ^ k1, b ^ h) ^ k0, len ^ k2);
+}
+
+}
+#endif
@@ -0,0 +1,153 @@
+//============================================================================
+//                                  libcpp-util
+//                   A simple odds-n-ends library for C++11
+//
+//         Licensed under modified BSD license. See LICENSE for details.
+//============================================================================
+
+#ifndef LIBCPP_UTIL_MEM_COMPARE_H
+#define LIBCPP_UTIL_MEM_COMPARE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Equality and three-way comparison of byte ranges, tuned for the short keys
+// that string_ref and friends mostly hold. memcmp is a call plus a dispatch on
+// length, which is most of the cost when the strings are a dozen bytes, so
+// short ranges are done inline with overlapping word loads. Long ranges still
+// go to memcmp, which has better vector code than we would write here.
+namespace cpputil {
+
+namespace mem_compare_detail {
+
+static const std::size_t inline_max = 64;
+
+template <typename T>
+inline T load(const unsigned char *p) {
+	T v;
+	std::memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+// Big-endian load, so that integer order is lexicographic byte order.
+inline std::uint64_t load_be64(const unsigned char *p) {
+	std::uint64_t v = load<std::uint64_t>(p);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	v = __builtin_bswap64(v);
+#endif
+	return v;
+}
+
+inline std::uint32_t load_be32(const unsigned char *p) {
+	std::uint32_t v = load<std::uint32_t>(p);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	v = __builtin_bswap32(v);
+#endif
+	return v;
+}
+
+} // End namespace mem_compare_detail
+
+inline bool mem_equal(const void *a, const void *b, std::size_t n) {
+	using namespace mem_compare_detail;
+	const unsigned char *p = static_cast<const unsigned char *>(a);
+	const unsigned char *q = static_cast<const unsigned char *>(b);
+	if (n > inline_max)
+		return p == q || !std::memcmp(p, q, n);
+	// Two loads covering the range from each end; they overlap unless n
+	// is exactly twice the word size.
+	if (n >= 16) {
+#ifdef __SSE2__
+		std::size_t i = 0;
+		for (; i + 16 < n; i += 16) {
+			__m128i x = _mm_loadu_si128((const __m128i *)(p + i));
+			__m128i y = _mm_loadu_si128((const __m128i *)(q + i));
+			if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) != 0xffff)
+				return false;
+		}
+		__m128i x = _mm_loadu_si128((const __m128i *)(p + n - 16));
+		__m128i y = _mm_loadu_si128((const __m128i *)(q + n - 16));
+		return _mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) == 0xffff;
+#else
+		std::size_t i = 0;
+		for (; i + 8 < n; i += 8)
+			if (load<std::uint64_t>(p + i) !=
+			    load<std::uint64_t>(q + i))
+				return false;
+		return load<std::uint64_t>(p + n - 8) ==
+		       load<std::uint64_t>(q + n - 8);
+#endif
+	}
+	if (n >= 8)
+		return ((load<std::uint64_t>(p) ^ load<std::uint64_t>(q)) |
+			(load<std::uint64_t>(p + n - 8) ^
+			 load<std::uint64_t>(q + n - 8))) == 0;
+	if (n >= 4)
+		return ((load<std::uint32_t>(p) ^ load<std::uint32_t>(q)) |
+			(load<std::uint32_t>(p + n - 4) ^
+			 load<std::uint32_t>(q + n - 4))) == 0;
+	if (n == 0)
+		return true;
+	return ((p[0] ^ q[0]) | (p[n / 2] ^ q[n / 2]) |
+		(p[n - 1] ^ q[n - 1])) == 0;
+}
+
+// memcmp semantics: sign of the first differing byte, as unsigned char.
+inline int mem_compare(const void *a, const void *b, std::size_t n) {
+	using namespace mem_compare_detail;
+	const unsigned char *p = static_cast<const unsigned char *>(a);
+	const unsigned char *q = static_cast<const unsigned char *>(b);
+	if (n > inline_max)
+		return std::memcmp(p, q, n);
+	std::uint64_t x, y;
+	if (n >= 8) {
+		for (std::size_t i = 0; i + 8 < n; i += 8) {
+			x = load_be64(p + i);
+			y = load_be64(q + i);
+			if (x != y)
+				return x < y ? -1 : 1;
+		}
+		// Overlaps bytes already known to be equal, which doesn't
+		// change the order.
+		x = load_be64(p + n - 8);
+		y = load_be64(q + n - 8);
+	} else if (n >= 4) {
+		x = (std::uint64_t)load_be32(p) << 32 | load_be32(p + n - 4);
+		y = (std::uint64_t)load_be32(q) << 32 | load_be32(q + n - 4);
+	} else if (n) {
+		x = p[0] << 16 | p[n / 2] << 8 | p[n - 1];
+		y = q[0] << 16 | q[n / 2] << 8 | q[n - 1];
+	} else {
+		return 0;
+	}
+	return x < y ? -1 : x > y;
+}
+
+// For string-like classes: use the byte kernels whenever the traits are the
+// standard ones, since char_traits<char>::compare is unsigned memcmp order and
+// every standard eq() is ==. Other traits (case-insensitive ones, say) get
+// what they asked for.
+template <typename charT, typename traits>
+inline bool traits_equal(const charT *a, const charT *b, std::size_t n) {
+	if (std::is_same<traits, std::char_traits<charT>>::value)
+		return mem_equal(a, b, n * sizeof(charT));
+	return !traits::compare(a, b, n);
+}
+
+template <typename charT, typename traits>
+inline int traits_compare(const charT *a, const charT *b, std::size_t n) {
+	if (sizeof(charT) == 1 &&
+	    std::is_same<traits, std::char_traits<charT>>::value)
+		return mem_compare(a, b, n);
+	return traits::compare(a, b, n);
+}
+
+}
+#endif
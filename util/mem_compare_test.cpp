@@ -0,0 +1,132 @@
+#include "mem_compare.h"
+#include "libcpp-util/util/test_check.h"
+#include "libcpp-util/cxx14/string_ref.h"
+#include "libcpp-util/cxx14/string_view.h"
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace cpputil;
+
+static int sign(int v) {
+	return (v > 0) - (v < 0);
+}
+
+// Both kernels against memcmp for one pair.
+static void check_pair(const unsigned char *a, const unsigned char *b,
+		       size_t n) {
+	int expect = sign(std::memcmp(a, b, n));
+	CHECK(mem_equal(a, b, n) == (expect == 0));
+	CHECK(sign(mem_compare(a, b, n)) == expect);
+	CHECK(sign(mem_compare(b, a, n)) == -expect);
+}
+
+// Equal ranges, and ranges differing at each position in turn, low byte
+// against high byte and the other way round so a signed compare shows.
+static void check_all(unsigned char *a, unsigned char *b, size_t n,
+		      std::mt19937 &rng) {
+	for (size_t i = 0; i < n; ++i)
+		a[i] = b[i] = (unsigned char)rng();
+	check_pair(a, b, n);
+	check_pair(a, a, n);
+	for (size_t i = 0; i < n; ++i) {
+		unsigned char keep = b[i];
+		b[i] = (unsigned char)(a[i] ^ 0x80);
+		check_pair(a, b, n);
+		b[i] = (unsigned char)(a[i] + 1);
+		check_pair(a, b, n);
+		// And a later difference the other way, which mustn't win.
+		if (i + 1 < n) {
+			unsigned char later = b[n - 1];
+			b[n - 1] = (unsigned char)(a[n - 1] - 1);
+			check_pair(a, b, n);
+			b[n - 1] = later;
+		}
+		b[i] = keep;
+	}
+}
+
+// Every length up to 64 and a few past, at every alignment within 16.
+static void test_lengths() {
+	std::mt19937 rng(5);
+	unsigned char a[16 + 200], b[16 + 200];
+	for (size_t n = 0; n <= 64; ++n)
+		for (size_t off = 0; off < 16; ++off)
+			check_all(a + off, b + (off * 7) % 16, n, rng);
+	for (size_t n : {65, 100, 128, 200})
+		check_all(a + 3, b + 1, n, rng);
+}
+
+// Ranges that end at the last byte before an unmapped page: a load past
+// the end faults.
+static void test_page_end() {
+	size_t page = size_t(sysconf(_SC_PAGESIZE));
+	unsigned char *m[2];
+	for (auto &p : m) {
+		void *v = mmap(nullptr, 2 * page, PROT_READ | PROT_WRITE,
+			       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		CHECK(v != MAP_FAILED);
+		p = static_cast<unsigned char *>(v);
+		CHECK(mprotect(p + page, page, PROT_NONE) == 0);
+	}
+	std::mt19937 rng(6);
+	for (size_t n = 0; n <= 64; ++n)
+		check_all(m[0] + page - n, m[1] + page - n, n, rng);
+	for (auto p : m)
+		munmap(p, 2 * page);
+}
+
+template <class Ref>
+static void check_strings(const std::string &x, const std::string &y) {
+	Ref a(x.data(), x.size()), b(y.data(), y.size());
+	int expect = sign(x.compare(y));
+	CHECK(sign(a.compare(b)) == expect);
+	CHECK((a == b) == (expect == 0) && (a != b) == (expect != 0));
+	CHECK((a < b) == (expect < 0) && (a > b) == (expect > 0));
+	CHECK((a <= b) == (expect <= 0) && (a >= b) == (expect >= 0));
+}
+
+// string_ref and string_view order as std::string does, prefixes and
+// bytes >= 0x80 included.
+static void test_string_compare() {
+	std::mt19937 rng(7);
+	for (int round = 0; round < 2000; ++round) {
+		std::string x(rng() % 70, '\0');
+		for (char &c : x)
+			c = "aZ\x80\xff"[rng() % 4];
+		std::string y = x;
+		switch (rng() % 4) {
+		case 0:
+			break;
+		case 1:
+			y.resize(rng() % (y.size() + 1));
+			break;
+		case 2:
+			y += char(rng());
+			break;
+		default:
+			if (!y.empty())
+				y[rng() % y.size()] = char(rng());
+			break;
+		}
+		check_strings<string_ref>(x, y);
+		check_strings<string_ref>(y, x);
+		check_strings<string_view>(x, y);
+		check_strings<string_view>(y, x);
+	}
+	std::wstring wx = L"abc\x100", wy = L"abc\x0ff";
+	CHECK(wstring_ref(wx.data(), wx.size()) > wstring_ref(wy.data(), 4));
+	CHECK(wstring_ref(wx.data(), 3) < wstring_ref(wx.data(), 4));
+}
+
+int main() {
+	test_lengths();
+	test_page_end();
+	test_string_compare();
+	printf("mem_compare_test: all passed\n");
+	return 0;
+}
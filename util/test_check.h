@@ -0,0 +1,26 @@
+//============================================================================
+//                                  libcpp-util
+//                   A simple odds-n-ends library for C++11
+//
+//         Licensed under modified BSD license. See LICENSE for details.
+//============================================================================
+
+#ifndef LIBCPP_UTIL_TEST_CHECK_H
+#define LIBCPP_UTIL_TEST_CHECK_H
+
+#include <cstdio>
+#include <cstdlib>
+
+// For the _test.cpp programs: prints where and what, and aborts, if cond
+// is false. Unlike assert() it stays in with NDEBUG, so tests can be built
+// at the optimization level the code ships at.
+#define CHECK(cond)                                                          \
+	do {                                                                 \
+		if (!(cond)) {                                               \
+			fprintf(stderr, "%s:%d: check failed: %s\n",         \
+				__FILE__, __LINE__, #cond);                  \
+			abort();                                             \
+		}                                                            \
+	} while (0)
+
+#endif